@@ -235,11 +235,29 @@ void main(void) {
 
 #include "nanovg2.h"
 
+#include <float.h>
 #include <math.h>
 #include <memory.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define NVG_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// 32 bit NEON has no vsqrtq_f32() or vdivq_f32()
+#include <arm_neon.h>
+#define NVG_NEON
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include <xhl/array.h>
 #include <xhl/files.h>
 #include <xhl/maths.h>
@@ -281,13 +299,6 @@ void main(void) {
 #define NVG_ASSERT(cond) assert(cond)
 #endif
 
-#if !defined(NVG_MALLOC) || !defined(NVG_REALLOC) || !defined(NVG_FREE)
-#include <stdlib.h>
-#define NVG_MALLOC(sz)       malloc(sz)
-#define NVG_REALLOC(ptr, sz) realloc(ptr, sz)
-#define NVG_FREE(ptr)        free(ptr)
-#endif
-
 static float nvg__sqrtf(float a) { return sqrtf(a); }
 static float nvg__modf(float a, float b) { return fmodf(a, b); }
 
@@ -364,6 +375,8 @@ static void nvg__setBackingScaleFactor(NVGcontext* ctx, int ratio)
     ctx->distTol            = 0.01f / ratio;
     ctx->fringeWidth        = 1.0f / ratio;
     ctx->backingScaleFactor = ratio;
+
+    ctx->view.compactStep[0] = 1.0f / (NVG_COMPACT_SUBPIXELS * ratio);
 }
 
 static NVGcompositeOperationState nvg__compositeOperationState(int op)
@@ -922,6 +935,64 @@ static float nvg__distPtSeg(float x, float y, float px, float py, float qx, floa
     return dx * dx + dy * dy;
 }
 
+// Grows a per frame buffer on the frame arena. The old block is abandoned until the arena is cleared, and the
+// capacity it grew to is reserved upfront from then on, see nvg__reserveFrameBuffers()
+static void* nvg__realloc(NVGcontext* ctx, void* prev_data, size_t prev_size, size_t next_size)
+{
+    void* new_data = linked_arena_alloc(ctx->frame_arena, next_size);
+    if (prev_data && prev_size)
+        memcpy(new_data, prev_data, prev_size);
+    return new_data;
+}
+
+static size_t sgnvg__vertexSize(const NVGcontext* ctx)
+{
+    if (ctx->flags & NVG_VERTEX_PULL)
+        return sizeof(SGNVGpullAttribute);
+    return (ctx->flags & NVG_COMPACT_VERTICES) ? sizeof(SGNVGcompactAttribute) : sizeof(SGNVGattribute);
+}
+
+static size_t sgnvg__indexSize(const NVGcontext* ctx)
+{
+    return (ctx->flags & NVG_COMPACT_VERTICES) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Reserves every per frame buffer at its high water mark, so frames that stay within it make no heap calls
+static void nvg__reserveFrameBuffers(NVGcontext* ctx)
+{
+    ctx->commands      = linked_arena_alloc(ctx->frame_arena, sizeof(*ctx->commands) * ctx->ccommands);
+    ctx->cache.points  = linked_arena_alloc(ctx->frame_arena, sizeof(*ctx->cache.points) * ctx->cache.cpoints);
+    ctx->cache.paths   = linked_arena_alloc(ctx->frame_arena, sizeof(*ctx->cache.paths) * ctx->cache.cpaths);
+    ctx->cache.verts   = linked_arena_alloc(ctx->frame_arena, sizeof(*ctx->cache.verts) * ctx->cache.cverts);
+    ctx->ncommands     = 0;
+    ctx->cache.npoints = 0;
+    ctx->cache.npaths  = 0;
+
+    ctx->deferred_first    = NULL;
+    ctx->deferred_last     = NULL;
+    ctx->ndeferred         = 0;
+    ctx->deferred_commands = NULL;
+    ctx->sdfPathCommands   = -1;
+
+    ctx->verts   = NULL;
+    ctx->indexes = NULL;
+    ctx->paints  = NULL;
+    ctx->sdfs    = NULL;
+    if (ctx->cverts)
+        ctx->verts = linked_arena_alloc(ctx->frame_arena, sgnvg__vertexSize(ctx) * ctx->cverts);
+    if (ctx->cindexes)
+        ctx->indexes = linked_arena_alloc(ctx->frame_arena, sgnvg__indexSize(ctx) * ctx->cindexes);
+    if (ctx->cpaints)
+        ctx->paints = linked_arena_alloc(ctx->frame_arena, sizeof(*ctx->paints) * ctx->cpaints);
+    if (ctx->csdfs)
+        ctx->sdfs = linked_arena_alloc(ctx->frame_arena, sizeof(*ctx->sdfs) * ctx->csdfs);
+    ctx->nverts     = 0;
+    ctx->vertexBase = 0;
+    ctx->nindexes   = 0;
+    ctx->npaints    = 0;
+    ctx->nsdfs      = 0;
+}
+
 void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 {
     NVGstate* state = &ctx->state;
@@ -929,12 +1000,8 @@ void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 
     if (ctx->ncommands + nvals > ctx->ccommands)
     {
-        float* commands;
-        int    ccommands = ctx->ncommands + nvals + ctx->ccommands / 2;
-        commands         = (float*)NVG_REALLOC(ctx->commands, sizeof(float) * ccommands);
-        if (commands == NULL)
-            return;
-        ctx->commands  = commands;
+        int ccommands  = ctx->ncommands + nvals + ctx->ccommands / 2;
+        ctx->commands  = nvg__realloc(ctx, ctx->commands, sizeof(float) * ctx->ncommands, sizeof(float) * ccommands);
         ctx->ccommands = ccommands;
     }
 
@@ -978,7 +1045,8 @@ void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 
     memcpy(&ctx->commands[ctx->ncommands], vals, nvals * sizeof(float));
 
-    ctx->ncommands += nvals;
+    ctx->ncommands         += nvals;
+    ctx->deferred_commands  = NULL;
 }
 
 static NVGpath* nvg__lastPath(NVGcontext* ctx)
@@ -993,12 +1061,9 @@ static void nvg__addPath(NVGcontext* ctx)
     NVGpath* path;
     if (ctx->cache.npaths + 1 > ctx->cache.cpaths)
     {
-        NVGpath* paths;
-        int      cpaths = ctx->cache.npaths + 1 + ctx->cache.cpaths / 2;
-        paths           = (NVGpath*)NVG_REALLOC(ctx->cache.paths, sizeof(NVGpath) * cpaths);
-        if (paths == NULL)
-            return;
-        ctx->cache.paths  = paths;
+        int cpaths = ctx->cache.npaths + 1 + ctx->cache.cpaths / 2;
+        ctx->cache.paths =
+            nvg__realloc(ctx, ctx->cache.paths, sizeof(NVGpath) * ctx->cache.npaths, sizeof(NVGpath) * cpaths);
         ctx->cache.cpaths = cpaths;
     }
     path = &ctx->cache.paths[ctx->cache.npaths];
@@ -1035,12 +1100,9 @@ static void nvg__addPoint(NVGcontext* ctx, float x, float y, int flags)
 
     if (ctx->cache.npoints + 1 > ctx->cache.cpoints)
     {
-        NVGpoint* points;
-        int       cpoints = ctx->cache.npoints + 1 + ctx->cache.cpoints / 2;
-        points            = (NVGpoint*)NVG_REALLOC(ctx->cache.points, sizeof(NVGpoint) * cpoints);
-        if (points == NULL)
-            return;
-        ctx->cache.points  = points;
+        int cpoints = ctx->cache.npoints + 1 + ctx->cache.cpoints / 2;
+        ctx->cache.points =
+            nvg__realloc(ctx, ctx->cache.points, sizeof(NVGpoint) * ctx->cache.npoints, sizeof(NVGpoint) * cpoints);
         ctx->cache.cpoints = cpoints;
     }
 
@@ -1081,12 +1143,9 @@ static NVGvertex* nvg__allocTempVerts(NVGcontext* ctx, int nverts)
 {
     if (nverts > ctx->cache.cverts)
     {
-        NVGvertex* verts;
         int cverts = (nverts + 0xff) & ~0xff; // Round up to prevent allocations when things change just slightly.
-        verts      = (NVGvertex*)NVG_REALLOC(ctx->cache.verts, sizeof(NVGvertex) * cverts);
-        if (verts == NULL)
-            return NULL;
-        ctx->cache.verts  = verts;
+        // Temp verts are rewritten by every expand, nothing to carry over
+        ctx->cache.verts  = nvg__realloc(ctx, NULL, 0, sizeof(NVGvertex) * cverts);
         ctx->cache.cverts = cverts;
     }
 
@@ -1138,6 +1197,236 @@ static void nvg__vset(NVGvertex* vtx, float x, float y, float u, float v)
     vtx->v = v;
 }
 
+// Curve flattening, adapted from Raph Levien's parabola integral method, also prototyped in program_flatten_quadbez.c
+// https://raphlinus.github.io/graphics/curves/2019/12/23/flatten-quadbez.html
+// Cubics are split into quadratics using a tenth of the tolerance, then points are spread evenly over the quadratics'
+// combined subdivision density, so every segment of the polyline carries about the same error
+
+// Enough quads to stay within quadTol at any practical zoom, long curves need more than 16 beyond 8x
+#define NVG_FLATTEN_MAX_QUADS    64
+#define NVG_FLATTEN_MAX_SEGMENTS 1024
+// Spreading points across neighbouring quads overshoots the target on sharp turns, so aim a little under tessTol
+#define NVG_FLATTEN_TOL_SCALE 0.8f
+// Neighbouring quads whose densities differ by more than this don't share a run of points, as a chord spanning a
+// flat quad and a tight one isn't bounded by their combined density
+#define NVG_FLATTEN_MAX_DENSITY_RATIO 3.0f
+// Points of a run evaluated together before they're added
+#define NVG_FLATTEN_BATCH 16
+
+// Approximates the integral of (1 + 4x^2) ^ -0.25 dx
+static float nvg__approxParabolaIntegral(float x)
+{
+    const float d = 0.67f;
+    return x / (1.0f - d + nvg__sqrtf(nvg__sqrtf(d * d * d * d + 0.25f * x * x)));
+}
+
+// Approximates the inverse of nvg__approxParabolaIntegral()
+static float nvg__approxParabolaInvIntegral(float x)
+{
+    const float b = 0.39f;
+    return x * (1.0f - b + nvg__sqrtf(b * b + 0.25f * x * x));
+}
+
+typedef struct NVGquadFlatten
+{
+    float pts[6];
+    float a0, a2; // parabola integral at either end
+    float u0, u2;
+    float val;  // subdivision density, the quad needs 0.5 * val / sqrt(tol) segments
+    int   bend; // sign of the quad's curvature
+} NVGquadFlatten;
+
+// Maps the quad onto the parabola y = x^2 and measures how many segments it needs
+static void nvg__quadFlattenParams(NVGquadFlatten* q, float sqrtTol)
+{
+    const float* p     = q->pts;
+    float        ddx   = 2.0f * p[2] - p[0] - p[4];
+    float        ddy   = 2.0f * p[3] - p[1] - p[5];
+    float        u0    = (p[2] - p[0]) * ddx + (p[3] - p[1]) * ddy;
+    float        u2    = (p[4] - p[2]) * ddx + (p[5] - p[3]) * ddy;
+    float        cross = (p[4] - p[0]) * ddy - (p[5] - p[1]) * ddx;
+
+    q->val  = 0.0f;
+    q->bend = cross > 0.0f ? 1 : (cross < 0.0f ? -1 : 0);
+    // Straight or folded back onto itself. Either way the end point is all that's needed
+    if (cross == 0.0f)
+        return;
+
+    float x0    = u0 / cross;
+    float x2    = u2 / cross;
+    float scale = nvg__absf(cross) / (nvg__sqrtf(ddx * ddx + ddy * ddy) * nvg__absf(x2 - x0));
+    if (!(scale > 0.0f && scale <= FLT_MAX))
+        return;
+
+    q->a0 = nvg__approxParabolaIntegral(x0);
+    q->a2 = nvg__approxParabolaIntegral(x2);
+    q->u0 = nvg__approxParabolaInvIntegral(q->a0);
+    q->u2 = nvg__approxParabolaInvIntegral(q->a2);
+
+    float da        = nvg__absf(q->a2 - q->a0);
+    float sqrtScale = nvg__sqrtf(scale);
+    if ((x0 < 0.0f) == (x2 < 0.0f))
+    {
+        q->val = da * sqrtScale;
+    }
+    else
+    {
+        // The quad passes through its curvature maximum, don't let the density near the cusp run away
+        float xmin = sqrtTol / sqrtScale;
+        q->val     = sqrtTol * da / nvg__approxParabolaIntegral(xmin);
+    }
+}
+
+// Points along a run of quads, laid out for 4 wide evaluation. Each is at the parabola integral a on its quad
+typedef struct NVGflattenBatch
+{
+    float a[NVG_FLATTEN_BATCH];
+    float u0[NVG_FLATTEN_BATCH];
+    float du[NVG_FLATTEN_BATCH];
+    float x0[NVG_FLATTEN_BATCH], y0[NVG_FLATTEN_BATCH];
+    float x1[NVG_FLATTEN_BATCH], y1[NVG_FLATTEN_BATCH];
+    float x2[NVG_FLATTEN_BATCH], y2[NVG_FLATTEN_BATCH];
+    float px[NVG_FLATTEN_BATCH], py[NVG_FLATTEN_BATCH];
+    int   quad[NVG_FLATTEN_BATCH];
+    int   count;
+    // The last point added, and its quad
+    float prevx, prevy;
+    int   prevq;
+} NVGflattenBatch;
+
+static void nvg__batchQuadPoint(NVGflattenBatch* b, const NVGquadFlatten* q, int quad, float x)
+{
+    int k      = b->count++;
+    b->a[k]    = q->a0 + (q->a2 - q->a0) * x;
+    b->u0[k]   = q->u0;
+    b->du[k]   = q->u2 - q->u0;
+    b->x0[k]   = q->pts[0];
+    b->y0[k]   = q->pts[1];
+    b->x1[k]   = q->pts[2];
+    b->y1[k]   = q->pts[3];
+    b->x2[k]   = q->pts[4];
+    b->y2[k]   = q->pts[5];
+    b->quad[k] = quad;
+}
+
+// Maps each batched point from the parabola back onto its quad. The vector loops round like the scalar one, as no
+// multiply and add is fused, so the points don't depend on where a batch splits
+static void nvg__evalQuadPoints(NVGflattenBatch* b)
+{
+    const float bias = 0.39f; // nvg__approxParabolaInvIntegral()
+    int         k    = 0;
+#if defined(NVG_SSE2)
+    __m128 one4     = _mm_set1_ps(1.0f);
+    __m128 two4     = _mm_set1_ps(2.0f);
+    __m128 quarter4 = _mm_set1_ps(0.25f);
+    __m128 bias4    = _mm_set1_ps(1.0f - bias);
+    __m128 bias24   = _mm_set1_ps(bias * bias);
+    for (; k + 4 <= b->count; k += 4)
+    {
+        __m128 a  = _mm_loadu_ps(&b->a[k]);
+        __m128 r  = _mm_sqrt_ps(_mm_add_ps(bias24, _mm_mul_ps(_mm_mul_ps(quarter4, a), a)));
+        __m128 u  = _mm_mul_ps(a, _mm_add_ps(bias4, r));
+        __m128 t  = _mm_div_ps(_mm_sub_ps(u, _mm_loadu_ps(&b->u0[k])), _mm_loadu_ps(&b->du[k]));
+        __m128 mt = _mm_sub_ps(one4, t);
+        __m128 w0 = _mm_mul_ps(mt, mt);
+        __m128 w1 = _mm_mul_ps(_mm_mul_ps(two4, mt), t);
+        __m128 w2 = _mm_mul_ps(t, t);
+        __m128 px = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(w0, _mm_loadu_ps(&b->x0[k])), _mm_mul_ps(w1, _mm_loadu_ps(&b->x1[k]))),
+            _mm_mul_ps(w2, _mm_loadu_ps(&b->x2[k])));
+        __m128 py = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(w0, _mm_loadu_ps(&b->y0[k])), _mm_mul_ps(w1, _mm_loadu_ps(&b->y1[k]))),
+            _mm_mul_ps(w2, _mm_loadu_ps(&b->y2[k])));
+        _mm_storeu_ps(&b->px[k], px);
+        _mm_storeu_ps(&b->py[k], py);
+    }
+#elif defined(NVG_NEON)
+    float32x4_t one4     = vdupq_n_f32(1.0f);
+    float32x4_t two4     = vdupq_n_f32(2.0f);
+    float32x4_t quarter4 = vdupq_n_f32(0.25f);
+    float32x4_t bias4    = vdupq_n_f32(1.0f - bias);
+    float32x4_t bias24   = vdupq_n_f32(bias * bias);
+    for (; k + 4 <= b->count; k += 4)
+    {
+        // No vmlaq_f32(), which may fuse the multiply and add where the scalar loop rounds twice
+        float32x4_t a  = vld1q_f32(&b->a[k]);
+        float32x4_t r  = vsqrtq_f32(vaddq_f32(bias24, vmulq_f32(vmulq_f32(quarter4, a), a)));
+        float32x4_t u  = vmulq_f32(a, vaddq_f32(bias4, r));
+        float32x4_t t  = vdivq_f32(vsubq_f32(u, vld1q_f32(&b->u0[k])), vld1q_f32(&b->du[k]));
+        float32x4_t mt = vsubq_f32(one4, t);
+        float32x4_t w0 = vmulq_f32(mt, mt);
+        float32x4_t w1 = vmulq_f32(vmulq_f32(two4, mt), t);
+        float32x4_t w2 = vmulq_f32(t, t);
+        float32x4_t px = vaddq_f32(
+            vaddq_f32(vmulq_f32(w0, vld1q_f32(&b->x0[k])), vmulq_f32(w1, vld1q_f32(&b->x1[k]))),
+            vmulq_f32(w2, vld1q_f32(&b->x2[k])));
+        float32x4_t py = vaddq_f32(
+            vaddq_f32(vmulq_f32(w0, vld1q_f32(&b->y0[k])), vmulq_f32(w1, vld1q_f32(&b->y1[k]))),
+            vmulq_f32(w2, vld1q_f32(&b->y2[k])));
+        vst1q_f32(&b->px[k], px);
+        vst1q_f32(&b->py[k], py);
+    }
+#endif
+    for (; k < b->count; k++)
+    {
+        float u  = nvg__approxParabolaInvIntegral(b->a[k]);
+        float t  = (u - b->u0[k]) / b->du[k];
+        float mt = 1.0f - t;
+        b->px[k] = mt * mt * b->x0[k] + 2.0f * mt * t * b->x1[k] + t * t * b->x2[k];
+        b->py[k] = mt * mt * b->y0[k] + 2.0f * mt * t * b->y1[k] + t * t * b->y2[k];
+    }
+}
+
+static void nvg__cubicPointAndTangent(const float* c, float t, float* pt, float* tan)
+{
+    float mt = 1.0f - t;
+    for (int i = 0; i < 2; i++)
+    {
+        float c0 = c[i], c1 = c[2 + i], c2 = c[4 + i], c3 = c[6 + i];
+        pt[i]  = mt * mt * mt * c0 + 3.0f * mt * t * (mt * c1 + t * c2) + t * t * t * c3;
+        tan[i] = 3.0f * (mt * mt * (c1 - c0) + 2.0f * mt * t * (c2 - c1) + t * t * (c3 - c2));
+    }
+}
+
+// A chord spanning quads may still cut the corner where they join, so adds the joins between quads from and to that
+// lie further than tol from the chord (x0, y0) to (x1, y1)
+static void nvg__addQuadJoins(
+    NVGcontext*           ctx,
+    const NVGquadFlatten* quads,
+    int                   from,
+    int                   to,
+    float                 x0,
+    float                 y0,
+    float                 x1,
+    float                 y1,
+    float                 tol)
+{
+    float dx   = x1 - x0;
+    float dy   = y1 - y0;
+    float len2 = dx * dx + dy * dy;
+    for (int i = from; i < to; i++)
+    {
+        float d = (quads[i].pts[4] - x0) * dy - (quads[i].pts[5] - y0) * dx;
+        if (d * d > tol * tol * len2)
+            nvg__addPoint(ctx, quads[i].pts[4], quads[i].pts[5], 0);
+    }
+}
+
+// Evaluates the batched points and adds them in order, each after the joins its chord cuts
+static void nvg__flushQuadPoints(NVGcontext* ctx, NVGflattenBatch* b, const NVGquadFlatten* quads, float tol)
+{
+    nvg__evalQuadPoints(b);
+    for (int k = 0; k < b->count; k++)
+    {
+        nvg__addQuadJoins(ctx, quads, b->prevq, b->quad[k], b->prevx, b->prevy, b->px[k], b->py[k], tol);
+        nvg__addPoint(ctx, b->px[k], b->py[k], 0);
+        b->prevx = b->px[k];
+        b->prevy = b->py[k];
+        b->prevq = b->quad[k];
+    }
+    b->count = 0;
+}
+
 static void nvg__tesselateBezier(
     NVGcontext* ctx,
     float       x1,
@@ -1148,46 +1437,92 @@ static void nvg__tesselateBezier(
     float       y3,
     float       x4,
     float       y4,
-    int         level,
     int         type)
 {
-    float x12, y12, x23, y23, x34, y34, x123, y123, x234, y234, x1234, y1234;
-    float dx, dy, d2, d3;
-
-    if (level > 10)
-        return;
+    const float    c[8]    = {x1, y1, x2, y2, x3, y3, x4, y4};
+    const float    tol     = ctx->tessTol * NVG_FLATTEN_TOL_SCALE;
+    const float    quadTol = tol * 0.1f;
+    const float    sqrtTol = nvg__sqrtf(tol - quadTol);
+    NVGquadFlatten quads[NVG_FLATTEN_MAX_QUADS];
+    int            nquads, nsegs, first, last, i, j;
+
+    // The closest quad is off by at most sqrt(3)/36 of the cubic's third difference, which shrinks with the cube of
+    // the number of splits
+    float ex  = x4 - 3.0f * x3 + 3.0f * x2 - x1;
+    float ey  = y4 - 3.0f * y3 + 3.0f * y2 - y1;
+    float err = nvg__sqrtf(ex * ex + ey * ey) * 0.0481125224f;
+    nquads    = nvg__clampi((int)nvg__ceilf(cbrtf(err / quadTol)), 1, NVG_FLATTEN_MAX_QUADS);
+
+    for (i = 0; i < nquads; i++)
+    {
+        NVGquadFlatten* q  = &quads[i];
+        float           dt = 1.0f / nquads;
+        float           tan0[2], tan1[2];
 
-    x12  = (x1 + x2) * 0.5f;
-    y12  = (y1 + y2) * 0.5f;
-    x23  = (x2 + x3) * 0.5f;
-    y23  = (y2 + y3) * 0.5f;
-    x34  = (x3 + x4) * 0.5f;
-    y34  = (y3 + y4) * 0.5f;
-    x123 = (x12 + x23) * 0.5f;
-    y123 = (y12 + y23) * 0.5f;
+        nvg__cubicPointAndTangent(c, i * dt, &q->pts[0], tan0);
+        nvg__cubicPointAndTangent(c, (i + 1) * dt, &q->pts[4], tan1);
+        // Control point of the quad matching the sub cubic's ends and its third difference midpoint
+        q->pts[2] = (q->pts[0] + q->pts[4]) * 0.5f + (tan0[0] - tan1[0]) * dt * 0.25f;
+        q->pts[3] = (q->pts[1] + q->pts[5]) * 0.5f + (tan0[1] - tan1[1]) * dt * 0.25f;
 
-    dx = x4 - x1;
-    dy = y4 - y1;
-    d2 = nvg__absf(((x2 - x4) * dy - (y2 - y4) * dx));
-    d3 = nvg__absf(((x3 - x4) * dy - (y3 - y4) * dx));
+        nvg__quadFlattenParams(q, sqrtTol);
+    }
 
-    if ((d2 + d3) * (d2 + d3) < ctx->tessTol * (dx * dx + dy * dy))
+    // Points are spread over runs of quads bending the same way. A chord spanning an inflection isn't bounded by the
+    // density either side of it, so runs end there, and where the density jumps between neighbouring quads
+    for (first = 0; first < nquads; first = last)
     {
-        nvg__addPoint(ctx, x4, y4, type);
-        return;
-    }
+        float sum = 0.0f, step, accum = 0.0f;
+        for (last = first; last < nquads; last++)
+        {
+            if (last > first)
+            {
+                const NVGquadFlatten* prev = &quads[last - 1];
+                const NVGquadFlatten* q    = &quads[last];
+                if ((q->bend != 0 && q->bend != quads[first].bend) ||
+                    q->val > prev->val * NVG_FLATTEN_MAX_DENSITY_RATIO ||
+                    prev->val > q->val * NVG_FLATTEN_MAX_DENSITY_RATIO)
+                    break;
+            }
+            sum += quads[last].val;
+        }
+
+        nsegs = nvg__clampi((int)nvg__ceilf(0.5f * sum / sqrtTol), 1, NVG_FLATTEN_MAX_SEGMENTS);
+        step  = sum / nsegs;
 
-    /*	if (nvg__absf(x1+x3-x2-x2) + nvg__absf(y1+y3-y2-y2) + nvg__absf(x2+x4-x3-x3) + nvg__absf(y2+y4-y3-y3) <
-       ctx->tessTol) { nvg__addPoint(ctx, x4, y4, type); return;
-            }*/
+        // Where each point lies is found in order, then the points are evaluated a batch at a time
+        NVGflattenBatch batch;
+        batch.count = 0;
+        batch.prevx = quads[first].pts[0];
+        batch.prevy = quads[first].pts[1];
+        batch.prevq = first;
+        for (i = first, j = 1; j < nsegs; j++)
+        {
+            float target = j * step;
+            while (i < last - 1 && accum + quads[i].val < target)
+            {
+                accum += quads[i].val;
+                i++;
+            }
+
+            const NVGquadFlatten* q = &quads[i];
+            if (q->val <= 0.0f)
+                continue;
+
+            nvg__batchQuadPoint(&batch, q, i, nvg__clampf((target - accum) / q->val, 0.0f, 1.0f));
+            if (batch.count == NVG_FLATTEN_BATCH)
+                nvg__flushQuadPoints(ctx, &batch, quads, tol);
+        }
+        nvg__flushQuadPoints(ctx, &batch, quads, tol);
 
-    x234  = (x23 + x34) * 0.5f;
-    y234  = (y23 + y34) * 0.5f;
-    x1234 = (x123 + x234) * 0.5f;
-    y1234 = (y123 + y234) * 0.5f;
+        // The run ends on its last quad's end point, the curve's end is added below
+        i = last - 1;
+        nvg__addQuadJoins(ctx, quads, batch.prevq, i, batch.prevx, batch.prevy, quads[i].pts[4], quads[i].pts[5], tol);
+        if (last < nquads)
+            nvg__addPoint(ctx, quads[i].pts[4], quads[i].pts[5], 0);
+    }
 
-    nvg__tesselateBezier(ctx, x1, y1, x12, y12, x123, y123, x1234, y1234, level + 1, 0);
-    nvg__tesselateBezier(ctx, x1234, y1234, x234, y234, x34, y34, x4, y4, level + 1, type);
+    nvg__addPoint(ctx, x4, y4, type);
 }
 
 static void nvg__flattenPaths(NVGcontext* ctx)
@@ -1243,7 +1578,6 @@ static void nvg__flattenPaths(NVGcontext* ctx)
                     cp2[1],
                     p[0],
                     p[1],
-                    0,
                     NVG_PT_CORNER);
             }
             i += 7;
@@ -1991,9 +2325,38 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 // Draw
 void nvgBeginPath(NVGcontext* ctx)
 {
-    ctx->ncommands     = 0;
-    ctx->cache.npoints = 0;
-    ctx->cache.npaths  = 0;
+    ctx->ncommands         = 0;
+    ctx->cache.npoints     = 0;
+    ctx->cache.npaths      = 0;
+    ctx->deferred_commands = NULL;
+    ctx->sdfPathCommands   = -1;
+}
+
+// NVG_SDF_PRIMITIVES. Makes the primitive just added to an empty path the path's shape, centred on cx, cy & turned by
+// angle. Returns the scale that takes the primitive's sizes to pixels, or 0 if the transform distorts its shape and the
+// path is left to be tesselated
+static float nvg__beginSdfPath(NVGcontext* ctx, enum SGNVGsdfType type, float cx, float cy, float angle)
+{
+    const float*   t     = ctx->state.xform;
+    SGNVGsdfShape* shape = &ctx->sdfPath;
+    float          scale = nvg__sqrtf(t[0] * t[0] + t[1] * t[1]);
+    float          cs    = nvg__cosf(angle);
+    float          sn    = nvg__sinf(angle);
+
+    ctx->sdfPathCommands = -1;
+    if (!(ctx->flags & NVG_SDF_PRIMITIVES))
+        return 0.0f;
+    // Only rotations, uniform scales & translations
+    if (scale < 1e-6f || nvg__absf(t[0] - t[3]) > scale * 1e-4f || nvg__absf(t[1] + t[2]) > scale * 1e-4f)
+        return 0.0f;
+
+    memset(shape, 0, sizeof(*shape));
+    nvgTransformPoint(&shape->center[0], &shape->center[1], t, cx, cy);
+    shape->axis[0]       = (t[0] * cs + t[2] * sn) / scale;
+    shape->axis[1]       = (t[1] * cs + t[3] * sn) / scale;
+    shape->type          = (float)type;
+    ctx->sdfPathCommands = ctx->ncommands;
+    return scale;
 }
 
 void nvgQuadTo(NVGcontext* ctx, float cx, float cy, float x, float y)
@@ -2085,6 +2448,7 @@ void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, in
     float dx = 0, dy = 0, x = 0, y = 0, tanx = 0, tany = 0;
     float px = 0, py = 0, ptanx = 0, ptany = 0;
     float vals[3 + 5 * 7 + 100];
+    float scale;
     int   i, ndivs, nvals;
     int   move = ctx->ncommands > 0 ? NVG_LINETO : NVG_MOVETO;
 
@@ -2159,12 +2523,40 @@ void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, in
     }
 
     nvg__appendCommands(ctx, vals, nvals);
+
+    // The shape's y axis points at the middle of the arc, which is symmetric around it
+    if (move == NVG_MOVETO && r > 0.0f &&
+        (scale = nvg__beginSdfPath(ctx, SGNVG_SDF_ARC_BUTT, cx, cy, a0 + da * 0.5f - NVG_PI * 0.5f)) > 0.0f)
+    {
+        if ((NVG_PI * 2 - nvg__absf(da)) * r * scale <= ctx->distTol)
+        {
+            // Ends that meet are joined into a ring by nvg__flattenPaths(), which has no caps to cut it
+            ctx->sdfPath.type    = SGNVG_SDF_ELLIPSE;
+            ctx->sdfPath.size[0] = r * scale;
+            ctx->sdfPath.size[1] = r * scale;
+        }
+        else
+        {
+            ctx->sdfPath.size[0] = nvg__sinf(nvg__absf(da) * 0.5f);
+            ctx->sdfPath.size[1] = nvg__cosf(nvg__absf(da) * 0.5f);
+            ctx->sdfPath.radius  = r * scale;
+        }
+    }
 }
 
 void nvgRect(NVGcontext* ctx, float x, float y, float w, float h)
 {
+    bool  empty  = ctx->ncommands == 0;
     float vals[] = {NVG_MOVETO, x, y, NVG_LINETO, x, y + h, NVG_LINETO, x + w, y + h, NVG_LINETO, x + w, y, NVG_CLOSE};
+    float scale;
     nvg__appendCommands(ctx, vals, NVG_ARRLEN(vals));
+
+    if (empty && w != 0.0f && h != 0.0f &&
+        (scale = nvg__beginSdfPath(ctx, SGNVG_SDF_RECT, x + w * 0.5f, y + h * 0.5f, 0.0f)) > 0.0f)
+    {
+        ctx->sdfPath.size[0] = nvg__absf(w) * 0.5f * scale;
+        ctx->sdfPath.size[1] = nvg__absf(h) * 0.5f * scale;
+    }
 }
 
 void nvgRect2(NVGcontext* ctx, float left, float top, float right, float bottom)
@@ -2197,6 +2589,8 @@ void nvgRoundedRectVarying(
     }
     else
     {
+        bool  empty = ctx->ncommands == 0;
+        float scale;
         float halfw = nvg__absf(w) * 0.5f;
         float halfh = nvg__absf(h) * 0.5f;
         float rxBL  = nvg__minf(radBottomLeft, halfw) * nvg__signf(w),
@@ -2252,6 +2646,16 @@ void nvgRoundedRectVarying(
             y + ryTL,
             NVG_CLOSE};
         nvg__appendCommands(ctx, vals, NVG_ARRLEN(vals));
+
+        // Corners that are squeezed into ellipses or differ are left to tesselation
+        if (empty && radTopRight == radTopLeft && radBottomRight == radTopLeft && radBottomLeft == radTopLeft &&
+            nvg__absf(rxTL) == nvg__absf(ryTL) && w != 0.0f && h != 0.0f &&
+            (scale = nvg__beginSdfPath(ctx, SGNVG_SDF_RECT, x + w * 0.5f, y + h * 0.5f, 0.0f)) > 0.0f)
+        {
+            ctx->sdfPath.size[0] = halfw * scale;
+            ctx->sdfPath.size[1] = halfh * scale;
+            ctx->sdfPath.radius  = nvg__absf(rxTL) * scale;
+        }
     }
 }
 
@@ -2340,6 +2744,8 @@ void nvgRoundedRect2(NVGcontext* ctx, float x, float y, float r, float b, float
 
 void nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry)
 {
+    bool  empty  = ctx->ncommands == 0;
+    float scale;
     float vals[] = {
         NVG_MOVETO,
         cx - rx,
@@ -2374,6 +2780,12 @@ void nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry)
         cy,
         NVG_CLOSE};
     nvg__appendCommands(ctx, vals, NVG_ARRLEN(vals));
+
+    if (empty && rx != 0.0f && ry != 0.0f && (scale = nvg__beginSdfPath(ctx, SGNVG_SDF_ELLIPSE, cx, cy, 0.0f)) > 0.0f)
+    {
+        ctx->sdfPath.size[0] = nvg__absf(rx) * scale;
+        ctx->sdfPath.size[1] = nvg__absf(ry) * scale;
+    }
 }
 
 void nvgCircle(NVGcontext* ctx, float cx, float cy, float r) { nvgEllipse(ctx, cx, cy, r, r); }
@@ -2417,23 +2829,44 @@ static uint32_t sgnvg__getCombinedBlendNumber(sg_blend_state blend)
 static void sgnvg__initPipeline(
     NVGcontext*             ctx,
     sg_pipeline             pip,
+    sg_shader               shader,
     const sg_stencil_state* stencil,
     sg_color_mask           write_mask,
     sg_cull_mode            cull_mode)
 {
+    sg_vertex_layout_state layout = {
+        // .buffers[0] = {.stride = sizeof(SGNVGattribute)},
+        .attrs =
+            {
+                [ATTR_nanovg_sg_vertex].format     = SG_VERTEXFORMAT_FLOAT2,
+                [ATTR_nanovg_sg_tcoord].format     = SG_VERTEXFORMAT_FLOAT2,
+                [ATTR_nanovg_sg_paintIndex].format = SG_VERTEXFORMAT_FLOAT,
+            },
+    };
+    sg_index_type index_type = SG_INDEXTYPE_UINT32;
+    if (ctx->flags & NVG_COMPACT_VERTICES)
+    {
+        layout = (sg_vertex_layout_state){
+            .attrs =
+                {
+                    [ATTR_nanovg_sg_compact_vertex].format      = SG_VERTEXFORMAT_SHORT2,
+                    [ATTR_nanovg_sg_compact_tcoordPaint].format = SG_VERTEXFORMAT_UBYTE4,
+                },
+        };
+        index_type = SG_INDEXTYPE_UINT16;
+    }
+    if ((ctx->flags & NVG_VERTEX_PULL) || shader.id == ctx->sdfShader.id)
+    {
+        // vs_pull & vs_sdf read the vertices themselves
+        layout     = (sg_vertex_layout_state){0};
+        index_type = SG_INDEXTYPE_NONE;
+    }
+
     sg_init_pipeline(
         pip,
         &(sg_pipeline_desc){
-            .shader = ctx->shader,
-            .layout =
-                {
-                    // .buffers[0] = {.stride = sizeof(SGNVGattribute)},
-                    .attrs =
-                        {
-                            [ATTR_nanovg_sg_vertex].format = SG_VERTEXFORMAT_FLOAT2,
-                            [ATTR_nanovg_sg_tcoord].format = SG_VERTEXFORMAT_FLOAT2,
-                        },
-                },
+            .shader  = shader,
+            .layout  = layout,
             .stencil = *stencil,
             .colors[0] =
                 {
@@ -2441,7 +2874,7 @@ static void sgnvg__initPipeline(
                     .blend      = ctx->blend,
                 },
             .primitive_type = SG_PRIMITIVETYPE_TRIANGLES,
-            .index_type     = SG_INDEXTYPE_UINT32,
+            .index_type     = index_type,
             .cull_mode      = cull_mode,
             .face_winding   = SG_FACEWINDING_CCW,
             .label          = NVG_LABEL("nanovg.pipeline"),
@@ -2457,6 +2890,8 @@ static bool sgnvg__pipelineTypeIsInUse(NVGcontext* ctx, enum SGNVGpipelineType t
     case SGNVG_PIP_FILL_DRAW:
     case SGNVG_PIP_FILL_ANTIALIAS:
         return true;
+    case SGNVG_PIP_SDF:
+        return (ctx->flags & NVG_SDF_PRIMITIVES) != 0;
 
     case SGNVG_PIP_NUM_: // to avoid warnings
         break;           /* fall through to assert */
@@ -2465,161 +2900,250 @@ static bool sgnvg__pipelineTypeIsInUse(NVGcontext* ctx, enum SGNVGpipelineType t
     return false;
 }
 
-static int sgnvg__getIndexFromCache(NVGcontext* ctx, uint32_t blendNumber)
+static void sgnvg__initPipelineOfType(NVGcontext* ctx, sg_pipeline pip, enum SGNVGpipelineType type)
+{
+    switch (type)
+    {
+    case SGNVG_PIP_BASE:
+        sgnvg__initPipeline(
+            ctx,
+            pip,
+            ctx->shader,
+            &(sg_stencil_state){
+                .enabled = false,
+            },
+            SG_COLORMASK_RGBA,
+            SG_CULLMODE_BACK);
+        break;
+
+    case SGNVG_PIP_FILL_STENCIL:
+        sgnvg__initPipeline(
+            ctx,
+            pip,
+            ctx->shader,
+            &(sg_stencil_state){
+                .enabled = true,
+                .front =
+                    {.compare       = SG_COMPAREFUNC_ALWAYS,
+                     .fail_op       = SG_STENCILOP_KEEP,
+                     .depth_fail_op = SG_STENCILOP_KEEP,
+                     .pass_op       = SG_STENCILOP_INCR_WRAP},
+                .back =
+                    {.compare       = SG_COMPAREFUNC_ALWAYS,
+                     .fail_op       = SG_STENCILOP_KEEP,
+                     .depth_fail_op = SG_STENCILOP_KEEP,
+                     .pass_op       = SG_STENCILOP_DECR_WRAP},
+                .read_mask  = 0xFF,
+                .write_mask = 0xFF,
+                .ref        = 0,
+            },
+            SG_COLORMASK_NONE,
+            SG_CULLMODE_NONE);
+        break;
+    case SGNVG_PIP_FILL_ANTIALIAS:
+        sgnvg__initPipeline(
+            ctx,
+            pip,
+            ctx->shader,
+            &(sg_stencil_state){
+                .enabled = true,
+                .front =
+                    {.compare       = SG_COMPAREFUNC_EQUAL,
+                     .fail_op       = SG_STENCILOP_KEEP,
+                     .depth_fail_op = SG_STENCILOP_KEEP,
+                     .pass_op       = SG_STENCILOP_KEEP},
+                .back =
+                    {.compare       = SG_COMPAREFUNC_EQUAL,
+                     .fail_op       = SG_STENCILOP_KEEP,
+                     .depth_fail_op = SG_STENCILOP_KEEP,
+                     .pass_op       = SG_STENCILOP_KEEP},
+                .read_mask  = 0xFF,
+                .write_mask = 0xFF,
+                .ref        = 0,
+            },
+            SG_COLORMASK_RGBA,
+            SG_CULLMODE_BACK);
+        break;
+    case SGNVG_PIP_FILL_DRAW:
+        sgnvg__initPipeline(
+            ctx,
+            pip,
+            ctx->shader,
+            &(sg_stencil_state){
+                .enabled = true,
+                .front =
+                    {.compare       = SG_COMPAREFUNC_NOT_EQUAL,
+                     .fail_op       = SG_STENCILOP_ZERO,
+                     .depth_fail_op = SG_STENCILOP_ZERO,
+                     .pass_op       = SG_STENCILOP_ZERO},
+                .back =
+                    {.compare       = SG_COMPAREFUNC_NOT_EQUAL,
+                     .fail_op       = SG_STENCILOP_ZERO,
+                     .depth_fail_op = SG_STENCILOP_ZERO,
+                     .pass_op       = SG_STENCILOP_ZERO},
+                .read_mask  = 0xFF,
+                .write_mask = 0xFF,
+                .ref        = 0,
+            },
+            SG_COLORMASK_RGBA,
+            SG_CULLMODE_BACK);
+        break;
+    case SGNVG_PIP_SDF:
+        sgnvg__initPipeline(
+            ctx,
+            pip,
+            ctx->sdfShader,
+            &(sg_stencil_state){
+                .enabled = false,
+            },
+            SG_COLORMASK_RGBA,
+            SG_CULLMODE_NONE);
+        break;
+
+    default:
+        NVG_ASSERT(0);
+    }
+}
+
+static uint32_t sgnvg__pipelineHash(uint32_t blendNumber, enum SGNVGpipelineType type)
+{
+    // Fibonacci hashing; the top bits mix in all the blend factors
+    return ((blendNumber ^ ((uint32_t)type << 6)) * 2654435769u) >> (32 - NANOVG_SG_PIPELINE_HASH_BITS);
+}
+
+// Returns the slot of the pipeline for `blendNumber` & `type`, or the empty slot ending its probe sequence
+static int sgnvg__findPipelineSlot(SGNVGpipelineCache* cache, uint32_t blendNumber, enum SGNVGpipelineType type)
 {
-    uint16_t currentUse = ctx->pipelineCache.currentUse;
+    int slot = sgnvg__pipelineHash(blendNumber, type);
+
+    // there's always an empty slot, as the table is larger than the cache
+    while (cache->slots[slot] != 0)
+    {
+        const SGNVGpipelineCacheEntry* entry = &cache->entries[cache->slots[slot] - 1];
+        if (entry->blend == blendNumber && entry->type == type)
+            break;
+        slot = (slot + 1) & (NANOVG_SG_PIPELINE_HASH_SIZE - 1);
+    }
+    return slot;
+}
 
-    int maxAge      = 0;
-    int maxAgeIndex = 0;
+// Backward shift deletion: later entries of the probe sequence move into the gap, so no lookup stops short of them
+static void sgnvg__removePipelineSlot(SGNVGpipelineCache* cache, int slot)
+{
+    const int mask = NANOVG_SG_PIPELINE_HASH_SIZE - 1;
 
-    // find the correct cache entry for `blend_number`
-    for (unsigned int i = 0; i < NANOVG_SG_PIPELINE_CACHE_SIZE; i++)
+    cache->slots[slot] = 0;
+    for (int next = (slot + 1) & mask; cache->slots[next] != 0; next = (next + 1) & mask)
     {
-        if (ctx->pipelineCache.keys[i].blend == blendNumber)
-        {
-            ctx->pipelineCache.keys[i].lastUse = ctx->pipelineCache.currentUse;
-            return i;
-        }
-        int age = (uint16_t)(currentUse - ctx->pipelineCache.keys[i].lastUse);
-        if (age > maxAge)
+        const SGNVGpipelineCacheEntry* entry = &cache->entries[cache->slots[next] - 1];
+        int                            home  = sgnvg__pipelineHash(entry->blend, entry->type);
+        // the gap lies between where the entry hashes to & where it is
+        if (((next - home) & mask) >= ((next - slot) & mask))
         {
-            maxAge      = age;
-            maxAgeIndex = i;
+            cache->slots[slot] = cache->slots[next];
+            cache->slots[next] = 0;
+            slot               = next;
         }
     }
-
-    // not found; reuse an old one
-    ctx->pipelineCache.currentUse                = ++currentUse;
-    ctx->pipelineCache.keys[maxAgeIndex].blend   = blendNumber;
-    ctx->pipelineCache.keys[maxAgeIndex].lastUse = currentUse;
-
-    sg_pipeline* pipelines       = ctx->pipelineCache.pipelines[maxAgeIndex];
-    uint8_t      pipelinesActive = ctx->pipelineCache.pipelinesActive[maxAgeIndex];
-    // we may have had data already initialized; deinit those
-    for (uint32_t type = SGNVG_PIP_BASE; type < SGNVG_PIP_NUM_; type++)
-        if (pipelinesActive & (1 << type))
-            sg_uninit_pipeline(pipelines[type]);
-    // mark all as inactive
-    ctx->pipelineCache.pipelinesActive[maxAgeIndex] = 0;
-    return maxAgeIndex;
 }
 
 static sg_pipeline sgnvg__getPipelineFromCache(NVGcontext* ctx, enum SGNVGpipelineType type)
 {
+    SGNVGpipelineCache*      cache = &ctx->pipelineCache;
+    SGNVGpipelineCacheEntry* entry;
+    int                      slot, index;
     NVG_ASSERT(sgnvg__pipelineTypeIsInUse(ctx, type));
 
-    int         pipelineCacheIndex = ctx->pipelineCacheIndex;
-    sg_pipeline pipeline           = ctx->pipelineCache.pipelines[pipelineCacheIndex][type];
-    uint8_t     typeMask           = 1 << type;
-    if (!(ctx->pipelineCache.pipelinesActive[pipelineCacheIndex] & typeMask))
+    slot = sgnvg__findPipelineSlot(cache, ctx->blendNumber, type);
+    if (cache->slots[slot] != 0)
     {
-        ctx->pipelineCache.pipelinesActive[pipelineCacheIndex] |= typeMask;
-        switch (type)
-        {
-        case SGNVG_PIP_BASE:
-            sgnvg__initPipeline(
-                ctx,
-                pipeline,
-                &(sg_stencil_state){
-                    .enabled = false,
-                },
-                SG_COLORMASK_RGBA,
-                SG_CULLMODE_BACK);
-            break;
-
-        case SGNVG_PIP_FILL_STENCIL:
-            sgnvg__initPipeline(
-                ctx,
-                pipeline,
-                &(sg_stencil_state){
-                    .enabled = true,
-                    .front =
-                        {.compare       = SG_COMPAREFUNC_ALWAYS,
-                         .fail_op       = SG_STENCILOP_KEEP,
-                         .depth_fail_op = SG_STENCILOP_KEEP,
-                         .pass_op       = SG_STENCILOP_INCR_WRAP},
-                    .back =
-                        {.compare       = SG_COMPAREFUNC_ALWAYS,
-                         .fail_op       = SG_STENCILOP_KEEP,
-                         .depth_fail_op = SG_STENCILOP_KEEP,
-                         .pass_op       = SG_STENCILOP_DECR_WRAP},
-                    .read_mask  = 0xFF,
-                    .write_mask = 0xFF,
-                    .ref        = 0,
-                },
-                SG_COLORMASK_NONE,
-                SG_CULLMODE_NONE);
-            break;
-        case SGNVG_PIP_FILL_ANTIALIAS:
-            sgnvg__initPipeline(
-                ctx,
-                pipeline,
-                &(sg_stencil_state){
-                    .enabled = true,
-                    .front =
-                        {.compare       = SG_COMPAREFUNC_EQUAL,
-                         .fail_op       = SG_STENCILOP_KEEP,
-                         .depth_fail_op = SG_STENCILOP_KEEP,
-                         .pass_op       = SG_STENCILOP_KEEP},
-                    .back =
-                        {.compare       = SG_COMPAREFUNC_EQUAL,
-                         .fail_op       = SG_STENCILOP_KEEP,
-                         .depth_fail_op = SG_STENCILOP_KEEP,
-                         .pass_op       = SG_STENCILOP_KEEP},
-                    .read_mask  = 0xFF,
-                    .write_mask = 0xFF,
-                    .ref        = 0,
-                },
-                SG_COLORMASK_RGBA,
-                SG_CULLMODE_BACK);
-            break;
-        case SGNVG_PIP_FILL_DRAW:
-            sgnvg__initPipeline(
-                ctx,
-                pipeline,
-                &(sg_stencil_state){
-                    .enabled = true,
-                    .front =
-                        {.compare       = SG_COMPAREFUNC_NOT_EQUAL,
-                         .fail_op       = SG_STENCILOP_ZERO,
-                         .depth_fail_op = SG_STENCILOP_ZERO,
-                         .pass_op       = SG_STENCILOP_ZERO},
-                    .back =
-                        {.compare       = SG_COMPAREFUNC_NOT_EQUAL,
-                         .fail_op       = SG_STENCILOP_ZERO,
-                         .depth_fail_op = SG_STENCILOP_ZERO,
-                         .pass_op       = SG_STENCILOP_ZERO},
-                    .read_mask  = 0xFF,
-                    .write_mask = 0xFF,
-                    .ref        = 0,
-                },
-                SG_COLORMASK_RGBA,
-                SG_CULLMODE_BACK);
-            break;
+        ctx->frame_stats.pipelineCacheHits++;
+        entry          = &cache->entries[cache->slots[slot] - 1];
+        entry->lastUse = ++cache->currentUse;
+        return entry->pipeline;
+    }
+    ctx->frame_stats.pipelineCacheMisses++;
 
-        default:
-            NVG_ASSERT(0);
+    if (cache->numEntries < NANOVG_SG_PIPELINE_CACHE_SIZE)
+    {
+        index                          = cache->numEntries++;
+        cache->entries[index].pipeline = sg_alloc_pipeline();
+    }
+    else
+    {
+        // full; reuse the least recently used one
+        uint32_t maxAge = 0;
+        index           = 0;
+        for (int i = 0; i < NANOVG_SG_PIPELINE_CACHE_SIZE; i++)
+        {
+            uint32_t age = cache->currentUse - cache->entries[i].lastUse;
+            if (age > maxAge)
+            {
+                maxAge = age;
+                index  = i;
+            }
         }
+        entry = &cache->entries[index];
+        sgnvg__removePipelineSlot(cache, sgnvg__findPipelineSlot(cache, entry->blend, entry->type));
+        sg_uninit_pipeline(entry->pipeline);
+        // the handle stays the same, so make sure the reinitialised pipeline gets applied
+        ctx->appliedPipeline = (sg_pipeline){SG_INVALID_ID};
+        // the removal may have shifted the probe sequence
+        slot = sgnvg__findPipelineSlot(cache, ctx->blendNumber, type);
     }
-    return pipeline;
+
+    entry              = &cache->entries[index];
+    entry->blend       = ctx->blendNumber;
+    entry->type        = type;
+    entry->lastUse     = ++cache->currentUse;
+    cache->slots[slot] = (uint8_t)(index + 1);
+    sgnvg__initPipelineOfType(ctx, entry->pipeline, type);
+    return entry->pipeline;
 }
 
-static void
-sgnvg__preparePipelineUniforms(NVGcontext* ctx, SGNVGfragUniforms* uniforms, enum SGNVGpipelineType pipelineType)
+static void sgnvg__applyPipeline(NVGcontext* ctx, enum SGNVGpipelineType pipelineType, int vertexBase)
 {
     sg_pipeline pip = sgnvg__getPipelineFromCache(ctx, pipelineType);
 
-    sg_apply_pipeline(pip);
+    // Paints are picked per vertex from the storage buffer, so nothing changes between draws with the same pipeline
+    if (pip.id == ctx->appliedPipeline.id && vertexBase == ctx->appliedVertexBase)
+        return;
+
+    if (pip.id != ctx->appliedPipeline.id)
+    {
+        ctx->appliedPipeline = pip;
+
+        sg_apply_pipeline(pip);
 
-    sg_apply_uniforms(UB_nanovg_viewSize, &(sg_range){&ctx->view, sizeof(ctx->view)});
-    ctx->frame_stats.uploaded_bytes += sizeof(ctx->view);
-    sg_apply_uniforms(UB_nanovg_frag, &(sg_range){uniforms, sizeof(*uniforms)});
-    ctx->frame_stats.uploaded_bytes += sizeof(*uniforms);
+        sg_apply_uniforms(UB_nanovg_viewSize, &(sg_range){&ctx->view, sizeof(ctx->view)});
+        ctx->frame_stats.uploaded_bytes += sizeof(ctx->view);
+    }
+    ctx->appliedVertexBase = vertexBase;
+
+    sg_bindings bindings = {.views[VIEW_nanovg_paints] = ctx->paintView};
+    if (pipelineType == SGNVG_PIP_SDF)
+    {
+        bindings.views[VIEW_nanovg_sdfs] = ctx->sdfView;
+    }
+    else if (ctx->flags & NVG_VERTEX_PULL)
+    {
+        bindings.views[VIEW_nanovg_verts] = ctx->vertView;
+    }
+    else
+    {
+        bindings.vertex_buffers[0]        = ctx->vertBuf;
+        bindings.vertex_buffer_offsets[0] = vertexBase * (int)sgnvg__vertexSize(ctx);
+        bindings.index_buffer             = ctx->indexBuf;
+    }
+    sg_apply_bindings(&bindings);
+}
 
-    sg_apply_bindings(&(sg_bindings){
-        .vertex_buffers[0] = ctx->vertBuf,
-        .index_buffer      = ctx->indexBuf,
-    });
+static void sgnvg__draw(NVGcontext* ctx, int offset, int count)
+{
+    if (count <= 0)
+        return;
+    sg_draw(offset, count, 1);
+    ctx->frame_stats.drawCallCount++;
 }
 
 static void sgnvg__xformToMat3x4(float* m3, float* t)
@@ -2646,6 +3170,16 @@ static NVGcolour sgnvg__premulColour(NVGcolour c)
     return c;
 }
 
+// Premultiplied RGBA8, as unpackUnorm4x8() reads it
+static uint32_t sgnvg__packColour(NVGcolour c)
+{
+    uint32_t rgba = 0;
+    c             = sgnvg__premulColour(c);
+    for (int i = 0; i < 4; i++)
+        rgba |= (uint32_t)(nvg__clampf(c.rgba[i], 0.0f, 1.0f) * 255.0f + 0.5f) << (i * 8);
+    return rgba;
+}
+
 static int sgnvg__convertPaint(
     NVGcontext*        ctx,
     SGNVGfragUniforms* frag,
@@ -2698,55 +3232,59 @@ static int sgnvg__convertPaint(
 
 static void sgnvg__fill(NVGcontext* ctx, SGNVGcall* call)
 {
-    SGNVGpath* paths = call->paths;
-    int        i, npaths = call->num_paths;
-
-    sgnvg__preparePipelineUniforms(ctx, call->uniforms, SGNVG_PIP_FILL_STENCIL);
-    for (i = 0; i < npaths; i++)
-        sg_draw(paths[i].fillOffset, paths[i].fillCount, 1);
+    sgnvg__applyPipeline(ctx, SGNVG_PIP_FILL_STENCIL, call->vertexBase);
+    sgnvg__draw(ctx, call->indexOffset, call->fillCount);
 
-    sgnvg__preparePipelineUniforms(ctx, call->uniforms + 1, SGNVG_PIP_FILL_ANTIALIAS);
     // Draw fringes
-    for (i = 0; i < npaths; i++)
-        sg_draw(paths[i].strokeOffset, paths[i].strokeCount, 1);
+    if (call->strokeCount > 0)
+    {
+        sgnvg__applyPipeline(ctx, SGNVG_PIP_FILL_ANTIALIAS, call->vertexBase);
+        sgnvg__draw(ctx, call->indexOffset + call->fillCount, call->strokeCount);
+    }
 
     // Draw fill
-    sgnvg__preparePipelineUniforms(ctx, call->uniforms + 1, SGNVG_PIP_FILL_DRAW);
-    sg_draw(call->triangleOffset, call->triangleCount, 1);
+    sgnvg__applyPipeline(ctx, SGNVG_PIP_FILL_DRAW, call->vertexBase);
+    sgnvg__draw(ctx, call->triangleOffset, call->triangleCount);
 }
 
-static void sgnvg__convexFill(NVGcontext* ctx, SGNVGcall* call)
+// Returns whether a call is drawn with one pipeline from one range of indexes, or of vertices for SGNVG_SDF. Runs of
+// these are merged into a single draw, as long as they share the pipeline, their ranges follow each other in the same
+// vertex chunk and their blend state matches
+static bool
+sgnvg__getCallRange(const SGNVGcall* call, enum SGNVGpipelineType* pipelineType, int* offset, int* count)
 {
-    SGNVGpath* paths = call->paths;
-    int        i, npaths = call->num_paths;
-
-    sgnvg__preparePipelineUniforms(ctx, call->uniforms, SGNVG_PIP_BASE);
-    for (i = 0; i < npaths; i++)
+    switch (call->type)
     {
-        sg_draw(paths[i].fillOffset, paths[i].fillCount, 1);
-        // Draw fringes
-        if (paths[i].strokeCount > 0)
-        {
-            sg_draw(paths[i].strokeOffset, paths[i].strokeCount, 1);
-        }
+    case SGNVG_CONVEXFILL:
+    case SGNVG_STROKE:
+        *pipelineType = SGNVG_PIP_BASE;
+        *offset       = call->indexOffset;
+        *count        = call->fillCount + call->strokeCount;
+        return true;
+    case SGNVG_TRIANGLES:
+        *pipelineType = SGNVG_PIP_BASE;
+        *offset       = call->triangleOffset;
+        *count        = call->triangleCount;
+        return true;
+    case SGNVG_SDF:
+        *pipelineType = SGNVG_PIP_SDF;
+        *offset       = call->triangleOffset;
+        *count        = call->triangleCount;
+        return true;
+    case SGNVG_NONE:
+    case SGNVG_FILL:
+        break;
     }
+    return false;
 }
 
-static void sgnvg__stroke(NVGcontext* ctx, SGNVGcall* call)
-{
-    SGNVGpath* paths  = call->paths;
-    int        npaths = call->num_paths, i;
-
-    sgnvg__preparePipelineUniforms(ctx, call->uniforms, SGNVG_PIP_BASE);
-    // Draw Strokes
-    for (i = 0; i < npaths; i++)
-        sg_draw(paths[i].strokeOffset, paths[i].strokeCount, 1);
-}
-
-static void sgnvg__triangles(NVGcontext* ctx, SGNVGcall* call)
+static void sgnvg__setBlend(NVGcontext* ctx, SGNVGblend blendFunc)
 {
-    sgnvg__preparePipelineUniforms(ctx, call->uniforms, SGNVG_PIP_BASE);
-    sg_draw(call->triangleOffset, call->triangleCount, 1);
+    ctx->blend.src_factor_rgb   = blendFunc.srcRGB;
+    ctx->blend.dst_factor_rgb   = blendFunc.dstRGB;
+    ctx->blend.src_factor_alpha = blendFunc.srcAlpha;
+    ctx->blend.dst_factor_alpha = blendFunc.dstAlpha;
+    ctx->blendNumber            = sgnvg__getCombinedBlendNumber(ctx->blend);
 }
 
 static void sgnvg__renderNVGCalls(NVGcontext* ctx, SGNVGcommandNVG* draws)
@@ -2754,29 +3292,48 @@ static void sgnvg__renderNVGCalls(NVGcontext* ctx, SGNVGcommandNVG* draws)
     SGNVGcall* call = draws->calls;
     int        i;
 
+    // Other draws may have run since, see snvg_command_draw_nvg()
+    ctx->appliedPipeline = (sg_pipeline){SG_INVALID_ID};
+
     for (i = 0; i < draws->num_calls && call != NULL; i++)
     {
-        ctx->blend.src_factor_rgb   = call->blendFunc.srcRGB;
-        ctx->blend.dst_factor_rgb   = call->blendFunc.dstRGB;
-        ctx->blend.src_factor_alpha = call->blendFunc.srcAlpha;
-        ctx->blend.dst_factor_alpha = call->blendFunc.dstAlpha;
-        ctx->pipelineCacheIndex     = sgnvg__getIndexFromCache(ctx, sgnvg__getCombinedBlendNumber(ctx->blend));
-        switch (call->type)
+        enum SGNVGpipelineType pipelineType;
+        int                    offset, count;
+
+        if (call->type == SGNVG_FILL)
         {
-        case SGNVG_NONE:
-            break;
-        case SGNVG_FILL:
+            sgnvg__setBlend(ctx, call->blendFunc);
             sgnvg__fill(ctx, call);
-            break;
-        case SGNVG_CONVEXFILL:
-            sgnvg__convexFill(ctx, call);
-            break;
-        case SGNVG_STROKE:
-            sgnvg__stroke(ctx, call);
-            break;
-        case SGNVG_TRIANGLES:
-            sgnvg__triangles(ctx, call);
-            break;
+        }
+        else if (sgnvg__getCallRange(call, &pipelineType, &offset, &count))
+        {
+            SGNVGblend             blendFunc  = call->blendFunc;
+            int                    vertexBase = call->vertexBase;
+            SGNVGcall*             next;
+            enum SGNVGpipelineType next_pipelineType;
+            int                    next_offset, next_count;
+
+            // Skipping calls that draw nothing, take in every following call that continues the range
+            while ((next = call->next) != NULL && i + 1 < draws->num_calls)
+            {
+                if (next->type == SGNVG_NONE)
+                {
+                    call = next;
+                    i++;
+                    continue;
+                }
+                if (!sgnvg__getCallRange(next, &next_pipelineType, &next_offset, &next_count) ||
+                    next_pipelineType != pipelineType || next_offset != offset + count ||
+                    next->vertexBase != vertexBase || memcmp(&next->blendFunc, &blendFunc, sizeof(blendFunc)) != 0)
+                    break;
+                count += next_count;
+                call   = next;
+                i++;
+            }
+
+            sgnvg__setBlend(ctx, blendFunc);
+            sgnvg__applyPipeline(ctx, pipelineType, vertexBase);
+            sgnvg__draw(ctx, offset, count);
         }
 
         call = call->next;
@@ -2829,6 +3386,24 @@ static SGNVGblend sgnvg__blendCompositeOperation(NVGcompositeOperationState op)
     return blend;
 }
 
+void nvgPrewarmPipelines(NVGcontext* ctx, const int* ops, int count)
+{
+    sg_blend_state blend       = ctx->blend;
+    uint32_t       blendNumber = ctx->blendNumber;
+
+    for (int i = 0; i < count; i++)
+    {
+        sgnvg__setBlend(ctx, sgnvg__blendCompositeOperation(nvg__compositeOperationState(ops[i])));
+        for (enum SGNVGpipelineType t = 0; t < SGNVG_PIP_NUM_; t++)
+            if (sgnvg__pipelineTypeIsInUse(ctx, t))
+                sgnvg__getPipelineFromCache(ctx, t);
+    }
+    ctx->blend       = blend;
+    ctx->blendNumber = blendNumber;
+}
+
+static int nvg__countArenaBlocks(const NVGcontext* ctx);
+
 void nvgBeginFrame(NVGcontext* ctx, int backingScaleFactor)
 {
     nvgReset(ctx);
@@ -2841,41 +3416,67 @@ void nvgBeginFrame(NVGcontext* ctx, int backingScaleFactor)
     NVG_ASSERT(ctx->arena_top == NULL);
     ctx->arena_top = linked_arena_get_top(ctx->arena);
 
-    ctx->frame_stats.drawCallCount  = 0;
-    ctx->frame_stats.fillTriCount   = 0;
-    ctx->frame_stats.strokeTriCount = 0;
-    ctx->frame_stats.textTriCount   = 0;
-    ctx->frame_stats.textTriCount   = 0;
-    ctx->frame_stats.uploaded_bytes = 0;
-
-    // Reset calls
-    ctx->nverts        = 0;
-    ctx->nindexes      = 0;
-    ctx->first_command = NULL;
+    ctx->frame_stats.drawCallCount       = 0;
+    ctx->frame_stats.fillTriCount        = 0;
+    ctx->frame_stats.strokeTriCount      = 0;
+    ctx->frame_stats.textTriCount        = 0;
+    ctx->frame_stats.sdfShapeCount       = 0;
+    ctx->frame_stats.pipelineCacheHits   = 0;
+    ctx->frame_stats.pipelineCacheMisses = 0;
+    ctx->frame_stats.uploaded_bytes      = 0;
+    ctx->frame_stats.allocCount          = 0;
+
+    // Reset calls. The previous frame's are dropped with frame_arena below
+    ctx->first_command    = NULL;
+    ctx->current_command  = NULL;
+    ctx->current_nvg_draw = NULL;
+    ctx->current_call     = NULL;
 
+    if (ctx->next_frame_arena != NULL)
+    {
+        linked_arena_destroy(ctx->frame_arena);
+        ctx->frame_arena      = ctx->next_frame_arena;
+        ctx->next_frame_arena = NULL;
+    }
+    ctx->arenaBlocks = nvg__countArenaBlocks(ctx);
     linked_arena_clear(ctx->frame_arena);
+    nvg__reserveFrameBuffers(ctx);
 
     nvg__setBackingScaleFactor(ctx, backingScaleFactor);
 }
 
+static void nvg__tesselateDeferredPaths(NVGcontext* ctx);
+static int  nvg__refitArenas(NVGcontext* ctx);
+
 void nvgEndFrame(NVGcontext* ctx)
 {
+    if (ctx->deferred_first != NULL)
+        nvg__tesselateDeferredPaths(ctx);
+
     if (ctx->cverts_gpu < ctx->nverts) // resize GPU vertex buffer
     {
+        bool pull = (ctx->flags & NVG_VERTEX_PULL) != 0;
         if (ctx->cverts_gpu) // delete old buffer if necessary
+        {
+            if (pull)
+                sg_uninit_view(ctx->vertView);
             sg_uninit_buffer(ctx->vertBuf);
+        }
         ctx->cverts_gpu = ctx->cverts;
         sg_init_buffer(
             ctx->vertBuf,
             &(sg_buffer_desc){
-                .size                = ctx->cverts_gpu * sizeof(*ctx->verts),
-                .usage.vertex_buffer = true,
-                .usage.stream_update = true,
-                .label               = NVG_LABEL("nanovg.vertBuf"),
+                .size                 = ctx->cverts_gpu * sgnvg__vertexSize(ctx),
+                .usage.vertex_buffer  = !pull,
+                .usage.storage_buffer = pull,
+                .usage.stream_update  = true,
+                .label                = NVG_LABEL("nanovg.vertBuf"),
             });
+        if (pull)
+            sg_init_view(ctx->vertView, &(sg_view_desc){.storage_buffer = {.buffer = ctx->vertBuf}});
     }
     // upload vertex data
-    size_t nbytes                    = ctx->nverts * sizeof(*ctx->verts);
+    size_t nbytes                    = ctx->nverts * sgnvg__vertexSize(ctx);
     ctx->frame_stats.uploaded_bytes += nbytes;
     if (nbytes)
         sg_update_buffer(ctx->vertBuf, &(sg_range){ctx->verts, nbytes});
@@ -2888,25 +3489,73 @@ void nvgEndFrame(NVGcontext* ctx)
         sg_init_buffer(
             ctx->indexBuf,
             &(sg_buffer_desc){
-                .size                = ctx->cindexes_gpu * sizeof(*ctx->indexes),
+                .size                = ctx->cindexes_gpu * sgnvg__indexSize(ctx),
                 .usage.index_buffer  = true,
                 .usage.stream_update = true,
                 .label               = NVG_LABEL("nanovg.indexBuf"),
             });
     }
     // upload index data
-    nbytes                           = ctx->nindexes * sizeof(*ctx->indexes);
+    nbytes                           = ctx->nindexes * sgnvg__indexSize(ctx);
     ctx->frame_stats.uploaded_bytes += nbytes;
     if (nbytes)
         sg_update_buffer(ctx->indexBuf, &(sg_range){ctx->indexes, nbytes});
 
-    SGNVGcommand* cmd       = ctx->first_command;
-    int           ncommands = 0;
-    while (cmd != NULL)
+    if (ctx->cpaints_gpu < ctx->npaints) // resize GPU paint buffer
     {
-        switch (cmd->type)
-        {
-        case SGNVG_CMD_BEGIN_PASS:
+        if (ctx->cpaints_gpu) // delete old buffer if necessary
+        {
+            sg_uninit_view(ctx->paintView);
+            sg_uninit_buffer(ctx->paintBuf);
+        }
+        ctx->cpaints_gpu = ctx->cpaints;
+        sg_init_buffer(
+            ctx->paintBuf,
+            &(sg_buffer_desc){
+                .size                 = ctx->cpaints_gpu * sizeof(*ctx->paints),
+                .usage.storage_buffer = true,
+                .usage.stream_update  = true,
+                .label                = NVG_LABEL("nanovg.paintBuf"),
+            });
+        sg_init_view(ctx->paintView, &(sg_view_desc){.storage_buffer = {.buffer = ctx->paintBuf}});
+    }
+    // upload paint data
+    nbytes                           = ctx->npaints * sizeof(*ctx->paints);
+    ctx->frame_stats.uploaded_bytes += nbytes;
+    if (nbytes)
+        sg_update_buffer(ctx->paintBuf, &(sg_range){ctx->paints, nbytes});
+
+    if (ctx->csdfs_gpu < ctx->nsdfs) // resize GPU SDF shape buffer
+    {
+        if (ctx->csdfs_gpu) // delete old buffer if necessary
+        {
+            sg_uninit_view(ctx->sdfView);
+            sg_uninit_buffer(ctx->sdfBuf);
+        }
+        ctx->csdfs_gpu = ctx->csdfs;
+        sg_init_buffer(
+            ctx->sdfBuf,
+            &(sg_buffer_desc){
+                .size                 = ctx->csdfs_gpu * sizeof(*ctx->sdfs),
+                .usage.storage_buffer = true,
+                .usage.stream_update  = true,
+                .label                = NVG_LABEL("nanovg.sdfBuf"),
+            });
+        sg_init_view(ctx->sdfView, &(sg_view_desc){.storage_buffer = {.buffer = ctx->sdfBuf}});
+    }
+    // upload SDF shape data
+    nbytes                           = ctx->nsdfs * sizeof(*ctx->sdfs);
+    ctx->frame_stats.uploaded_bytes += nbytes;
+    if (nbytes)
+        sg_update_buffer(ctx->sdfBuf, &(sg_range){ctx->sdfs, nbytes});
+
+    SGNVGcommand* cmd       = ctx->first_command;
+    int           ncommands = 0;
+    while (cmd != NULL)
+    {
+        switch (cmd->type)
+        {
+        case SGNVG_CMD_BEGIN_PASS:
         {
             SGNVGcommandBeginPass* p = cmd->payload.beginPass;
 
@@ -2934,6 +3583,10 @@ void nvgEndFrame(NVGcontext* ctx)
     xassert(ctx->arena_top != NULL);
     linked_arena_release(ctx->arena, ctx->arena_top);
     ctx->arena_top = NULL;
+
+    // Arenas never unlink their blocks during a frame, so any new ones were allocated this frame
+    ctx->frame_stats.allocCount  = nvg__countArenaBlocks(ctx) - ctx->arenaBlocks;
+    ctx->frame_stats.allocCount += nvg__refitArenas(ctx);
 }
 
 static int sgnvg__maxVertCount(const NVGpath* paths, int npaths)
@@ -3001,18 +3654,24 @@ SGNVGcommand* sgnvg__allocCommand(NVGcontext* ctx, enum SGNVGcommandType type, c
     return cmd;
 }
 
+// Returns -1 if the vertices can't all be reached from one NVG_COMPACT_VERTICES chunk
 static int sgnvg__allocVerts(NVGcontext* ctx, int n)
 {
     int ret = 0;
-    if (ctx->nverts + n > ctx->cverts)
+    if (ctx->flags & NVG_COMPACT_VERTICES)
     {
-        SGNVGattribute* verts;
-        int             cverts = nvg__maxi(ctx->nverts + n, 4096) + ctx->cverts / 2; // 1.5x Overallocate
-        verts                  = (SGNVGattribute*)NVG_REALLOC(ctx->verts, sizeof(SGNVGattribute) * cverts);
-        if (verts == NULL)
+        // 16-bit indexes are relative to the chunk, so vertices that would cross its end start the next chunk
+        if (n > NVG_COMPACT_CHUNK_VERTS)
             return -1;
-        ctx->verts  = verts;
-        ctx->cverts = cverts;
+        if (ctx->nverts + n - ctx->vertexBase > NVG_COMPACT_CHUNK_VERTS)
+            ctx->vertexBase = ctx->nverts;
+    }
+    if (ctx->nverts + n > ctx->cverts)
+    {
+        int    cverts = nvg__maxi(ctx->nverts + n, 4096) + ctx->cverts / 2; // 1.5x Overallocate
+        size_t size   = sgnvg__vertexSize(ctx);
+        ctx->verts    = nvg__realloc(ctx, ctx->verts, size * ctx->nverts, size * cverts);
+        ctx->cverts   = cverts;
     }
     ret          = ctx->nverts;
     ctx->nverts += n;
@@ -3024,30 +3683,92 @@ static int sgnvg__allocIndexes(NVGcontext* ctx, int n)
     int ret = 0;
     if (ctx->nindexes + n > ctx->cindexes)
     {
-        uint32_t* indexes;
-        int       cindexes = nvg__maxi(ctx->nindexes + n, 4096) + ctx->cindexes / 2; // 1.5x Overallocate
-        indexes            = (uint32_t*)NVG_REALLOC(ctx->indexes, sizeof(uint32_t) * cindexes);
-        if (indexes == NULL)
-            return -1;
-        ctx->indexes  = indexes;
-        ctx->cindexes = cindexes;
+        int    cindexes = nvg__maxi(ctx->nindexes + n, 4096) + ctx->cindexes / 2; // 1.5x Overallocate
+        size_t size     = sgnvg__indexSize(ctx);
+        ctx->indexes    = nvg__realloc(ctx, ctx->indexes, size * ctx->nindexes, size * cindexes);
+        ctx->cindexes   = cindexes;
     }
     ret            = ctx->nindexes;
     ctx->nindexes += n;
     return ret;
 }
 
-static void sgnvg__vset(SGNVGattribute* vtx, float x, float y, float u, float v)
+// Returns -1 once NVG_COMPACT_VERTICES runs out of 16-bit paint indexes
+static int sgnvg__allocPaint(NVGcontext* ctx)
 {
-    vtx->vertex[0] = x;
-    vtx->vertex[1] = y;
-    vtx->tcoord[0] = u;
-    vtx->tcoord[1] = v;
+    int ret = 0;
+    if ((ctx->flags & NVG_COMPACT_VERTICES) && ctx->npaints == NVG_COMPACT_MAX_PAINTS)
+        return -1;
+    if (ctx->npaints + 1 > ctx->cpaints)
+    {
+        int    cpaints = nvg__maxi(ctx->npaints + 1, 256) + ctx->cpaints / 2; // 1.5x Overallocate
+        size_t nbytes  = sizeof(SGNVGfragUniforms) * ctx->npaints;
+        ctx->paints    = nvg__realloc(ctx, ctx->paints, nbytes, sizeof(SGNVGfragUniforms) * cpaints);
+        ctx->cpaints   = cpaints;
+    }
+    ret = ctx->npaints;
+    ctx->npaints++;
+    return ret;
 }
 
-static void sgnvg__generateTriangleFanIndexes(uint32_t* indexes, int offset, int nverts)
+static int sgnvg__allocSdf(NVGcontext* ctx)
+{
+    int ret = 0;
+    if (ctx->nsdfs + 1 > ctx->csdfs)
+    {
+        int    csdfs = nvg__maxi(ctx->nsdfs + 1, 256) + ctx->csdfs / 2; // 1.5x Overallocate
+        size_t size  = sizeof(SGNVGsdfShape);
+        ctx->sdfs    = nvg__realloc(ctx, ctx->sdfs, size * ctx->nsdfs, size * csdfs);
+        ctx->csdfs   = csdfs;
+    }
+    ret = ctx->nsdfs;
+    ctx->nsdfs++;
+    return ret;
+}
+
+// Positions are rounded to the nearest fixed-point step of 1/NVG_COMPACT_SUBPIXELS device pixels, and clamped to the
+// +-4096 device pixels it can reach. 'steps' is the number of steps per unit
+static void
+sgnvg__compactVset(SGNVGcompactAttribute* vtx, float x, float y, float u, float v, int paintIndex, float steps)
+{
+    vtx->vertex[0]     = (int16_t)floorf(nvg__clampf(x * steps, -32768.0f, 32767.0f) + 0.5f);
+    vtx->vertex[1]     = (int16_t)floorf(nvg__clampf(y * steps, -32768.0f, 32767.0f) + 0.5f);
+    vtx->tcoord[0]     = (uint8_t)(u * 128.0f + 0.5f);
+    vtx->tcoord[1]     = (uint8_t)(v * 128.0f + 0.5f);
+    vtx->paintIndex[0] = (uint8_t)(paintIndex & 0xFF);
+    vtx->paintIndex[1] = (uint8_t)(paintIndex >> 8);
+}
+
+// NVG_VERTEX_PULL has no indexes. Instead each vertex says how vs_pull draws the triangle starting at it
+static void sgnvg__setPullTriangles(NVGcontext* ctx, int offset, int nverts, int triangle)
+{
+    SGNVGpullAttribute* vtx = &ctx->pullVerts[offset];
+    for (int i = 0; i < nverts; i++)
+        vtx[i].triangle = i < nverts - 2 ? triangle : SGNVG_PULL_NONE;
+}
+
+// Writes indexes from 'ioffset' for vertices from 'offset'. NVG_COMPACT_VERTICES indexes are relative to the chunk
+static void sgnvg__generateTriangleFanIndexes(NVGcontext* ctx, int ioffset, int offset, int nverts)
 {
     // following triangles all use starting vertex, previous vertex, and current vertex
+    if (ctx->flags & NVG_VERTEX_PULL)
+    {
+        sgnvg__setPullTriangles(ctx, offset, nverts, offset);
+        return;
+    }
+    if (ctx->flags & NVG_COMPACT_VERTICES)
+    {
+        uint16_t* indexes = &ctx->compactIndexes[ioffset];
+        offset           -= ctx->vertexBase;
+        for (int i = 2; i < nverts; i++)
+        {
+            indexes[3 * (i - 2) + 0] = (uint16_t)(offset + 0);
+            indexes[3 * (i - 2) + 1] = (uint16_t)(offset + i - 1);
+            indexes[3 * (i - 2) + 2] = (uint16_t)(offset + i);
+        }
+        return;
+    }
+    uint32_t* indexes = &ctx->indexes[ioffset];
     for (int i = 2; i < nverts; i++)
     {
         indexes[3 * (i - 2) + 0] = offset + 0;
@@ -3056,7 +3777,7 @@ static void sgnvg__generateTriangleFanIndexes(uint32_t* indexes, int offset, int
     }
 }
 
-static void sgnvg__generateTriangleStripIndexes(uint32_t* indexes, int offset, int nverts)
+static void sgnvg__generateTriangleStripIndexes(NVGcontext* ctx, int ioffset, int offset, int nverts)
 {
     // following triangles all use previous 2 vertices, and current vertex
     // we use bit-shifts to get the sequence:
@@ -3070,6 +3791,26 @@ static void sgnvg__generateTriangleStripIndexes(uint32_t* indexes, int offset, i
     //                  first index = above & ~1 = floor_to_even(i-1)
     //                              second index = above | 1 = ceil_to_even(i-2)
     // all this trickery ensures that we maintain correct (CCW) vertex order
+    // NVG_VERTEX_PULL strips start on an even vertex, so vs_pull gets the same order from the vertex index alone
+    if (ctx->flags & NVG_VERTEX_PULL)
+    {
+        NVG_ASSERT((offset & 1) == 0);
+        sgnvg__setPullTriangles(ctx, offset, nverts, SGNVG_PULL_STRIP);
+        return;
+    }
+    if (ctx->flags & NVG_COMPACT_VERTICES)
+    {
+        uint16_t* indexes = &ctx->compactIndexes[ioffset];
+        offset           -= ctx->vertexBase;
+        for (int i = 2; i < nverts; i++)
+        {
+            indexes[3 * (i - 2) + 0] = (uint16_t)(offset + ((i - 1) & ~1));
+            indexes[3 * (i - 2) + 1] = (uint16_t)(offset + ((i - 2) | 1));
+            indexes[3 * (i - 2) + 2] = (uint16_t)(offset + i);
+        }
+        return;
+    }
+    uint32_t* indexes = &ctx->indexes[ioffset];
     for (int i = 2; i < nverts; i++)
     {
         indexes[3 * (i - 2) + 0] = offset + ((i - 1) & ~1);
@@ -3078,138 +3819,877 @@ static void sgnvg__generateTriangleStripIndexes(uint32_t* indexes, int offset, i
     }
 }
 
-void nvgFill(NVGcontext* ctx)
+// Copies expanded vertices into the frame's vertex buffer from 'offset'. 'move' is an optional transform applied on the
+// way, used to replay retained geometry
+static void
+sgnvg__copyVerts(NVGcontext* ctx, int offset, const NVGvertex* src, int n, const float* move, int paintIndex)
 {
-    NVGstate* state = &ctx->state;
+    if (ctx->flags & NVG_COMPACT_VERTICES)
+    {
+        SGNVGcompactAttribute* cdst  = &ctx->compactVerts[offset];
+        float                  steps = (float)(NVG_COMPACT_SUBPIXELS * ctx->backingScaleFactor);
+        for (int i = 0; i < n; i++)
+        {
+            float x = src[i].x, y = src[i].y;
+            if (move != NULL)
+                nvgTransformPoint(&x, &y, move, src[i].x, src[i].y);
+            sgnvg__compactVset(&cdst[i], x, y, src[i].u, src[i].v, paintIndex, steps);
+        }
+        return;
+    }
+    if (ctx->flags & NVG_VERTEX_PULL)
+    {
+        SGNVGpullAttribute* pdst = &ctx->pullVerts[offset];
+        for (int i = 0; i < n; i++)
+        {
+            pdst[i].vertex[0] = src[i].x;
+            pdst[i].vertex[1] = src[i].y;
+            if (move != NULL)
+                nvgTransformPoint(&pdst[i].vertex[0], &pdst[i].vertex[1], move, src[i].x, src[i].y);
+            pdst[i].tcoord[0]  = src[i].u;
+            pdst[i].tcoord[1]  = src[i].v;
+            pdst[i].paintIndex = (float)paintIndex;
+        }
+        return;
+    }
 
-    if (ctx->ncommands == 0)
+    SGNVGattribute* dst   = &ctx->verts[offset];
+    float           index = (float)paintIndex;
+    if (move == NULL)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            dst[i].vertex[0]  = src[i].x;
+            dst[i].vertex[1]  = src[i].y;
+            dst[i].tcoord[0]  = src[i].u;
+            dst[i].tcoord[1]  = src[i].v;
+            dst[i].paintIndex = index;
+        }
         return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        nvgTransformPoint(&dst[i].vertex[0], &dst[i].vertex[1], move, src[i].x, src[i].y);
+        dst[i].tcoord[0]  = src[i].u;
+        dst[i].tcoord[1]  = src[i].v;
+        dst[i].paintIndex = index;
+    }
+}
 
-    const NVGpath* path;
-    NVGpaint       paint = state->paint;
-    int            i;
+// Writes a path drawn as a triangle fan or strip, and moves the vertex & index offsets past it. Returns the number of
+// indexes written. NVG_VERTEX_PULL draws three vertices for every vertex pulled, so its index offset just follows the
+// vertex offset
+static int sgnvg__writeTriangles(
+    NVGcontext*      ctx,
+    int*             offset,
+    int*             ioffset,
+    const NVGvertex* src,
+    int              n,
+    bool             strip,
+    const float*     move,
+    int              paintIndex)
+{
+    int start = *ioffset;
+    if ((ctx->flags & NVG_VERTEX_PULL) && strip && (*offset & 1))
+    {
+        // Padding, so the strip starts on an even vertex. Written whole, as the arena holds an earlier frame's bytes
+        ctx->pullVerts[*offset] = (SGNVGpullAttribute){.triangle = SGNVG_PULL_NONE};
+        (*offset)++;
+    }
 
-    nvg__flattenPaths(ctx);
-    nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+    sgnvg__copyVerts(ctx, *offset, src, n, move, paintIndex);
+    if (strip)
+        sgnvg__generateTriangleStripIndexes(ctx, *ioffset, *offset, n);
+    else
+        sgnvg__generateTriangleFanIndexes(ctx, *ioffset, *offset, n);
 
-    NVGcompositeOperationState compositeOperation = state->compositeOperation;
-    NVGscissor*                scissor            = &state->scissor;
-    float                      fringe             = ctx->fringeWidth;
-    const float*               bounds             = ctx->cache.bounds;
-    const NVGpath*             paths              = ctx->cache.paths;
-    int                        npaths             = ctx->cache.npaths;
+    *offset += n;
+    if (ctx->flags & NVG_VERTEX_PULL)
+        *ioffset = *offset * 3;
+    else
+        *ioffset += (n - 2) * 3;
+    return *ioffset - start;
+}
 
-    SGNVGcall*         call = NULL;
-    SGNVGattribute*    quad = NULL;
-    SGNVGfragUniforms* frag = NULL;
-    int                maxverts, offset, maxindexes, ioffset;
+// Links a new call into the current nvg draw. Its type stays SGNVG_NONE until the geometry is written, so the call
+// draws nothing if that fails
+static SGNVGcall* sgnvg__beginCall(NVGcontext* ctx, const char* label)
+{
+    SGNVGcall* call = NULL;
 
     // Looks like you forgot to call snvg_command_draw_nvg() before issuing nvgFill()/nvgStroke()/nvgText() commands!
     // NVG_ASSERT(ctx->current_nvg_draw != NULL); // TODO: remove?
     if (ctx->current_nvg_draw == NULL)
-        snvg_command_draw_nvg(ctx, NVG_LABEL("nvgFill"));
+        snvg_command_draw_nvg(ctx, label);
 
     call = linked_arena_alloc_clear(ctx->frame_arena, sizeof(*call));
 
     if (call == NULL)
-        return;
+        return NULL;
 
-    call->type          = SGNVG_FILL;
-    call->triangleCount = 4;
-    call->paths         = linked_arena_alloc_clear(ctx->frame_arena, npaths * sizeof(*call->paths));
-    if (call->paths == NULL)
-        return;
-    call->num_paths = npaths;
-    call->blendFunc = sgnvg__blendCompositeOperation(compositeOperation);
+    call->blendFunc = sgnvg__blendCompositeOperation(ctx->state.compositeOperation);
+    sgnvg__addCall(ctx, call);
+    return call;
+}
+
+// Writes a fill's geometry and paint into a call from sgnvg__beginCall(). The paint's index is taken when the call is,
+// so paints keep the order of the calls however late their geometry is written
+static void sgnvg__writeFillCall(
+    NVGcontext*    ctx,
+    SGNVGcall*     call,
+    int            paintIndex,
+    const NVGpath* paths,
+    int            npaths,
+    const float*   bounds,
+    const float*   move,
+    NVGpaint*      paint,
+    NVGscissor*    scissor)
+{
+    const NVGpath* path;
+    int            i;
+    float          fringe = ctx->fringeWidth;
+
+    int       maxverts, offset, maxindexes, ioffset;
+    int       triangleCount = 4;
+    NVGvertex quad[4];
 
     if (npaths == 1 && paths[0].convex)
+        triangleCount = 0; // Bounding box fill quad not needed for convex fill
+
+    // Allocate vertices for all the paths. NVG_VERTEX_PULL may pad each strip, and has no indexes
+    maxverts = sgnvg__maxVertCount(paths, npaths) + triangleCount;
+    if (ctx->flags & NVG_VERTEX_PULL)
+        maxverts += npaths + 1;
+    offset = sgnvg__allocVerts(ctx, maxverts);
+    if (offset == -1)
+        return;
+    if (ctx->flags & NVG_VERTEX_PULL)
+    {
+        ioffset = offset * 3;
+    }
+    else
+    {
+        maxindexes = sgnvg__maxIndexCount(paths, npaths) + nvg__maxi(triangleCount - 2, 0) * 3;
+        ioffset    = sgnvg__allocIndexes(ctx, maxindexes);
+        if (ioffset == -1)
+            return;
+    }
+    call->vertexBase = ctx->vertexBase;
+
+    // Fill shader. The stencil passes write no colour, so they share it
+    sgnvg__convertPaint(ctx, &ctx->paints[paintIndex], paint, scissor, fringe, fringe, -1.0f);
+
+    // All fills first then all fringes, which is the order they are drawn in
+    call->indexOffset = ioffset;
+    for (i = 0; i < npaths; i++)
+    {
+        path = &paths[i];
+        if (path->nfill > 0) // fill: triangle fan
+            call->fillCount +=
+                sgnvg__writeTriangles(ctx, &offset, &ioffset, path->fill, path->nfill, false, move, paintIndex);
+    }
+    for (i = 0; i < npaths; i++)
     {
-        call->type          = SGNVG_CONVEXFILL;
-        call->triangleCount = 0; // Bounding box fill quad not needed for convex fill
+        path = &paths[i];
+        if (path->nstroke > 0) // stroke: triangle strip
+            call->strokeCount +=
+                sgnvg__writeTriangles(ctx, &offset, &ioffset, path->stroke, path->nstroke, true, move, paintIndex);
     }
 
-    // Allocate vertices for all the paths.
-    maxverts = sgnvg__maxVertCount(paths, npaths) + call->triangleCount;
-    offset   = sgnvg__allocVerts(ctx, maxverts);
+    if (triangleCount > 0)
+    {
+        // Quad
+        nvg__vset(&quad[0], bounds[2], bounds[3], 0.5f, 1.0f);
+        nvg__vset(&quad[1], bounds[2], bounds[1], 0.5f, 1.0f);
+        nvg__vset(&quad[2], bounds[0], bounds[3], 0.5f, 1.0f);
+        nvg__vset(&quad[3], bounds[0], bounds[1], 0.5f, 1.0f);
+        call->triangleOffset = ioffset;
+        call->triangleCount  = sgnvg__writeTriangles(ctx, &offset, &ioffset, quad, 4, true, NULL, paintIndex);
+        call->type           = SGNVG_FILL;
+    }
+    else
+    {
+        call->type = SGNVG_CONVEXFILL;
+    }
+    ctx->nverts = offset; // Give back unused padding, so the next call's vertices follow on
+
+    // Count triangles
+    for (i = 0; i < npaths; i++)
+    {
+        path = &paths[i];
+
+        ctx->frame_stats.fillTriCount += path->nfill - 2;
+        ctx->frame_stats.fillTriCount += path->nstroke - 2;
+    }
+}
+
+static void
+sgnvg__renderFill(NVGcontext* ctx, const NVGpath* paths, int npaths, const float* bounds, const float* move)
+{
+    NVGpaint   paint      = ctx->state.paint;
+    SGNVGcall* call       = sgnvg__beginCall(ctx, NVG_LABEL("nvgFill"));
+    int        paintIndex = call != NULL ? sgnvg__allocPaint(ctx) : -1;
+    if (paintIndex != -1)
+        sgnvg__writeFillCall(ctx, call, paintIndex, paths, npaths, bounds, move, &paint, &ctx->state.scissor);
+}
+
+// Writes a stroke's geometry and paint into a call from sgnvg__beginCall(), like sgnvg__writeFillCall()
+static void sgnvg__writeStrokeCall(
+    NVGcontext*    ctx,
+    SGNVGcall*     call,
+    int            paintIndex,
+    const NVGpath* paths,
+    int            npaths,
+    float          strokeWidth,
+    const float*   move,
+    NVGpaint*      paint,
+    NVGscissor*    scissor)
+{
+    int   i;
+    float fringe = ctx->fringeWidth;
+    int   maxverts, offset, maxindexes, ioffset;
+
+    // Allocate vertices for all the paths. NVG_VERTEX_PULL may pad each strip, and has no indexes
+    maxverts = sgnvg__maxVertCount(paths, npaths);
+    if (ctx->flags & NVG_VERTEX_PULL)
+        maxverts += npaths;
+    offset = sgnvg__allocVerts(ctx, maxverts);
     if (offset == -1)
         return;
-    maxindexes = sgnvg__maxIndexCount(paths, npaths) + nvg__maxi(call->triangleCount - 2, 0) * 3;
-    ioffset    = sgnvg__allocIndexes(ctx, maxindexes);
-    if (ioffset == -1)
-        return;
+    if (ctx->flags & NVG_VERTEX_PULL)
+    {
+        ioffset = offset * 3;
+    }
+    else
+    {
+        maxindexes = sgnvg__maxIndexCount(paths, npaths);
+        ioffset    = sgnvg__allocIndexes(ctx, maxindexes);
+        if (ioffset == -1)
+            return;
+    }
+    call->vertexBase = ctx->vertexBase;
+
+    // Fill shader
+    sgnvg__convertPaint(ctx, &ctx->paints[paintIndex], paint, scissor, strokeWidth, fringe, -1.0f);
 
+    call->indexOffset = ioffset;
     for (i = 0; i < npaths; i++)
     {
-        SGNVGpath* copy = &call->paths[i];
-        path            = &paths[i];
-        if (path->nfill > 0)
+        const NVGpath* path = &paths[i];
+
+        if (path->nstroke) // stroke: triangle strip
+            call->strokeCount +=
+                sgnvg__writeTriangles(ctx, &offset, &ioffset, path->stroke, path->nstroke, true, move, paintIndex);
+    }
+    call->type  = SGNVG_STROKE;
+    ctx->nverts = offset; // Give back unused padding, so the next call's vertices follow on
+
+    // Count triangles
+    for (i = 0; i < npaths; i++)
+        ctx->frame_stats.strokeTriCount += paths[i].nstroke - 2;
+}
+
+static void sgnvg__renderStroke(
+    NVGcontext*    ctx,
+    const NVGpath* paths,
+    int            npaths,
+    float          strokeWidth,
+    NVGpaint*      paint,
+    const float*   move)
+{
+    SGNVGcall* call       = sgnvg__beginCall(ctx, NVG_LABEL("nvgStroke"));
+    int        paintIndex = call != NULL ? sgnvg__allocPaint(ctx) : -1;
+    if (paintIndex != -1)
+        sgnvg__writeStrokeCall(ctx, call, paintIndex, paths, npaths, strokeWidth, move, paint, &ctx->state.scissor);
+}
+
+// NVG_SDF_PRIMITIVES. Draws the fill, or the stroke if strokeWidth > 0, of a path made of one primitive as its SDF
+// shape. Returns false if the shape can't match the tesselated path, which must then be drawn instead
+static bool sgnvg__renderSdf(NVGcontext* ctx, NVGpaint* paint, float strokeWidth)
+{
+    const NVGstate* state  = &ctx->state;
+    float           fringe = ctx->fringeWidth;
+    SGNVGsdfShape   shape  = ctx->sdfPath;
+    SGNVGcall*      call;
+    int             paintIndex, index;
+
+    if (ctx->sdfPathCommands != ctx->ncommands)
+        return false;
+
+    if (strokeWidth > 0.0f)
+    {
+        switch ((enum SGNVGsdfType)shape.type)
         {
-            // fill: triangle fan
-            copy->fillOffset = ioffset;
-            copy->fillCount  = (path->nfill - 2) * 3;
-            memcpy(&ctx->verts[offset], path->fill, sizeof(NVGvertex) * path->nfill);
-            sgnvg__generateTriangleFanIndexes(&ctx->indexes[ioffset], offset, path->nfill);
-            offset  += path->nfill;
-            ioffset += copy->fillCount;
+        case SGNVG_SDF_RECT:
+            // Round joins round the corners like a radius would. Miters are sharp if the limit lets right angles be
+            if (shape.radius > 0.0f || state->lineJoin == NVG_ROUND)
+                shape.type = SGNVG_SDF_RECT_STROKE;
+            else if (state->lineJoin == NVG_MITER && state->miterLimit * state->miterLimit * 0.5f >= 1.0f)
+                shape.type = SGNVG_SDF_MITER_RECT_STROKE;
+            else
+                return false;
+            break;
+        case SGNVG_SDF_ELLIPSE:
+            // The outlines of a stroked ellipse aren't ellipses
+            if (shape.size[0] != shape.size[1])
+                return false;
+            shape.type = SGNVG_SDF_CIRCLE_STROKE;
+            break;
+        case SGNVG_SDF_ARC_BUTT:
+            if (state->lineCap == NVG_SQUARE)
+                return false;
+            if (state->lineCap == NVG_ROUND)
+                shape.type = SGNVG_SDF_ARC_ROUND;
+            break;
+        default:
+            return false;
         }
-        if (path->nstroke > 0)
+    }
+    else if (shape.type == SGNVG_SDF_ARC_BUTT)
+    {
+        return false; // Filled arcs are closed by a chord
+    }
+
+    call = sgnvg__beginCall(ctx, strokeWidth > 0.0f ? NVG_LABEL("nvgStroke") : NVG_LABEL("nvgFill"));
+    if (call == NULL)
+        return true;
+
+    // Solid colours without scissor are common enough in UIs to leave their paint out
+    if (memcmp(&paint->innerColour, &paint->outerColour, sizeof(paint->innerColour)) == 0 &&
+        (state->scissor.extent[0] < -0.5f || state->scissor.extent[1] < -0.5f))
+    {
+        paintIndex   = -1;
+        shape.colour = sgnvg__packColour(paint->innerColour);
+    }
+    else
+    {
+        paintIndex = sgnvg__allocPaint(ctx);
+        if (paintIndex == -1)
+            return true;
+        sgnvg__convertPaint(
+            ctx,
+            &ctx->paints[paintIndex],
+            paint,
+            &ctx->state.scissor,
+            strokeWidth > 0.0f ? strokeWidth : fringe,
+            fringe,
+            -1.0f);
+    }
+
+    shape.strokeWidth = strokeWidth;
+    shape.fringe      = fringe;
+    shape.paintIndex  = (float)paintIndex;
+
+    index = sgnvg__allocSdf(ctx);
+    if (index == -1)
+        return true;
+    ctx->sdfs[index] = shape;
+
+    call->triangleOffset = index * 6;
+    call->triangleCount  = 6;
+    call->type           = SGNVG_SDF;
+
+    ctx->frame_stats.sdfShapeCount++;
+    return true;
+}
+
+//
+// Deferred tesselation
+//
+// With NVG_DEFERRED_TESSELATION, nvgFill() & nvgStroke() only link their call and record the path with the state it is
+// drawn with. nvgEndFrame() tesselates the recorded paths on a pool of threads, each flattening & expanding into its
+// own scratch context, then writes the geometry into the frame's buffers in submission order. Tesselating a path only
+// reads the path & its settings, so the output is identical to drawing without the flag, whatever the thread count.
+//
+
+#define NVG_MAX_TESS_THREADS (8)
+// Paths are handed out to threads in batches to keep contention on the shared counter low
+#define NVG_TESS_BATCH (8)
+
+typedef struct NVGdeferredPath
+{
+    struct NVGdeferredPath* next;
+    SGNVGcall*              call;
+    int                     paintIndex;
+    float*                  commands; // shared with other fills & strokes of the same path
+    int                     ncommands;
+    int                     stroke;
+    float                   strokeWidth; // in pixels, see nvg__strokeWidth()
+    int                     lineCap;
+    int                     lineJoin;
+    float                   miterLimit;
+    NVGpaint                paint;
+    NVGscissor              scissor;
+
+    // Written by the tesselating thread. Vertices live on its scratch frame arena
+    NVGpath* paths;
+    int      npaths;
+    float    bounds[4];
+} NVGdeferredPath;
+
+#ifdef _WIN32
+typedef HANDLE             nvg_thread_t;
+typedef CRITICAL_SECTION   nvg_mutex_t;
+typedef CONDITION_VARIABLE nvg_cond_t;
+#else
+typedef pthread_t       nvg_thread_t;
+typedef pthread_mutex_t nvg_mutex_t;
+typedef pthread_cond_t  nvg_cond_t;
+#endif
+
+typedef struct NVGtessWorker
+{
+    struct NVGtessPool* pool;
+    // Only the commands, path cache, tolerances & frame arena are used. The arena keeps the vertices of every path the
+    // worker tesselated until the next nvgEndFrame()
+    NVGcontext   scratch;
+    nvg_thread_t thread;
+} NVGtessWorker;
+
+typedef struct NVGtessPool
+{
+    NVGtessWorker     workers[NVG_MAX_TESS_THREADS]; // workers[0] is the thread calling nvgEndFrame()
+    int               num_workers;
+    NVGdeferredPath** items;
+    int               num_items;
+    volatile long     next_item;
+
+    nvg_mutex_t mutex;
+    nvg_cond_t  start;
+    nvg_cond_t  done;
+    unsigned    generation; // Bumped to start a job
+    int         num_busy;   // Pool threads yet to finish the current job
+    int         quit;
+} NVGtessPool;
+
+static int nvg__arenaBlocks(const LinkedArena* arena)
+{
+    int n = 0;
+    for (; arena != NULL; arena = arena->next)
+        n++;
+    return n;
+}
+
+static int nvg__countArenaBlocks(const NVGcontext* ctx)
+{
+    int n = nvg__arenaBlocks(ctx->arena) + nvg__arenaBlocks(ctx->frame_arena) + nvg__arenaBlocks(ctx->next_frame_arena);
+    if (ctx->tess_pool != NULL)
+        for (int i = 0; i < ctx->tess_pool->num_workers; i++)
+            n += nvg__arenaBlocks(ctx->tess_pool->workers[i].scratch.frame_arena);
+    return n;
+}
+
+// Bytes taken from an arena's blocks, counting the ends of blocks skipped past as taken
+static size_t nvg__arenaUsed(const LinkedArena* arena)
+{
+    size_t n = 0;
+    for (; arena != NULL; arena = arena->next)
+        n += arena->size;
+    return n;
+}
+
+// An arena that chained blocks leaves the buffers grown in it spread over them. Reserving the buffers again, in order &
+// first fit, can skip past blocks they no longer fit in, and chain another even in a frame that needs no more memory.
+// Such arenas are replaced by one block holding everything they took, as are tesselation workers' arenas too small to
+// take a whole frame. Returns the number of blocks allocated
+static int nvg__refitArenas(NVGcontext* ctx)
+{
+    NVGtessPool* pool    = ctx->tess_pool;
+    int          nblocks = 0;
+
+    // This frame's buffers are read until the next nvgBeginFrame(), which swaps the block in
+    if (ctx->frame_arena->next != NULL && ctx->next_frame_arena == NULL)
+    {
+        ctx->next_frame_arena = linked_arena_create(nvg__arenaUsed(ctx->frame_arena) + sizeof(LinkedArena));
+        nblocks++;
+    }
+
+    if (pool != NULL)
+    {
+        // Batches fall to whichever worker takes them first, so a later frame tesselating no more paths may hand any
+        // worker all of them. Each worker needs room for everything the pool took, reserved at the largest path cache.
+        // How the batches fall also changes which flattened points get reused, and so what the pool takes
+        size_t used    = 0;
+        int    cpoints = 0;
+        int    cpaths  = 0;
+        for (int i = 0; i < pool->num_workers; i++)
+        {
+            NVGcontext* scratch  = &pool->workers[i].scratch;
+            used                += nvg__arenaUsed(scratch->frame_arena);
+            cpoints              = nvg__maxi(cpoints, scratch->cache.cpoints);
+            cpaths               = nvg__maxi(cpaths, scratch->cache.cpaths);
+        }
+        used += sizeof(NVGpoint) * cpoints + sizeof(NVGpath) * cpaths;
+        for (int i = 0; i < pool->num_workers; i++)
+        {
+            NVGcontext* scratch    = &pool->workers[i].scratch;
+            scratch->cache.cpoints = cpoints;
+            scratch->cache.cpaths  = cpaths;
+            if (scratch->frame_arena->next != NULL || scratch->frame_arena->capacity < used)
+            {
+                linked_arena_destroy(scratch->frame_arena);
+                scratch->frame_arena = linked_arena_create(used + used / 2 + sizeof(LinkedArena)); // 1.5x Overallocate
+                nblocks++;
+            }
+        }
+    }
+    return nblocks;
+}
+
+#ifdef _WIN32
+static void nvg__mutexInit(nvg_mutex_t* m) { InitializeCriticalSection(m); }
+static void nvg__mutexDestroy(nvg_mutex_t* m) { DeleteCriticalSection(m); }
+static void nvg__mutexLock(nvg_mutex_t* m) { EnterCriticalSection(m); }
+static void nvg__mutexUnlock(nvg_mutex_t* m) { LeaveCriticalSection(m); }
+static void nvg__condInit(nvg_cond_t* c) { InitializeConditionVariable(c); }
+static void nvg__condDestroy(nvg_cond_t* c) { (void)c; }
+static void nvg__condWait(nvg_cond_t* c, nvg_mutex_t* m) { SleepConditionVariableCS(c, m, INFINITE); }
+static void nvg__condBroadcast(nvg_cond_t* c) { WakeAllConditionVariable(c); }
+
+static int nvg__fetchAddBatch(NVGtessPool* pool)
+{
+    return (int)InterlockedExchangeAdd(&pool->next_item, NVG_TESS_BATCH);
+}
+
+static void nvg__tessWorkerLoop(NVGtessWorker* worker);
+
+static DWORD WINAPI nvg__tessThreadProc(LPVOID arg)
+{
+    nvg__tessWorkerLoop((NVGtessWorker*)arg);
+    return 0;
+}
+
+static bool nvg__tessThreadStart(NVGtessWorker* worker)
+{
+    worker->thread = CreateThread(NULL, 0, nvg__tessThreadProc, worker, 0, NULL);
+    return worker->thread != NULL;
+}
+
+static void nvg__tessThreadJoin(NVGtessWorker* worker)
+{
+    WaitForSingleObject(worker->thread, INFINITE);
+    CloseHandle(worker->thread);
+}
+
+static int nvg__numCores(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+static void nvg__mutexInit(nvg_mutex_t* m) { pthread_mutex_init(m, NULL); }
+static void nvg__mutexDestroy(nvg_mutex_t* m) { pthread_mutex_destroy(m); }
+static void nvg__mutexLock(nvg_mutex_t* m) { pthread_mutex_lock(m); }
+static void nvg__mutexUnlock(nvg_mutex_t* m) { pthread_mutex_unlock(m); }
+static void nvg__condInit(nvg_cond_t* c) { pthread_cond_init(c, NULL); }
+static void nvg__condDestroy(nvg_cond_t* c) { pthread_cond_destroy(c); }
+static void nvg__condWait(nvg_cond_t* c, nvg_mutex_t* m) { pthread_cond_wait(c, m); }
+static void nvg__condBroadcast(nvg_cond_t* c) { pthread_cond_broadcast(c); }
+
+static int nvg__fetchAddBatch(NVGtessPool* pool)
+{
+    return (int)__atomic_fetch_add(&pool->next_item, NVG_TESS_BATCH, __ATOMIC_RELAXED);
+}
+
+static void nvg__tessWorkerLoop(NVGtessWorker* worker);
+
+static void* nvg__tessThreadProc(void* arg)
+{
+    nvg__tessWorkerLoop((NVGtessWorker*)arg);
+    return NULL;
+}
+
+static bool nvg__tessThreadStart(NVGtessWorker* worker)
+{
+    return pthread_create(&worker->thread, NULL, nvg__tessThreadProc, worker) == 0;
+}
+
+static void nvg__tessThreadJoin(NVGtessWorker* worker) { pthread_join(worker->thread, NULL); }
+
+static int nvg__numCores(void) { return (int)sysconf(_SC_NPROCESSORS_ONLN); }
+#endif
+
+static void nvg__tesselateDeferredPath(NVGcontext* scratch, NVGdeferredPath* item)
+{
+    NVGpathCache* cache = &scratch->cache;
+
+    // Like nvgFill() followed by nvgStroke(), a path recorded again right after itself reuses its flattened points
+    if (scratch->commands != item->commands || scratch->ncommands != item->ncommands)
+    {
+        scratch->commands  = item->commands;
+        scratch->ncommands = item->ncommands;
+        cache->npoints     = 0;
+        cache->npaths      = 0;
+    }
+    // Expand every path into fresh vertices, so its paths keep pointing at them until nvgEndFrame() copies them out
+    cache->cverts = 0;
+
+    nvg__flattenPaths(scratch);
+    if (item->stroke)
+        nvg__expandStroke(
+            scratch,
+            item->strokeWidth * 0.5f,
+            scratch->fringeWidth,
+            item->lineCap,
+            item->lineJoin,
+            item->miterLimit);
+    else
+        nvg__expandFill(scratch, scratch->fringeWidth, NVG_MITER, 2.4f);
+
+    item->npaths = cache->npaths;
+    item->paths  = linked_arena_alloc(scratch->frame_arena, sizeof(*item->paths) * cache->npaths);
+    memcpy(item->paths, cache->paths, sizeof(*item->paths) * cache->npaths);
+    memcpy(item->bounds, cache->bounds, sizeof(item->bounds));
+}
+
+static void nvg__runTessJob(NVGtessPool* pool, NVGcontext* scratch)
+{
+    int begin;
+    while ((begin = nvg__fetchAddBatch(pool)) < pool->num_items)
+    {
+        int end = nvg__mini(begin + NVG_TESS_BATCH, pool->num_items);
+        for (int i = begin; i < end; i++)
+            nvg__tesselateDeferredPath(scratch, pool->items[i]);
+    }
+}
+
+static void nvg__tessWorkerLoop(NVGtessWorker* worker)
+{
+    NVGtessPool* pool       = worker->pool;
+    unsigned     generation = 0;
+    int          quit       = 0;
+
+    while (!quit)
+    {
+        nvg__mutexLock(&pool->mutex);
+        while (pool->generation == generation && !pool->quit)
+            nvg__condWait(&pool->start, &pool->mutex);
+        generation = pool->generation;
+        quit       = pool->quit;
+        nvg__mutexUnlock(&pool->mutex);
+
+        if (!quit)
         {
-            // stroke: triangle strip
-            copy->strokeOffset = ioffset;
-            copy->strokeCount  = (path->nstroke - 2) * 3;
-            memcpy(&ctx->verts[offset], path->stroke, sizeof(NVGvertex) * path->nstroke);
-            sgnvg__generateTriangleStripIndexes(&ctx->indexes[ioffset], offset, path->nstroke);
-            offset  += path->nstroke;
-            ioffset += copy->strokeCount;
+            nvg__runTessJob(pool, &worker->scratch);
+
+            nvg__mutexLock(&pool->mutex);
+            if (--pool->num_busy == 0)
+                nvg__condBroadcast(&pool->done);
+            nvg__mutexUnlock(&pool->mutex);
         }
     }
+}
+
+static NVGtessPool* nvg__createTessPool(NVGcontext* ctx, int numThreads)
+{
+    NVGtessPool* pool        = linked_arena_alloc_clear(ctx->arena, sizeof(*pool));
+    int          num_threads = nvg__clampi(numThreads > 0 ? numThreads : nvg__numCores(), 1, NVG_MAX_TESS_THREADS);
+
+    nvg__mutexInit(&pool->mutex);
+    nvg__condInit(&pool->start);
+    nvg__condInit(&pool->done);
 
-    // Setup uniforms for draw calls
-    if (call->type == SGNVG_FILL)
+    for (int i = 0; i < num_threads; i++)
     {
-        // Quad
-        call->triangleOffset = ioffset;
-        call->triangleCount  = (call->triangleCount - 2) * 3; // convert vertex count into index
-        quad                 = &ctx->verts[offset];
-        sgnvg__vset(&quad[0], bounds[2], bounds[3], 0.5f, 1.0f);
-        sgnvg__vset(&quad[1], bounds[2], bounds[1], 0.5f, 1.0f);
-        sgnvg__vset(&quad[2], bounds[0], bounds[3], 0.5f, 1.0f);
-        sgnvg__vset(&quad[3], bounds[0], bounds[1], 0.5f, 1.0f);
-        sgnvg__generateTriangleStripIndexes(&ctx->indexes[ioffset], offset, 4);
-
-        frag = linked_arena_alloc_clear(ctx->frame_arena, 2 * sizeof(*frag));
-        if (frag == NULL)
-            return;
+        NVGtessWorker* worker = &pool->workers[pool->num_workers];
 
-        call->uniforms = frag;
+        worker->pool                  = pool;
+        worker->scratch.frame_arena   = linked_arena_create(1024 * 64);
+        worker->scratch.cache.cpoints = NVG_INIT_POINTS_SIZE;
+        worker->scratch.cache.cpaths  = NVG_INIT_PATHS_SIZE;
+        if (worker->scratch.frame_arena == NULL)
+            break;
+        // The calling thread is workers[0]. If a thread fails to start the others simply take more of the batches
+        if (i > 0 && !nvg__tessThreadStart(worker))
+        {
+            linked_arena_destroy(worker->scratch.frame_arena);
+            break;
+        }
+        pool->num_workers++;
+    }
+    return pool;
+}
+
+static void nvg__destroyTessPool(NVGtessPool* pool)
+{
+    nvg__mutexLock(&pool->mutex);
+    pool->quit = 1;
+    nvg__condBroadcast(&pool->start);
+    nvg__mutexUnlock(&pool->mutex);
 
-        // Simple shader for stencil
-        frag->strokeThr = -1.0f;
-        frag->type      = NSVG_SHADER_SIMPLE;
-        // Fill shader
-        sgnvg__convertPaint(ctx, frag + 1, &paint, scissor, fringe, fringe, -1.0f);
+    for (int i = 0; i < pool->num_workers; i++)
+    {
+        if (i > 0)
+            nvg__tessThreadJoin(&pool->workers[i]);
+        linked_arena_destroy(pool->workers[i].scratch.frame_arena);
     }
+
+    nvg__condDestroy(&pool->done);
+    nvg__condDestroy(&pool->start);
+    nvg__mutexDestroy(&pool->mutex);
+}
+
+static void nvg__runTessPool(NVGtessPool* pool, NVGcontext* ctx, NVGdeferredPath** items, int num_items)
+{
+    // Not worth waking threads that would receive no batches
+    int num_workers = nvg__mini(pool->num_workers, (num_items + NVG_TESS_BATCH - 1) / NVG_TESS_BATCH);
+
+    for (int i = 0; i < pool->num_workers; i++)
+    {
+        NVGcontext* scratch = &pool->workers[i].scratch;
+
+        linked_arena_clear(scratch->frame_arena);
+        scratch->cache.points = linked_arena_alloc(scratch->frame_arena, sizeof(NVGpoint) * scratch->cache.cpoints);
+        scratch->cache.paths  = linked_arena_alloc(scratch->frame_arena, sizeof(NVGpath) * scratch->cache.cpaths);
+        scratch->commands     = NULL;
+        scratch->tessTol      = ctx->tessTol;
+        scratch->distTol      = ctx->distTol;
+        scratch->fringeWidth  = ctx->fringeWidth;
+    }
+
+    pool->items     = items;
+    pool->num_items = num_items;
+    pool->next_item = 0;
+
+    if (num_workers <= 1)
+    {
+        nvg__runTessJob(pool, &pool->workers[0].scratch);
+        return;
+    }
+
+    nvg__mutexLock(&pool->mutex);
+    pool->num_busy = pool->num_workers - 1;
+    pool->generation++;
+    nvg__condBroadcast(&pool->start);
+    nvg__mutexUnlock(&pool->mutex);
+
+    nvg__runTessJob(pool, &pool->workers[0].scratch);
+
+    nvg__mutexLock(&pool->mutex);
+    while (pool->num_busy > 0)
+        nvg__condWait(&pool->done, &pool->mutex);
+    nvg__mutexUnlock(&pool->mutex);
+}
+
+// Records a fill or stroke of the current path for nvgEndFrame() to tesselate. Its call and paint are taken now, so
+// they keep their place among the frame's draws, SDF shapes included
+static NVGdeferredPath* nvg__deferPath(NVGcontext* ctx, const char* label)
+{
+    SGNVGcall*       call       = sgnvg__beginCall(ctx, label);
+    int              paintIndex = call != NULL ? sgnvg__allocPaint(ctx) : -1;
+    NVGdeferredPath* item       = NULL;
+
+    if (paintIndex == -1)
+        return NULL;
+
+    item = linked_arena_alloc_clear(ctx->frame_arena, sizeof(*item));
+    if (item == NULL)
+        return NULL;
+
+    // Fills & strokes of the same path share one copy of it, until the path is added to or a new one begins
+    if (ctx->deferred_commands == NULL)
+    {
+        ctx->deferred_commands = linked_arena_alloc(ctx->frame_arena, sizeof(float) * ctx->ncommands);
+        memcpy(ctx->deferred_commands, ctx->commands, sizeof(float) * ctx->ncommands);
+    }
+
+    item->call       = call;
+    item->paintIndex = paintIndex;
+    item->commands   = ctx->deferred_commands;
+    item->ncommands  = ctx->ncommands;
+    item->scissor    = ctx->state.scissor;
+
+    if (ctx->deferred_last != NULL)
+        ctx->deferred_last->next = item;
     else
+        ctx->deferred_first = item;
+    ctx->deferred_last = item;
+    ctx->ndeferred++;
+    return item;
+}
+
+static void nvg__tesselateDeferredPaths(NVGcontext* ctx)
+{
+    NVGdeferredPath** items = linked_arena_alloc(ctx->frame_arena, sizeof(*items) * ctx->ndeferred);
+    NVGdeferredPath*  item  = ctx->deferred_first;
+
+    for (int i = 0; i < ctx->ndeferred; i++, item = item->next)
+        items[i] = item;
+
+    nvg__runTessPool(ctx->tess_pool, ctx, items, ctx->ndeferred);
+
+    // Written in submission order, so the frame's buffers come out as if every path had been drawn immediately
+    for (int i = 0; i < ctx->ndeferred; i++)
     {
-        frag = linked_arena_alloc_clear(ctx->frame_arena, sizeof(*frag));
-        if (frag == NULL)
-            return;
-        call->uniforms = frag;
-        // Fill shader
-        sgnvg__convertPaint(ctx, frag, &paint, scissor, fringe, fringe, -1.0f);
+        item = items[i];
+        if (item->stroke)
+            sgnvg__writeStrokeCall(
+                ctx,
+                item->call,
+                item->paintIndex,
+                item->paths,
+                item->npaths,
+                item->strokeWidth,
+                NULL,
+                &item->paint,
+                &item->scissor);
+        else
+            sgnvg__writeFillCall(
+                ctx,
+                item->call,
+                item->paintIndex,
+                item->paths,
+                item->npaths,
+                item->bounds,
+                NULL,
+                &item->paint,
+                &item->scissor);
     }
 
-    sgnvg__addCall(ctx, call);
+    ctx->deferred_first = NULL;
+    ctx->deferred_last  = NULL;
+    ctx->ndeferred      = 0;
+}
 
-    // Count triangles
-    for (i = 0; i < ctx->cache.npaths; i++)
+// Returns the stroke width in pixels for the current transform
+static float nvg__strokeWidth(NVGcontext* ctx, float stroke_width, NVGpaint* paint)
+{
+    float scale       = nvg__getAverageScale(ctx->state.xform);
+    float strokeWidth = nvg__clampf(stroke_width * scale, 0.0f, 200.0f);
+
+    if (strokeWidth < ctx->fringeWidth)
     {
-        path = &ctx->cache.paths[i];
+        // If the stroke width is less than pixel size, use alpha to emulate coverage.
+        // Since coverage is area, scale by alpha*alpha.
+        float alpha           = nvg__clampf(strokeWidth / ctx->fringeWidth, 0.0f, 1.0f);
+        paint->innerColour.a *= alpha * alpha;
+        paint->outerColour.a *= alpha * alpha;
+        strokeWidth           = ctx->fringeWidth;
+    }
+    return strokeWidth;
+}
+
+void nvgFill(NVGcontext* ctx)
+{
+    if (ctx->ncommands == 0)
+        return;
 
-        ctx->frame_stats.fillTriCount  += path->nfill - 2;
-        ctx->frame_stats.fillTriCount  += path->nstroke - 2;
-        ctx->frame_stats.drawCallCount += 2;
+    if (sgnvg__renderSdf(ctx, &ctx->state.paint, 0.0f))
+        return;
+
+    if (ctx->tess_pool != NULL)
+    {
+        NVGdeferredPath* item = nvg__deferPath(ctx, NVG_LABEL("nvgFill"));
+        if (item != NULL)
+            item->paint = ctx->state.paint;
+        return;
     }
+
+    nvg__flattenPaths(ctx);
+    nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+
+    sgnvg__renderFill(ctx, ctx->cache.paths, ctx->cache.npaths, ctx->cache.bounds, NULL);
 }
 
 void nvgStroke(NVGcontext* ctx, float stroke_width)
@@ -3219,95 +4699,239 @@ void nvgStroke(NVGcontext* ctx, float stroke_width)
     if (ctx->ncommands == 0)
         return;
 
-    float    scale       = nvg__getAverageScale(state->xform);
-    float    strokeWidth = nvg__clampf(stroke_width * scale, 0.0f, 200.0f);
     NVGpaint paint       = state->paint;
-    int      i;
+    float    strokeWidth = nvg__strokeWidth(ctx, stroke_width, &paint);
 
-    if (strokeWidth < ctx->fringeWidth)
+    // Strokes thinner than a pixel are widened to one & faded instead. The SDF's coverage of the widened stroke strays
+    // further from the thin one than the tesselated stroke's does, so those are left to be tesselated
+    if (stroke_width * nvg__getAverageScale(state->xform) >= ctx->fringeWidth &&
+        sgnvg__renderSdf(ctx, &paint, strokeWidth))
+        return;
+
+    if (ctx->tess_pool != NULL)
     {
-        // If the stroke width is less than pixel size, use alpha to emulate coverage.
-        // Since coverage is area, scale by alpha*alpha.
-        float alpha          = nvg__clampf(strokeWidth / ctx->fringeWidth, 0.0f, 1.0f);
-        paint.innerColour.a *= alpha * alpha;
-        paint.outerColour.a *= alpha * alpha;
-        strokeWidth          = ctx->fringeWidth;
+        NVGdeferredPath* item = nvg__deferPath(ctx, NVG_LABEL("nvgStroke"));
+        if (item != NULL)
+        {
+            item->stroke      = 1;
+            item->strokeWidth = strokeWidth;
+            item->lineCap     = state->lineCap;
+            item->lineJoin    = state->lineJoin;
+            item->miterLimit  = state->miterLimit;
+            item->paint       = paint;
+        }
+        return;
     }
 
     nvg__flattenPaths(ctx);
     nvg__expandStroke(ctx, strokeWidth * 0.5f, ctx->fringeWidth, state->lineCap, state->lineJoin, state->miterLimit);
 
-    NVGcompositeOperationState compositeOperation = state->compositeOperation;
-    NVGscissor*                scissor            = &state->scissor;
-    float                      fringe             = ctx->fringeWidth;
-    const NVGpath*             paths              = ctx->cache.paths;
-    int                        npaths             = ctx->cache.npaths;
-
-    SGNVGcall*         call  = NULL;
-    SGNVGfragUniforms* frags = NULL;
-    int                maxverts, offset, maxindexes, ioffset;
+    sgnvg__renderStroke(ctx, ctx->cache.paths, ctx->cache.npaths, strokeWidth, &paint, NULL);
+}
 
-    // Looks like you forgot to call snvg_command_draw_nvg() before issuing nvgFill()/nvgStroke()/nvgText() commands!
-    // NVG_ASSERT(ctx->current_nvg_draw != NULL); // TODO: remove?
-    if (ctx->current_nvg_draw == NULL)
-        snvg_command_draw_nvg(ctx, NVG_LABEL("nvgStroke"));
+void nvgRetainPath(NVGcontext* ctx, NVGretainedPath* path)
+{
+    xarr_setlen(path->commands, ctx->ncommands);
+    if (ctx->ncommands)
+        memcpy(path->commands, ctx->commands, sizeof(float) * ctx->ncommands);
+    memcpy(path->xform, ctx->state.xform, sizeof(path->xform));
 
-    call = linked_arena_alloc_clear(ctx->frame_arena, sizeof(*call));
+    path->fill.built   = 0;
+    path->stroke.built = 0;
+}
 
-    if (call == NULL)
-        return;
+void nvgFreeRetainedPath(NVGretainedPath* path)
+{
+    xarr_free(path->commands);
+    xarr_free(path->fill.verts);
+    xarr_free(path->fill.paths);
+    xarr_free(path->stroke.verts);
+    xarr_free(path->stroke.paths);
+    memset(path, 0, sizeof(*path));
+}
 
-    call->type  = SGNVG_STROKE;
-    call->paths = linked_arena_alloc_clear(ctx->frame_arena, npaths * sizeof(*call->paths));
-    if (call->paths == NULL)
-        return;
-    call->num_paths = npaths;
-    call->blendFunc = sgnvg__blendCompositeOperation(compositeOperation);
+// Makes the retained commands the current path, moved from the transform they were recorded with to the current one
+static void nvg__loadRetainedPath(NVGcontext* ctx, const NVGretainedPath* path)
+{
+    int    ncommands = xarr_len(path->commands);
+    float  xform[6], move[6];
+    float* vals;
 
-    // Allocate vertices for all the paths.
-    maxverts = sgnvg__maxVertCount(paths, npaths);
-    offset   = sgnvg__allocVerts(ctx, maxverts);
-    if (offset == -1)
-        return;
-    maxindexes = sgnvg__maxIndexCount(paths, npaths);
-    ioffset    = sgnvg__allocIndexes(ctx, maxindexes);
-    if (ioffset == -1)
+    nvgBeginPath(ctx);
+    if (ncommands == 0)
         return;
 
-    for (i = 0; i < npaths; i++)
+    memcpy(xform, ctx->state.xform, sizeof(xform));
+    if (memcmp(path->xform, xform, sizeof(xform)) == 0)
     {
-        SGNVGpath*     copy = &call->paths[i];
-        const NVGpath* path = &paths[i];
+        nvgTransformIdentity(move);
+    }
+    else
+    {
+        nvgTransformInverse(move, path->xform);
+        nvgTransformMultiply(move, xform);
+    }
 
-        if (path->nstroke)
+    // nvg__appendCommands() transforms in place
+    vals = linked_arena_alloc(ctx->frame_arena, sizeof(float) * ncommands);
+    memcpy(vals, path->commands, sizeof(float) * ncommands);
+    memcpy(ctx->state.xform, move, sizeof(move));
+    nvg__appendCommands(ctx, vals, ncommands);
+    memcpy(ctx->state.xform, xform, sizeof(xform));
+}
+
+// Copies the expanded path cache into retained geometry, built with the current transform
+static void nvg__storeRetainedGeometry(NVGcontext* ctx, NVGretainedGeometry* geo)
+{
+    const NVGpathCache* cache  = &ctx->cache;
+    int                 nverts = sgnvg__maxVertCount(cache->paths, cache->npaths);
+    int                 i;
+
+    xarr_setlen(geo->verts, nverts);
+    xarr_setlen(geo->paths, cache->npaths);
+
+    nverts = 0;
+    for (i = 0; i < cache->npaths; i++)
+    {
+        NVGpath* path = &geo->paths[i];
+        *path         = cache->paths[i];
+        path->fill    = NULL;
+        path->stroke  = NULL;
+        if (path->nfill > 0)
         {
-            // stroke: triangle strip
-            copy->strokeOffset = ioffset;
-            copy->strokeCount  = (path->nstroke - 2) * 3;
-            memcpy(&ctx->verts[offset], path->stroke, sizeof(NVGvertex) * path->nstroke);
-            sgnvg__generateTriangleStripIndexes(&ctx->indexes[ioffset], offset, path->nstroke);
-            offset  += path->nstroke;
-            ioffset += copy->strokeCount;
+            path->fill = &geo->verts[nverts];
+            memcpy(path->fill, cache->paths[i].fill, sizeof(NVGvertex) * path->nfill);
+            nverts += path->nfill;
+        }
+        if (path->nstroke > 0)
+        {
+            path->stroke = &geo->verts[nverts];
+            memcpy(path->stroke, cache->paths[i].stroke, sizeof(NVGvertex) * path->nstroke);
+            nverts += path->nstroke;
         }
     }
 
-    // Fill shader
-    frags = linked_arena_alloc_clear(ctx->frame_arena, sizeof(*frags));
-    if (frags == NULL)
+    memcpy(geo->xform, ctx->state.xform, sizeof(geo->xform));
+    memcpy(geo->bounds, cache->bounds, sizeof(geo->bounds));
+    geo->fringe = ctx->fringeWidth;
+    geo->built  = 1;
+}
+
+// Returns true if the geometry can be replayed under the current transform, and writes the transform that takes it
+// there to 'move'. Only translations, rotations and small uniform scales keep the fringe and tesselation close enough
+static bool nvg__canReplayRetainedGeometry(NVGcontext* ctx, const NVGretainedGeometry* geo, float* move)
+{
+    const float* xform = ctx->state.xform;
+    float        scale;
+
+    if (!geo->built || geo->fringe != ctx->fringeWidth)
+        return false;
+
+    if (xform[0] == geo->xform[0] && xform[1] == geo->xform[1] && xform[2] == geo->xform[2] &&
+        xform[3] == geo->xform[3])
+    {
+        nvgTransformTranslate(move, xform[4] - geo->xform[4], xform[5] - geo->xform[5]);
+        return true;
+    }
+
+    if (!nvgTransformInverse(move, geo->xform))
+        return false;
+    nvgTransformMultiply(move, xform);
+
+    scale = nvg__sqrtf(move[0] * move[0] + move[1] * move[1]);
+    if (nvg__absf(move[0] - move[3]) > scale * 1e-4f || nvg__absf(move[1] + move[2]) > scale * 1e-4f)
+        return false;
+    return scale <= NVG_RETAIN_SCALE_TOLERANCE && scale * NVG_RETAIN_SCALE_TOLERANCE >= 1.0f;
+}
+
+// Returns the transform to copy retained vertices with, or NULL if they were built with the current one
+static const float* nvg__retainedMove(NVGcontext* ctx, const NVGretainedGeometry* geo, const float* move)
+{
+    return memcmp(geo->xform, ctx->state.xform, sizeof(geo->xform)) == 0 ? NULL : move;
+}
+
+void nvgFillRetainedPath(NVGcontext* ctx, NVGretainedPath* path)
+{
+    NVGretainedGeometry* geo = &path->fill;
+    float                move_xform[6];
+    const float*         move;
+    float                bounds[4];
+
+    nvgBeginPath(ctx);
+    if (xarr_len(path->commands) == 0)
         return;
-    call->uniforms = frags;
-    sgnvg__convertPaint(ctx, call->uniforms, &paint, scissor, strokeWidth, fringe, -1.0f);
 
-    sgnvg__addCall(ctx, call);
+    if (!nvg__canReplayRetainedGeometry(ctx, geo, move_xform))
+    {
+        nvg__loadRetainedPath(ctx, path);
+        nvg__flattenPaths(ctx);
+        nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+        nvg__storeRetainedGeometry(ctx, geo);
+    }
+    if (xarr_len(geo->paths) == 0)
+        return;
 
-    // Count triangles
-    for (i = 0; i < ctx->cache.npaths; i++)
+    move = nvg__retainedMove(ctx, geo, move_xform);
+    memcpy(bounds, geo->bounds, sizeof(bounds));
+    if (move != NULL)
     {
-        const NVGpath* path = &ctx->cache.paths[i];
+        // Bounds of the moved bounding box, loose when rotated but the cover quad only has to enclose the fill
+        float x[4], y[4];
+        nvgTransformPoint(&x[0], &y[0], move, geo->bounds[0], geo->bounds[1]);
+        nvgTransformPoint(&x[1], &y[1], move, geo->bounds[2], geo->bounds[1]);
+        nvgTransformPoint(&x[2], &y[2], move, geo->bounds[2], geo->bounds[3]);
+        nvgTransformPoint(&x[3], &y[3], move, geo->bounds[0], geo->bounds[3]);
+        bounds[0] = nvg__minf(nvg__minf(x[0], x[1]), nvg__minf(x[2], x[3]));
+        bounds[1] = nvg__minf(nvg__minf(y[0], y[1]), nvg__minf(y[2], y[3]));
+        bounds[2] = nvg__maxf(nvg__maxf(x[0], x[1]), nvg__maxf(x[2], x[3]));
+        bounds[3] = nvg__maxf(nvg__maxf(y[0], y[1]), nvg__maxf(y[2], y[3]));
+    }
+
+    sgnvg__renderFill(ctx, geo->paths, xarr_len(geo->paths), bounds, move);
+}
+
+void nvgStrokeRetainedPath(NVGcontext* ctx, NVGretainedPath* path, float stroke_width)
+{
+    NVGstate*            state = &ctx->state;
+    NVGretainedGeometry* geo   = &path->stroke;
+    float                move_xform[6];
+    const float*         move;
+    bool                 same_style;
+
+    nvgBeginPath(ctx);
+    if (xarr_len(path->commands) == 0)
+        return;
 
-        ctx->frame_stats.strokeTriCount += path->nstroke - 2;
-        ctx->frame_stats.drawCallCount++;
+    NVGpaint paint       = state->paint;
+    float    strokeWidth = nvg__strokeWidth(ctx, stroke_width, &paint);
+
+    same_style = geo->strokeWidth == stroke_width && geo->lineCap == state->lineCap &&
+                 geo->lineJoin == state->lineJoin && geo->miterLimit == state->miterLimit;
+    if (!same_style || !nvg__canReplayRetainedGeometry(ctx, geo, move_xform))
+    {
+        nvg__loadRetainedPath(ctx, path);
+        nvg__flattenPaths(ctx);
+        nvg__expandStroke(
+            ctx,
+            strokeWidth * 0.5f,
+            ctx->fringeWidth,
+            state->lineCap,
+            state->lineJoin,
+            state->miterLimit);
+        nvg__storeRetainedGeometry(ctx, geo);
+        geo->strokeWidth = stroke_width;
+        geo->pixelWidth  = strokeWidth;
+        geo->lineCap     = state->lineCap;
+        geo->lineJoin    = state->lineJoin;
+        geo->miterLimit  = state->miterLimit;
     }
+    if (xarr_len(geo->paths) == 0)
+        return;
+
+    // Replays under a small scale move the geometry's fringe with it, so the shader has to see the width it was
+    // expanded with rather than the current one. The paint's thin stroke alpha is still taken at the current scale
+    move = nvg__retainedMove(ctx, geo, move_xform);
+    sgnvg__renderStroke(ctx, geo->paths, xarr_len(geo->paths), geo->pixelWidth, &paint, move);
 }
 
 void snvg_command_begin_pass(
@@ -3345,10 +4969,13 @@ void snvg_command_draw_nvg(NVGcontext* ctx, const char* label)
     ctx->current_nvg_draw = draws;
 }
 
-NVGcontext* nvgCreateContext(int flags)
+NVGcontext* nvgCreateContext(int flags) { return nvgCreateContextEx(flags, 0); }
+
+NVGcontext* nvgCreateContextEx(int flags, int numThreads)
 {
     NVGcontext*  ctx            = NULL;
-    size_t       init_arena_cap = xm_maxull(1024 * 64, sizeof(*ctx));
+    size_t       pool_size      = (flags & NVG_DEFERRED_TESSELATION) ? sizeof(NVGtessPool) + 64 : 0;
+    size_t       init_arena_cap = xm_maxull(1024 * 64, sizeof(*ctx) + pool_size);
     LinkedArena* arena          = linked_arena_create_ex(0, init_arena_cap);
 
     ctx        = linked_arena_alloc(arena, sizeof(*ctx));
@@ -3358,21 +4985,19 @@ NVGcontext* nvgCreateContext(int flags)
     NVG_ASSERT_GOTO(ctx->frame_arena != NULL, error);
 
     ctx->flags = flags;
+    NVG_ASSERT_GOTO(!((flags & NVG_VERTEX_PULL) && (flags & NVG_COMPACT_VERTICES)), error);
 
     // if(ctx->flags & NVG_ANTIALIAS)
-    ctx->shader = sg_make_shader(nanovg_sg_shader_desc(sg_query_backend()));
+    if (flags & NVG_VERTEX_PULL)
+        ctx->shader = sg_make_shader(nanovg_sg_pull_shader_desc(sg_query_backend()));
+    else if (flags & NVG_COMPACT_VERTICES)
+        ctx->shader = sg_make_shader(nanovg_sg_compact_shader_desc(sg_query_backend()));
+    else
+        ctx->shader = sg_make_shader(nanovg_sg_shader_desc(sg_query_backend()));
     // else
     // ctx->shader = sg_make_shader(nanovg_sg_shader_desc(sg_query_backend()));
-    for (int i = 0; i < NANOVG_SG_PIPELINE_CACHE_SIZE; i++)
-    {
-        for (enum SGNVGpipelineType t = 0; t < SGNVG_PIP_NUM_; t++)
-        {
-            // only allocate pipelines if correct flags are set
-            if (!sgnvg__pipelineTypeIsInUse(ctx, t))
-                continue;
-            ctx->pipelineCache.pipelines[i][t] = sg_alloc_pipeline();
-        }
-    }
+    if (flags & NVG_SDF_PRIMITIVES)
+        ctx->sdfShader = sg_make_shader(nanovg_sg_sdf_shader_desc(sg_query_backend()));
 
     ctx->blend = (sg_blend_state){
         .enabled          = true,
@@ -3384,27 +5009,30 @@ NVGcontext* nvgCreateContext(int flags)
         .op_alpha         = SG_BLENDOP_ADD,
     };
 
-    ctx->vertBuf  = sg_alloc_buffer();
-    ctx->indexBuf = sg_alloc_buffer();
+    ctx->vertBuf   = sg_alloc_buffer();
+    ctx->vertView  = sg_alloc_view();
+    ctx->indexBuf  = sg_alloc_buffer();
+    ctx->paintBuf  = sg_alloc_buffer();
+    ctx->paintView = sg_alloc_view();
+    ctx->sdfBuf    = sg_alloc_buffer();
+    ctx->sdfView   = sg_alloc_view();
 
     nvgReset(ctx);
     nvg__setBackingScaleFactor(ctx, 1);
+    nvgPrewarmPipelines(ctx, (const int[]){NVG_SOURCE_OVER}, 1);
 
-    ctx->commands  = (float*)NVG_MALLOC(sizeof(float) * NVG_INIT_COMMANDS_SIZE);
-    ctx->ccommands = NVG_INIT_COMMANDS_SIZE;
-    NVG_ASSERT_GOTO(ctx->commands != NULL, error);
-
-    ctx->cache.points  = (NVGpoint*)NVG_MALLOC(sizeof(NVGpoint) * NVG_INIT_POINTS_SIZE);
+    // Per frame buffers live on the frame arena and are reserved again by every nvgBeginFrame()
+    ctx->ccommands     = NVG_INIT_COMMANDS_SIZE;
     ctx->cache.cpoints = NVG_INIT_POINTS_SIZE;
-    NVG_ASSERT_GOTO(ctx->cache.points != NULL, error);
+    ctx->cache.cpaths  = NVG_INIT_PATHS_SIZE;
+    ctx->cache.cverts  = NVG_INIT_VERTS_SIZE;
+    nvg__reserveFrameBuffers(ctx);
 
-    ctx->cache.paths  = (NVGpath*)NVG_MALLOC(sizeof(NVGpath) * NVG_INIT_PATHS_SIZE);
-    ctx->cache.cpaths = NVG_INIT_PATHS_SIZE;
-    NVG_ASSERT_GOTO(ctx->cache.paths != NULL, error);
-
-    ctx->cache.verts  = (NVGvertex*)NVG_MALLOC(sizeof(NVGvertex) * NVG_INIT_VERTS_SIZE);
-    ctx->cache.cverts = NVG_INIT_VERTS_SIZE;
-    NVG_ASSERT_GOTO(ctx->cache.verts != NULL, error);
+    if (flags & NVG_DEFERRED_TESSELATION)
+    {
+        ctx->tess_pool = nvg__createTessPool(ctx, numThreads);
+        NVG_ASSERT_GOTO(ctx->tess_pool->num_workers > 0, error);
+    }
 
     return ctx;
 
@@ -3419,36 +5047,49 @@ void nvgDestroyContext(NVGcontext* ctx)
     if (ctx == NULL)
         return;
 
-    NVG_FREE(ctx->commands);
-    NVG_FREE(ctx->cache.points);
-    NVG_FREE(ctx->cache.paths);
-    NVG_FREE(ctx->cache.verts);
+    if (ctx->tess_pool != NULL)
+        nvg__destroyTessPool(ctx->tess_pool);
+    if (ctx->next_frame_arena != NULL)
+        linked_arena_destroy(ctx->next_frame_arena);
 
     sg_destroy_shader(ctx->shader);
+    if (ctx->flags & NVG_SDF_PRIMITIVES)
+        sg_destroy_shader(ctx->sdfShader);
 
-    for (int i = 0; i < NANOVG_SG_PIPELINE_CACHE_SIZE; i++)
+    for (int i = 0; i < ctx->pipelineCache.numEntries; i++)
     {
-        for (enum SGNVGpipelineType t = 0; t < SGNVG_PIP_NUM_; t++)
-        {
-            // only uninitialize if correct flags are set
-            if (!sgnvg__pipelineTypeIsInUse(ctx, t))
-                continue;
-            if (ctx->pipelineCache.pipelinesActive[i] & (1 << t))
-                sg_uninit_pipeline(ctx->pipelineCache.pipelines[i][t]);
-            sg_dealloc_pipeline(ctx->pipelineCache.pipelines[i][t]);
-        }
+        sg_uninit_pipeline(ctx->pipelineCache.entries[i].pipeline);
+        sg_dealloc_pipeline(ctx->pipelineCache.entries[i].pipeline);
     }
 
     if (ctx->cverts_gpu)
+    {
+        if (ctx->flags & NVG_VERTEX_PULL)
+            sg_uninit_view(ctx->vertView);
         sg_uninit_buffer(ctx->vertBuf);
+    }
+    sg_dealloc_view(ctx->vertView);
     sg_dealloc_buffer(ctx->vertBuf);
 
     if (ctx->cindexes_gpu)
         sg_uninit_buffer(ctx->indexBuf);
     sg_dealloc_buffer(ctx->indexBuf);
 
-    NVG_FREE(ctx->verts);
-    NVG_FREE(ctx->indexes);
+    if (ctx->cpaints_gpu)
+    {
+        sg_uninit_view(ctx->paintView);
+        sg_uninit_buffer(ctx->paintBuf);
+    }
+    sg_dealloc_view(ctx->paintView);
+    sg_dealloc_buffer(ctx->paintBuf);
+
+    if (ctx->csdfs_gpu)
+    {
+        sg_uninit_view(ctx->sdfView);
+        sg_uninit_buffer(ctx->sdfBuf);
+    }
+    sg_dealloc_view(ctx->sdfView);
+    sg_dealloc_buffer(ctx->sdfBuf);
 
     if (ctx->frame_arena)
     {
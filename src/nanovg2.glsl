@@ -1,21 +1,29 @@
 @module nanovg
 
-@vs vs
-
+@block view
 layout (binding = 0) uniform viewSize {
 #if defined(_HLSL5_) && !defined(USE_SOKOL)
     mat4 dummy;
 #endif
     vec4 _viewSize;
+    vec4 _compactStep;
 };
+@end
+
+@vs vs
+@include_block view
+
 layout (location = 0) in vec2 vertex;
 layout (location = 1) in vec2 tcoord;
+layout (location = 2) in float paintIndex;
 layout (location = 0) out vec2 ftcoord;
 layout (location = 1) out vec2 fpos;
+layout (location = 2) flat out int fpaintIndex;
 
 void main(void) {
 	ftcoord = tcoord;
 	fpos = vertex;
+	fpaintIndex = int(paintIndex);
     float x = 2.0 * (vertex.x - _viewSize.x) / _viewSize.z - 1.0;
     float y = 1.0 - 2.0 * (vertex.y - _viewSize.y) / _viewSize.w;
 	gl_Position = vec4(
@@ -27,72 +35,167 @@ void main(void) {
 }
 @end
 
-@fs fs
-precision highp float;
-#if defined(_HLSL5_) && !defined(USE_SOKOL)
-    uniform frag {
-        mat4 _scissorMat;
-        vec4 _scissorExt;
-        vec4 _scissorScale;
-        mat4 _paintMat;
-        vec4 _extent;
-        vec4 _radius;
-        vec4 _feather;
-        vec4 innerCol;
-        vec4 outerCol;
-        vec4 _strokeMult;
-        int texType;
-        int type;
-    };
-    #define scissorMat mat3(_scissorMat)
-    #define scissorExt _scissorExt.xy
-    #define scissorScale _scissorScale.xy
-    #define paintMat mat3(_paintMat)
-    #define extent _extent.xy
-    #define radius _radius.x
-    #define feather _feather.x
-    #define strokeMult _strokeMult.x
-    #define strokeThr _strokeMult.y
-#else
-    #ifdef USE_UNIFORMBUFFER
-        layout(std140,binding=1) uniform frag {
-            mat3 scissorMat;
-            mat3 paintMat;
-            vec4 innerCol;
-            vec4 outerCol;
-            vec2 scissorExt;
-            vec2 scissorScale;
-            vec2 extent;
-            float radius;
-            float feather;
-            float strokeMult;
-            float strokeThr;
-            int texType;
-            int type;
-        };
-    #else
-        layout(std140,binding=1) uniform frag {
-            vec4 dummy[11];
-        };
-        #define scissorMat mat3(dummy[0].xyz, dummy[1].xyz, dummy[2].xyz)
-        #define paintMat mat3(dummy[3].xyz, dummy[4].xyz, dummy[5].xyz)
-        #define innerCol dummy[6]
-        #define outerCol dummy[7]
-        #define scissorExt dummy[8].xy
-        #define scissorScale dummy[8].zw
-        #define extent dummy[9].xy
-        #define radius dummy[9].z
-        #define feather dummy[9].w
-        #define strokeMult dummy[10].x
-        #define strokeThr dummy[10].y
-        #define texType int(dummy[10].z)
-        #define type int(dummy[10].w)
-    #endif
-#endif
+// NVG_COMPACT_VERTICES. 8 byte vertices: positions are fixed-point in steps of _compactStep.x units, tcoords are in
+// 1/128 and the paint index is split over two bytes. Read as integers, the pipeline feeds SHORT2 & UBYTE4. Must match
+// SGNVGcompactAttribute
+@vs vs_compact
+@include_block view
 
-layout(location = 0) in vec2 ftcoord;
-layout(location = 1) in vec2 fpos;
-layout(location = 0) out vec4 outColor;
+layout (location = 0) in ivec2 vertex;
+layout (location = 1) in uvec4 tcoordPaint;
+layout (location = 0) out vec2 ftcoord;
+layout (location = 1) out vec2 fpos;
+layout (location = 2) flat out int fpaintIndex;
+
+void main(void) {
+	vec2 pos = vec2(vertex) * _compactStep.x;
+	ftcoord = vec2(tcoordPaint.xy) * (1.0 / 128.0);
+	fpos = pos;
+	fpaintIndex = int(tcoordPaint.z) + int(tcoordPaint.w) * 256;
+    float x = 2.0 * (pos.x - _viewSize.x) / _viewSize.z - 1.0;
+    float y = 1.0 - 2.0 * (pos.y - _viewSize.y) / _viewSize.w;
+	gl_Position = vec4(
+        x,
+        y,
+        0,
+        1
+    );
+}
+@end
+
+// NVG_VERTEX_PULL. Draws the triangle starting at every vertex, taking its corners from the storage buffer like the fan
+// & strip indexes would. Must match SGNVGpullAttribute
+@vs vs_pull
+@include_block view
+
+struct vertex_t {
+    vec2 pos;
+    vec2 tcoord;
+    float paintIndex;
+    int triangle;
+};
+layout(binding=1) readonly buffer verts {
+    vertex_t vtx[];
+};
+layout (location = 0) out vec2 ftcoord;
+layout (location = 1) out vec2 fpos;
+layout (location = 2) flat out int fpaintIndex;
+
+#define PULL_NONE -1
+#define PULL_STRIP -2
+
+void main(void) {
+	int t = gl_VertexIndex / 3;
+	int corner = gl_VertexIndex - t * 3;
+	int triangle = vtx[t].triangle;
+	if (triangle == PULL_NONE) {
+		// Past the end of a path, outside the clip volume
+		ftcoord = vec2(0.0);
+		fpos = vec2(0.0);
+		fpaintIndex = 0;
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+	int i = t + corner;
+	if (triangle == PULL_STRIP) {
+		// Strips start on an even vertex, see sgnvg__generateTriangleStripIndexes()
+		if (corner == 0)
+			i = (t + 1) & ~1;
+		else if (corner == 1)
+			i = t | 1;
+	} else if (corner == 0) {
+		i = triangle;
+	}
+	vec2 pos = vtx[i].pos;
+	ftcoord = vtx[i].tcoord;
+	fpos = pos;
+	fpaintIndex = int(vtx[i].paintIndex);
+    float x = 2.0 * (pos.x - _viewSize.x) / _viewSize.z - 1.0;
+    float y = 1.0 - 2.0 * (pos.y - _viewSize.y) / _viewSize.w;
+	gl_Position = vec4(
+        x,
+        y,
+        0,
+        1
+    );
+}
+@end
+
+// NVG_SDF_PRIMITIVES. Six vertices per shape make a quad around it, along the shape's own axes, which leaves room for
+// its stroke & fringe. Must match SGNVGsdfShape
+@vs vs_sdf
+@include_block view
+
+struct shape_t {
+    vec4 centerAxis;
+    vec4 sizeRadiusStroke;
+    float fringe;
+    float paintIndex;
+    float type;
+    uint colour;
+};
+layout(binding=2) readonly buffer sdfs {
+    shape_t shp[];
+};
+layout (location = 0) out vec2 flocal;
+layout (location = 1) out vec2 fpos;
+layout (location = 2) flat out int fpaintIndex;
+layout (location = 3) flat out vec4 fsizeRadiusStroke;
+layout (location = 4) flat out vec2 ffringeType;
+layout (location = 5) flat out vec4 fcolor;
+
+#define SDF_ARC_BUTT 5
+
+const int quad[6] = int[6](0, 1, 2, 2, 1, 3);
+
+void main(void) {
+	int s = gl_VertexIndex / 6;
+	int corner = quad[gl_VertexIndex - s * 6];
+	vec4 sizeRadiusStroke = shp[s].sizeRadiusStroke;
+	// Arcs fit in their radius, anything else in its size
+	vec2 ext = int(shp[s].type) >= SDF_ARC_BUTT ? sizeRadiusStroke.zz : sizeRadiusStroke.xy;
+	ext += sizeRadiusStroke.w * 0.5 + shp[s].fringe;
+	flocal = ext * vec2(float(corner & 1) * 2.0 - 1.0, float(corner >> 1) * 2.0 - 1.0);
+	vec2 axis = shp[s].centerAxis.zw;
+	vec2 pos = shp[s].centerAxis.xy + flocal.x * axis + flocal.y * vec2(-axis.y, axis.x);
+	fpos = pos;
+	fpaintIndex = int(shp[s].paintIndex);
+	fsizeRadiusStroke = sizeRadiusStroke;
+	ffringeType = vec2(shp[s].fringe, shp[s].type);
+	fcolor = unpackUnorm4x8(shp[s].colour);
+    float x = 2.0 * (pos.x - _viewSize.x) / _viewSize.z - 1.0;
+    float y = 1.0 - 2.0 * (pos.y - _viewSize.y) / _viewSize.w;
+	gl_Position = vec4(
+        x,
+        y,
+        0,
+        1
+    );
+}
+@end
+
+// Paints of every call in the frame, picked per vertex so calls with different paints can share a draw. Included after
+// the fragment shader's inputs, which must have fpaintIndex
+@block paint
+struct paint_t {
+    vec4 data[11];
+};
+layout(binding=0) readonly buffer paints {
+    paint_t paint[];
+};
+#define scissorMat mat3(paint[fpaintIndex].data[0].xyz, paint[fpaintIndex].data[1].xyz, paint[fpaintIndex].data[2].xyz)
+#define paintMat mat3(paint[fpaintIndex].data[3].xyz, paint[fpaintIndex].data[4].xyz, paint[fpaintIndex].data[5].xyz)
+#define innerCol paint[fpaintIndex].data[6]
+#define outerCol paint[fpaintIndex].data[7]
+#define scissorExt paint[fpaintIndex].data[8].xy
+#define scissorScale paint[fpaintIndex].data[8].zw
+#define extent paint[fpaintIndex].data[9].xy
+#define radius paint[fpaintIndex].data[9].z
+#define feather paint[fpaintIndex].data[9].w
+#define strokeMult paint[fpaintIndex].data[10].x
+#define strokeThr paint[fpaintIndex].data[10].y
+#define texType int(paint[fpaintIndex].data[10].z)
+#define type int(paint[fpaintIndex].data[10].w)
 
 #define M_1_PI   0.318309886183790671538  // 1/pi
 #define M_PI     3.14159265359  // 1/pi
@@ -111,11 +214,6 @@ float scissorMask(vec2 p) {
     return clamp(sc.x,0.0,1.0) * clamp(sc.y,0.0,1.0);
 }
 
-// Stroke - from [0..1] to clipped pyramid, where the slope is 1px.
-float strokeMask() {
-    return min(1.0, (1.0-abs(ftcoord.x*2.0-1.0))*strokeMult) * min(1.0, ftcoord.y);
-}
-
 float fastsin(in float x)
 {
     float norm = fract(x * M_1_PI);
@@ -129,6 +227,27 @@ float dither_noise(in vec2 uv_coord){
     return (1.0 / 255.0) * noise - (0.5 / 255.0); // (-0.5 - 0.5) / 255 range. Shift 8bit colour +/- rgb value
 }
 
+// Calculate gradient color using box gradient
+vec4 gradientColor(vec2 p) {
+    vec2 pt = (paintMat * vec3(p,1.0)).xy;
+    float d = clamp((sdroundrect(pt, extent, radius) + feather*0.5) / feather, 0.0, 1.0);
+    return mix(innerCol,outerCol,d);
+}
+@end
+
+@fs fs
+precision highp float;
+layout(location = 0) in vec2 ftcoord;
+layout(location = 1) in vec2 fpos;
+layout(location = 2) flat in int fpaintIndex;
+layout(location = 0) out vec4 outColor;
+@include_block paint
+
+// Stroke - from [0..1] to clipped pyramid, where the slope is 1px.
+float strokeMask() {
+    return min(1.0, (1.0-abs(ftcoord.x*2.0-1.0))*strokeMult) * min(1.0, ftcoord.y);
+}
+
 void main(void) {
     vec4 result = vec4(0);
 
@@ -141,10 +260,7 @@ void main(void) {
     }
 
     if (type == 0) {    // Gradient
-        // Calculate gradient color using box gradient
-        vec2 pt = (paintMat * vec3(fpos,1.0)).xy;
-        float d = clamp((sdroundrect(pt, extent, radius) + feather*0.5) / feather, 0.0, 1.0);
-        vec4 color = mix(innerCol,outerCol,d);
+        vec4 color = gradientColor(fpos);
         float noise = dither_noise(fpos);
         // Combine alpha
         color *= strokeAlpha;
@@ -158,4 +274,81 @@ void main(void) {
 }
 @end
 
-@program sg vs fs
\ No newline at end of file
+// NVG_SDF_PRIMITIVES. Covers the quad by the distance to the shape in pixels, with the same ramp as the fringes of
+// tesselated paths. The distances are Inigo Quilez' 2D distance functions. Must match SGNVGsdfShape
+@fs fs_sdf
+precision highp float;
+layout(location = 0) in vec2 flocal;
+layout(location = 1) in vec2 fpos;
+layout(location = 2) flat in int fpaintIndex;
+layout(location = 3) flat in vec4 fsizeRadiusStroke;
+layout(location = 4) flat in vec2 ffringeType;
+layout(location = 5) flat in vec4 fcolor;
+layout(location = 0) out vec4 outColor;
+@include_block paint
+
+#define SDF_RECT 0
+#define SDF_RECT_STROKE 1
+#define SDF_MITER_RECT_STROKE 2
+#define SDF_ELLIPSE 3
+#define SDF_CIRCLE_STROKE 4
+#define SDF_ARC_BUTT 5
+#define SDF_ARC_ROUND 6
+
+// Approximate, but exact for circles and close enough near the outline, which is all the coverage ramp needs
+float sdellipse(vec2 p, vec2 r) {
+    float k1 = length(p / (r * r));
+    if (k1 == 0.0)
+        return -min(r.x, r.y);
+    float k0 = length(p / r);
+    return k0 * (k0 - 1.0) / k1;
+}
+
+float shapeDistance() {
+    vec2 size = fsizeRadiusStroke.xy;
+    float rad = fsizeRadiusStroke.z;
+    float hw = fsizeRadiusStroke.w * 0.5;
+    int shapeType = int(ffringeType.y);
+
+    if (shapeType == SDF_RECT)
+        return sdroundrect(flocal, size, rad);
+    if (shapeType == SDF_RECT_STROKE)
+        return abs(sdroundrect(flocal, size, rad)) - hw;
+    if (shapeType == SDF_MITER_RECT_STROKE)
+        return max(sdroundrect(flocal, size + hw, 0.0), -sdroundrect(flocal, size - hw, 0.0));
+    if (shapeType == SDF_ELLIPSE)
+        return sdellipse(flocal, size);
+    if (shapeType == SDF_CIRCLE_STROKE)
+        return abs(length(flocal) - size.x) - hw;
+
+    // Arcs are symmetric around y
+    vec2 q = vec2(abs(flocal.x), flocal.y);
+    if (shapeType == SDF_ARC_ROUND)
+        return (size.y * q.x > size.x * q.y ? length(q - size * rad) : abs(length(q) - rad)) - hw;
+    // Butt caps cut the stroke along the radius through the arc's end
+    return max(abs(length(q) - rad) - hw, q.x * size.y - q.y * size.x);
+}
+
+void main(void) {
+    float coverage = clamp(0.5 - shapeDistance() / ffringeType.x, 0.0, 1.0);
+    // Solid colours without scissor have no paint
+    vec4 color = fcolor;
+    float scissor = 1.0;
+    if (fpaintIndex >= 0) {
+        color = gradientColor(fpos);
+        scissor = scissorMask(fpos);
+    }
+    if (coverage == 0.0 || scissor == 0.0)
+        discard;
+
+    color *= coverage;
+    color.rgb += dither_noise(fpos);
+    color *= scissor;
+    outColor = color;
+}
+@end
+
+@program sg vs fs
+@program sg_compact vs_compact fs
+@program sg_pull vs_pull fs
+@program sg_sdf vs_sdf fs_sdf
\ No newline at end of file
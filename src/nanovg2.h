@@ -218,6 +218,24 @@ enum NVGcreateFlags
     NVG_ANTIALIAS = 1 << 0,
     // Flag indicating that additional debug checks are done.
     NVG_DEBUG = 1 << 2,
+    // Flag indicating that nvgFill() & nvgStroke() only record the path, and nvgEndFrame() tesselates all recorded
+    // paths on a pool of threads, see nvgCreateContextEx(). The output is identical to tesselating immediately.
+    NVG_DEFERRED_TESSELATION = 1 << 3,
+    // Flag indicating that vertices are packed into 8 bytes & indexes into 16 bits, see SGNVGcompactAttribute.
+    // Positions are rounded to 1/8 of a device pixel and must be within +-4096 device pixels, which is +-2048 units
+    // at a backingScaleFactor of 2. A fill or stroke may have at most 65536 vertices and a frame at most 65536 fills
+    // & strokes, anything past these is not drawn.
+    NVG_COMPACT_VERTICES = 1 << 4,
+    // Flag indicating that no indexes are uploaded. The vertex shader pulls vertices from a storage buffer, see
+    // SGNVGpullAttribute. Can't be combined with NVG_COMPACT_VERTICES.
+    NVG_VERTEX_PULL = 1 << 5,
+    // Flag indicating that fills & strokes of a path made of just one nvgRect(), nvgRoundedRect(), nvgEllipse(),
+    // nvgCircle() or nvgArc() are drawn as a signed distance field, see SGNVGsdfShape, when the path was recorded
+    // with a transform that only rotates, scales uniformly & translates. Other paths are tesselated, as are strokes
+    // thinner than a pixel.
+    // Their coverage differs from the tesselated path's by up to half a pixel's, where the tesselated path strays from
+    // the exact shape along its chords, round joins & round caps. The SDF's coverage is the closer of the two.
+    NVG_SDF_PRIMITIVES = 1 << 6,
 };
 
 enum SGNVGshaderType
@@ -276,27 +294,74 @@ enum SGNVGcallType
     SGNVG_CONVEXFILL,
     SGNVG_STROKE,
     SGNVG_TRIANGLES,
+    SGNVG_SDF,
 };
 
-typedef struct SGNVGpath
-{
-    int fillOffset;
-    int fillCount;
-    int strokeOffset;
-    int strokeCount;
-} SGNVGpath;
-
 typedef struct SGNVGattribute
 {
     float vertex[2];
     float tcoord[2];
+    float paintIndex; // into the frame's paints, so draws with different paints can be merged
 } SGNVGattribute;
 
+// NVG_COMPACT_VERTICES. Indexes are relative to the start of the 64k vertex chunk a call is in
+#define NVG_COMPACT_SUBPIXELS 8 // per device pixel
+#define NVG_COMPACT_CHUNK_VERTS 65536
+#define NVG_COMPACT_MAX_PAINTS 65536
+
+typedef struct SGNVGcompactAttribute
+{
+    int16_t vertex[2];     // fixed-point, in 1/NVG_COMPACT_SUBPIXELS device pixels
+    uint8_t tcoord[2];     // fixed-point, in 1/128 units. Exact for nanovg's 0, 0.5 & 1
+    uint8_t paintIndex[2]; // low byte first
+} SGNVGcompactAttribute;
+
+// NVG_VERTEX_PULL. Every vertex draws the triangle starting at it, which vs_pull picks the corners of like the fan &
+// strip indexes would. The last two vertices of a path draw nothing
+#define SGNVG_PULL_NONE -1
+#define SGNVG_PULL_STRIP -2
+
+typedef struct SGNVGpullAttribute
+{
+    float vertex[2];
+    float tcoord[2];
+    float paintIndex;
+    int   triangle; // SGNVG_PULL_NONE, SGNVG_PULL_STRIP, or the first vertex of its fan. Must match vs_pull
+} SGNVGpullAttribute;
+
+// NVG_SDF_PRIMITIVES. Each shape is a quad of six vertices that vs_sdf pulls from the shapes storage buffer, and fs_sdf
+// covers by the shape's distance in pixels. Must match fs_sdf
+enum SGNVGsdfType
+{
+    SGNVG_SDF_RECT, // rounded if radius > 0
+    SGNVG_SDF_RECT_STROKE,
+    SGNVG_SDF_MITER_RECT_STROKE, // of a rect with no radius
+    SGNVG_SDF_ELLIPSE,
+    SGNVG_SDF_CIRCLE_STROKE,
+    SGNVG_SDF_ARC_BUTT, // arcs are only stroked
+    SGNVG_SDF_ARC_ROUND,
+};
+
+typedef struct SGNVGsdfShape
+{
+    float    center[2];
+    float    axis[2];     // the shape's x axis, unit length
+    float    size[2];     // half extents of rects, radii of ellipses, sine & cosine of half an arc's aperture
+    float    radius;      // of rect corners & arcs
+    float    strokeWidth; // 0 for fills
+    float    fringe;
+    float    paintIndex; // -1 for a solid colour without scissor, which needs no paint
+    float    type;       // SGNVGsdfType
+    uint32_t colour;     // with paintIndex -1. Premultiplied RGBA8, red in the low byte
+} SGNVGsdfShape;
+
 typedef struct SGNVGvertUniforms
 {
     float viewSize[4];
+    float compactStep[4]; // NVG_COMPACT_VERTICES. x is the units in one fixed-point step of a position
 } SGNVGvertUniforms;
 
+// Read by the fragment shader from the paints storage buffer, indexed by SGNVGattribute.paintIndex
 typedef struct SGNVGfragUniforms
 {
 #define NANOVG_SG_UNIFORMARRAY_SIZE 11
@@ -322,15 +387,21 @@ typedef struct SGNVGfragUniforms
     };
 } SGNVGfragUniforms;
 
-// LRU cache; keep its size relatively small, as items are accessed via a linear search
-#define NANOVG_SG_PIPELINE_CACHE_SIZE 32
+// LRU cache of pipelines, one per blend state & SGNVGpipelineType in use. Only misses search it linearly, for the least
+// recently used entry once it's full
+#define NANOVG_SG_PIPELINE_CACHE_SIZE 64
+// Hash table over the cache; a power of two at least twice its size, to keep probe sequences short
+#define NANOVG_SG_PIPELINE_HASH_BITS 7
+#define NANOVG_SG_PIPELINE_HASH_SIZE (1 << NANOVG_SG_PIPELINE_HASH_BITS)
 
-typedef struct SGNVGpipelineCacheKey
+typedef struct SGNVGpipelineCacheEntry
 {
-    uint32_t blend; // cached as `src_factor_rgb | (dst_factor_rgb << 8) | (src_factor_alpha << 16) | (dst_factor_alpha
-                    // << 24)`
-    uint32_t lastUse; // updated on each read
-} SGNVGpipelineCacheKey;
+    // cached as `src_factor_rgb | (dst_factor_rgb << 8) | (src_factor_alpha << 16) | (dst_factor_alpha << 24)`
+    uint32_t    blend;
+    uint32_t    type;    // SGNVGpipelineType
+    uint32_t    lastUse; // updated on each read
+    sg_pipeline pipeline;
+} SGNVGpipelineCacheEntry;
 
 enum SGNVGpipelineType
 {
@@ -342,32 +413,36 @@ enum SGNVGpipelineType
     SGNVG_PIP_FILL_ANTIALIAS, // only used if sg->flags & NVG_ANTIALIAS
     SGNVG_PIP_FILL_DRAW,
 
+    // used by SGNVG_SDF calls, only if sg->flags & NVG_SDF_PRIMITIVES
+    SGNVG_PIP_SDF,
+
     SGNVG_PIP_NUM_
 };
 
 typedef struct SGNVGpipelineCache
 {
-    // keys are stored as a separate array for search performance
-    SGNVGpipelineCacheKey keys[NANOVG_SG_PIPELINE_CACHE_SIZE];
-    sg_pipeline           pipelines[NANOVG_SG_PIPELINE_CACHE_SIZE][SGNVG_PIP_NUM_];
-    uint8_t               pipelinesActive[NANOVG_SG_PIPELINE_CACHE_SIZE];
-    uint32_t              currentUse; // incremented on each overwrite
+    SGNVGpipelineCacheEntry entries[NANOVG_SG_PIPELINE_CACHE_SIZE];
+    int                     numEntries;
+    // Open addressed with linear probing; holds index + 1 into entries, 0 for empty slots
+    uint8_t                 slots[NANOVG_SG_PIPELINE_HASH_SIZE];
+    uint32_t                currentUse; // incremented on each read
 } SGNVGpipelineCache;
 
 typedef struct SGNVGcall
 {
     enum SGNVGcallType type;
-    int                triangleOffset;
-    int                triangleCount;
+    int                vertexBase; // NVG_COMPACT_VERTICES chunk the indexes are relative to, otherwise 0
+    // The indexes of every path's fill are followed by those of every path's fringe or stroke, so each is one draw.
+    // With NVG_VERTEX_PULL these count the vertices drawn, three for each vertex pulled
+    int indexOffset;
+    int fillCount;
+    int strokeCount;
+    // Bounding box quad covering a SGNVG_FILL, the triangles of SGNVG_TRIANGLES, or the six vertices of a SGNVG_SDF
+    int triangleOffset;
+    int triangleCount;
 
     SGNVGblend blendFunc;
 
-    int        num_paths;
-    SGNVGpath* paths;
-
-    // depending on SGNVGcall.type and NVG_STENCIL_STROKES, this may be 2 consecutive uniforms
-    SGNVGfragUniforms* uniforms;
-
     struct SGNVGcall* next;
 } SGNVGcall;
 
@@ -411,7 +486,7 @@ typedef struct NVGcontext
     LinkedArena* arena;
     void*        arena_top;
 
-    float*       commands;
+    float*       commands; // per frame, like the path cache, see verts below
     int          ccommands;
     int          ncommands;
     float        commandx, commandy;
@@ -428,46 +503,96 @@ typedef struct NVGcontext
         int fillTriCount;
         int strokeTriCount;
         int textTriCount;
+        int sdfShapeCount;
+        // Pipeline lookups, misses build a pipeline. See nvgPrewarmPipelines()
+        int pipelineCacheHits;
+        int pipelineCacheMisses;
         // Track how much data is uploaded to GPU
         size_t uploaded_bytes;
+        // Blocks the context's arenas took from the OS this frame. 0 once every per frame buffer has reached its high
+        // water mark. Retained paths own their memory and aren't counted
+        int allocCount;
     } frame_stats;
 
     // SGNVGcontext....
 
     sg_shader          shader;
+    sg_shader          sdfShader; // NVG_SDF_PRIMITIVES
     SGNVGvertUniforms  view;
     int                flags;
     sg_buffer          vertBuf;
+    sg_view            vertView; // NVG_VERTEX_PULL
     sg_buffer          indexBuf;
+    sg_buffer          paintBuf;
+    sg_view            paintView;
+    sg_buffer          sdfBuf;
+    sg_view            sdfView;
     SGNVGpipelineCache pipelineCache;
 
-    // Per frame buffers
-    SGNVGattribute* verts;
-    int             cverts;
-    int             nverts;
-    int             cverts_gpu;
-    uint32_t*       indexes;
-    int             cindexes;
-    int             nindexes;
-    int             cindexes_gpu;
+    // Per frame buffers, on frame_arena. Their capacities are high water marks that nvgBeginFrame() reserves upfront
+    union
+    {
+        SGNVGattribute*        verts;
+        SGNVGcompactAttribute* compactVerts; // NVG_COMPACT_VERTICES
+        SGNVGpullAttribute*    pullVerts;    // NVG_VERTEX_PULL
+    };
+    int cverts;
+    int nverts;
+    int cverts_gpu;
+    int vertexBase; // NVG_COMPACT_VERTICES, first vertex of the current chunk
+    union
+    {
+        uint32_t* indexes;
+        uint16_t* compactIndexes; // NVG_COMPACT_VERTICES
+    };
+    int                cindexes;
+    int                nindexes;
+    int                cindexes_gpu;
+    SGNVGfragUniforms* paints;
+    int                cpaints;
+    int                npaints;
+    int                cpaints_gpu;
+    SGNVGsdfShape*     sdfs; // NVG_SDF_PRIMITIVES
+    int                csdfs;
+    int                nsdfs;
+    int                csdfs_gpu;
 
     // Feel free to allocate anything you want with this at any time in a frame after nvgBeginFrame() is called
     // Note all allocations are dropped when nvgBeginFrame() is called
     // It is also unadvised to release anything you allocate with this.
     // If these rules/guidelines are okay with you, go ahead
     LinkedArena* frame_arena;
+    LinkedArena* next_frame_arena; // One block holding all of frame_arena, for the frame after it outgrew it
+    int          arenaBlocks;      // in arena, frame_arena and the tesselation workers' arenas when the frame began
 
     SGNVGcall*       current_call;     // linked list current position
     SGNVGcommandNVG* current_nvg_draw; // linked list current position
     SGNVGcommand*    current_command;  // linked list current position
     SGNVGcommand*    first_command;    // linked list start
 
+    // NVG_DEFERRED_TESSELATION. Fills & strokes recorded this frame, tesselated by nvgEndFrame()
+    struct NVGtessPool*     tess_pool;
+    struct NVGdeferredPath* deferred_first;
+    struct NVGdeferredPath* deferred_last;
+    int                     ndeferred;
+    float*                  deferred_commands; // Copy of the current path shared by its recorded fills & strokes
+
+    // NVG_SDF_PRIMITIVES. The primitive the current path is made of, in pixels, as long as ncommands is sdfPathCommands
+    SGNVGsdfShape sdfPath;
+    int           sdfPathCommands;
+
     // state
-    int            pipelineCacheIndex;
+    uint32_t       blendNumber; // of blend, keying the pipeline cache
     sg_blend_state blend;
+    sg_pipeline    appliedPipeline;   // Bindings & uniforms are only applied again when the pipeline changes
+    int            appliedVertexBase; // or the NVG_COMPACT_VERTICES chunk does
 } NVGcontext;
 
 NVGcontext* nvgCreateContext(int flags);
+// Like nvgCreateContext(), also setting the number of threads NVG_DEFERRED_TESSELATION tesselates on, counting the one
+// calling nvgEndFrame(). 0 picks the number of logical cores, 1 tesselates everything on the calling thread, and at
+// most 8 are used. The output is identical regardless of thread count.
+NVGcontext* nvgCreateContextEx(int flags, int numThreads);
 void        nvgDestroyContext(NVGcontext* ctx);
 
 // Debug function to dump cached path data.
@@ -503,6 +628,10 @@ void nvgSetGlobalCompositeBlendFunc(NVGcontext* ctx, int sfactor, int dfactor);
 // should be one of NVGblendFactor.
 void nvgSetGlobalCompositeBlendFuncSeparate(NVGcontext* ctx, int srcRGB, int dstRGB, int srcAlpha, int dstAlpha);
 
+// Builds the pipelines for each of the count composite operations in ops, so their first use doesn't stall a frame.
+// The ops should be one of NVGcompositeOperation. NVG_SOURCE_OVER is built by nvgCreateContext().
+void nvgPrewarmPipelines(NVGcontext* ctx, const int* ops, int count);
+
 //
 // Colour utils
 //
@@ -767,6 +896,54 @@ void nvgFill(NVGcontext* ctx);
 // Fills the current path with current stroke style.
 void nvgStroke(NVGcontext* ctx, float stroke_width);
 
+//
+// Retained paths
+//
+// A retained path keeps a copy of a path's commands along with its tesselated fill and stroke geometry, so static
+// shapes skip flattening, joins and expansion on later frames. Cached geometry is replayed while the transform only
+// moved or rotated it, and while its scale stays within NVG_RETAIN_SCALE_TOLERANCE of the scale it was built at.
+// Stroke geometry is also keyed on the stroke width, caps, joins and miter limit. Anything else rebuilds it.
+//
+// Zero initialise an NVGretainedPath, record it with nvgRetainPath(), and release it with nvgFreeRetainedPath().
+// Drawing a retained path replaces the current path, as if nvgBeginPath() was called.
+
+#ifndef NVG_RETAIN_SCALE_TOLERANCE
+#define NVG_RETAIN_SCALE_TOLERANCE 1.09f // an eighth of an octave either way
+#endif
+
+typedef struct NVGretainedGeometry
+{
+    NVGvertex* verts; // xarr
+    NVGpath*   paths; // xarr, fill & stroke point into verts
+    int        built;
+    float      xform[6]; // transform the geometry was built with
+    float      bounds[4];
+    float      fringe;
+
+    // Stroke style, unused by fills
+    float strokeWidth;
+    float pixelWidth; // strokeWidth in pixels as expanded when built, which the stroke's UVs are relative to
+    int   lineCap;
+    int   lineJoin;
+    float miterLimit;
+} NVGretainedGeometry;
+
+typedef struct NVGretainedPath
+{
+    float*              commands; // xarr, already transformed by xform
+    float               xform[6]; // transform when the path was retained
+    NVGretainedGeometry fill;
+    NVGretainedGeometry stroke;
+} NVGretainedPath;
+
+// Copies the current path into 'path', dropping any geometry cached from a previous recording.
+void nvgRetainPath(NVGcontext* ctx, NVGretainedPath* path);
+// Fills a retained path with the current fill style.
+void nvgFillRetainedPath(NVGcontext* ctx, NVGretainedPath* path);
+// Strokes a retained path with the current stroke style.
+void nvgStrokeRetainedPath(NVGcontext* ctx, NVGretainedPath* path, float stroke_width);
+void nvgFreeRetainedPath(NVGretainedPath* path);
+
 //
 // Text
 //
@@ -5,12 +5,10 @@
 #include <math.h>
 #include <string.h>
 #include <xhl/alloc.h>
+#include <xhl/array.h>
 #include <xhl/files.h>
 
-#define NVG_MALLOC(sz)       xmalloc(sz)
-#define NVG_REALLOC(ptr, sz) xrealloc(ptr, sz)
-#define NVG_FREE(ptr)        xfree(ptr)
-#define NVG_ASSERT           xassert
+#define NVG_ASSERT xassert
 
 #include "nanosvg.h"
 #include "nanovg2.h"
@@ -30,6 +28,28 @@ the respective coords, and taking an x, y, and scale parameter for growing/shrin
 This would be ideal for drawing an SVG icon directly into a texture map
 */
 
+// Record the tiger's paths once and replay their cached tesselation every frame
+#define RETAIN_PATHS (1)
+// Tesselate paths on a pool of threads in nvgEndFrame(). Retained paths are already tesselated, so this only changes
+// anything with RETAIN_PATHS (0)
+#define DEFERRED_TESSELATION (0)
+// Set to 1 to draw a panel of knobs & buttons over the tiger. Consecutive draws sharing a blend state are merged into
+// one, which the panel's many small shapes show off
+#define DRAW_WIDGETS (0)
+// Set to 1 to pack vertices into 8 bytes & indexes into 16 bits, see NVG_COMPACT_VERTICES
+#define COMPACT_VERTICES (0)
+// Set to 1 to pull vertices from a storage buffer instead of uploading indexes, see NVG_VERTEX_PULL
+#define VERTEX_PULL (0)
+// Set to 1 to draw rects, rounded rects, circles, ellipses & arcs as signed distance fields, see NVG_SDF_PRIMITIVES.
+// The widget panel is made of little else
+#define SDF_PRIMITIVES (0)
+// Set to 1 to print the draw calls, triangles & bytes uploaded every 60 frames
+#define PRINT_FRAME_STATS (0)
+
+#if COMPACT_VERTICES && VERTEX_PULL
+#error "NVG_COMPACT_VERTICES and NVG_VERTEX_PULL can't be combined"
+#endif
+
 // clang-format off
 #define nvgHexColour2(hex) (NVGcolour){\
                                         ( hex >>  0  & 0xff) / 255.0f,\
@@ -44,14 +64,45 @@ static struct
     NVGcontext* nvg;
     NSVGimage*  svg;
 
+    NVGretainedPath* paths; // xarr, one per visible svg path
+
     int width, height;
+    int frame; // frames drawn so far
 } state;
 
+static void build_path(NVGcontext* vg, const NSVGpath* path)
+{
+    nvgBeginPath(vg);
+    nvgMoveTo(vg, path->pts[0], path->pts[1]);
+    for (int i = 0; i < path->npts - 1; i += 3)
+    {
+        float* p = &path->pts[i * 2];
+        nvgBezierTo(vg, p[2], p[3], p[4], p[5], p[6], p[7]);
+    }
+    if (path->closed)
+    {
+        nvgClosePath(vg);
+    }
+}
+
 void program_setup()
 {
     xalloc_init();
 
-    state.nvg    = nvgCreateContext(NVG_ANTIALIAS);
+    int flags = NVG_ANTIALIAS;
+#if DEFERRED_TESSELATION
+    flags |= NVG_DEFERRED_TESSELATION;
+#endif
+#if COMPACT_VERTICES
+    flags |= NVG_COMPACT_VERTICES;
+#endif
+#if VERTEX_PULL
+    flags |= NVG_VERTEX_PULL;
+#endif
+#if SDF_PRIMITIVES
+    flags |= NVG_SDF_PRIMITIVES;
+#endif
+    state.nvg    = nvgCreateContext(flags);
     state.width  = APP_WIDTH;
     state.height = APP_HEIGHT;
 
@@ -59,9 +110,29 @@ void program_setup()
 
     state.svg = nsvgParseFromFile(path_tiger_svg, "px", 96);
     println("size: %f x %f", state.svg->width, state.svg->height);
+
+#if RETAIN_PATHS
+    for (NSVGshape* shape = state.svg->shapes; shape != NULL; shape = shape->next)
+    {
+        if (!(shape->flags & NSVG_FLAGS_VISIBLE))
+            continue;
+
+        for (NSVGpath* path = shape->paths; path != NULL; path = path->next)
+        {
+            NVGretainedPath retained = {0};
+            build_path(state.nvg, path);
+            nvgRetainPath(state.nvg, &retained);
+            xarr_push(state.paths, retained);
+        }
+    }
+#endif
 }
 void program_shutdown()
 {
+    for (int i = 0; i < xarr_len(state.paths); i++)
+        nvgFreeRetainedPath(&state.paths[i]);
+    xarr_free(state.paths);
+
     nvgDestroyContext(state.nvg);
 
     nsvgDelete(state.svg);
@@ -79,6 +150,52 @@ bool program_event(const PWEvent* event)
     return false;
 }
 
+static void draw_widgets(NVGcontext* vg)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        float x     = 40 + (i % 8) * 70;
+        float y     = 40 + (i / 8) * 110;
+        float value = (i % 5) / 4.0f;
+        float a0    = NVG_PI * 0.75f;
+        float a1    = a0 + NVG_PI * 1.5f * value;
+
+        // Knob: body, track, value arc & pointer
+        nvgBeginPath(vg);
+        nvgCircle(vg, x + 25, y + 25, 18);
+        nvgSetColour(vg, nvgRGBA(48, 52, 60, 255));
+        nvgFill(vg);
+
+        nvgSetLineCap(vg, NVG_ROUND);
+        nvgBeginPath(vg);
+        nvgArc(vg, x + 25, y + 25, 23, a0, NVG_PI * 2.25f, NVG_CW);
+        nvgSetColour(vg, nvgRGBA(90, 94, 102, 255));
+        nvgStroke(vg, 3);
+        if (value > 0)
+        {
+            nvgBeginPath(vg);
+            nvgArc(vg, x + 25, y + 25, 23, a0, a1, NVG_CW);
+            nvgSetColour(vg, nvgRGBA(255, 160, 40, 255));
+            nvgStroke(vg, 3);
+        }
+
+        nvgBeginPath(vg);
+        nvgMoveTo(vg, x + 25 + cosf(a1) * 6, y + 25 + sinf(a1) * 6);
+        nvgLineTo(vg, x + 25 + cosf(a1) * 15, y + 25 + sinf(a1) * 15);
+        nvgSetColour(vg, nvgRGBA(240, 240, 240, 255));
+        nvgStroke(vg, 2);
+        nvgSetLineCap(vg, NVG_BUTT);
+
+        // Button underneath
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, x, y + 60, 50, 24, 5);
+        nvgSetColour(vg, (i & 1) ? nvgRGBA(255, 160, 40, 255) : nvgRGBA(48, 52, 60, 255));
+        nvgFill(vg);
+        nvgSetColour(vg, nvgRGBA(20, 20, 24, 255));
+        nvgStroke(vg, 1);
+    }
+}
+
 NVGpaint createLinearGradient(NVGcontext* vg, NSVGgradient* gradient, float alpha)
 {
     float inverse[6];
@@ -119,43 +236,65 @@ void program_tick()
 
     NVGcontext* vg = state.nvg;
 
+    int path_idx = 0;
     for (NSVGshape* shape = state.svg->shapes; shape != NULL; shape = shape->next)
     {
 
         if (!(shape->flags & NSVG_FLAGS_VISIBLE))
             continue;
 
-        for (NSVGpath* path = shape->paths; path != NULL; path = path->next)
+        for (NSVGpath* path = shape->paths; path != NULL; path = path->next, path_idx++)
         {
-            nvgBeginPath(vg);
-            nvgMoveTo(vg, path->pts[0], path->pts[1]);
-            for (int i = 0; i < path->npts - 1; i += 3)
-            {
-                float* p = &path->pts[i * 2];
-                nvgBezierTo(vg, p[2], p[3], p[4], p[5], p[6], p[7]);
-            }
-            if (path->closed)
-            {
-                nvgClosePath(vg);
-            }
+#if !RETAIN_PATHS
+            build_path(vg, path);
+#endif
 
             if (shape->fill.type)
             {
                 xassert(shape->fill.type == NSVG_PAINT_COLOR); // todo, handle linear and radial gradients
                 nvgSetColour(vg, nvgHexColour2(shape->fill.color));
+#if RETAIN_PATHS
+                nvgFillRetainedPath(vg, &state.paths[path_idx]);
+#else
                 nvgFill(vg);
+#endif
             }
 
             if (shape->stroke.type)
             {
                 xassert(shape->stroke.type == NSVG_PAINT_COLOR);
                 nvgSetColour(vg, nvgHexColour2(shape->stroke.color));
+#if RETAIN_PATHS
+                nvgStrokeRetainedPath(vg, &state.paths[path_idx], shape->strokeWidth);
+#else
                 nvgStroke(vg, shape->strokeWidth);
+#endif
             }
         }
     }
 
+#if DRAW_WIDGETS
+    draw_widgets(vg);
+#endif
+
     snvg_command_end_pass(vg, "end pass");
 
     nvgEndFrame(vg);
+
+#if PRINT_FRAME_STATS
+    if (state.frame % 60 == 0)
+    {
+        println(
+            "%d draw calls, %d fill & %d stroke triangles, %d SDF shapes, %zu bytes uploaded",
+            vg->frame_stats.drawCallCount,
+            vg->frame_stats.fillTriCount,
+            vg->frame_stats.strokeTriCount,
+            vg->frame_stats.sdfShapeCount,
+            vg->frame_stats.uploaded_bytes);
+    }
+#endif
+
+    // The first frame grows nanovg's buffers to fit the tiger. Every frame after it should reuse them
+    xassert(state.frame == 0 || vg->frame_stats.allocCount == 0);
+    state.frame++;
 }
\ No newline at end of file
@@ -25,6 +25,7 @@
 //------------------------------------------------------------------------------
 #include "common.h"
 
+#include "program_slug_cull.h"
 #include "slugutil.h"
 
 #define STB_TRUETYPE_IMPLEMENTATION
@@ -36,43 +37,71 @@
 #include <xhl/debug.h>
 #include <xhl/files.h>
 #include <xhl/maths.h>
+#include <xhl/time.h>
 
-#define MAX_DRAWN_GLYPHS  (16 * 1024)
-#define MAX_DRAW_COMMANDS (128)
-#define TOTAL_LINES       (6)
-#define FONT_SIZE         (48.0f)
-#define MIN_ZOOM          (0.1f)
-#define MAX_ZOOM          (50.0f)
+#define MAX_DRAWN_GLYPHS    (16 * 1024)
+#define GLYPH_PAGE_SIZE     (1024) // glyph instances per GPU buffer
+#define NUM_GLYPH_PAGES     (MAX_DRAWN_GLYPHS / GLYPH_PAGE_SIZE)
+#define CULL_GROUP_SIZE     (64) // local_size_x of the cull passes
+#define MAX_DRAW_COMMANDS   (128)
+#define MAX_LAYOUTS         (256) // power of 2
+#define MAX_LAYOUT_VERTICES (16 * 1024)
+#define MAX_LAYOUT_TEXT     (16 * 1024) // codepoints of all cached layouts
+#define TOTAL_LINES         (6)
+#define FONT_SIZE           (48.0f)
+#define LOD_PIXELS_PER_EM   (16.0f) // text drawn smaller than this uses the glyphs' simplified LOD bands
+#define MIN_ZOOM            (0.1f)
+#define MAX_ZOOM            (50.0f)
+// Set to 1 to time a full single threaded build of every glyph in the bundled fonts on startup
+#define BENCHMARK_FONT_BUILD (0)
+// Set to 1 to build every glyph of the bundled fonts on startup and print their band statistics and LOD error
+#define PRINT_BAND_STATS (0)
+// Set to 1 to time laying out 100k codepoints of the demo text, uncached, on startup
+#define BENCHMARK_LAYOUT (0)
+// Set to 0 to cull glyphs with the CPU mirror of the cull passes even when compute is available
+#define CULL_ON_GPU (1)
 
 static uint32_t line[TOTAL_LINES][128];
 
-// per-glyph data in glyph buffer, expanded 4x via hardware-instancing
+// Textures are looked up through the font when drawing, as lazy fonts may recreate them while glyphs are pushed.
+// Fonts sharing a collection share textures, so their glyphs end up in the same draw command.
 typedef struct
 {
-    vec4_t   draw_rect;
-    vec4_t   glyph_bbox;
-    vec4_t   band_transform;
-    int16_t  glyph_params[4];
-    uint32_t color;
-} glyph_vertex_t;
+    int                base_instance;
+    int                num_instances;
+    const slug_font_t* font;
+} draw_command_t;
 
+// A line of text laid out once at (0, 0), kept as glyph vertices that only need moving to the line's origin
 typedef struct
 {
-    int     base_instance;
-    int     num_instances;
-    sg_view curve_tex_view;
-    sg_view band_tex_view;
-} draw_command_t;
+    uint64_t           hash; // of font, size, emoji, lod and the codepoints, 0 for unused slots
+    const slug_font_t* font;
+    float              size;
+    bool               emoji;
+    bool               lod; // vertices point at the glyphs' LOD bands
+    float              width;
+    int                first_codepoint; // copy of the line in layout_text, compared on a hash match
+    int                num_codepoints;
+    int                first_vertex;
+    int                num_vertices;
+} layout_t;
 
 static glyph_vertex_t glyph_vertices[MAX_DRAWN_GLYPHS];
 static draw_command_t draw_commands[MAX_DRAW_COMMANDS];
+static glyph_vertex_t layout_vertices[MAX_LAYOUT_VERTICES];
+static uint32_t       layout_text[MAX_LAYOUT_TEXT];
+static int            cull_prefix[MAX_DRAWN_GLYPHS + 1]; // CPU culling only, see cull_glyphs()
+static int            cull_visible[MAX_DRAWN_GLYPHS];
 
 static struct
 {
     uint32_t    width;
     uint32_t    height;
-    sg_buffer   buf;
+    sg_buffer   pages[NUM_GLYPH_PAGES];
+    sg_view     page_views[NUM_GLYPH_PAGES]; // storage views for the cull passes and vs_pull
     sg_pipeline pip;
+    sg_pipeline pull_pip;
     sg_sampler  smp;
     struct
     {
@@ -85,9 +114,10 @@ static struct
     } inp;
     struct
     {
-        slug_font_t cairo;
-        slug_font_t lucide;
-        slug_font_t twemoji;
+        slug_font_collection_t collection;
+        slug_font_t            cairo;
+        slug_font_t            lucide;
+        slug_font_t            twemoji;
     } fonts;
     struct
     {
@@ -96,22 +126,34 @@ static struct
         int                cur_draw_command;
         const slug_font_t* cur_font;
     } draw;
-} state;
-
-static float measure_line(const slug_font_t* font, const uint32_t* text)
-{
-    float    total = 0.0f;
-    uint32_t ucp;
-    while ((ucp = *text++) != 0)
+    struct
     {
-        const slug_glyph_t* glyph = slug_get_glyph(font, ucp);
-        if (glyph)
-        {
-            total += glyph->advance * FONT_SIZE;
-        }
-    }
-    return total;
-}
+        int  num_uploaded[NUM_GLYPH_PAGES]; // instances the GPU copy of each page holds
+        bool dirty[NUM_GLYPH_PAGES];
+        int  num_pushed;                    // totals over the app's lifetime, reported on shutdown
+        int  num_written;
+        int  num_page_uploads;
+    } stream;
+    struct
+    {
+        bool        on_gpu;
+        sg_buffer   counts;  // visible glyphs per group of CULL_GROUP_SIZE instances
+        sg_buffer   prefix;  // visible glyphs before each instance, and in total
+        sg_buffer   visible; // instances that passed, in stream order
+        sg_view     counts_view;
+        sg_view     prefix_view;
+        sg_view     visible_view;
+        sg_pipeline count_pip;
+        sg_pipeline compact_pip;
+    } cull;
+    struct
+    {
+        layout_t table[MAX_LAYOUTS]; // open addressing
+        int      num_layouts;
+        int      num_vertices;
+        int      num_codepoints;
+    } layouts;
+} state;
 
 static void begin_push_glyphs(void)
 {
@@ -128,33 +170,107 @@ static void push_draw_command(void)
     {
         xassert(state.draw.cur_font);
         draw_commands[state.draw.cur_draw_command++] = (draw_command_t){
-            .base_instance  = state.draw.start_glyph_vertex,
-            .num_instances  = state.draw.cur_glyph_vertex - state.draw.start_glyph_vertex,
-            .curve_tex_view = state.draw.cur_font->curve.tex_view,
-            .band_tex_view  = state.draw.cur_font->band.tex_view,
+            .base_instance = state.draw.start_glyph_vertex,
+            .num_instances = state.draw.cur_glyph_vertex - state.draw.start_glyph_vertex,
+            .font          = state.draw.cur_font,
         };
         state.draw.start_glyph_vertex = state.draw.cur_glyph_vertex;
     }
 }
 
+// glyph_vertices persists between frames as a mirror of what the GPU pages hold. A run is only copied, and its pages
+// marked dirty, when it differs from what is already at its position, so static text costs a compare per glyph.
+// The vertices are moved by (x, y) on the way in.
+static void write_glyph_vertices(const glyph_vertex_t* vertices, int num_vertices, float x, float y)
+{
+    int  first   = state.draw.cur_glyph_vertex;
+    bool changed = false;
+    state.stream.num_pushed += num_vertices;
+    for (int i = 0; i < num_vertices; i++)
+    {
+        glyph_vertex_t v  = vertices[i];
+        v.draw_rect.x    += x;
+        v.draw_rect.y    += y;
+        if (memcmp(&glyph_vertices[first + i], &v, sizeof(v)) != 0)
+        {
+            glyph_vertices[first + i] = v;
+            changed                   = true;
+        }
+    }
+    if (changed)
+    {
+        for (int page = first / GLYPH_PAGE_SIZE; page <= (first + num_vertices - 1) / GLYPH_PAGE_SIZE; page++)
+        {
+            state.stream.dirty[page] = true;
+        }
+        state.stream.num_written += num_vertices;
+    }
+    state.draw.cur_glyph_vertex += num_vertices;
+}
+
 static void end_push_glyphs(void)
 {
     // push final draw command
     push_draw_command();
-    // update the glyph instance buffer
-    sg_update_buffer(
-        state.buf,
-        &(sg_range){
-            .ptr  = glyph_vertices,
-            .size = state.draw.cur_glyph_vertex * sizeof(glyph_vertex_t),
-        });
+    // Upload the pages that changed. A page that grew is uploaded too, as the GPU copy of a page is undefined past
+    // what was last uploaded (D3D11 discards the whole buffer on update). sokol can only replace a buffer's contents
+    // once per frame, so a page is the granularity of a partial update.
+    for (int page = 0; page < NUM_GLYPH_PAGES; page++)
+    {
+        int num_used = xm_clampi(state.draw.cur_glyph_vertex - page * GLYPH_PAGE_SIZE, 0, GLYPH_PAGE_SIZE);
+        if ((num_used > 0) && (state.stream.dirty[page] || (num_used > state.stream.num_uploaded[page])))
+        {
+            sg_update_buffer(
+                state.pages[page],
+                &(sg_range){
+                    .ptr  = &glyph_vertices[page * GLYPH_PAGE_SIZE],
+                    .size = num_used * sizeof(glyph_vertex_t),
+                });
+            state.stream.num_uploaded[page] = num_used;
+            state.stream.dirty[page]        = false;
+            state.stream.num_page_uploads++;
+        }
+    }
 }
 
-static void push_glyph_vertex(const glyph_vertex_t* v)
+// Fills the cull buffers with the GPU version of cull_glyphs(). The count pass must finish for every page before
+// the compact pass starts, as each group of the compact pass sums the counts of all groups before it.
+static void dispatch_cull_passes(vec4_t cull_rect)
 {
-    if (state.draw.cur_glyph_vertex < MAX_DRAWN_GLYPHS)
+    int num_glyphs = state.draw.cur_glyph_vertex;
+    for (int compact = 0; compact < 2; compact++)
     {
-        glyph_vertices[state.draw.cur_glyph_vertex++] = *v;
+        sg_begin_pass(&(sg_pass){.compute = true, .label = compact ? "slug-cull-compact" : "slug-cull-count"});
+        sg_apply_pipeline(compact ? state.cull.compact_pip : state.cull.count_pip);
+        for (int page = 0; page < NUM_GLYPH_PAGES; page++)
+        {
+            int first    = page * GLYPH_PAGE_SIZE;
+            int num_used = xm_clampi(num_glyphs - first, 0, GLYPH_PAGE_SIZE);
+            if (num_used == 0)
+            {
+                break;
+            }
+            cs_cull_params_t params = {
+                .cull_rect = {cull_rect.x, cull_rect.y, cull_rect.z, cull_rect.w},
+                .cull_page = {first, num_used, num_glyphs, 0},
+            };
+            sg_apply_uniforms(UB_cs_cull_params, &SG_RANGE(params));
+            sg_bindings bind             = {0};
+            bind.views[VIEW_cull_glyphs] = state.page_views[page];
+            if (compact)
+            {
+                bind.views[VIEW_cull_counts]      = state.cull.counts_view;
+                bind.views[VIEW_cull_prefix_out]  = state.cull.prefix_view;
+                bind.views[VIEW_cull_visible_out] = state.cull.visible_view;
+            }
+            else
+            {
+                bind.views[VIEW_cull_counts_out] = state.cull.counts_view;
+            }
+            sg_apply_bindings(&bind);
+            sg_dispatch((num_used + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        }
+        sg_end_pass();
     }
 }
 
@@ -167,13 +283,10 @@ static uint32_t pack_color_u32(vec4_t color)
     return (a << 24) | (b << 16) | (g << 8) | r;
 }
 
-static void push_glyph(const slug_font_t* font, const slug_glyph_t* glyph, float x, float y, vec4_t color)
+// Starts a new draw command if the font draws with different textures than the glyphs pushed so far
+static void set_draw_font(const slug_font_t* font)
 {
-    if ((glyph->max_band_x < 0.0f) || (glyph->max_band_y < 0.0f))
-    {
-        return;
-    }
-    if (font != state.draw.cur_font)
+    if ((state.draw.cur_font == 0) || (slug_curve_texture(font) != slug_curve_texture(state.draw.cur_font)))
     {
         if (state.draw.cur_font != 0)
         {
@@ -181,13 +294,17 @@ static void push_glyph(const slug_font_t* font, const slug_glyph_t* glyph, float
         }
         state.draw.cur_font = font;
     }
-    const glyph_vertex_t glyph_vertex = {
+}
+
+static glyph_vertex_t make_glyph_vertex(const slug_glyph_t* glyph, float x, float y, float size, vec4_t color)
+{
+    return (glyph_vertex_t){
         .draw_rect =
             {
-                x + (glyph->bbox.x0 * FONT_SIZE),
-                y + (glyph->bbox.y0 * FONT_SIZE),
-                (glyph->bbox.x1 - glyph->bbox.x0) * FONT_SIZE,
-                (glyph->bbox.y1 - glyph->bbox.y0) * FONT_SIZE,
+                x + (glyph->bbox.x0 * size),
+                y + (glyph->bbox.y0 * size),
+                (glyph->bbox.x1 - glyph->bbox.x0) * size,
+                (glyph->bbox.y1 - glyph->bbox.y0) * size,
             },
         .glyph_bbox =
             {
@@ -212,80 +329,235 @@ static void push_glyph(const slug_font_t* font, const slug_glyph_t* glyph, float
             },
         .color = pack_color_u32(color),
     };
-    push_glyph_vertex(&glyph_vertex);
 }
 
-static void push_line(const slug_font_t* font, const uint32_t* text, float x, float y)
+static bool glyph_has_bands(const slug_glyph_t* glyph)
 {
-    uint32_t cp = 0;
-    while ((cp = *text++) != 0)
+    return (glyph->max_band_x >= 0.0f) && (glyph->max_band_y >= 0.0f);
+}
+
+static void push_layout_vertex(layout_t* layout, const glyph_vertex_t* v)
+{
+    if (state.layouts.num_vertices < MAX_LAYOUT_VERTICES)
     {
-        const slug_glyph_t* glyph = slug_get_glyph(font, cp);
-        if (glyph)
-        {
-            push_glyph(font, glyph, x, y, (vec4_t){1.0f, 1.0f, 1.0f, 1.0f});
-            x += glyph->advance * FONT_SIZE;
-        }
+        layout_vertices[state.layouts.num_vertices++] = *v;
+        layout->num_vertices++;
     }
 }
 
-static void push_emoji(const slug_font_t* font, uint32_t codepoint, float x, float y)
+// Pushes each COLR layer of the emoji as its own glyph
+static void layout_emoji(layout_t* layout, slug_font_t* font, uint32_t codepoint, float x, float y)
 {
     const slug_colr_base_t* colr_base = slug_find_colr_base(font, codepoint);
     if (colr_base == 0)
     {
         return;
     }
-    // draw each layer as its own glyph
     for (uint16_t i = 0; i < colr_base->num_layers; i++)
     {
-        slug_colr_layer_t* layer = &font->colr_layers[colr_base->first_layer + i];
-        if (layer->glyph_id >= xarr_len(font->glyphs))
+        slug_colr_layer_t*  layer = &font->colr_layers[colr_base->first_layer + i];
+        const slug_glyph_t* glyph = slug_get_glyph_by_index(font, layer->glyph_id);
+        if ((glyph == 0) || !glyph_has_bands(glyph))
         {
             continue;
         }
-        slug_glyph_t* glyph = &font->glyphs[layer->glyph_id];
-        vec4_t        color = {1.0f, 1.0f, 1.0f, 1.0f};
+        vec4_t color = {1.0f, 1.0f, 1.0f, 1.0f};
         if (layer->palette_index < xarr_len(font->cpal_colors))
         {
             color = font->cpal_colors[layer->palette_index];
         }
-        push_glyph(font, glyph, x, y, color);
+        slug_glyph_t   drawn = layout->lod ? slug_glyph_lod(glyph) : *glyph;
+        glyph_vertex_t v     = make_glyph_vertex(&drawn, x, y, layout->size, color);
+        push_layout_vertex(layout, &v);
     }
 }
 
-static void push_line_emoji(const slug_font_t* font, const uint32_t* text, float x, float y)
+// Lays out the line with its origin at (0, 0), applying kerning between consecutive glyphs
+static void build_layout(layout_t* layout, slug_font_t* font, const uint32_t* text)
 {
-    uint32_t cp = 0;
+    const vec4_t white    = {1.0f, 1.0f, 1.0f, 1.0f};
+    float        em_scale = stbtt_ScaleForMappingEmToPixels(&font->info, 1.0f);
+    float        x        = 0.0f;
+    int          prev     = 0;
+    uint32_t     cp       = 0;
+
+    layout->first_vertex = state.layouts.num_vertices;
+    layout->num_vertices = 0;
     while ((cp = *text++) != 0)
     {
-        const slug_glyph_t* glyph = slug_get_glyph(font, cp);
-        if (glyph)
+        int                 glyph_index = slug_find_glyph_index(font, cp);
+        const slug_glyph_t* glyph       = slug_get_glyph_by_index(font, glyph_index);
+        if (glyph == 0)
+        {
+            continue;
+        }
+        if (prev != 0)
+        {
+            x += (float)stbtt_GetGlyphKernAdvance(&font->info, prev, glyph_index) * em_scale * layout->size;
+        }
+        if (layout->emoji)
         {
-            push_emoji(font, cp, x, y);
-            x += glyph->advance * FONT_SIZE;
+            layout_emoji(layout, font, cp, x, 0.0f);
         }
+        else if (glyph_has_bands(glyph))
+        {
+            slug_glyph_t   drawn = layout->lod ? slug_glyph_lod(glyph) : *glyph;
+            glyph_vertex_t v     = make_glyph_vertex(&drawn, x, 0.0f, layout->size, white);
+            push_layout_vertex(layout, &v);
+        }
+        x    += glyph->advance * layout->size;
+        prev  = glyph_index;
     }
+    layout->width = x;
 }
 
-static void push_centered_line(const slug_font_t* font, const uint32_t* text, int line_nr)
+static uint64_t hash_layout_key(const slug_font_t* font, float size, bool emoji, bool lod, const uint32_t* text)
 {
-    const float line_height  = FONT_SIZE * 1.5f;
-    const float block_height = (float)TOTAL_LINES * line_height;
-    float       line_width   = measure_line(font, text);
-    float       base_x       = ((float)state.width - line_width) * 0.5f;
-    float       base_y       = ((float)state.height + block_height) * 0.5f - (float)line_nr * line_height;
-    push_line(font, text, base_x, base_y);
+    // FNV-1a over the font, size, emoji and lod flags and codepoints
+    uint32_t size_bits;
+    memcpy(&size_bits, &size, sizeof(size_bits));
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash          = (hash ^ (uint64_t)(uintptr_t)font) * 0x100000001b3ull;
+    hash          = (hash ^ size_bits) * 0x100000001b3ull;
+    hash          = (hash ^ (uint64_t)emoji) * 0x100000001b3ull;
+    hash          = (hash ^ (uint64_t)lod) * 0x100000001b3ull;
+    for (; *text != 0; text++)
+    {
+        hash = (hash ^ *text) * 0x100000001b3ull;
+    }
+    // 0 marks unused slots
+    return hash != 0 ? hash : 1;
+}
+
+static int text_length(const uint32_t* text)
+{
+    int len = 0;
+    while (text[len] != 0)
+    {
+        len++;
+    }
+    return len;
+}
+
+static bool layout_matches(
+    const layout_t*    layout,
+    const slug_font_t* font,
+    float              size,
+    bool               emoji,
+    bool               lod,
+    const uint32_t*    text,
+    int                text_len)
+{
+    return (layout->font == font) && (layout->size == size) && (layout->emoji == emoji) && (layout->lod == lod) &&
+           (layout->num_codepoints == text_len) &&
+           (memcmp(&layout_text[layout->first_codepoint], text, text_len * sizeof(uint32_t)) == 0);
+}
+
+static void clear_layouts(void)
+{
+    memset(state.layouts.table, 0, sizeof(state.layouts.table));
+    state.layouts.num_layouts    = 0;
+    state.layouts.num_vertices   = 0;
+    state.layouts.num_codepoints = 0;
+}
+
+// Returns the cached layout for the line, laying it out on first use. Lines that hash the same are told apart by
+// their font, size, flags and codepoints.
+static layout_t* get_layout(slug_font_t* font, float size, bool emoji, bool lod, const uint32_t* text)
+{
+    uint64_t hash     = hash_layout_key(font, size, emoji, lod, text);
+    int      text_len = text_length(text);
+    uint32_t mask     = MAX_LAYOUTS - 1;
+    uint32_t slot     = (uint32_t)hash & mask;
+    while (state.layouts.table[slot].hash != 0)
+    {
+        layout_t* layout = &state.layouts.table[slot];
+        if ((layout->hash == hash) && layout_matches(layout, font, size, emoji, lod, text, text_len))
+        {
+            return layout;
+        }
+        slot = (slot + 1) & mask;
+    }
+    xassert(text_len <= MAX_LAYOUT_TEXT);
+    // Keep the table at most half full. Labels are cheap to lay out again, so start over rather than evict
+    if (((state.layouts.num_layouts + 1) > (MAX_LAYOUTS / 2)) ||
+        (state.layouts.num_vertices > (MAX_LAYOUT_VERTICES / 2)) ||
+        ((state.layouts.num_codepoints + text_len) > MAX_LAYOUT_TEXT))
+    {
+        clear_layouts();
+        slot = (uint32_t)hash & mask;
+    }
+    layout_t* layout = &state.layouts.table[slot];
+    memcpy(&layout_text[state.layouts.num_codepoints], text, text_len * sizeof(uint32_t));
+
+    *layout = (layout_t){
+        .hash            = hash,
+        .font            = font,
+        .size            = size,
+        .emoji           = emoji,
+        .lod             = lod,
+        .first_codepoint = state.layouts.num_codepoints,
+        .num_codepoints  = text_len,
+    };
+    state.layouts.num_codepoints += text_len;
+    build_layout(layout, font, text);
+    state.layouts.num_layouts++;
+    return layout;
+}
+
+// Copies the layout's vertices into the glyph buffer with its origin at (x, y)
+static void push_layout(const slug_font_t* font, const layout_t* layout, float x, float y)
+{
+    int num_vertices = xm_mini(layout->num_vertices, MAX_DRAWN_GLYPHS - state.draw.cur_glyph_vertex);
+    if (num_vertices > 0)
+    {
+        set_draw_font(font);
+        write_glyph_vertices(&layout_vertices[layout->first_vertex], num_vertices, x, y);
+    }
 }
 
-static void push_centered_line_emoji(const slug_font_t* font, const uint32_t* text, int line_nr)
+#if BENCHMARK_LAYOUT
+static void benchmark_layout(const char* name, slug_font_t* font, const uint32_t* text, bool emoji)
+{
+    int text_len = text_length(text);
+    // The first layout makes the glyphs resident
+    layout_t layout = {.size = FONT_SIZE, .emoji = emoji};
+    build_layout(&layout, font, text);
+
+    int      num_codepoints = 0;
+    uint64_t time_start     = xtime_now_ns();
+    while (num_codepoints < 100000)
+    {
+        state.layouts.num_vertices = 0;
+        build_layout(&layout, font, text);
+        num_codepoints += text_len;
+    }
+    uint64_t time_end = xtime_now_ns();
+    println("Laid out %d %s codepoints in: %.3fms", num_codepoints, name, xtime_convert_ns_to_ms(time_end - time_start));
+    clear_layouts();
+}
+#endif
+
+static void push_centered_layout(slug_font_t* font, const uint32_t* text, int line_nr, bool emoji)
 {
     const float line_height  = FONT_SIZE * 1.5f;
     const float block_height = (float)TOTAL_LINES * line_height;
-    float       line_width   = measure_line(font, text);
-    float       base_x       = ((float)state.width - line_width) * 0.5f;
-    float       base_y       = ((float)state.height + block_height) * 0.5f - (float)line_nr * line_height;
-    push_line_emoji(font, text, base_x, base_y);
+    // Zooming out far enough switches to the LOD, which is a different layout of the same line
+    bool      lod    = slug_use_lod(font, FONT_SIZE * state.inp.zoom);
+    layout_t* layout = get_layout(font, FONT_SIZE, emoji, lod, text);
+    float     base_x = ((float)state.width - layout->width) * 0.5f;
+    float     base_y = ((float)state.height + block_height) * 0.5f - (float)line_nr * line_height;
+    push_layout(font, layout, base_x, base_y);
+}
+
+static void push_centered_line(slug_font_t* font, const uint32_t* text, int line_nr)
+{
+    push_centered_layout(font, text, line_nr, false);
+}
+
+static void push_centered_line_emoji(slug_font_t* font, const uint32_t* text, int line_nr)
+{
+    push_centered_layout(font, text, line_nr, true);
 }
 
 static void load_font(slug_font_t* font, const char* path)
@@ -294,9 +566,110 @@ static void load_font(slug_font_t* font, const char* path)
     xassert(file.data);
     if (file.data)
     {
-        slug_load_font(font, &(slug_range_t){.ptr = file.data, .size = file.size});
+        // Glyphs are built on first use, the demo only ever draws a handful of them. All fonts share the
+        // collection's textures so every line of text is drawn in one instanced draw.
+        slug_load_font_desc(
+            font,
+            &(slug_range_t){.ptr = file.data, .size = file.size},
+            &(slug_font_desc_t){
+                .lazy              = true,
+                .collection        = &state.fonts.collection,
+                .lod_pixels_per_em = LOD_PIXELS_PER_EM,
+            });
+    }
+}
+
+#if BENCHMARK_FONT_BUILD
+static void benchmark_font_build(const char* path)
+{
+    XFile file = read_file(path);
+    xassert(file.data);
+
+    slug_font_t font       = {0};
+    uint64_t    time_start = xtime_now_ns();
+    slug_load_font_desc(
+        &font,
+        &(slug_range_t){.ptr = file.data, .size = file.size},
+        &(slug_font_desc_t){.num_threads = 1});
+    uint64_t time_end = xtime_now_ns();
+    println("Built %s in: %.3fms", path, xtime_convert_ns_to_ms(time_end - time_start));
+
+    slug_unload_font(&font);
+    XFILES_FREE(file.data);
+}
+#endif
+
+#if PRINT_BAND_STATS
+static void print_band_stats(const char* name, const slug_font_stats_t* stats)
+{
+    if (stats->num_bands > 0)
+    {
+        println(
+            "%s: %d glyphs, %d bands, avg %.2f max %d curves per band, %d shared bands, %d band texels (%d unshared)",
+            name,
+            stats->num_glyphs,
+            stats->num_bands,
+            (float)stats->num_band_entries / (float)stats->num_bands,
+            stats->max_band_entries,
+            stats->num_shared_bands,
+            stats->num_band_texels,
+            stats->num_unshared_band_texels);
+    }
+}
+
+// The demo's fonts only hold the glyphs drawn so far, so build every glyph of a copy of each font to report on. The
+// copy is lazy so it keeps its texels, which lets slug_measure_lod_error() compare each glyph to its LOD.
+static void print_font_band_stats(const char* path)
+{
+    XFile file = read_file(path);
+    xassert(file.data);
+
+    slug_font_t font = {0};
+    slug_load_font_desc(
+        &font,
+        &(slug_range_t){.ptr = file.data, .size = file.size},
+        &(slug_font_desc_t){.lazy = true, .lod_pixels_per_em = LOD_PIXELS_PER_EM});
+    for (int i = 0; i < font.info.numGlyphs; i++)
+    {
+        slug_get_glyph_by_index(&font, i);
+    }
+    print_band_stats(path, &font.stats);
+    print_band_stats("  LOD", &font.lod_stats);
+
+    slug_texels_t texels;
+    if (slug_get_font_texels(&font, &texels))
+    {
+        static const float SIZES[] = {LOD_PIXELS_PER_EM * 0.5f, LOD_PIXELS_PER_EM - 0.01f};
+        for (int s = 0; s < ARRLEN(SIZES); s++)
+        {
+            float sum_error  = 0.0f;
+            float max_error  = 0.0f;
+            int   num_glyphs = 0;
+            for (int i = 0; i < font.info.numGlyphs; i++)
+            {
+                slug_lod_error_t error;
+                if (slug_measure_lod_error(&texels, slug_get_glyph_by_index(&font, i), SIZES[s], &error))
+                {
+                    sum_error += error.mean_error;
+                    max_error  = xm_maxf(max_error, error.max_error);
+                    num_glyphs++;
+                }
+            }
+            if (num_glyphs > 0)
+            {
+                println(
+                    "  LOD at %.2f ppem: mean coverage error %.4f, worst pixel %.3f",
+                    SIZES[s],
+                    sum_error / (float)num_glyphs,
+                    max_error);
+            }
+        }
     }
+
+    slug_unload_font(&font);
+    XFILES_FREE(file.data);
 }
+#endif
 
 void program_setup()
 {
@@ -347,15 +720,77 @@ void program_setup()
     line[5][14] = 0x1F34E; // red apple
     line[5][15] = 0x1F370; // shortcake
 
-    // A stream-update buffer which holds one glyph_vertex_t per glyph, this
+    // Glyphs that are off screen are culled each frame, by compute passes
+    // when they're available and by their CPU mirror when they're not
+    state.cull.on_gpu = CULL_ON_GPU && sg_query_features().compute;
+
+    // Dynamic-update buffers which hold one glyph_vertex_t per glyph, this
     // is expanded 4x via hardware instancing with the 4 corner vertex positions
-    // synthesized in the vertex shader.
-    state.buf = sg_make_buffer(&(sg_buffer_desc){
-        .usage.stream_update = true,
-        .size                = MAX_DRAWN_GLYPHS * sizeof(glyph_vertex_t),
-        .label               = "slug-glyph-buffer",
-    });
+    // synthesized in the vertex shader. The instances are split over pages so
+    // a frame only uploads the pages whose glyphs changed, and the rest keep
+    // their contents from earlier frames. With GPU culling the pages are also
+    // read as storage buffers, by the cull passes and by vs_pull.
+    for (int page = 0; page < NUM_GLYPH_PAGES; page++)
+    {
+        state.pages[page] = sg_make_buffer(&(sg_buffer_desc){
+            .usage.vertex_buffer  = true,
+            .usage.storage_buffer = state.cull.on_gpu,
+            .usage.dynamic_update = true,
+            .size                 = GLYPH_PAGE_SIZE * sizeof(glyph_vertex_t),
+            .label                = "slug-glyph-page",
+        });
+        if (state.cull.on_gpu)
+        {
+            state.page_views[page] = sg_make_view(&(sg_view_desc){.storage_buffer = state.pages[page]});
+        }
+    }
+    if (state.cull.on_gpu)
+    {
+        _Static_assert(sizeof(glyph_vertex_t) == 15 * sizeof(uint32_t), "shaders read glyph_vertex_t as 15 words");
+        _Static_assert(GLYPH_PAGE_SIZE % CULL_GROUP_SIZE == 0, "cull groups can't straddle pages");
+        // The cull buffers are only written by the cull passes
+        state.cull.counts = sg_make_buffer(&(sg_buffer_desc){
+            .usage.storage_buffer = true,
+            .size                 = (MAX_DRAWN_GLYPHS / CULL_GROUP_SIZE) * sizeof(int),
+            .label                = "slug-cull-counts",
+        });
+        state.cull.prefix = sg_make_buffer(&(sg_buffer_desc){
+            .usage.storage_buffer = true,
+            .size                 = (MAX_DRAWN_GLYPHS + 1) * sizeof(int),
+            .label                = "slug-cull-prefix",
+        });
+        state.cull.visible = sg_make_buffer(&(sg_buffer_desc){
+            .usage.storage_buffer = true,
+            .size                 = MAX_DRAWN_GLYPHS * sizeof(int),
+            .label                = "slug-cull-visible",
+        });
+        state.cull.counts_view  = sg_make_view(&(sg_view_desc){.storage_buffer = state.cull.counts});
+        state.cull.prefix_view  = sg_make_view(&(sg_view_desc){.storage_buffer = state.cull.prefix});
+        state.cull.visible_view = sg_make_view(&(sg_view_desc){.storage_buffer = state.cull.visible});
 
+        state.cull.count_pip = sg_make_pipeline(&(sg_pipeline_desc){
+            .compute = true,
+            .shader  = sg_make_shader(cull_count_shader_desc(sg_query_backend())),
+            .label   = "slug-cull-count-pipeline",
+        });
+        state.cull.compact_pip = sg_make_pipeline(&(sg_pipeline_desc){
+            .compute = true,
+            .shader  = sg_make_shader(cull_compact_shader_desc(sg_query_backend())),
+            .label   = "slug-cull-compact-pipeline",
+        });
+    }
+
+    // premultiplied alpha
+    const sg_color_target_state blend = {
+        .blend =
+            {
+                .enabled          = true,
+                .src_factor_rgb   = SG_BLENDFACTOR_ONE,
+                .dst_factor_rgb   = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+                .src_factor_alpha = SG_BLENDFACTOR_ONE,
+                .dst_factor_alpha = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+            },
+    };
     // the pipeline is configured with a single instance-stepped buffer which
     // provides the per-glyph data, also note that rendering is non-indexed
     // and each glyph is rendered as a 4-vertex triangle-strip
@@ -375,19 +810,21 @@ void program_setup()
             },
         .index_type     = SG_INDEXTYPE_NONE,
         .primitive_type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
-        .colors[0] =
-            {
-                .blend =
-                    {
-                        .enabled          = true,
-                        .src_factor_rgb   = SG_BLENDFACTOR_ONE,
-                        .dst_factor_rgb   = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
-                        .src_factor_alpha = SG_BLENDFACTOR_ONE,
-                        .dst_factor_alpha = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
-                    },
-            },
-        .label = "slug-pipeline",
+        .colors[0]      = blend,
+        .label          = "slug-pipeline",
     });
+    // the same, but pulling the glyphs that passed the cull passes from the
+    // glyph pages, so it has no vertex layout
+    if (state.cull.on_gpu)
+    {
+        state.pull_pip = sg_make_pipeline(&(sg_pipeline_desc){
+            .shader         = sg_make_shader(slug_pull_shader_desc(sg_query_backend())),
+            .index_type     = SG_INDEXTYPE_NONE,
+            .primitive_type = SG_PRIMITIVETYPE_TRIANGLE_STRIP,
+            .colors[0]      = blend,
+            .label          = "slug-pull-pipeline",
+        });
+    }
     state.smp = sg_make_sampler(&(sg_sampler_desc){
         .min_filter = SG_FILTER_NEAREST,
         .mag_filter = SG_FILTER_NEAREST,
@@ -396,16 +833,43 @@ void program_setup()
         .label      = "slug-sampler",
     });
 
+#if BENCHMARK_FONT_BUILD
+    xtime_init();
+    benchmark_font_build(SRC_DIR XFILES_DIR_STR "Cairo.ttf");
+    benchmark_font_build(SRC_DIR XFILES_DIR_STR "lucide.ttf");
+    benchmark_font_build(SRC_DIR XFILES_DIR_STR "twemoji.ttf");
+#endif
+#if PRINT_BAND_STATS
+    print_font_band_stats(SRC_DIR XFILES_DIR_STR "Cairo.ttf");
+    print_font_band_stats(SRC_DIR XFILES_DIR_STR "lucide.ttf");
+    print_font_band_stats(SRC_DIR XFILES_DIR_STR "twemoji.ttf");
+#endif
+
+    slug_init_collection(&state.fonts.collection, &(slug_collection_desc_t){.compact_curves = true});
     load_font(&state.fonts.cairo, SRC_DIR XFILES_DIR_STR "Cairo.ttf");
     load_font(&state.fonts.lucide, SRC_DIR XFILES_DIR_STR "lucide.ttf");
     load_font(&state.fonts.twemoji, SRC_DIR XFILES_DIR_STR "twemoji.ttf");
+
+#if BENCHMARK_LAYOUT
+    xtime_init();
+    benchmark_layout("Cairo", &state.fonts.cairo, line[0], false);
+    benchmark_layout("twemoji", &state.fonts.twemoji, line[5], true);
+#endif
 }
 
 void program_shutdown()
 {
+    println(
+        "Glyph instances: %d pushed, %d written, %d page uploads",
+        state.stream.num_pushed,
+        state.stream.num_written,
+        state.stream.num_page_uploads);
+
     slug_unload_font(&state.fonts.cairo);
     slug_unload_font(&state.fonts.lucide);
     slug_unload_font(&state.fonts.twemoji);
+    slug_destroy_collection(&state.fonts.collection);
+    clear_layouts();
 }
 
 void program_tick()
@@ -414,9 +878,11 @@ void program_tick()
     float             sy        = 2.0f / ((float)state.height / state.inp.zoom);
     float             tx        = -1.0f - state.inp.pan_x * sx;
     float             ty        = -1.0f - state.inp.pan_y * sy;
-    const vs_params_t vs_params = {
+    vs_params_t       vs_params = {
         .xform = {sx, sy, tx, ty},
     };
+    // the area of the screen that's visible at the current zoom and pan, in the pixels glyphs are laid out in
+    vec4_t cull_rect = {(-1.0f - tx) / sx, (-1.0f - ty) / sy, (1.0f - tx) / sx, (1.0f - ty) / sy};
 
     // record text into glyph buffer and draw commands
     bool any_valid = state.fonts.cairo.valid || state.fonts.lucide.valid || state.fonts.twemoji.valid;
@@ -439,6 +905,20 @@ void program_tick()
             push_centered_line_emoji(&state.fonts.twemoji, line[5], 5);
         }
         end_push_glyphs();
+        // upload any glyphs that were built while pushing text
+        slug_flush_collection(&state.fonts.collection);
+
+        if (state.cull.on_gpu)
+        {
+            if (state.draw.cur_glyph_vertex > 0)
+            {
+                dispatch_cull_passes(cull_rect);
+            }
+        }
+        else
+        {
+            cull_glyphs(glyph_vertices, state.draw.cur_glyph_vertex, cull_rect, cull_prefix, cull_visible);
+        }
     }
 
     sg_begin_pass(&(sg_pass){
@@ -447,22 +927,72 @@ void program_tick()
     });
     if (any_valid)
     {
-        sg_apply_pipeline(state.pip);
-        sg_apply_uniforms(UB_vs_params, &SG_RANGE(vs_params));
+        sg_apply_pipeline(state.cull.on_gpu ? state.pull_pip : state.pip);
         for (int i = 0; i < state.draw.cur_draw_command; i++)
         {
             const draw_command_t* cmd = &draw_commands[i];
-            sg_apply_bindings(&(sg_bindings){
-                .vertex_buffers[0]        = state.buf,
-                .vertex_buffer_offsets[0] = cmd->base_instance * sizeof(glyph_vertex_t),
-                .views =
+            vs_params.compact_curves  = cmd->font->compact_curves;
+            sg_apply_uniforms(UB_vs_params, &SG_RANGE(vs_params));
+            // a command's instances are contiguous in glyph_vertices but may straddle pages
+            int instance = cmd->base_instance;
+            int end      = cmd->base_instance + cmd->num_instances;
+            while (instance < end)
+            {
+                int page       = instance / GLYPH_PAGE_SIZE;
+                int page_first = page * GLYPH_PAGE_SIZE;
+                int page_end   = xm_mini(end, page_first + GLYPH_PAGE_SIZE);
+                if (state.cull.on_gpu)
+                {
+                    // The number of visible glyphs is only known on the GPU, so every instance is drawn and
+                    // vs_pull collapses the ones past it. Culled glyphs cost an early out vertex shader, but no
+                    // fragments.
+                    vs_params.cull_range[0] = instance;
+                    vs_params.cull_range[1] = page_end;
+                    vs_params.cull_range[2] = page_first;
+                    sg_apply_uniforms(UB_vs_params, &SG_RANGE(vs_params));
+                    sg_apply_bindings(&(sg_bindings){
+                        .views =
+                            {
+                                [VIEW_band_tex]     = slug_band_texture(cmd->font)->tex_view,
+                                [VIEW_curve_tex]    = slug_curve_texture(cmd->font)->tex_view,
+                                [VIEW_glyph_page]   = state.page_views[page],
+                                [VIEW_cull_prefix]  = state.cull.prefix_view,
+                                [VIEW_cull_visible] = state.cull.visible_view,
+                            },
+                        .samplers[SMP_point_sampler] = state.smp,
+                    });
+                    sg_draw(0, 6, page_end - instance);
+                }
+                else
+                {
+                    // draw each run of consecutive glyphs that passed straight from the page
+                    int visible     = cull_prefix[instance];
+                    int end_visible = cull_prefix[page_end];
+                    while (visible < end_visible)
                     {
-                        [VIEW_band_tex]  = cmd->band_tex_view,
-                        [VIEW_curve_tex] = cmd->curve_tex_view,
-                    },
-                .samplers[SMP_point_sampler] = state.smp,
-            });
-            sg_draw(0, 6, cmd->num_instances);
+                        int run_first = cull_visible[visible];
+                        int run_count = 1;
+                        while (((visible + run_count) < end_visible) &&
+                               (cull_visible[visible + run_count] == (run_first + run_count)))
+                        {
+                            run_count++;
+                        }
+                        sg_apply_bindings(&(sg_bindings){
+                            .vertex_buffers[0]        = state.pages[page],
+                            .vertex_buffer_offsets[0] = (run_first - page_first) * sizeof(glyph_vertex_t),
+                            .views =
+                                {
+                                    [VIEW_band_tex]  = slug_band_texture(cmd->font)->tex_view,
+                                    [VIEW_curve_tex] = slug_curve_texture(cmd->font)->tex_view,
+                                },
+                            .samplers[SMP_point_sampler] = state.smp,
+                        });
+                        sg_draw(0, 6, run_count);
+                        visible += run_count;
+                    }
+                }
+                instance = page_end;
+            }
         }
     }
     sg_end_pass();
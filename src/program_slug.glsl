@@ -1,26 +1,84 @@
-@vs vs
+@block glyph_vs
 layout(binding=0) uniform vs_params {
     vec4 xform; // xy = scale, zw = translate
+    int compact_curves; // curve texels are RGBA16 snorm relative to the glyph bbox
+    ivec4 cull_range; // vs_pull only: x = first instance drawn, y = one past the last, z = first instance of the page
 };
 
-in vec4 draw_rect;          // xy = screen position (pixels), zw = screen size (pixels)
-in vec4 glyph_bbox;         // xy = min corner (glyph space), zw = max corner (glyph space)
-in vec4 in_band_transform;  // xy = band_scale, zw = band_offset
-in ivec4 in_glyph_params;   // x = glyph_loc_x, y = glyph_loc_y, z = max_band_x, w = max_band_y
-in vec4 in_text_color;      // RGBA
 out vec2 glyph_pos;         // fragment position in glyph space
 flat out vec4 band_transform;
 flat out ivec4 glyph_params;
 flat out vec4 text_color;
+flat out vec4 curve_transform; // xy = offset, zw = scale
 
-void main(){
+void emit_glyph(vec4 rect, vec4 bbox, vec4 in_transform, ivec4 in_params, vec4 in_color) {
     vec2 quad_pos = vec2(gl_VertexIndex & 1, (gl_VertexIndex>>1) & 1);
-    vec2 screen_pos = draw_rect.xy + quad_pos * draw_rect.zw;
+    vec2 screen_pos = rect.xy + quad_pos * rect.zw;
     gl_Position = vec4(screen_pos * xform.xy + xform.zw, 0.0, 1.0);
-    glyph_pos = mix(glyph_bbox.xy, glyph_bbox.zw, quad_pos);
-    band_transform = in_band_transform;
-    glyph_params = in_glyph_params;
-    text_color = in_text_color;
+    glyph_pos = mix(bbox.xy, bbox.zw, quad_pos);
+    band_transform = in_transform;
+    glyph_params = in_params;
+    text_color = in_color;
+    if (compact_curves != 0) {
+        curve_transform = vec4((bbox.xy + bbox.zw) * 0.5, (bbox.zw - bbox.xy) * 0.5);
+    } else {
+        curve_transform = vec4(0.0, 0.0, 1.0, 1.0);
+    }
+}
+@end
+
+@vs vs
+@include_block glyph_vs
+
+in vec4 draw_rect;          // xy = screen position (pixels), zw = screen size (pixels)
+in vec4 glyph_bbox;         // xy = min corner (glyph space), zw = max corner (glyph space)
+in vec4 in_band_transform;  // xy = band_scale, zw = band_offset
+in ivec4 in_glyph_params;   // x = glyph_loc_x, y = glyph_loc_y, z = max_band_x, w = max_band_y
+in vec4 in_text_color;      // RGBA
+
+void main(){
+    emit_glyph(draw_rect, glyph_bbox, in_band_transform, in_glyph_params, in_text_color);
+}
+@end
+
+// Draws the glyphs that the cull passes kept. Instances are pulled from the glyph page as raw words, as the
+// instance attributes can't be indexed. Instances past the number of visible glyphs collapse to a point.
+@vs vs_pull
+@include_block glyph_vs
+
+struct glyph_word { uint bits; };
+layout(binding=2) readonly buffer glyph_page {
+    glyph_word page_words[]; // glyph_vertex_t, 15 words each
+};
+struct cull_index { int value; };
+layout(binding=3) readonly buffer cull_prefix {
+    cull_index prefix[]; // visible instances before each instance of the glyph stream
+};
+layout(binding=4) readonly buffer cull_visible {
+    cull_index visible[]; // glyph stream instances that passed, in order
+};
+
+vec4 load_vec4(int word) {
+    return uintBitsToFloat(uvec4(
+        page_words[word].bits, page_words[word + 1].bits, page_words[word + 2].bits, page_words[word + 3].bits));
+}
+
+void main(){
+    int first_visible = prefix[cull_range.x].value;
+    int num_visible = prefix[cull_range.y].value - first_visible;
+    if (gl_InstanceIndex >= num_visible) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+    int word = (visible[first_visible + gl_InstanceIndex].value - cull_range.z) * 15;
+    int params_01 = int(page_words[word + 12].bits);
+    int params_23 = int(page_words[word + 13].bits);
+    emit_glyph(
+        load_vec4(word),
+        load_vec4(word + 4),
+        load_vec4(word + 8),
+        ivec4((params_01 << 16) >> 16, params_01 >> 16, (params_23 << 16) >> 16, params_23 >> 16),
+        unpackUnorm4x8(page_words[word + 14].bits));
 }
 @end
 
@@ -36,6 +94,7 @@ in vec2 glyph_pos;
 flat in vec4 band_transform;
 flat in ivec4 glyph_params;
 flat in vec4 text_color;
+flat in vec4 curve_transform;
 out vec4 frag_color;
 
 ivec2 bandLoc(ivec2 base, int offset) {
@@ -44,6 +103,14 @@ ivec2 bandLoc(ivec2 base, int offset) {
     pos.x &= 4095;
     return pos;
 }
+vec4 fetchCurvePoints01(ivec2 coord) {
+    vec4 texel = texelFetch(sampler2D(curve_tex, point_sampler), coord, 0);
+    return texel * curve_transform.zwzw + curve_transform.xyxy;
+}
+vec2 fetchCurvePoint2(ivec2 coord) {
+    vec2 texel = texelFetch(sampler2D(curve_tex, point_sampler), coord, 0).xy;
+    return texel * curve_transform.zw + curve_transform.xy;
+}
 uint calcRootCode(float y1, float y2, float y3) {
     uint s1 = floatBitsToUint(y1) >> 31u;
     uint s2 = floatBitsToUint(y2) >> 30u;
@@ -102,11 +169,9 @@ void main() {
             ivec2 entry_coord = bandLoc(entry_list_start, i);
             uvec2 band_entry = texelFetch(usampler2D(band_tex, point_sampler), entry_coord, 0).xy;
             ivec2 curve_tex_coord = ivec2(band_entry.x, band_entry.y);
-            vec4 points_01 = texelFetch(sampler2D(curve_tex, point_sampler), curve_tex_coord, 0)
-                            - vec4(glyph_pos, glyph_pos);
+            vec4 points_01 = fetchCurvePoints01(curve_tex_coord) - vec4(glyph_pos, glyph_pos);
             ivec2 next_tex_coord = bandLoc(curve_tex_coord, 1);
-            vec2 point_2 = texelFetch(sampler2D(curve_tex, point_sampler), next_tex_coord, 0).xy
-                          - glyph_pos;
+            vec2 point_2 = fetchCurvePoint2(next_tex_coord) - glyph_pos;
             if (max(max(points_01.x, points_01.z), point_2.x) * glyph_units_per_pixel.x < -0.5) break;
             uint root_mask = calcRootCode(points_01.y, points_01.w, point_2.y);
             if (root_mask != 0u) {
@@ -134,11 +199,9 @@ void main() {
             ivec2 entry_coord = bandLoc(entry_list_start, i);
             uvec2 band_entry = texelFetch(usampler2D(band_tex, point_sampler), entry_coord, 0).xy;
             ivec2 curve_tex_coord = ivec2(band_entry.x, band_entry.y);
-            vec4 points_01 = texelFetch(sampler2D(curve_tex, point_sampler), curve_tex_coord, 0)
-                            - vec4(glyph_pos, glyph_pos);
+            vec4 points_01 = fetchCurvePoints01(curve_tex_coord) - vec4(glyph_pos, glyph_pos);
             ivec2 next_tex_coord = bandLoc(curve_tex_coord, 1);
-            vec2 point_2 = texelFetch(sampler2D(curve_tex, point_sampler), next_tex_coord, 0).xy
-                          - glyph_pos;
+            vec2 point_2 = fetchCurvePoint2(next_tex_coord) - glyph_pos;
             if (max(max(points_01.y, points_01.w), point_2.y) * glyph_units_per_pixel.y < -0.5) break;
             uint root_mask = calcRootCode(points_01.x, points_01.z, point_2.x);
             if (root_mask != 0u) {
@@ -165,4 +228,108 @@ void main() {
 }
 @end
 
+@block cull_cs
+layout(binding=0) uniform cs_cull_params {
+    vec4 cull_rect; // xy = min corner, zw = max corner of the visible area in screen pixels
+    ivec4 cull_page; // x = first instance of the page, y = instances in the page, z = instances in the glyph stream
+};
+
+struct cull_glyph_word { uint bits; };
+layout(binding=0) readonly buffer cull_glyphs {
+    cull_glyph_word glyph_words[]; // glyph_vertex_t, 15 words each
+};
+
+// Must match cull_glyph() in program_slug_cull.h
+bool glyph_visible(int instance) {
+    int word = instance * 15;
+    vec2 pos = uintBitsToFloat(uvec2(glyph_words[word].bits, glyph_words[word + 1].bits));
+    vec2 size = uintBitsToFloat(uvec2(glyph_words[word + 2].bits, glyph_words[word + 3].bits));
+    vec2 lo = min(pos, pos + size);
+    vec2 hi = max(pos, pos + size);
+    return all(lessThanEqual(lo, cull_rect.zw)) && all(greaterThanEqual(hi, cull_rect.xy));
+}
+@end
+
+// Counts the visible glyphs of each group of 64 instances. Dispatched once per glyph page.
+@cs cs_cull_count
+@include_block cull_cs
+
+struct cull_count { int value; };
+layout(binding=1) buffer cull_counts_out {
+    cull_count counts_out[];
+};
+
+shared int group_flags[64];
+
+layout(local_size_x = 64) in;
+
+void main() {
+    int local = int(gl_LocalInvocationIndex);
+    int instance = int(gl_GlobalInvocationID.x);
+    group_flags[local] = ((instance < cull_page.y) && glyph_visible(instance)) ? 1 : 0;
+    barrier();
+    if (local == 0) {
+        int num_visible = 0;
+        for (int i = 0; i < 64; i++) {
+            num_visible += group_flags[i];
+        }
+        counts_out[(cull_page.x >> 6) + int(gl_WorkGroupID.x)].value = num_visible;
+    }
+}
+@end
+
+// Writes the visible instances in stream order, so overlapping glyphs like COLR layers keep their paint order.
+// Each group starts after the visible glyphs of every group before it, which the count pass has summed per group.
+@cs cs_cull_compact
+@include_block cull_cs
+
+struct cull_count { int value; };
+layout(binding=1) readonly buffer cull_counts {
+    cull_count counts[];
+};
+layout(binding=2) buffer cull_prefix_out {
+    cull_count prefix_out[];
+};
+layout(binding=3) buffer cull_visible_out {
+    cull_count visible_out[];
+};
+
+shared int group_flags[64];
+shared int group_first;
+
+layout(local_size_x = 64) in;
+
+void main() {
+    int local = int(gl_LocalInvocationIndex);
+    int instance = int(gl_GlobalInvocationID.x);
+    group_flags[local] = ((instance < cull_page.y) && glyph_visible(instance)) ? 1 : 0;
+    if (local == 0) {
+        int first = 0;
+        int group = (cull_page.x >> 6) + int(gl_WorkGroupID.x);
+        for (int i = 0; i < group; i++) {
+            first += counts[i].value;
+        }
+        group_first = first;
+    }
+    barrier();
+    if (instance < cull_page.y) {
+        int prefix = group_first;
+        for (int i = 0; i < local; i++) {
+            prefix += group_flags[i];
+        }
+        int stream_instance = cull_page.x + instance;
+        prefix_out[stream_instance].value = prefix;
+        if (group_flags[local] != 0) {
+            visible_out[prefix].value = stream_instance;
+        }
+        if (stream_instance == cull_page.z - 1) {
+            prefix_out[cull_page.z].value = prefix + group_flags[local];
+        }
+    }
+}
+@end
+
 @program slug vs fs
+@program slug_pull vs_pull fs
+@program cull_count cs_cull_count
+@program cull_compact cs_cull_compact
@@ -1,83 +1,68 @@
 //------------------------------------------------------------------------------
 //  program_slug2.c
 //
-//  Self-contained demo of using the Slug vector-fill algorithm (see program_slug.c,
-//  https://terathon.com/blog/decade-slug.html) to render a plain vector shape instead of text.
+//  Demo of using the Slug vector-fill algorithm (see program_slug.c, https://terathon.com/blog/decade-slug.html) to
+//  render plain vector shapes instead of text.
 //
 //  Slug's GPU-side algorithm (banded curve lookup + dual-axis winding-number raycast, see program_slug2.glsl) has no
-//  idea it's rendering glyphs - it just fills a closed contour of quadratic Bezier curves. The only font-specific part
-//  of the original port (src/slugutil.c) is the CPU-side step that turns a TrueType outline into that contour
-//  representation via stb_truetype. This file replaces that step with a much simpler one: it turns a plain array of 2D
-//  points (`points` below) into the same curve/band data. Straight edges become "degenerate" quadratic curves whose
-//  control point is the edge's midpoint - exactly what slugutil.c already does for TrueType line segments (see its
-//  `vline` case). Everything downstream (band building, curve/band texture packing, the vertex layout, the pipeline,
-//  the shader) is carried over unchanged in spirit.
+//  idea it's rendering glyphs - it just fills closed contours of quadratic Bezier curves. slugutil.c's shape builder
+//  turns path commands (lines, quadratics, cubics, any number of contours) into the same curve/band data it builds
+//  for TrueType outlines, and packs every shape into one shared pair of textures. All shapes are then drawn with a
+//  single instanced draw.
 //------------------------------------------------------------------------------
 #include "common.h"
 
+#include "slugutil.h"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
 #include "program_slug2.glsl.h"
 
 #include <xhl/array.h>
 #include <xhl/debug.h>
-#include <xhl/vector.h>
 
 #include <math.h>
-#include <stdlib.h>
 
-// A single closed contour in normalised 0-1 space: consecutive points form straight edges, and the last point repeats
-// the first to close the loop. Swap this out (or extend the build code to handle more than one contour, eg. for shapes
-// with holes) to draw a different shape.
-static const xvec2f points[] = {
-    {0.5f, 0.5f},
-    {0.8f, 0.8f},
-    {0.3f, 0.8f},
-    {0.5f, 0.5f},
+// Shapes are built in a 100x100 design space with y pointing up, which is one em
+#define SHAPE_DESIGN_SIZE (100.0f)
+#define NUM_SHAPES        (3)
+#define MAX_INSTANCES     (64)
+
+// A triangle given as one closed nanosvg style path: x0,y0 followed by cx1,cy1,cx2,cy2,x1,y1 per cubic. Straight
+// cubics like these come out as single degenerate quadratics.
+static const float triangle_path[] = {
+    50.0f, 10.0f,                             // start
+    60.0f, 25.0f, 80.0f, 55.0f, 90.0f, 70.0f, // cubic to the right corner
+    70.0f, 70.0f, 30.0f, 70.0f, 10.0f, 70.0f, // cubic to the left corner
+    20.0f, 55.0f, 40.0f, 25.0f, 50.0f, 10.0f, // cubic back to the start
 };
 
-#define SHAPE_TEX_WIDTH (4096) // must match the 12-bit shift/mask baked into program_slug2.glsl's bandLoc()
-#define MAX_BANDS       (16)   // max bands per axis, same cap the original algorithm uses
-
-typedef struct
-{
-    uint16_t x, y;
-} u16vec2_t;
-
-// One quadratic bezier curve: p[0] = start, p[1] = control, p[2] = end.
-// A straight edge is a "degenerate" curve with control = midpoint.
-typedef struct
-{
-    xvec2f   p[3];
-    uint16_t texture[2]; // filled in during packing: texel coords in curve_tex
-} shape_curve_t;
-
-typedef struct
-{
-    int   curve_index;
-    float sort_key;
-} band_entry_t;
-
-typedef struct
-{
-    float x0, y0, x1, y1;
-} bbox_t;
+// A flat NSVGimage2 as printed by parse_svg() in program_nanosvg.c
+// clang-format off
+static const unsigned long long SVG_DATA_Retrig_icon[] = {
+0x41E0000041E00000,4294968272,8589934594,56,1958505086976,3985729651168,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,4287728258,
+0,0,0,0,0,0,0,0,0,0,0x3F8000003F800000,0x4080000000000000,0,0,0,0,562954248388608,1,4287728258,0,0,0,0,0,0,0,0,0,0,0x3F8000003F800000,
+0x4080000000000000,0,0,0,0,8589934592,0,4295819264,4297785370,0x40C0000040C00000,0x40C0000040D55555,0x40C0000040EAAAAB,0x40C0000041000000,
+0x4135555641000000,0x4185555541000000,0x41B0000041000000,0x41B0000040EAAAAB,0x41B0000040D55555,0x41B0000040C00000,0x4185555540C00000,
+0x4135555640C00000,0x40C0000040C00000,0x4190000041880000,0x41900000419E1759,0x417C2EB241B00000,0x4150000041B00000,0x4123D14E41B00000,
+0x41000000419E1759,0x4100000041880000,0x41000000417AAAAB,0x4100000041655555,0x4100000041500000,0x410AAAAB41500000,0x4115555541500000,
+0x4120000041500000,0x4120000041655555,0x41200000417AAAAB,0x4120000041880000,0x4120000041954155,0x41357D5641A00000,0x4150000041A00000,
+0x416A82AA41A00000,0x4180000041954155,0x4180000041880000,0x418000004182AAAB,0x41800000417AAAAB,0x4180000041700000,0x4170000041700000,
+0x4160000041700000,0x4150000041700000,0x41655555415AAAAB,0x417AAAAB41455555,0x4188000041300000,0x4192AAAB41455555,0x419D5555415AAAAB,
+0x41A8000041700000,0x41A0000041700000,0x4198000041700000,0x4190000041700000,0x41900000417AAAAB,0x419000004182AAAB,0x4190000041880000,
+0x4190000041880000,0x4190000041880000,0x4190000041880000,
+};
+// clang-format on
 
-// Intermediate state while building the shape's curve/band data.
-typedef struct
-{
-    shape_curve_t* curves; // xhl/array
-    bbox_t         bbox;
-    band_entry_t** horizontal_bands; // xhl/array of xhl/array
-    band_entry_t** vertical_bands;   // xhl/array of xhl/array
-    xvec2f         band_scale;
-    xvec2f         band_offset;
-} shape_build_t;
+static const int icon_sizes[] = {16, 24, 32, 48, 64, 96};
 
 // Per-instance vertex data uploaded to the GPU.
 typedef struct
 {
-    xvec4f   draw_rect;       // xy = screen pos (px), zw = screen size (px)
-    xvec4f   shape_bbox;      // xy = min corner, zw = max corner (shape build space)
-    xvec4f   band_transform;  // xy = band_scale, zw = band_offset
+    vec4_t   draw_rect;       // xy = screen pos (px), zw = screen size (px)
+    vec4_t   shape_bbox;      // xy = min corner, zw = max corner (shape build space)
+    vec4_t   band_transform;  // xy = band_scale, zw = band_offset
     int16_t  shape_params[4]; // xy = shape_loc, zw = max_band_x/y
     uint32_t color;
 } shape_vertex_t;
@@ -89,24 +74,14 @@ static struct
     sg_buffer   buf;
     sg_pipeline pip;
     sg_sampler  smp;
-    sg_image    curve_img;
-    sg_view     curve_tex_view;
-    sg_image    band_img;
-    sg_view     band_tex_view;
-    struct
-    {
-        bbox_t bbox;
-        float  max_band_x;
-        float  max_band_y;
-        xvec2f band_scale;
-        xvec2f band_offset;
-        int    shape_loc[2];
-    } shape;
+    // program_slug2.glsl reads curves as plain floats, so the collection doesn't use compact curves
+    slug_font_collection_t collection;
+    slug_glyph_t           shapes[NUM_SHAPES];
+    uint32_t               colors[NUM_SHAPES];
+    slug_icon_t            icon;
 } state;
 
-static float minf(float a, float b) { return a < b ? a : b; }
-static float maxf(float a, float b) { return a > b ? a : b; }
-static int   clampi(int val, int lo, int hi) { return val < lo ? lo : (val > hi ? hi : val); }
+static shape_vertex_t instances[MAX_INSTANCES];
 
 static uint32_t pack_color(float r, float g, float b, float a)
 {
@@ -117,252 +92,90 @@ static uint32_t pack_color(float r, float g, float b, float a)
     return (ua << 24) | (ub << 16) | (ug << 8) | ur;
 }
 
-// Turn the point list into a single contour of quadratic curves and compute
-// its bounding box. Mirrors slugutil.c's handling of TrueType's `vline` verts.
-static void build_curves(const xvec2f* pts, int count, shape_build_t* out)
-{
-    bbox_t bbox = {pts[0].x, pts[0].y, pts[0].x, pts[0].y};
-    for (int i = 1; i < count; i++)
-    {
-        bbox.x0 = minf(bbox.x0, pts[i].x);
-        bbox.y0 = minf(bbox.y0, pts[i].y);
-        bbox.x1 = maxf(bbox.x1, pts[i].x);
-        bbox.y1 = maxf(bbox.y1, pts[i].y);
-    }
-    out->bbox = bbox;
-
-    for (int i = 0; i < count - 1; i++)
-    {
-        xvec2f prev = pts[i];
-        xvec2f cur  = pts[i + 1];
-        xvec2f mid  = {(prev.x + cur.x) * 0.5f, (prev.y + cur.y) * 0.5f};
-        xarr_push(out->curves, ((shape_curve_t){.p = {prev, mid, cur}}));
-    }
-}
-
-static int band_cmp(const void* a, const void* b)
-{
-    const band_entry_t* pa = (const band_entry_t*)a;
-    const band_entry_t* pb = (const band_entry_t*)b;
-    // NOTE: inverted sort-order is not a bug
-    if (pa->sort_key > pb->sort_key)
-    {
-        return -1;
-    }
-    else if (pa->sort_key < pb->sort_key)
-    {
-        return 1;
-    }
-    else
-    {
-        return 0;
-    }
-}
-
-// Buckets curves into horizontal/vertical bands so the fragment shader only
-// has to test the handful of curves that can possibly cross its scanline,
-// instead of every curve in the shape.
-static void build_bands(shape_build_t* shape)
+// A circle made of four cubics, counter-clockwise unless reversed
+static void add_circle(slug_shape_builder_t* shape, float cx, float cy, float r, bool reverse)
 {
-    int num_curves = (int)xarr_len(shape->curves);
-    xassert(num_curves > 0);
-
-    float band_width  = maxf(shape->bbox.x1 - shape->bbox.x0, 1.0f);
-    float band_height = maxf(shape->bbox.y1 - shape->bbox.y0, 1.0f);
-    int   num_bands_h = clampi(num_curves, 1, MAX_BANDS);
-    int   num_bands_v = clampi(num_curves, 1, MAX_BANDS);
-
-    xarr_setlen(shape->horizontal_bands, num_bands_h);
-    xarr_setlen(shape->vertical_bands, num_bands_v);
-    for (int i = 0; i < num_bands_h; i++)
-    {
-        shape->horizontal_bands[i] = 0;
-    }
-    for (int i = 0; i < num_bands_v; i++)
-    {
-        shape->vertical_bands[i] = 0;
-    }
-
-    shape->band_scale  = (xvec2f){(float)num_bands_v / band_width, (float)num_bands_h / band_height};
-    shape->band_offset = (xvec2f){-shape->bbox.x0 * shape->band_scale.x, -shape->bbox.y0 * shape->band_scale.y};
-
-    float h_band_size = band_height / (float)num_bands_h;
-    float v_band_size = band_width / (float)num_bands_v;
-    float h_pad       = h_band_size * 0.5f;
-    float v_pad       = v_band_size * 0.5f;
-
-    for (int ci = 0; ci < num_curves; ci++)
-    {
-        shape_curve_t* curve = &shape->curves[ci];
-        float          y_min = minf(minf(curve->p[0].y, curve->p[1].y), curve->p[2].y);
-        float          y_max = maxf(maxf(curve->p[0].y, curve->p[1].y), curve->p[2].y);
-        float          x_min = minf(minf(curve->p[0].x, curve->p[1].x), curve->p[2].x);
-        float          x_max = maxf(maxf(curve->p[0].x, curve->p[1].x), curve->p[2].x);
-
-        int band_first = clampi((int)floorf((y_min - h_pad - shape->bbox.y0) / h_band_size), 0, num_bands_h - 1);
-        int band_last  = clampi((int)floorf((y_max + h_pad - shape->bbox.y0) / h_band_size), 0, num_bands_h - 1);
-        for (int i = band_first; i <= band_last; i++)
-        {
-            xarr_push(shape->horizontal_bands[i], ((band_entry_t){.curve_index = ci, .sort_key = x_max}));
-        }
-
-        band_first = clampi((int)floorf((x_min - v_pad - shape->bbox.x0) / v_band_size), 0, num_bands_v - 1);
-        band_last  = clampi((int)floorf((x_max + v_pad - shape->bbox.x0) / v_band_size), 0, num_bands_v - 1);
-        for (int i = band_first; i <= band_last; i++)
-        {
-            xarr_push(shape->vertical_bands[i], ((band_entry_t){.curve_index = ci, .sort_key = y_max}));
-        }
-    }
-
-    for (int i = 0; i < num_bands_h; i++)
-    {
-        if (shape->horizontal_bands[i])
-        {
-            qsort(shape->horizontal_bands[i], xarr_len(shape->horizontal_bands[i]), sizeof(band_entry_t), band_cmp);
-        }
-    }
-    for (int i = 0; i < num_bands_v; i++)
-    {
-        if (shape->vertical_bands[i])
-        {
-            qsort(shape->vertical_bands[i], xarr_len(shape->vertical_bands[i]), sizeof(band_entry_t), band_cmp);
-        }
-    }
+    const float k = 0.5522847f * r; // control point distance for a quarter circle
+    const float d = reverse ? -1.0f : 1.0f;
+    slug_shape_move_to(shape, cx + r, cy);
+    slug_shape_cubic_to(shape, cx + r, cy + d * k, cx + k, cy + d * r, cx, cy + d * r);
+    slug_shape_cubic_to(shape, cx - k, cy + d * r, cx - r, cy + d * k, cx - r, cy);
+    slug_shape_cubic_to(shape, cx - r, cy - d * k, cx - k, cy - d * r, cx, cy - d * r);
+    slug_shape_cubic_to(shape, cx + k, cy - d * r, cx + r, cy - d * k, cx + r, cy);
+    slug_shape_close(shape);
 }
 
-static void
-write_band_set(band_entry_t** bands, shape_curve_t* curves, u16vec2_t* pixels, int header_offset, int* write_offset)
+static void build_shapes(void)
 {
-    // Write headers: each band stores (count, data_offset) where data_offset is relative to the shape's texture origin,
-    // matching how the shader indexes into the texture via bandLoc().
-    int data_offset = *write_offset;
-    for (int band_index = 0; band_index < (int)xarr_len(bands); band_index++)
-    {
-        band_entry_t* band                  = bands[band_index];
-        pixels[header_offset + band_index]  = (u16vec2_t){(uint16_t)xarr_len(band), (uint16_t)data_offset};
-        data_offset                        += (int)xarr_len(band);
-    }
-    // Write curve references at the offsets declared above.
-    data_offset = *write_offset;
-    for (int band_index = 0; band_index < (int)xarr_len(bands); band_index++)
-    {
-        band_entry_t* band = bands[band_index];
-        for (int i = 0; i < (int)xarr_len(band); i++)
-        {
-            shape_curve_t* curve  = &curves[band[i].curve_index];
-            pixels[data_offset++] = (u16vec2_t){curve->texture[0], curve->texture[1]};
-        }
-    }
-    *write_offset = data_offset;
+    slug_init_collection(&state.collection, &(slug_collection_desc_t){0});
+    slug_shape_builder_t shape;
+
+    // A ring: the hole winds the other way, so the nonzero fill leaves it empty
+    slug_begin_shape(&shape, &(slug_shape_desc_t){.units_per_em = SHAPE_DESIGN_SIZE});
+    add_circle(&shape, 50.0f, 50.0f, 45.0f, false);
+    add_circle(&shape, 50.0f, 50.0f, 25.0f, true);
+    slug_end_shape(&shape, &state.collection, &state.shapes[0]);
+    state.colors[0] = pack_color(0.95f, 0.55f, 0.2f, 1.0f);
+
+    // A frame with rounded corners around a square hole, the contours are left open and closed by the builder
+    slug_begin_shape(&shape, &(slug_shape_desc_t){.units_per_em = SHAPE_DESIGN_SIZE});
+    slug_shape_move_to(&shape, 20.0f, 5.0f);
+    slug_shape_line_to(&shape, 80.0f, 5.0f);
+    slug_shape_quad_to(&shape, 95.0f, 5.0f, 95.0f, 20.0f);
+    slug_shape_line_to(&shape, 95.0f, 80.0f);
+    slug_shape_quad_to(&shape, 95.0f, 95.0f, 80.0f, 95.0f);
+    slug_shape_line_to(&shape, 20.0f, 95.0f);
+    slug_shape_quad_to(&shape, 5.0f, 95.0f, 5.0f, 80.0f);
+    slug_shape_line_to(&shape, 5.0f, 20.0f);
+    slug_shape_quad_to(&shape, 5.0f, 5.0f, 20.0f, 5.0f);
+    slug_shape_move_to(&shape, 30.0f, 30.0f);
+    slug_shape_line_to(&shape, 30.0f, 70.0f);
+    slug_shape_line_to(&shape, 70.0f, 70.0f);
+    slug_shape_line_to(&shape, 70.0f, 30.0f);
+    slug_end_shape(&shape, &state.collection, &state.shapes[1]);
+    state.colors[1] = pack_color(0.3f, 0.7f, 0.95f, 1.0f);
+
+    slug_begin_shape(&shape, &(slug_shape_desc_t){.units_per_em = SHAPE_DESIGN_SIZE});
+    slug_shape_add_cubic_path(&shape, triangle_path, (int)ARRLEN(triangle_path) / 2);
+    slug_end_shape(&shape, &state.collection, &state.shapes[2]);
+    state.colors[2] = pack_color(0.5f, 0.9f, 0.4f, 1.0f);
+
+    slug_bake_svg_icon(
+        &state.collection,
+        (const struct NSVGimage2*)SVG_DATA_Retrig_icon,
+        &(slug_shape_desc_t){0},
+        &state.icon);
 }
 
-// Packs the shape's curves and band lookup tables into two textures (curve_tex / band_tex) and uploads them, exactly
-// what the shader in program_slug2.glsl expects to sample from. Since there's only ever one shape here, it always
-// starts at texture origin (0, 0) - no multi-shape atlas packing needed.
-static void pack_textures(shape_build_t* shape)
+// Draws a shape with its em square's origin at x, y
+static int push_shape(int num_instances, const slug_glyph_t* shape, float x, float y, float px_per_em, uint32_t color)
 {
-    xvec4f*    curve_pixels = 0; // xhl/array
-    u16vec2_t* band_pixels  = 0; // xhl/array
-
-    // Curve texture: N curve entries + 1 trailing texel for the shared end point of the last curve (closing the
-    // contour).
-    int num_curves = (int)xarr_len(shape->curves);
-    int needed     = num_curves + 1;
-    xarr_setlen(curve_pixels, needed);
-    for (int i = 0; i < num_curves; i++)
-    {
-        shape_curve_t* curve = &shape->curves[i];
-        curve_pixels[i]      = (xvec4f){curve->p[0].x, curve->p[0].y, curve->p[1].x, curve->p[1].y};
-        curve->texture[0]    = (uint16_t)(i % SHAPE_TEX_WIDTH);
-        curve->texture[1]    = (uint16_t)(i / SHAPE_TEX_WIDTH);
-    }
-    shape_curve_t* last_curve = &shape->curves[num_curves - 1];
-    curve_pixels[num_curves]  = (xvec4f){last_curve->p[2].x, last_curve->p[2].y, 0.0f, 0.0f};
-
-    int curve_height = (needed + SHAPE_TEX_WIDTH - 1) / SHAPE_TEX_WIDTH;
-    xarr_setlen(curve_pixels, curve_height * SHAPE_TEX_WIDTH);
-    for (int i = needed; i < (int)xarr_len(curve_pixels); i++)
-    {
-        curve_pixels[i] = (xvec4f){0};
-    }
-
-    // Band texture: header entries (count, offset) for every band, followed by the curve-texel references each band's
-    // header points at.
-    int num_bands_h = (int)xarr_len(shape->horizontal_bands);
-    int num_bands_v = (int)xarr_len(shape->vertical_bands);
-    int header_size = num_bands_h + num_bands_v;
-
-    int total_entries = header_size;
-    for (int i = 0; i < num_bands_h; i++)
-    {
-        total_entries += (int)xarr_len(shape->horizontal_bands[i]);
-    }
-    for (int i = 0; i < num_bands_v; i++)
+    if (num_instances >= MAX_INSTANCES)
     {
-        total_entries += (int)xarr_len(shape->vertical_bands[i]);
+        return num_instances;
     }
-    xarr_setlen(band_pixels, total_entries);
-
-    int write_offset = header_size;
-    write_band_set(shape->horizontal_bands, shape->curves, band_pixels, 0, &write_offset);
-    write_band_set(shape->vertical_bands, shape->curves, band_pixels, num_bands_h, &write_offset);
-
-    int band_height = (total_entries + SHAPE_TEX_WIDTH - 1) / SHAPE_TEX_WIDTH;
-    xarr_setlen(band_pixels, band_height * SHAPE_TEX_WIDTH);
-    for (int i = total_entries; i < (int)xarr_len(band_pixels); i++)
-    {
-        band_pixels[i] = (u16vec2_t){0};
-    }
-
-    state.curve_img      = sg_make_image(&(sg_image_desc){
-             .width              = SHAPE_TEX_WIDTH,
-             .height             = curve_height,
-             .pixel_format       = SG_PIXELFORMAT_RGBA32F,
-             .data.mip_levels[0] = {.ptr = curve_pixels, .size = xarr_len(curve_pixels) * sizeof(xvec4f)},
-             .label              = "vecshape-curve-texture",
-    });
-    state.curve_tex_view = sg_make_view(&(sg_view_desc){.texture.image = state.curve_img});
-
-    state.band_img      = sg_make_image(&(sg_image_desc){
-             .width              = SHAPE_TEX_WIDTH,
-             .height             = band_height,
-             .pixel_format       = SG_PIXELFORMAT_RG16UI,
-             .data.mip_levels[0] = {.ptr = band_pixels, .size = xarr_len(band_pixels) * sizeof(u16vec2_t)},
-             .label              = "vecshape-band-texture",
-    });
-    state.band_tex_view = sg_make_view(&(sg_view_desc){.texture.image = state.band_img});
-
-    state.shape.shape_loc[0] = 0;
-    state.shape.shape_loc[1] = 0;
-
-    xarr_free(curve_pixels);
-    xarr_free(band_pixels);
-}
-
-static void build_shape(void)
-{
-    shape_build_t build = {0};
-    build_curves(points, (int)ARRLEN(points), &build);
-    build_bands(&build);
-    pack_textures(&build);
-
-    state.shape.bbox        = build.bbox;
-    state.shape.band_scale  = build.band_scale;
-    state.shape.band_offset = build.band_offset;
-    state.shape.max_band_x  = (float)(xarr_len(build.vertical_bands) - 1);
-    state.shape.max_band_y  = (float)(xarr_len(build.horizontal_bands) - 1);
+    slug_bbox_t bbox = shape->bbox;
 
-    xarr_free(build.curves);
-    for (int i = 0; i < (int)xarr_len(build.horizontal_bands); i++)
-    {
-        xarr_free(build.horizontal_bands[i]);
-    }
-    xarr_free(build.horizontal_bands);
-    for (int i = 0; i < (int)xarr_len(build.vertical_bands); i++)
-    {
-        xarr_free(build.vertical_bands[i]);
-    }
-    xarr_free(build.vertical_bands);
+    instances[num_instances] = (shape_vertex_t){
+        .draw_rect =
+            {
+                x + bbox.x0 * px_per_em,
+                y + bbox.y0 * px_per_em,
+                (bbox.x1 - bbox.x0) * px_per_em,
+                (bbox.y1 - bbox.y0) * px_per_em,
+            },
+        .shape_bbox     = {bbox.x0, bbox.y0, bbox.x1, bbox.y1},
+        .band_transform = {shape->band_scale.x, shape->band_scale.y, shape->band_offset.x, shape->band_offset.y},
+        .shape_params =
+            {
+                (int16_t)shape->glyph_loc[0],
+                (int16_t)shape->glyph_loc[1],
+                (int16_t)shape->max_band_x,
+                (int16_t)shape->max_band_y,
+            },
+        .color = color,
+    };
+    return num_instances + 1;
 }
 
 void program_setup()
@@ -371,10 +184,10 @@ void program_setup()
     state.height = APP_HEIGHT;
 
     // A stream-update buffer holding one shape_vertex_t per drawn shape, expanded 4x via hardware instancing with the 4
-    // corner vertex positions synthesized in the vertex shader. Only one shape is drawn here.
+    // corner vertex positions synthesized in the vertex shader.
     state.buf = sg_make_buffer(&(sg_buffer_desc){
         .usage.stream_update = true,
-        .size                = sizeof(shape_vertex_t),
+        .size                = sizeof(instances),
         .label               = "vecshape-instance-buffer",
     });
 
@@ -415,15 +228,13 @@ void program_setup()
         .label      = "vecshape-sampler",
     });
 
-    build_shape();
+    build_shapes();
 }
 
 void program_shutdown()
 {
-    sg_destroy_image(state.curve_img);
-    sg_destroy_view(state.curve_tex_view);
-    sg_destroy_image(state.band_img);
-    sg_destroy_view(state.band_tex_view);
+    slug_free_icon(&state.icon);
+    slug_destroy_collection(&state.collection);
 }
 
 void program_tick()
@@ -434,27 +245,31 @@ void program_tick()
         .xform = {sx, sy, -1.0f, -1.0f},
     };
 
-    // Points are normalised 0-1, so scale x by window width and y by window height directly - this is recomputed every
-    // tick, so resizing the window rescales the shape immediately.
-    bbox_t bbox = state.shape.bbox;
-    float  w    = (float)state.width;
-    float  h    = (float)state.height;
-
-    const shape_vertex_t vertex = {
-        .draw_rect  = {bbox.x0 * w, bbox.y0 * h, (bbox.x1 - bbox.x0) * w, (bbox.y1 - bbox.y0) * h},
-        .shape_bbox = {bbox.x0, bbox.y0, bbox.x1, bbox.y1},
-        .band_transform =
-            {state.shape.band_scale.x, state.shape.band_scale.y, state.shape.band_offset.x, state.shape.band_offset.y},
-        .shape_params =
-            {
-                (int16_t)state.shape.shape_loc[0],
-                (int16_t)state.shape.shape_loc[1],
-                (int16_t)state.shape.max_band_x,
-                (int16_t)state.shape.max_band_y,
-            },
-        .color = pack_color(0.95f, 0.55f, 0.2f, 1.0f),
-    };
-    sg_update_buffer(state.buf, &SG_RANGE(vertex));
+    // Shapes sit side by side in square cells along the top of the window, the icon is drawn at several sizes below
+    // them. This is recomputed every tick, so resizing the window rescales everything immediately.
+    slug_flush_collection(&state.collection);
+    float cell_size     = fminf((float)state.width / NUM_SHAPES, (float)state.height * 0.75f);
+    int   num_instances = 0;
+    for (int i = 0; i < NUM_SHAPES; i++)
+    {
+        float cell_x  = (float)i * cell_size;
+        float cell_y  = (float)state.height - cell_size;
+        num_instances = push_shape(num_instances, &state.shapes[i], cell_x, cell_y, cell_size, state.colors[i]);
+    }
+    float icon_x = 16.0f;
+    for (int i = 0; i < (int)ARRLEN(icon_sizes); i++)
+    {
+        // Like COLR glyphs, all layers go at the same position in order
+        float size = (float)icon_sizes[i];
+        for (int j = 0; j < xarr_len(state.icon.layers); j++)
+        {
+            const slug_icon_layer_t* layer = &state.icon.layers[j];
+            uint32_t color = pack_color(layer->color.x, layer->color.y, layer->color.z, layer->color.w);
+            num_instances  = push_shape(num_instances, &layer->shape, icon_x, 16.0f, size, color);
+        }
+        icon_x += size + 16.0f;
+    }
+    sg_update_buffer(state.buf, &(sg_range){instances, num_instances * sizeof(shape_vertex_t)});
 
     sg_begin_pass(&(sg_pass){
         .action    = {.colors[0] = {.load_action = SG_LOADACTION_CLEAR, .clear_value = {0.1f, 0.1f, 0.1f, 1.0f}}},
@@ -466,12 +281,12 @@ void program_tick()
         .vertex_buffers[0] = state.buf,
         .views =
             {
-                [VIEW_band_tex]  = state.band_tex_view,
-                [VIEW_curve_tex] = state.curve_tex_view,
+                [VIEW_band_tex]  = state.collection.band.tex_view,
+                [VIEW_curve_tex] = state.collection.curve.tex_view,
             },
         .samplers[SMP_point_sampler] = state.smp,
     });
-    sg_draw(0, 6, 1);
+    sg_draw(0, 6, num_instances);
     sg_end_pass();
 }
 
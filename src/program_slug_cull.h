@@ -0,0 +1,48 @@
+#pragma once
+// The glyph instance of program_slug.c and the CPU mirror of its cull passes, kept apart so tests can run them
+// without a window or GPU.
+#include "slugutil.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <xhl/maths.h>
+
+// per-glyph data in glyph buffer, expanded 4x via hardware-instancing
+typedef struct
+{
+    vec4_t   draw_rect;
+    vec4_t   glyph_bbox;
+    vec4_t   band_transform;
+    int16_t  glyph_params[4];
+    uint32_t color;
+} glyph_vertex_t;
+
+// Must match glyph_visible() in program_slug.glsl. cull_rect is the visible area in screen pixels, as min and max
+// corners, and a glyph passes if its draw rect touches it.
+static inline bool cull_glyph(const glyph_vertex_t* glyph, vec4_t cull_rect)
+{
+    float x0 = glyph->draw_rect.x;
+    float y0 = glyph->draw_rect.y;
+    float x1 = glyph->draw_rect.x + glyph->draw_rect.z;
+    float y1 = glyph->draw_rect.y + glyph->draw_rect.w;
+    return (xm_minf(x0, x1) <= cull_rect.z) && (xm_minf(y0, y1) <= cull_rect.w) && (xm_maxf(x0, x1) >= cull_rect.x) &&
+           (xm_maxf(y0, y1) >= cull_rect.y);
+}
+
+// CPU mirror of the cull passes. Fills the same lists the GPU does: prefix[i] is the number of visible glyphs before
+// instance i, prefix[num_glyphs] the total, and visible holds the instances that passed in stream order.
+static inline int
+cull_glyphs(const glyph_vertex_t* glyphs, int num_glyphs, vec4_t cull_rect, int* prefix, int* visible)
+{
+    int num_visible = 0;
+    for (int i = 0; i < num_glyphs; i++)
+    {
+        prefix[i] = num_visible;
+        if (cull_glyph(&glyphs[i], cull_rect))
+        {
+            visible[num_visible++] = i;
+        }
+    }
+    prefix[num_glyphs] = num_visible;
+    return num_visible;
+}
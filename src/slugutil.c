@@ -2,184 +2,1535 @@
 //  Slug utility functions.
 //  NOTE: memory management during font loading is *really* unoptimized.
 //
-//  PS: should the font processing actually be moved into an offline tool?
+//  PS: slug_bake_font_cache() lets the font processing run in an offline tool.
 //------------------------------------------------------------------------------
 
 #include "slugutil.h"
+#include "nanosvg3.h"
 #include "xhl/array.h"
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SLUG_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SLUG_NEON
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define SLUG_MAX_BUILD_THREADS (32)
+// Glyphs are handed out to build threads in batches to keep contention on the shared counter low
+#define SLUG_BUILD_BATCH (16)
+
+// How many fewer curves a pixel has to test for one more band texel to be worth storing
+#define SLUG_BAND_TEXEL_COST (0.01f)
+// Lazy fonts start with this many texture rows and double whenever they run out
+#define SLUG_LAZY_MIN_ROWS (4)
+// The codepoint lookup is split into pages of 256 codepoints, only pages with mapped codepoints are stored
+#define SLUG_CMAP_PAGE_BITS (8)
+#define SLUG_CMAP_PAGE_SIZE (1 << SLUG_CMAP_PAGE_BITS)
+#define SLUG_CMAP_NUM_PAGES (0x110000 >> SLUG_CMAP_PAGE_BITS)
 
 typedef struct
 {
-    uint16_t x, y;
-} u16vec2_t;
+    vec4_t*           curve_pixels; // managed by xhl/array.h
+    int               curve_height;
+    bool              compact_curves; // curve_pixels hold bbox relative coordinates in [-1, 1]
+    u16vec2_t*        band_pixels;    // managed by xhl/array.h
+    int               band_height;
+    slug_font_stats_t stats;
+} pack_textures_t;
+
+static bool parse_colr_v0(slug_font_t* font, const slug_range_t* data);
+static bool parse_cpal(slug_font_t* font, const slug_range_t* data);
+static void build_cmap(slug_font_t* font, const slug_range_t* data);
+static void init_build_glyph(
+    const stbtt_fontinfo* info,
+    int                   glyph_index,
+    float                 scale,
+    bool                  compact_curves,
+    slug_glyph_build_t*   out);
+static void build_bands(slug_glyph_build_t* glyph);
+static void free_build_glyph(slug_glyph_build_t* glyph);
+static void         pack_textures(pack_textures_t* res, slug_glyph_build_t* glyphs, int num_glyphs);
+static void         finalize_textures(pack_textures_t* res);
+static void         pack_glyph(pack_textures_t* res, slug_glyph_build_t* glyph);
+static slug_glyph_t make_glyph(const slug_glyph_build_t* glyph);
+static void         set_glyph_lod(slug_glyph_t* out, const slug_glyph_build_t* lod);
+static void         build_lod_glyph(const slug_glyph_build_t* glyph, float lod_pixels_per_em, slug_glyph_build_t* out);
+static void build_glyphs_parallel(
+    const stbtt_fontinfo* info,
+    float                 em_scale,
+    bool                  compact_curves,
+    slug_glyph_build_t*   glyphs,
+    slug_glyph_build_t*   lod_glyphs,
+    float                 lod_pixels_per_em,
+    int                   num_threads);
+
+static int mini(int a, int b) { return a < b ? a : b; }
+
+static int maxi(int a, int b) { return a > b ? a : b; }
+
+static int clampi(int val, int minval, int maxval)
+{
+    if (val < minval)
+        return minval;
+    else if (val > maxval)
+        return maxval;
+    else
+        return val;
+}
+
+static float minf(float a, float b) { return a < b ? a : b; }
+
+static float maxf(float a, float b) { return a > b ? a : b; }
+
+static void make_glyph_resident(slug_font_t* font, int glyph_index)
+{
+    slug_glyph_build_t build_glyph;
+    init_build_glyph(&font->info, glyph_index, font->lazy.em_scale, font->compact_curves, &build_glyph);
+    build_bands(&build_glyph);
+
+    // Fonts in a collection pack straight into the collection's textures
+    slug_font_collection_t* collection   = font->collection;
+    vec4_t**                curve_pixels = collection ? &collection->curve_pixels : &font->lazy.curve_pixels;
+    u16vec2_t**             band_pixels  = collection ? &collection->band_pixels : &font->lazy.band_pixels;
+
+    pack_textures_t res = {
+        .curve_pixels   = *curve_pixels,
+        .band_pixels    = *band_pixels,
+        .compact_curves = font->compact_curves,
+        .stats          = font->stats,
+    };
+    pack_glyph(&res, &build_glyph);
+    *curve_pixels = res.curve_pixels;
+    *band_pixels  = res.band_pixels;
+    font->stats   = res.stats;
+
+    font->glyphs[glyph_index] = make_glyph(&build_glyph);
+
+    if (font->lod_pixels_per_em > 0.0f)
+    {
+        slug_glyph_build_t lod_glyph;
+        build_lod_glyph(&build_glyph, font->lod_pixels_per_em, &lod_glyph);
+        res.stats = font->lod_stats;
+        pack_glyph(&res, &lod_glyph);
+        *curve_pixels   = res.curve_pixels;
+        *band_pixels    = res.band_pixels;
+        font->lod_stats = res.stats;
+        set_glyph_lod(&font->glyphs[glyph_index], &lod_glyph);
+        free_build_glyph(&lod_glyph);
+    }
+
+    font->lazy.resident[glyph_index] = 1;
+    font->lazy.dirty                 = true;
+    if (collection)
+    {
+        collection->dirty = true;
+    }
+    free_build_glyph(&build_glyph);
+}
+
+const slug_glyph_t* slug_get_glyph_by_index(slug_font_t* font, int glyph_index)
+{
+    if ((glyph_index < 0) || (glyph_index >= xarr_len(font->glyphs)))
+    {
+        return 0;
+    }
+    if (font->lazy.enabled && !font->lazy.resident[glyph_index])
+    {
+        make_glyph_resident(font, glyph_index);
+    }
+    return &font->glyphs[glyph_index];
+}
+
+static const slug_cmap_entry_t* find_cmap_entry(const slug_font_t* font, uint32_t codepoint)
+{
+    // Page 0 of cmap_entries is all zeroes, unmapped pages and codepoints point at it
+    static const slug_cmap_entry_t unmapped = {0};
+    if ((codepoint >= 0x110000) || (font->cmap_pages == 0))
+    {
+        return &unmapped;
+    }
+    int page = font->cmap_pages[codepoint >> SLUG_CMAP_PAGE_BITS];
+    return &font->cmap_entries[page * SLUG_CMAP_PAGE_SIZE + (codepoint & (SLUG_CMAP_PAGE_SIZE - 1))];
+}
+
+int slug_find_glyph_index(const slug_font_t* font, uint32_t codepoint)
+{
+    return find_cmap_entry(font, codepoint)->glyph_index;
+}
+
+const slug_glyph_t* slug_get_glyph(slug_font_t* font, uint32_t codepoint)
+{
+    return slug_get_glyph_by_index(font, slug_find_glyph_index(font, codepoint));
+}
+
+static int colr_base_cmp(const void* a, const void* b)
+{
+    const slug_colr_base_t* pa = (slug_colr_base_t*)a;
+    const slug_colr_base_t* pb = (slug_colr_base_t*)b;
+    if (pa->glyph_id < pb->glyph_id)
+    {
+        return -1;
+    }
+    else if (pa->glyph_id > pb->glyph_id)
+    {
+        return 1;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+const slug_colr_base_t* slug_find_colr_base(const slug_font_t* font, uint32_t codepoint)
+{
+    int colr_base = find_cmap_entry(font, codepoint)->colr_base;
+    return colr_base > 0 ? &font->colr_bases[colr_base - 1] : 0;
+}
+
+bool slug_load_font(slug_font_t* font, const slug_range_t* data)
+{
+    return slug_load_font_desc(font, data, &(slug_font_desc_t){0});
+}
+
+static void free_font_arrays(slug_font_t* font)
+{
+    xarr_free(font->glyphs);
+    xarr_free(font->cpal_colors);
+    xarr_free(font->colr_bases);
+    xarr_free(font->colr_layers);
+    xarr_free(font->cmap_pages);
+    xarr_free(font->cmap_entries);
+    xarr_free(font->lazy.resident);
+    xarr_free(font->lazy.curve_pixels);
+    xarr_free(font->lazy.band_pixels);
+}
+
+// Parses the font and, unless it's lazy, builds and packs every glyph into res. Fonts in a collection are
+// appended to the collection's pixels, which res then takes over. Doesn't touch sokol, so this is also what bakes
+// font caches headless.
+static bool build_font(slug_font_t* font, const slug_range_t* data, const slug_font_desc_t* desc, pack_textures_t* res)
+{
+    font->collection        = desc->collection;
+    font->compact_curves    = desc->collection ? desc->collection->compact_curves : desc->compact_curves;
+    font->lod_pixels_per_em = maxf(desc->lod_pixels_per_em, 0.0f);
+    if (!stbtt_InitFont(&font->info, data->ptr, 0))
+    {
+        free_font_arrays(font);
+        return false;
+    }
+    float em_scale = stbtt_ScaleForMappingEmToPixels(&font->info, 1.0f);
+
+    // colored emoji-fonts...
+    if (!parse_colr_v0(font, data))
+    {
+        free_font_arrays(font);
+        return false;
+    }
+    if (!parse_cpal(font, data))
+    {
+        free_font_arrays(font);
+        return false;
+    }
+    build_cmap(font, data);
+
+    int num_glyphs = font->info.numGlyphs;
+    if (desc->lazy)
+    {
+        xarr_setlen(font->glyphs, num_glyphs);
+        xarr_setlen(font->lazy.resident, num_glyphs);
+        memset(font->glyphs, 0, num_glyphs * sizeof(slug_glyph_t));
+        memset(font->lazy.resident, 0, num_glyphs);
+        font->lazy.enabled  = true;
+        font->lazy.dirty    = true;
+        font->lazy.em_scale = em_scale;
+        return true;
+    }
+
+    slug_glyph_build_t* build_glyphs = 0;
+    slug_glyph_build_t* lod_glyphs   = 0;
+    xarr_setlen(build_glyphs, num_glyphs);
+    if (font->lod_pixels_per_em > 0.0f)
+    {
+        xarr_setlen(lod_glyphs, num_glyphs);
+    }
+    build_glyphs_parallel(
+        &font->info,
+        em_scale,
+        font->compact_curves,
+        build_glyphs,
+        lod_glyphs,
+        font->lod_pixels_per_em,
+        desc->num_threads);
+
+    // LOD glyphs are packed after all the full glyphs, their stats are kept apart
+    *res = (pack_textures_t){.compact_curves = font->compact_curves};
+    if (font->collection)
+    {
+        res->curve_pixels = font->collection->curve_pixels;
+        res->band_pixels  = font->collection->band_pixels;
+    }
+    pack_textures(res, build_glyphs, num_glyphs);
+    font->stats = res->stats;
+    if (lod_glyphs)
+    {
+        res->stats = (slug_font_stats_t){0};
+        pack_textures(res, lod_glyphs, num_glyphs);
+        font->lod_stats = res->stats;
+        res->stats      = font->stats;
+    }
+    if (!font->collection)
+    {
+        finalize_textures(res);
+    }
+
+    xarr_setlen(font->glyphs, num_glyphs);
+    for (int i = 0; i < num_glyphs; i++)
+    {
+        font->glyphs[i] = make_glyph(&build_glyphs[i]);
+        if (lod_glyphs)
+        {
+            set_glyph_lod(&font->glyphs[i], &lod_glyphs[i]);
+        }
+    }
+
+    for (int i = 0; i < num_glyphs; i++)
+    {
+        free_build_glyph(&build_glyphs[i]);
+        if (lod_glyphs)
+        {
+            free_build_glyph(&lod_glyphs[i]);
+        }
+    }
+    xarr_free(build_glyphs);
+    xarr_free(lod_glyphs);
+    return true;
+}
+
+static size_t curve_texel_size(bool compact_curves)
+{
+    return compact_curves ? sizeof(s16vec4_t) : sizeof(vec4_t);
+}
+
+static sg_pixel_format curve_pixel_format(bool compact_curves)
+{
+    return compact_curves ? SG_PIXELFORMAT_RGBA16SN : SG_PIXELFORMAT_RGBA32F;
+}
+
+// Converts bbox relative curve texels to RGBA16 snorm. Returned array is managed via xhl/array.h
+static s16vec4_t* encode_compact_curves(const vec4_t* pixels, int num_texels)
+{
+    s16vec4_t* encoded = 0;
+    xarr_setlen(encoded, num_texels);
+    for (int i = 0; i < num_texels; i++)
+    {
+        encoded[i] = (s16vec4_t){
+            slug_encode_snorm16(pixels[i].x),
+            slug_encode_snorm16(pixels[i].y),
+            slug_encode_snorm16(pixels[i].z),
+            slug_encode_snorm16(pixels[i].w),
+        };
+    }
+    return encoded;
+}
+
+// curve_pixels are vec4_t or s16vec4_t depending on font->compact_curves
+static void make_font_textures(
+    slug_font_t*     font,
+    const void*      curve_pixels,
+    int              curve_height,
+    const u16vec2_t* band_pixels,
+    int              band_height)
+{
+    font->curve.height = curve_height;
+    font->band.height  = band_height;
+
+    font->curve.img      = sg_make_image(&(sg_image_desc){
+             .width        = SLUG_TEX_WIDTH,
+             .height       = font->curve.height,
+             .pixel_format = curve_pixel_format(font->compact_curves),
+             .data.mip_levels[0] =
+            {
+                     .ptr  = curve_pixels,
+                     .size = (size_t)curve_height * SLUG_TEX_WIDTH * curve_texel_size(font->compact_curves),
+            },
+    });
+    font->curve.tex_view = sg_make_view(&(sg_view_desc){.texture.image = font->curve.img});
+
+    font->band.img      = sg_make_image(&(sg_image_desc){
+             .width        = SLUG_TEX_WIDTH,
+             .height       = font->band.height,
+             .pixel_format = SG_PIXELFORMAT_RG16UI,
+             .data.mip_levels[0] =
+            {
+                     .ptr  = band_pixels,
+                     .size = (size_t)band_height * SLUG_TEX_WIDTH * sizeof(u16vec2_t),
+            },
+    });
+    font->band.tex_view = sg_make_view(&(sg_view_desc){.texture.image = font->band.img});
+}
+
+bool slug_load_font_desc(slug_font_t* font, const slug_range_t* data, const slug_font_desc_t* desc)
+{
+    assert(font);
+    assert(desc);
+    assert(data && data->ptr && data->size > 0);
+    assert(!font->valid);
+    *font = (slug_font_t){0};
+
+    pack_textures_t res = {0};
+    if (!build_font(font, data, desc, &res))
+    {
+        *font = (slug_font_t){0};
+        return false;
+    }
+    if (font->collection)
+    {
+        // the collection's textures are updated by slug_flush_collection()
+        if (!font->lazy.enabled)
+        {
+            font->collection->curve_pixels = res.curve_pixels;
+            font->collection->band_pixels  = res.band_pixels;
+            font->collection->dirty        = true;
+        }
+        font->valid = true;
+        return true;
+    }
+    else if (font->lazy.enabled)
+    {
+        // textures are created by slug_flush_font()
+    }
+    else if (font->compact_curves)
+    {
+        s16vec4_t* curve_pixels = encode_compact_curves(res.curve_pixels, (int)xarr_len(res.curve_pixels));
+        make_font_textures(font, curve_pixels, res.curve_height, res.band_pixels, res.band_height);
+        xarr_free(curve_pixels);
+    }
+    else
+    {
+        make_font_textures(font, res.curve_pixels, res.curve_height, res.band_pixels, res.band_height);
+    }
+    xarr_free(res.curve_pixels);
+    xarr_free(res.band_pixels);
+    font->valid = true;
+    return true;
+}
+
+void slug_unload_font(slug_font_t* font)
+{
+    sg_destroy_image(font->curve.img);
+    sg_destroy_view(font->curve.tex_view);
+    sg_destroy_image(font->band.img);
+    sg_destroy_view(font->band.tex_view);
+    free_font_arrays(font);
+    *font = (slug_font_t){0};
+}
+
+//------------------------------------------------------------------------------
+//  Font cache
+//
+//  Layout of a cache blob, all sections start on a 16 byte boundary so the blob
+//  can be memory-mapped and used in place:
+//
+//      slug_cache_header_t
+//      curve texels        (vec4_t or s16vec4_t, curve_height * SLUG_TEX_WIDTH)
+//      band texels         (u16vec2_t,        band_height * SLUG_TEX_WIDTH)
+//      glyphs              (slug_glyph_t,     num_glyphs)
+//      CPAL colors         (vec4_t,           num_cpal_colors)
+//      COLR base glyphs    (slug_colr_base_t, num_colr_bases)
+//      COLR layers         (slug_colr_layer_t, num_colr_layers)
+//
+//  Everything is stored in native byte order. Bump SLUG_CACHE_VERSION whenever
+//  the layout or the contents of the packed textures change.
+//------------------------------------------------------------------------------
+
+#define SLUG_CACHE_MAGIC   (0x47554c53) // 'SLUG'
+#define SLUG_CACHE_VERSION (8)
+
+enum
+{
+    SLUG_CACHE_COMPACT_CURVES = 1 << 0,
+};
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t font_hash;
+    uint32_t flags;
+    uint32_t curve_height;
+    uint32_t band_height;
+    uint32_t num_glyphs;
+    uint32_t num_cpal_colors;
+    uint32_t num_colr_bases;
+    uint32_t num_colr_layers;
+    uint32_t curve_offset;
+    uint32_t band_offset;
+    uint32_t glyphs_offset;
+    uint32_t cpal_offset;
+    uint32_t colr_bases_offset;
+    uint32_t colr_layers_offset;
+    float    lod_pixels_per_em;
+    slug_font_stats_t stats;
+    slug_font_stats_t lod_stats;
+} slug_cache_header_t;
+
+static uint32_t align_cache_offset(size_t offset) { return (uint32_t)((offset + 15) & ~(size_t)15); }
+
+static uint64_t hash_fnv1a(uint64_t hash, const void* ptr, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)ptr;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t slug_hash_font(const slug_range_t* data)
+{
+    // Hashing every byte of a large font would cost a good part of what the cache saves. The table directory holds
+    // the checksum of every table, so together with the file size it changes whenever the font does.
+    const uint8_t* p        = (const uint8_t*)data->ptr;
+    uint64_t       size     = data->size;
+    uint64_t       hash     = hash_fnv1a(0xcbf29ce484222325ull, &size, sizeof(size));
+    size_t         dir_size = 12; // sfnt version, numTables, searchRange, entrySelector, rangeShift
+    if (data->size >= dir_size)
+    {
+        dir_size += 16 * (size_t)((p[4] << 8) | p[5]); // tag, checksum, offset, length of each table
+    }
+    if (dir_size > data->size)
+    {
+        // Not a font stbtt_InitFont() accepts, so it will fail to load anyway
+        return hash_fnv1a(hash, p, data->size);
+    }
+    return hash_fnv1a(hash, p, dir_size);
+}
+
+bool slug_bake_font_cache(const slug_range_t* data, const slug_font_desc_t* desc, slug_range_t* out_cache)
+{
+    assert(data && data->ptr && data->size > 0);
+    assert(desc);
+    assert(out_cache);
+    *out_cache = (slug_range_t){0};
+
+    // A lazy font has nothing to bake, and the cache holds the font's own textures
+    slug_font_desc_t build_desc = *desc;
+    build_desc.lazy             = false;
+    build_desc.collection       = NULL;
+
+    slug_font_t     font = {0};
+    pack_textures_t res  = {0};
+    if (!build_font(&font, data, &build_desc, &res))
+    {
+        return false;
+    }
+
+    slug_cache_header_t hdr = {
+        .magic             = SLUG_CACHE_MAGIC,
+        .version           = SLUG_CACHE_VERSION,
+        .font_hash         = slug_hash_font(data),
+        .flags             = font.compact_curves ? SLUG_CACHE_COMPACT_CURVES : 0,
+        .curve_height      = (uint32_t)res.curve_height,
+        .band_height       = (uint32_t)res.band_height,
+        .num_glyphs        = (uint32_t)xarr_len(font.glyphs),
+        .num_cpal_colors   = (uint32_t)xarr_len(font.cpal_colors),
+        .num_colr_bases    = (uint32_t)xarr_len(font.colr_bases),
+        .num_colr_layers   = (uint32_t)xarr_len(font.colr_layers),
+        .lod_pixels_per_em = font.lod_pixels_per_em,
+        .stats             = font.stats,
+        .lod_stats         = font.lod_stats,
+    };
+    size_t size            = sizeof(hdr);
+    hdr.curve_offset       = align_cache_offset(size);
+    size_t curve_size      = (size_t)hdr.curve_height * SLUG_TEX_WIDTH * curve_texel_size(font.compact_curves);
+    size                   = hdr.curve_offset + curve_size;
+    hdr.band_offset        = align_cache_offset(size);
+    size                   = hdr.band_offset + (size_t)hdr.band_height * SLUG_TEX_WIDTH * sizeof(u16vec2_t);
+    hdr.glyphs_offset      = align_cache_offset(size);
+    size                   = hdr.glyphs_offset + hdr.num_glyphs * sizeof(slug_glyph_t);
+    hdr.cpal_offset        = align_cache_offset(size);
+    size                   = hdr.cpal_offset + hdr.num_cpal_colors * sizeof(vec4_t);
+    hdr.colr_bases_offset  = align_cache_offset(size);
+    size                   = hdr.colr_bases_offset + hdr.num_colr_bases * sizeof(slug_colr_base_t);
+    hdr.colr_layers_offset = align_cache_offset(size);
+    size                   = hdr.colr_layers_offset + hdr.num_colr_layers * sizeof(slug_colr_layer_t);
+
+    // calloc so the alignment padding is deterministic
+    uint8_t* blob = (uint8_t*)calloc(1, size);
+    if (blob)
+    {
+        memcpy(blob, &hdr, sizeof(hdr));
+        if (font.compact_curves)
+        {
+            s16vec4_t* curve_pixels = encode_compact_curves(res.curve_pixels, (int)xarr_len(res.curve_pixels));
+            memcpy(blob + hdr.curve_offset, curve_pixels, curve_size);
+            xarr_free(curve_pixels);
+        }
+        else
+        {
+            memcpy(blob + hdr.curve_offset, res.curve_pixels, curve_size);
+        }
+        memcpy(blob + hdr.band_offset, res.band_pixels, (size_t)hdr.band_height * SLUG_TEX_WIDTH * sizeof(u16vec2_t));
+        memcpy(blob + hdr.glyphs_offset, font.glyphs, hdr.num_glyphs * sizeof(slug_glyph_t));
+        memcpy(blob + hdr.cpal_offset, font.cpal_colors, hdr.num_cpal_colors * sizeof(vec4_t));
+        memcpy(blob + hdr.colr_bases_offset, font.colr_bases, hdr.num_colr_bases * sizeof(slug_colr_base_t));
+        memcpy(blob + hdr.colr_layers_offset, font.colr_layers, hdr.num_colr_layers * sizeof(slug_colr_layer_t));
+        *out_cache = (slug_range_t){.ptr = blob, .size = size};
+    }
+
+    xarr_free(res.curve_pixels);
+    xarr_free(res.band_pixels);
+    free_font_arrays(&font);
+    return blob != NULL;
+}
+
+void slug_free_font_cache(slug_range_t* cache)
+{
+    free((void*)cache->ptr);
+    *cache = (slug_range_t){0};
+}
+
+static bool cache_section_fits(const slug_range_t* cache, uint32_t offset, size_t size)
+{
+    return ((offset & 15) == 0) && (offset <= cache->size) && (size <= cache->size - offset);
+}
+
+bool slug_load_font_cache(slug_font_t* font, const slug_range_t* data, const slug_range_t* cache)
+{
+    assert(font);
+    assert(data && data->ptr && data->size > 0);
+    assert(cache);
+    assert(!font->valid);
+    *font = (slug_font_t){0};
+
+    if (cache->ptr == NULL || cache->size < sizeof(slug_cache_header_t))
+    {
+        return false;
+    }
+    const uint8_t*             blob = (const uint8_t*)cache->ptr;
+    const slug_cache_header_t* hdr  = (const slug_cache_header_t*)blob;
+    bool                       compact_curves = (hdr->flags & SLUG_CACHE_COMPACT_CURVES) != 0;
+    size_t curve_size = (size_t)hdr->curve_height * SLUG_TEX_WIDTH * curve_texel_size(compact_curves);
+    if ((hdr->magic != SLUG_CACHE_MAGIC) || (hdr->version != SLUG_CACHE_VERSION) ||
+        (hdr->curve_height == 0) || (hdr->band_height == 0) ||
+        !cache_section_fits(cache, hdr->curve_offset, curve_size) ||
+        !cache_section_fits(cache, hdr->band_offset, (size_t)hdr->band_height * SLUG_TEX_WIDTH * sizeof(u16vec2_t)) ||
+        !cache_section_fits(cache, hdr->glyphs_offset, hdr->num_glyphs * sizeof(slug_glyph_t)) ||
+        !cache_section_fits(cache, hdr->cpal_offset, hdr->num_cpal_colors * sizeof(vec4_t)) ||
+        !cache_section_fits(cache, hdr->colr_bases_offset, hdr->num_colr_bases * sizeof(slug_colr_base_t)) ||
+        !cache_section_fits(cache, hdr->colr_layers_offset, hdr->num_colr_layers * sizeof(slug_colr_layer_t)))
+    {
+        return false;
+    }
+    // The cache is stale if it was baked from a different font file
+    if (hdr->font_hash != slug_hash_font(data))
+    {
+        return false;
+    }
+    // Codepoint lookups still go through the font's cmap
+    if (!stbtt_InitFont(&font->info, data->ptr, 0) || (font->info.numGlyphs != (int)hdr->num_glyphs))
+    {
+        *font = (slug_font_t){0};
+        return false;
+    }
+
+    font->compact_curves    = compact_curves;
+    font->lod_pixels_per_em = hdr->lod_pixels_per_em;
+    font->stats             = hdr->stats;
+    font->lod_stats         = hdr->lod_stats;
+    xarr_setlen(font->glyphs, hdr->num_glyphs);
+    xarr_setlen(font->cpal_colors, hdr->num_cpal_colors);
+    xarr_setlen(font->colr_bases, hdr->num_colr_bases);
+    xarr_setlen(font->colr_layers, hdr->num_colr_layers);
+    memcpy(font->glyphs, blob + hdr->glyphs_offset, hdr->num_glyphs * sizeof(slug_glyph_t));
+    memcpy(font->cpal_colors, blob + hdr->cpal_offset, hdr->num_cpal_colors * sizeof(vec4_t));
+    memcpy(font->colr_bases, blob + hdr->colr_bases_offset, hdr->num_colr_bases * sizeof(slug_colr_base_t));
+    memcpy(font->colr_layers, blob + hdr->colr_layers_offset, hdr->num_colr_layers * sizeof(slug_colr_layer_t));
+    build_cmap(font, data);
+
+    // Texels are uploaded straight from the cache
+    make_font_textures(
+        font,
+        blob + hdr->curve_offset,
+        (int)hdr->curve_height,
+        (const u16vec2_t*)(blob + hdr->band_offset),
+        (int)hdr->band_height);
+    font->valid = true;
+    return true;
+}
+
+static int lazy_texture_height(int cur_height, int num_texels)
+{
+    int rows   = (num_texels + SLUG_TEX_WIDTH - 1) / SLUG_TEX_WIDTH;
+    int height = cur_height > 0 ? cur_height : SLUG_LAZY_MIN_ROWS;
+    while (height < rows)
+    {
+        height *= 2;
+    }
+    return height;
+}
+
+static void update_lazy_texture(
+    slug_texture_t* tex,
+    const void*     pixels,
+    int             height,
+    size_t          texel_size,
+    sg_pixel_format pixel_format)
+{
+    if (height != tex->height)
+    {
+        // sokol images can't be resized, so recreate it. Everything gets reuploaded below anyway
+        sg_destroy_view(tex->tex_view);
+        sg_destroy_image(tex->img);
+        tex->img = sg_make_image(&(sg_image_desc){
+            .width                = SLUG_TEX_WIDTH,
+            .height               = height,
+            .pixel_format         = pixel_format,
+            .usage.dynamic_update = true,
+        });
+        tex->tex_view = sg_make_view(&(sg_view_desc){.texture.image = tex->img});
+        tex->height   = height;
+    }
+    sg_update_image(
+        tex->img,
+        &(sg_image_data){
+            .mip_levels[0] =
+                {
+                    .ptr  = pixels,
+                    .size = (size_t)height * SLUG_TEX_WIDTH * texel_size,
+                },
+        });
+}
+
+// Grows the textures to fit the pixels and uploads them. The pixel arrays are temporarily padded to whole rows.
+static void upload_lazy_pixels(
+    slug_texture_t* curve,
+    slug_texture_t* band,
+    vec4_t**        curve_pixels,
+    u16vec2_t**     band_pixels,
+    bool            compact_curves)
+{
+    // NOTE: sg_update_image() can only replace a whole image, so rather than uploading just the new rows the
+    // entire texture is reuploaded. This only happens on frames where new glyphs became resident.
+    int num_curve_texels = (int)xarr_len(*curve_pixels);
+    int curve_height     = lazy_texture_height(curve->height, num_curve_texels);
+    xarr_setlen(*curve_pixels, curve_height * SLUG_TEX_WIDTH);
+    memset(*curve_pixels + num_curve_texels, 0, (curve_height * SLUG_TEX_WIDTH - num_curve_texels) * sizeof(vec4_t));
+    if (compact_curves)
+    {
+        s16vec4_t* encoded = encode_compact_curves(*curve_pixels, curve_height * SLUG_TEX_WIDTH);
+        update_lazy_texture(curve, encoded, curve_height, sizeof(s16vec4_t), SG_PIXELFORMAT_RGBA16SN);
+        xarr_free(encoded);
+    }
+    else
+    {
+        update_lazy_texture(curve, *curve_pixels, curve_height, sizeof(vec4_t), SG_PIXELFORMAT_RGBA32F);
+    }
+    xarr_setlen(*curve_pixels, num_curve_texels);
+
+    int num_band_texels = (int)xarr_len(*band_pixels);
+    int band_height     = lazy_texture_height(band->height, num_band_texels);
+    xarr_setlen(*band_pixels, band_height * SLUG_TEX_WIDTH);
+    memset(*band_pixels + num_band_texels, 0, (band_height * SLUG_TEX_WIDTH - num_band_texels) * sizeof(u16vec2_t));
+    update_lazy_texture(band, *band_pixels, band_height, sizeof(u16vec2_t), SG_PIXELFORMAT_RG16UI);
+    xarr_setlen(*band_pixels, num_band_texels);
+}
+
+void slug_flush_font(slug_font_t* font)
+{
+    if (font->collection)
+    {
+        slug_flush_collection(font->collection);
+        return;
+    }
+    if (!font->lazy.enabled || !font->lazy.dirty)
+    {
+        return;
+    }
+    upload_lazy_pixels(
+        &font->curve,
+        &font->band,
+        &font->lazy.curve_pixels,
+        &font->lazy.band_pixels,
+        font->compact_curves);
+    font->lazy.dirty = false;
+}
+
+//------------------------------------------------------------------------------
+//  Font collections
+//------------------------------------------------------------------------------
+
+void slug_init_collection(slug_font_collection_t* collection, const slug_collection_desc_t* desc)
+{
+    assert(collection);
+    assert(desc);
+    *collection                = (slug_font_collection_t){0};
+    collection->compact_curves = desc->compact_curves;
+}
+
+void slug_destroy_collection(slug_font_collection_t* collection)
+{
+    sg_destroy_view(collection->curve.tex_view);
+    sg_destroy_image(collection->curve.img);
+    sg_destroy_view(collection->band.tex_view);
+    sg_destroy_image(collection->band.img);
+    xarr_free(collection->curve_pixels);
+    xarr_free(collection->band_pixels);
+    *collection = (slug_font_collection_t){0};
+}
+
+void slug_flush_collection(slug_font_collection_t* collection)
+{
+    if (!collection->dirty)
+    {
+        return;
+    }
+    upload_lazy_pixels(
+        &collection->curve,
+        &collection->band,
+        &collection->curve_pixels,
+        &collection->band_pixels,
+        collection->compact_curves);
+    collection->dirty = false;
+}
+
+//------------------------------------------------------------------------------
+//  Shapes
+//
+//  A shape is built exactly like a glyph, only its contours come from path
+//  commands instead of a TrueType outline. Cubics are split into as many
+//  quadratics as the tolerance needs: a single quadratic with control point
+//  (3 * (c1 + c2) - p0 - p3) / 4 is off by at most sqrt(3) / 36 times the
+//  length of the cubic's third difference, and splitting into n pieces
+//  shrinks that by n^3.
+//------------------------------------------------------------------------------
+
+// Keeps degenerate tolerances from exploding the curve count
+#define SLUG_SHAPE_MAX_CUBIC_SPLITS (64)
+
+void slug_begin_shape(slug_shape_builder_t* shape, const slug_shape_desc_t* desc)
+{
+    assert(shape);
+    assert(desc);
+    *shape                 = (slug_shape_builder_t){0};
+    shape->scale           = desc->units_per_em > 0.0f ? 1.0f / desc->units_per_em : 1.0f;
+    shape->cubic_tolerance = desc->cubic_tolerance * shape->scale;
+    shape->even_odd        = desc->even_odd;
+}
+
+// current is already in ems
+static void push_shape_line(slug_shape_builder_t* shape, vec2_t current)
+{
+    if ((current.x == shape->previous.x) && (current.y == shape->previous.y))
+    {
+        return;
+    }
+    vec2_t mid = vec2_mulf(vec2_add(shape->previous, current), 0.5f);
+    xarr_push(shape->build.curves, ((slug_curve_t){.p = {shape->previous, mid, current}}));
+    shape->previous = current;
+}
+
+void slug_shape_close(slug_shape_builder_t* shape)
+{
+    if (!shape->in_contour)
+    {
+        return;
+    }
+    push_shape_line(shape, shape->start);
+    int count = (int)xarr_len(shape->build.curves) - shape->contour_start;
+    if (count > 0)
+    {
+        xarr_push(shape->build.contours, ((slug_contour_range_t){.start = shape->contour_start, .count = count}));
+    }
+    shape->in_contour = false;
+}
+
+void slug_shape_move_to(slug_shape_builder_t* shape, float x, float y)
+{
+    slug_shape_close(shape);
+    shape->start         = vec2(x * shape->scale, y * shape->scale);
+    shape->previous      = shape->start;
+    shape->contour_start = (int)xarr_len(shape->build.curves);
+    shape->in_contour    = true;
+}
+
+void slug_shape_line_to(slug_shape_builder_t* shape, float x, float y)
+{
+    assert(shape->in_contour);
+    push_shape_line(shape, vec2(x * shape->scale, y * shape->scale));
+}
+
+void slug_shape_quad_to(slug_shape_builder_t* shape, float cx, float cy, float x, float y)
+{
+    assert(shape->in_contour);
+    vec2_t current = vec2(x * shape->scale, y * shape->scale);
+    vec2_t control = vec2(cx * shape->scale, cy * shape->scale);
+    xarr_push(shape->build.curves, ((slug_curve_t){.p = {shape->previous, control, current}}));
+    shape->previous = current;
+}
+
+static vec2_t eval_cubic(const vec2_t p[4], float t)
+{
+    float u = 1.0f - t;
+    return vec2(
+        u * u * u * p[0].x + 3.0f * u * u * t * p[1].x + 3.0f * u * t * t * p[2].x + t * t * t * p[3].x,
+        u * u * u * p[0].y + 3.0f * u * u * t * p[1].y + 3.0f * u * t * t * p[2].y + t * t * t * p[3].y);
+}
+
+static vec2_t eval_cubic_tangent(const vec2_t p[4], float t)
+{
+    float u = 1.0f - t;
+    return vec2(
+        3.0f * u * u * (p[1].x - p[0].x) + 6.0f * u * t * (p[2].x - p[1].x) + 3.0f * t * t * (p[3].x - p[2].x),
+        3.0f * u * u * (p[1].y - p[0].y) + 6.0f * u * t * (p[2].y - p[1].y) + 3.0f * t * t * (p[3].y - p[2].y));
+}
+
+void slug_shape_cubic_to(slug_shape_builder_t* shape, float c1x, float c1y, float c2x, float c2y, float x, float y)
+{
+    assert(shape->in_contour);
+    const float  s    = shape->scale;
+    const vec2_t p[4] = {shape->previous, vec2(c1x * s, c1y * s), vec2(c2x * s, c2y * s), vec2(x * s, y * s)};
+
+    float tolerance = shape->cubic_tolerance;
+    if (tolerance <= 0.0f)
+    {
+        float x_min = minf(minf(p[0].x, p[1].x), minf(p[2].x, p[3].x));
+        float x_max = maxf(maxf(p[0].x, p[1].x), maxf(p[2].x, p[3].x));
+        float y_min = minf(minf(p[0].y, p[1].y), minf(p[2].y, p[3].y));
+        float y_max = maxf(maxf(p[0].y, p[1].y), maxf(p[2].y, p[3].y));
+        tolerance   = maxf(x_max - x_min, y_max - y_min) / 1024.0f;
+    }
+    float dx        = p[3].x - 3.0f * p[2].x + 3.0f * p[1].x - p[0].x;
+    float dy        = p[3].y - 3.0f * p[2].y + 3.0f * p[1].y - p[0].y;
+    float error     = sqrtf(3.0f) / 36.0f * sqrtf(dx * dx + dy * dy);
+    int   num_quads = 1;
+    if ((tolerance > 0.0f) && (error > tolerance))
+    {
+        num_quads = clampi((int)ceilf(cbrtf(error / tolerance)), 1, SLUG_SHAPE_MAX_CUBIC_SPLITS);
+    }
+
+    // Each piece of the cubic between t0 and t1 has control points p(t0) + h/3 p'(t0) and p(t1) - h/3 p'(t1), which
+    // makes the quadratic's control point the endpoints' midpoint plus h/4 (p'(t0) - p'(t1))
+    float  h        = 1.0f / (float)num_quads;
+    vec2_t tangent0 = eval_cubic_tangent(p, 0.0f);
+    for (int i = 0; i < num_quads; i++)
+    {
+        float  t1       = (float)(i + 1) * h;
+        vec2_t p1       = i == num_quads - 1 ? p[3] : eval_cubic(p, t1);
+        vec2_t tangent1 = eval_cubic_tangent(p, t1);
+        vec2_t mid      = vec2_mulf(vec2_add(shape->previous, p1), 0.5f);
+        vec2_t control  = vec2_add(mid, vec2_mulf(vec2_sub(tangent0, tangent1), h * 0.25f));
+        xarr_push(shape->build.curves, ((slug_curve_t){.p = {shape->previous, control, p1}}));
+        shape->previous = p1;
+        tangent0        = tangent1;
+    }
+}
+
+void slug_shape_add_cubic_path(slug_shape_builder_t* shape, const float* pts, int npts)
+{
+    if (npts < 1)
+    {
+        return;
+    }
+    slug_shape_move_to(shape, pts[0], pts[1]);
+    for (int i = 1; i + 2 < npts; i += 3)
+    {
+        const float* p = &pts[i * 2];
+        slug_shape_cubic_to(shape, p[0], p[1], p[2], p[3], p[4], p[5]);
+    }
+    slug_shape_close(shape);
+}
+
+static vec2_t eval_quad(const slug_curve_t* curve, float t)
+{
+    float u = 1.0f - t;
+    return vec2(
+        u * u * curve->p[0].x + 2.0f * u * t * curve->p[1].x + t * t * curve->p[2].x,
+        u * u * curve->p[0].y + 2.0f * u * t * curve->p[1].y + t * t * curve->p[2].y);
+}
+
+// Exact signed area, positive for counter-clockwise contours. Each curve adds its chord's share of the polygon plus
+// the area between the chord and the curve, which is 2/3 of the triangle spanned by its control points.
+static float contour_area(const slug_curve_t* curves, int count)
+{
+    float area = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        vec2_t p0  = curves[i].p[0];
+        vec2_t p1  = curves[i].p[1];
+        vec2_t p2  = curves[i].p[2];
+        area      += (p0.x * p2.y - p2.x * p0.y) * 0.5f;
+        area      += ((p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y)) * (1.0f / 3.0f);
+    }
+    return area;
+}
+
+// Whether pt is inside the contour, counting crossings of a ray in +X with the contour's curves flattened to lines
+static bool contour_contains(const slug_curve_t* curves, int count, vec2_t pt)
+{
+    enum
+    {
+        SEGMENTS_PER_CURVE = 8
+    };
+    bool inside = false;
+    for (int i = 0; i < count; i++)
+    {
+        vec2_t a = curves[i].p[0];
+        for (int j = 1; j <= SEGMENTS_PER_CURVE; j++)
+        {
+            vec2_t b = eval_quad(&curves[i], (float)j / (float)SEGMENTS_PER_CURVE);
+            if ((a.y > pt.y) != (b.y > pt.y))
+            {
+                float x = a.x + (pt.y - a.y) / (b.y - a.y) * (b.x - a.x);
+                if (x > pt.x)
+                {
+                    inside = !inside;
+                }
+            }
+            a = b;
+        }
+    }
+    return inside;
+}
 
-typedef struct
+static void reverse_contour(slug_curve_t* curves, int count)
 {
-    vec4_t*    curve_pixels; // managed by xhl/array.h
-    int        curve_height;
-    u16vec2_t* band_pixels; // managed by xhl/array.h
-    int        band_height;
-} pack_textures_t;
+    for (int i = 0, j = count - 1; i < j; i++, j--)
+    {
+        slug_curve_t tmp = curves[i];
+        curves[i]        = curves[j];
+        curves[j]        = tmp;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        vec2_t tmp     = curves[i].p[0];
+        curves[i].p[0] = curves[i].p[2];
+        curves[i].p[2] = tmp;
+    }
+}
 
-static bool parse_colr_v0(slug_font_t* font, const slug_range_t* data);
-static bool parse_cpal(slug_font_t* font, const slug_range_t* data);
-static void init_build_glyph(const stbtt_fontinfo* info, int glyph_index, float scale, slug_glyph_build_t* out);
-static void build_bands(slug_glyph_build_t* glyph);
-static void free_build_glyph(slug_glyph_build_t* glyph);
-static pack_textures_t pack_textures(slug_glyph_build_t* glyphs, int num_glyphs);
+// The shader fills by nonzero winding. An even-odd fill is the same as a nonzero one where contours nested in an odd
+// number of others wind clockwise and all other contours wind counter-clockwise.
+static void orient_even_odd(slug_glyph_build_t* build)
+{
+    int num_contours = (int)xarr_len(build->contours);
+    for (int i = 0; i < num_contours; i++)
+    {
+        slug_contour_range_t* contour = &build->contours[i];
+        slug_curve_t*         curves  = &build->curves[contour->start];
+        vec2_t                pt      = eval_quad(&curves[0], 0.5f);
+        int                   depth   = 0;
+        for (int j = 0; j < num_contours; j++)
+        {
+            slug_contour_range_t* other = &build->contours[j];
+            if ((j != i) && contour_contains(&build->curves[other->start], other->count, pt))
+            {
+                depth++;
+            }
+        }
+        bool clockwise = contour_area(curves, contour->count) < 0.0f;
+        if (clockwise != (depth & 1))
+        {
+            reverse_contour(curves, contour->count);
+        }
+    }
+}
 
-const slug_glyph_t* slug_get_glyph(const slug_font_t* font, uint32_t codepoint)
+void slug_end_shape(slug_shape_builder_t* shape, slug_font_collection_t* collection, slug_glyph_t* out)
 {
-    int idx = stbtt_FindGlyphIndex(&font->info, codepoint);
-    if ((idx >= 0) && (idx < xarr_len(font->glyphs)))
+    assert(collection);
+    assert(out);
+    slug_shape_close(shape);
+
+    slug_glyph_build_t* build = &shape->build;
+    if (shape->even_odd)
     {
-        return &font->glyphs[idx];
+        orient_even_odd(build);
     }
-    else
+    if (xarr_len(build->curves) > 0)
     {
-        return 0;
+        vec2_t first = build->curves[0].p[0];
+        build->bbox  = (slug_bbox_t){first.x, first.y, first.x, first.y};
+    }
+    for (int i = 0; i < xarr_len(build->curves); i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            vec2_t p       = build->curves[i].p[j];
+            build->bbox.x0 = minf(build->bbox.x0, p.x);
+            build->bbox.y0 = minf(build->bbox.y0, p.y);
+            build->bbox.x1 = maxf(build->bbox.x1, p.x);
+            build->bbox.y1 = maxf(build->bbox.y1, p.y);
+        }
     }
+    build_bands(build);
+
+    pack_textures_t res = {
+        .curve_pixels   = collection->curve_pixels,
+        .band_pixels    = collection->band_pixels,
+        .compact_curves = collection->compact_curves,
+    };
+    pack_glyph(&res, build);
+    collection->curve_pixels = res.curve_pixels;
+    collection->band_pixels  = res.band_pixels;
+    collection->dirty        = true;
+
+    *out = make_glyph(build);
+    free_build_glyph(build);
+    *shape = (slug_shape_builder_t){0};
 }
 
-static int colr_base_cmp(const void* a, const void* b)
+//------------------------------------------------------------------------------
+//  SVG icons
+//------------------------------------------------------------------------------
+
+static vec4_t unpack_svg_color(unsigned int color)
 {
-    const slug_colr_base_t* pa = (slug_colr_base_t*)a;
-    const slug_colr_base_t* pb = (slug_colr_base_t*)b;
-    if (pa->glyph_id < pb->glyph_id)
+    // nanosvg colors are 0xAABBGGRR
+    return vec4(
+        (float)(color & 0xff) / 255.0f,
+        (float)((color >> 8) & 0xff) / 255.0f,
+        (float)((color >> 16) & 0xff) / 255.0f,
+        (float)(color >> 24) / 255.0f);
+}
+
+static vec4_t svg_fill_color(NSVGimage2* svg, const NSVGshape2* svg_shape)
+{
+    vec4_t color = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    if (svg_shape->fill.type == NSVG_PAINT_COLOR)
     {
-        return -1;
+        color = unpack_svg_color(svg_shape->fill.color);
     }
-    else if (pa->glyph_id > pb->glyph_id)
+    else if (svg_shape->fill.nstops > 0)
     {
-        return 1;
+        const NSVGgradientStop* stops = nsvg_get_stops(svg) + svg_shape->fill.stop_idx;
+        for (int i = 0; i < svg_shape->fill.nstops; i++)
+        {
+            vec4_t stop  = unpack_svg_color(stops[i].color);
+            color.x     += stop.x;
+            color.y     += stop.y;
+            color.z     += stop.z;
+            color.w     += stop.w;
+        }
+        float scale = 1.0f / (float)svg_shape->fill.nstops;
+        color       = vec4(color.x * scale, color.y * scale, color.z * scale, color.w * scale);
     }
-    else
+    color.w *= svg_shape->opacity;
+    return color;
+}
+
+void slug_bake_svg_icon(
+    slug_font_collection_t*  collection,
+    const struct NSVGimage2* svg_image,
+    const slug_shape_desc_t* desc,
+    slug_icon_t*             out)
+{
+    assert(collection);
+    assert(svg_image);
+    assert(desc);
+    assert(out);
+    // nanosvg's accessors don't take const
+    NSVGimage2*       svg    = (NSVGimage2*)svg_image;
+    const NSVGshape2* shapes = nsvg_get_shapes(svg);
+    const NSVGpath2*  paths  = nsvg_get_paths(svg);
+    const float*      points = nsvg_get_points(svg);
+
+    // Icons are stored in ems like glyphs, with the larger side of the SVG being 1 em
+    float units_per_em = maxf(maxf(svg->width, svg->height), 1e-6f);
+    *out               = (slug_icon_t){.width = svg->width / units_per_em, .height = svg->height / units_per_em};
+    for (unsigned shape_idx = svg->first_shape_idx; shape_idx != 0; shape_idx = shapes[shape_idx].next_shape_index)
     {
-        return 0;
+        const NSVGshape2* svg_shape = &shapes[shape_idx];
+        vec4_t            color     = svg_fill_color(svg, svg_shape);
+        if ((svg_shape->fill.type == NSVG_PAINT_NONE) || (color.w <= 0.0f))
+        {
+            continue;
+        }
+
+        slug_shape_desc_t shape_desc = *desc;
+        shape_desc.units_per_em      = units_per_em;
+        shape_desc.even_odd          = svg_shape->fillRule == NSVG_FILLRULE_EVENODD;
+        slug_shape_builder_t builder;
+        slug_begin_shape(&builder, &shape_desc);
+        for (unsigned path_idx = svg_shape->first_path_index; path_idx != 0; path_idx = paths[path_idx].next_path_idx)
+        {
+            // SVG's y points down, flip it so icons are laid out like glyphs
+            const NSVGpath2* path = &paths[path_idx];
+            const float*     pts  = points + path->first_pt_idx;
+            if (path->npts < 1)
+            {
+                continue;
+            }
+            slug_shape_move_to(&builder, pts[0], svg->height - pts[1]);
+            for (int i = 1; i + 2 < path->npts; i += 3)
+            {
+                const float* p = &pts[i * 2];
+                slug_shape_cubic_to(
+                    &builder,
+                    p[0],
+                    svg->height - p[1],
+                    p[2],
+                    svg->height - p[3],
+                    p[4],
+                    svg->height - p[5]);
+            }
+            // Fills close open paths too
+            slug_shape_close(&builder);
+        }
+
+        slug_icon_layer_t layer = {.color = color};
+        slug_end_shape(&builder, collection, &layer.shape);
+        if (layer.shape.max_band_x >= 0)
+        {
+            xarr_push(out->layers, layer);
+        }
     }
 }
 
-const slug_colr_base_t* slug_find_colr_base(const slug_font_t* font, uint32_t codepoint)
+void slug_free_icon(slug_icon_t* icon)
+{
+    xarr_free(icon->layers);
+    *icon = (slug_icon_t){0};
+}
+
+//------------------------------------------------------------------------------
+//  CPU rasterizer
+//
+//  A reference for the coverage program_slug.glsl computes, reading the same
+//  band and curve texels. Instead of looping over curves per pixel it relies
+//  on every pixel of a row sharing one horizontal band, and every pixel of a
+//  column sharing one vertical band. A curve's crossings with a row's ray
+//  only depend on the row, so they are solved once per row and then applied
+//  to all pixels of the row 4 at a time with SSE2 or NEON. Columns are done
+//  the same way with transposed accumulators. The vector code rounds exactly
+//  like the scalar fallback, so the coverage doesn't depend on the platform.
+//
+//  The shader stops at the first curve entirely left of (below) the pixel.
+//  Every curve after it contributes nothing anyway, so walking the whole band
+//  gives the same coverage.
+//------------------------------------------------------------------------------
+
+bool slug_get_font_texels(const slug_font_t* font, slug_texels_t* out)
 {
-    int idx = stbtt_FindGlyphIndex(&font->info, codepoint);
-    if (idx <= 0)
+    // Other fonts free their texels once they're uploaded
+    assert(font->collection || font->lazy.enabled);
+    const slug_font_collection_t* collection = font->collection;
+    if (collection)
     {
-        return 0;
+        *out = (slug_texels_t){collection->curve_pixels, collection->band_pixels, collection->compact_curves};
+        return true;
     }
-    size_t num = xarr_len(font->colr_bases);
-    if (num == 0)
+    if (font->lazy.enabled)
     {
-        return 0;
+        *out = (slug_texels_t){font->lazy.curve_pixels, font->lazy.band_pixels, font->compact_curves};
+        return true;
     }
-    const slug_colr_base_t key = {.glyph_id = (uint16_t)idx};
-    return (slug_colr_base_t*)bsearch(&key, font->colr_bases, num, sizeof(slug_colr_base_t), colr_base_cmp);
+    return false;
 }
 
-bool slug_load_font(slug_font_t* font, const slug_range_t* data)
+static uint32_t calc_root_code(float y1, float y2, float y3)
 {
-    assert(font);
-    assert(data && data->ptr && data->size > 0);
-    assert(!font->valid);
-    *font = (slug_font_t){0};
+    // Same as calcRootCode() in program_slug.glsl
+    uint32_t u1, u2, u3;
+    memcpy(&u1, &y1, sizeof(u1));
+    memcpy(&u2, &y2, sizeof(u2));
+    memcpy(&u3, &y3, sizeof(u3));
+    uint32_t s1       = u1 >> 31u;
+    uint32_t s2       = u2 >> 30u;
+    uint32_t s3       = u3 >> 29u;
+    uint32_t combined = (s2 & 2u) | (s1 & ~2u);
+    combined          = (s3 & 4u) | (combined & ~4u);
+    return (0x2E74u >> combined) & 0x0101u;
+}
 
-    if (!stbtt_InitFont(&font->info, data->ptr, 0))
+// Solves where the curve crosses the line through its local origin along one axis. p0..p2 are (along, across)
+// pairs with the across components relative to the line, returns the along positions of both roots.
+static void solve_crossings(const float p0[2], const float p1[2], const float p2[2], float* c1, float* c2)
+{
+    // Same as solveHoriz()/solveVert() in program_slug.glsl
+    float a[2]         = {p0[0] - p1[0] * 2.0f + p2[0], p0[1] - p1[1] * 2.0f + p2[1]};
+    float b[2]         = {p0[0] - p1[0], p0[1] - p1[1]};
+    float inv_a        = 1.0f / a[1];
+    float half_inv_b   = 0.5f / b[1];
+    float discriminant = sqrtf(maxf(b[1] * b[1] - a[1] * p0[1], 0.0f));
+    float t1           = (b[1] - discriminant) * inv_a;
+    float t2           = (b[1] + discriminant) * inv_a;
+    if (fabsf(a[1]) < 1.0f / 65536.0f)
     {
-        slug_unload_font(font);
-        return false;
+        t1 = p0[1] * half_inv_b;
+        t2 = t1;
     }
-    float em_scale = stbtt_ScaleForMappingEmToPixels(&font->info, 1.0f);
+    *c1 = (a[0] * t1 - b[0] * 2.0f) * t1 + p0[0];
+    *c2 = (a[0] * t2 - b[0] * 2.0f) * t2 + p0[0];
+}
 
-    // colored emoji-fonts...
-    if (!parse_colr_v0(font, data))
+// Adds the crossing at along position c to the winding and edge weights of a row (or column) of pixels. centers are
+// the pixel centers along the ray in glyph units.
+static void accumulate_crossing(
+    float        c,
+    float        sign,
+    float        units_per_pixel,
+    const float* centers,
+    float*       winding,
+    float*       edge_weight,
+    int          count)
+{
+    int i = 0;
+    // _mm_min_ps(a, b) and vminq_f32(a, b) are a < b ? a : b like minf(), the same goes for max
+#if defined(SLUG_SSE2)
+    __m128 c4        = _mm_set1_ps(c);
+    __m128 sign4     = _mm_set1_ps(sign);
+    __m128 scale4    = _mm_set1_ps(units_per_pixel);
+    __m128 zero4     = _mm_setzero_ps();
+    __m128 half4     = _mm_set1_ps(0.5f);
+    __m128 one4      = _mm_set1_ps(1.0f);
+    __m128 two4      = _mm_set1_ps(2.0f);
+    __m128 abs_mask4 = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= count; i += 4)
     {
-        slug_unload_font(font);
-        return false;
+        __m128 crossing = _mm_mul_ps(_mm_sub_ps(c4, _mm_loadu_ps(&centers[i])), scale4);
+        __m128 wind     = _mm_min_ps(_mm_max_ps(_mm_add_ps(crossing, half4), zero4), one4);
+        __m128 edge     = _mm_sub_ps(one4, _mm_mul_ps(_mm_and_ps(crossing, abs_mask4), two4));
+        edge            = _mm_min_ps(_mm_max_ps(edge, zero4), one4);
+        _mm_storeu_ps(&winding[i], _mm_add_ps(_mm_loadu_ps(&winding[i]), _mm_mul_ps(sign4, wind)));
+        _mm_storeu_ps(&edge_weight[i], _mm_max_ps(_mm_loadu_ps(&edge_weight[i]), edge));
     }
-    if (!parse_cpal(font, data))
+#elif defined(SLUG_NEON)
+    float32x4_t c4     = vdupq_n_f32(c);
+    float32x4_t sign4  = vdupq_n_f32(sign);
+    float32x4_t scale4 = vdupq_n_f32(units_per_pixel);
+    float32x4_t zero4  = vdupq_n_f32(0.0f);
+    float32x4_t half4  = vdupq_n_f32(0.5f);
+    float32x4_t one4   = vdupq_n_f32(1.0f);
+    float32x4_t two4   = vdupq_n_f32(2.0f);
+    for (; i + 4 <= count; i += 4)
     {
-        slug_unload_font(font);
-        return false;
+        // No vmlaq_f32(), which may fuse the multiply and add where the scalar loop rounds twice
+        float32x4_t crossing = vmulq_f32(vsubq_f32(c4, vld1q_f32(&centers[i])), scale4);
+        float32x4_t wind     = vminq_f32(vmaxq_f32(vaddq_f32(crossing, half4), zero4), one4);
+        float32x4_t edge     = vsubq_f32(one4, vmulq_f32(vabsq_f32(crossing), two4));
+        edge                 = vminq_f32(vmaxq_f32(edge, zero4), one4);
+        vst1q_f32(&winding[i], vaddq_f32(vld1q_f32(&winding[i]), vmulq_f32(sign4, wind)));
+        vst1q_f32(&edge_weight[i], vmaxq_f32(vld1q_f32(&edge_weight[i]), edge));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float crossing  = (c - centers[i]) * units_per_pixel;
+        float wind      = minf(maxf(crossing + 0.5f, 0.0f), 1.0f);
+        float edge      = minf(maxf(1.0f - fabsf(crossing) * 2.0f, 0.0f), 1.0f);
+        winding[i]     += sign * wind;
+        edge_weight[i]  = maxf(edge_weight[i], edge);
     }
+}
 
-    slug_glyph_build_t* build_glyphs = 0;
-    xarr_setlen(build_glyphs, font->info.numGlyphs);
-    for (int i = 0; i < xarr_len(build_glyphs); i++)
+// Curves of compact fonts are read back from RGBA16 snorm texels, so round them the same way
+static vec4_t curve_texel(const slug_texels_t* texels, int index)
+{
+    vec4_t texel = texels->curve_pixels[index];
+    if (texels->compact_curves)
     {
-        init_build_glyph(&font->info, i, em_scale, &build_glyphs[i]);
-        build_bands(&build_glyphs[i]);
+        texel = vec4(
+            slug_decode_snorm16(slug_encode_snorm16(texel.x)),
+            slug_decode_snorm16(slug_encode_snorm16(texel.y)),
+            slug_decode_snorm16(slug_encode_snorm16(texel.z)),
+            slug_decode_snorm16(slug_encode_snorm16(texel.w)));
     }
+    return texel;
+}
 
-    pack_textures_t res = pack_textures(build_glyphs, (int)xarr_len(build_glyphs));
-    font->curve.height  = res.curve_height;
-    font->band.height   = res.band_height;
+// Casts rays along one axis (0 = +X for horizontal bands, 1 = +Y for vertical bands) for every line of pixels.
+// The results are stored line by line, so vertical rays end up transposed.
+static void rasterize_axis(
+    const slug_texels_t* texels,
+    const slug_glyph_t*  glyph,
+    int                  axis,
+    float                pixels_per_em,
+    const float*         along_centers,
+    int                  num_along,
+    const float*         across_centers,
+    int                  num_across,
+    float*               winding,
+    float*               edge_weight)
+{
+    int   glyph_start = glyph->glyph_loc[1] * SLUG_TEX_WIDTH + glyph->glyph_loc[0];
+    int   max_band    = axis == 0 ? (int)glyph->max_band_y : (int)glyph->max_band_x;
+    int   header_base = axis == 0 ? 0 : (int)glyph->max_band_y + 1;
+    float band_scale  = axis == 0 ? glyph->band_scale.y : glyph->band_scale.x;
+    float band_offset = axis == 0 ? glyph->band_offset.y : glyph->band_offset.x;
+    float sign        = axis == 0 ? 1.0f : -1.0f;
 
-    font->curve.img      = sg_make_image(&(sg_image_desc){
-             .width        = SLUG_TEX_WIDTH,
-             .height       = font->curve.height,
-             .pixel_format = SG_PIXELFORMAT_RGBA32F,
-             .data.mip_levels[0] =
-            {
-                     .ptr  = res.curve_pixels,
-                     .size = xarr_len(res.curve_pixels) * sizeof(vec4_t),
-            },
-    });
-    font->curve.tex_view = sg_make_view(&(sg_view_desc){.texture.image = font->curve.img});
+    // Same as curve_transform in program_slug.glsl
+    vec2_t curve_offset = vec2(0.0f, 0.0f);
+    vec2_t curve_scale  = vec2(1.0f, 1.0f);
+    if (texels->compact_curves)
+    {
+        curve_offset = vec2((glyph->bbox.x0 + glyph->bbox.x1) * 0.5f, (glyph->bbox.y0 + glyph->bbox.y1) * 0.5f);
+        curve_scale  = vec2((glyph->bbox.x1 - glyph->bbox.x0) * 0.5f, (glyph->bbox.y1 - glyph->bbox.y0) * 0.5f);
+    }
 
-    font->band.img      = sg_make_image(&(sg_image_desc){
-             .width        = SLUG_TEX_WIDTH,
-             .height       = font->band.height,
-             .pixel_format = SG_PIXELFORMAT_RG16UI,
-             .data.mip_levels[0] =
+    for (int line = 0; line < num_across; line++)
+    {
+        float* line_winding     = &winding[line * num_along];
+        float* line_edge_weight = &edge_weight[line * num_along];
+        memset(line_winding, 0, num_along * sizeof(float));
+        memset(line_edge_weight, 0, num_along * sizeof(float));
+
+        float     center      = across_centers[line];
+        int       band_index  = clampi((int)(center * band_scale + band_offset), 0, max_band);
+        u16vec2_t band_header = texels->band_pixels[glyph_start + header_base + band_index];
+        for (int i = 0; i < band_header.x; i++)
+        {
+            u16vec2_t entry       = texels->band_pixels[glyph_start + band_header.y + i];
+            int       curve_index = entry.y * SLUG_TEX_WIDTH + entry.x;
+            vec4_t    points_01   = curve_texel(texels, curve_index);
+            vec4_t    points_2    = curve_texel(texels, curve_index + 1);
+
+            vec2_t p[3];
+            p[0] = vec2_add(vec2_mul(vec2(points_01.x, points_01.y), curve_scale), curve_offset);
+            p[1] = vec2_add(vec2_mul(vec2(points_01.z, points_01.w), curve_scale), curve_offset);
+            p[2] = vec2_add(vec2_mul(vec2(points_2.x, points_2.y), curve_scale), curve_offset);
+            // (along, across) pairs with across relative to the ray, the along positions stay absolute
+            float q[3][2];
+            for (int k = 0; k < 3; k++)
             {
-                     .ptr  = res.band_pixels,
-                     .size = xarr_len(res.band_pixels) * sizeof(u16vec2_t),
-            },
-    });
-    font->band.tex_view = sg_make_view(&(sg_view_desc){.texture.image = font->band.img});
+                q[k][0] = axis == 0 ? p[k].x : p[k].y;
+                q[k][1] = (axis == 0 ? p[k].y : p[k].x) - center;
+            }
+            uint32_t root_mask = calc_root_code(q[0][1], q[1][1], q[2][1]);
+            if (root_mask == 0)
+            {
+                continue;
+            }
+            float c1, c2;
+            solve_crossings(q[0], q[1], q[2], &c1, &c2);
+            // The second root winds the other way
+            if (root_mask & 1u)
+            {
+                accumulate_crossing(c1, sign, pixels_per_em, along_centers, line_winding, line_edge_weight, num_along);
+            }
+            if (root_mask > 1u)
+            {
+                accumulate_crossing(c2, -sign, pixels_per_em, along_centers, line_winding, line_edge_weight, num_along);
+            }
+        }
+    }
+}
 
-    int num_glyphs = (int)xarr_len(build_glyphs);
-    xarr_setlen(font->glyphs, num_glyphs);
-    for (int i = 0; i < num_glyphs; i++)
+void slug_rasterize_glyph(
+    const slug_texels_t* texels,
+    const slug_glyph_t*  glyph,
+    float                pixels_per_em,
+    uint8_t*             coverage,
+    int                  width,
+    int                  height,
+    int                  stride)
+{
+    for (int y = 0; y < height; y++)
+    {
+        memset(&coverage[y * stride], 0, width);
+    }
+    if ((glyph->max_band_x < 0.0f) || (glyph->max_band_y < 0.0f) || (width <= 0) || (height <= 0))
     {
-        const slug_glyph_build_t* bg = &build_glyphs[i];
-        font->glyphs[i]              = (slug_glyph_t){.bbox        = bg->bbox,
-                                                      .advance     = bg->advance,
-                                                      .lsb         = bg->lsb,
-                                                      .max_band_x  = xarr_len(bg->vertical_bands) - 1,
-                                                      .max_band_y  = xarr_len(bg->horizontal_bands) - 1,
-                                                      .band_scale  = bg->band_scale,
-                                                      .band_offset = bg->band_offset,
-                                                      .glyph_loc   = {
-                                             [0] = bg->glyph_loc[0],
-                                             [1] = bg->glyph_loc[1],
-                                         }};
+        return;
     }
 
-    xarr_free(res.curve_pixels);
-    xarr_free(res.band_pixels);
-    for (int i = 0; i < xarr_len(build_glyphs); i++)
+    // Pixel centers in glyph space, row 0 is the top of the bitmap
+    float* x_centers     = (float*)malloc(width * sizeof(float));
+    float* y_centers     = (float*)malloc(height * sizeof(float));
+    float* h_winding     = (float*)malloc((size_t)width * height * sizeof(float));
+    float* h_edge_weight = (float*)malloc((size_t)width * height * sizeof(float));
+    float* v_winding     = (float*)malloc((size_t)width * height * sizeof(float));
+    float* v_edge_weight = (float*)malloc((size_t)width * height * sizeof(float));
+    for (int x = 0; x < width; x++)
     {
-        free_build_glyph(&build_glyphs[i]);
+        x_centers[x] = glyph->bbox.x0 + ((float)x + 0.5f) / pixels_per_em;
     }
-    xarr_free(build_glyphs);
-    font->valid = true;
-    return true;
+    for (int y = 0; y < height; y++)
+    {
+        y_centers[y] = glyph->bbox.y1 - ((float)y + 0.5f) / pixels_per_em;
+    }
+
+    // h_* is indexed [y][x], v_* is indexed [x][y]
+    rasterize_axis(texels, glyph, 0, pixels_per_em, x_centers, width, y_centers, height, h_winding, h_edge_weight);
+    rasterize_axis(texels, glyph, 1, pixels_per_em, y_centers, height, x_centers, width, v_winding, v_edge_weight);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float hw  = h_winding[y * width + x];
+            float hew = h_edge_weight[y * width + x];
+            float vw  = v_winding[x * height + y];
+            float vew = v_edge_weight[x * height + y];
+            // Same as the end of program_slug.glsl
+            float cov = maxf(
+                fabsf(hw * hew + vw * vew) / maxf(hew + vew, 1.0f / 65536.0f),
+                minf(fabsf(hw), fabsf(vw)));
+            cov                      = minf(maxf(cov, 0.0f), 1.0f);
+            coverage[y * stride + x] = (uint8_t)lrintf(cov * 255.0f);
+        }
+    }
+
+    free(x_centers);
+    free(y_centers);
+    free(h_winding);
+    free(h_edge_weight);
+    free(v_winding);
+    free(v_edge_weight);
 }
 
-void slug_unload_font(slug_font_t* font)
+bool slug_measure_lod_error(
+    const slug_texels_t* texels,
+    const slug_glyph_t*  glyph,
+    float                pixels_per_em,
+    slug_lod_error_t*    out)
 {
-    sg_destroy_image(font->curve.img);
-    sg_destroy_view(font->curve.tex_view);
-    sg_destroy_image(font->band.img);
-    sg_destroy_view(font->band.tex_view);
-    xarr_free(font->glyphs);
-    xarr_free(font->cpal_colors);
-    xarr_free(font->colr_bases);
-    xarr_free(font->colr_layers);
-    *font = (slug_font_t){0};
+    *out = (slug_lod_error_t){0};
+    if ((glyph->max_band_x < 0.0f) || (glyph->max_band_y < 0.0f))
+    {
+        return false;
+    }
+    int          width    = maxi((int)ceilf((glyph->bbox.x1 - glyph->bbox.x0) * pixels_per_em), 1);
+    int          height   = maxi((int)ceilf((glyph->bbox.y1 - glyph->bbox.y0) * pixels_per_em), 1);
+    slug_glyph_t lod      = slug_glyph_lod(glyph);
+    uint8_t*     full     = (uint8_t*)malloc((size_t)width * height);
+    uint8_t*     simple   = (uint8_t*)malloc((size_t)width * height);
+    int          sum_diff = 0;
+    int          max_diff = 0;
+    slug_rasterize_glyph(texels, glyph, pixels_per_em, full, width, height, width);
+    slug_rasterize_glyph(texels, &lod, pixels_per_em, simple, width, height, width);
+    for (int i = 0; i < width * height; i++)
+    {
+        int diff  = abs((int)full[i] - (int)simple[i]);
+        sum_diff += diff;
+        max_diff  = maxi(max_diff, diff);
+        if (diff > 255 / 4)
+        {
+            out->num_pixels++;
+        }
+    }
+    out->mean_error = (float)sum_diff / (255.0f * (float)(width * height));
+    out->max_error  = (float)max_diff / 255.0f;
+    free(full);
+    free(simple);
+    return true;
 }
 
 static uint32_t make_tag(char a, char b, char c, char d) { return (a << 24) | (b << 16) | (c << 8) | d; }
@@ -274,51 +1625,139 @@ static bool parse_colr_v0(slug_font_t* font, const slug_range_t* data)
     return true;
 }
 
-static int mini(int a, int b) { return a < b ? a : b; }
-
-static int clampi(int val, int minval, int maxval)
+static bool parse_cpal(slug_font_t* font, const slug_range_t* data)
 {
-    if (val < minval)
-        return minval;
-    else if (val > maxval)
-        return maxval;
-    else
-        return val;
+    int table_offset = find_otf_table(data, make_tag('C', 'P', 'A', 'L'));
+    if (table_offset < 0)
+    {
+        // not a bug, CPAL is optional
+        return true;
+    }
+    // Table header (12 bytes from table start):
+    //   Offset +0: u16 version
+    //   Offset +2: u16 numPaletteEntries   (number of colors per palette)
+    //   Offset +4: u16 numPalettes         (usually 1)
+    //   Offset +6: u16 numColorRecords     (total colors across all palettes)
+    //   Offset +8: u32 offsetFirstColorRecord  (from table start)
+    int num_entries       = (int)read_u16be(data, table_offset + 2);
+    int num_color_records = (int)read_u16be(data, table_offset + 6);
+    int color_offset      = table_offset + (int)read_u32be(data, table_offset + 8);
+    int count             = mini(num_entries, num_color_records);
+    xarr_setlen(font->cpal_colors, count);
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t* src = (uint8_t*)data->ptr + color_offset + i * 4;
+        vec4_t*        dst = &font->cpal_colors[i];
+        dst->z             = ((float)*src++) / 255.0f;
+        dst->y             = ((float)*src++) / 255.0f;
+        dst->x             = ((float)*src++) / 255.0f;
+        dst->w             = ((float)*src) / 255.0f;
+    }
+    return true;
 }
 
-static float minf(float a, float b) { return a < b ? a : b; }
+static void map_codepoint(slug_font_t* font, const uint16_t* glyph_colr_bases, uint32_t codepoint)
+{
+    int glyph_index = stbtt_FindGlyphIndex(&font->info, (int)codepoint);
+    if (glyph_index <= 0)
+    {
+        return;
+    }
+    uint16_t* page = &font->cmap_pages[codepoint >> SLUG_CMAP_PAGE_BITS];
+    if (*page == 0)
+    {
+        int num_entries = (int)xarr_len(font->cmap_entries);
+        xarr_setlen(font->cmap_entries, num_entries + SLUG_CMAP_PAGE_SIZE);
+        memset(font->cmap_entries + num_entries, 0, SLUG_CMAP_PAGE_SIZE * sizeof(slug_cmap_entry_t));
+        *page = (uint16_t)(num_entries / SLUG_CMAP_PAGE_SIZE);
+    }
+    slug_cmap_entry_t* page_entries                     = &font->cmap_entries[*page * SLUG_CMAP_PAGE_SIZE];
+    page_entries[codepoint & (SLUG_CMAP_PAGE_SIZE - 1)] = (slug_cmap_entry_t){
+        .glyph_index = (uint16_t)glyph_index,
+        .colr_base   = glyph_colr_bases[glyph_index],
+    };
+}
 
-static float maxf(float a, float b) { return a > b ? a : b; }
+static void map_codepoint_range(slug_font_t* font, const uint16_t* glyph_colr_bases, uint32_t first, uint32_t last)
+{
+    last = last < 0x10FFFF ? last : 0x10FFFF;
+    for (uint32_t codepoint = first; codepoint <= last; codepoint++)
+    {
+        map_codepoint(font, glyph_colr_bases, codepoint);
+    }
+}
 
-static bool parse_cpal(slug_font_t* font, const slug_range_t* data)
+// Builds the two level codepoint -> glyph/COLR base table. The cmap subtable stbtt picked is only walked for the
+// codepoint ranges it covers, the glyph indices themselves still come from stbtt_FindGlyphIndex().
+static void build_cmap(slug_font_t* font, const slug_range_t* data)
 {
-    int table_offset = find_otf_table(data, make_tag('C', 'P', 'A', 'L'));
-    if (table_offset < 0)
+    xarr_setlen(font->cmap_pages, SLUG_CMAP_NUM_PAGES);
+    xarr_setlen(font->cmap_entries, SLUG_CMAP_PAGE_SIZE);
+    memset(font->cmap_pages, 0, SLUG_CMAP_NUM_PAGES * sizeof(uint16_t));
+    memset(font->cmap_entries, 0, SLUG_CMAP_PAGE_SIZE * sizeof(slug_cmap_entry_t));
+
+    // COLR base index + 1 for every glyph, 0 if it has no layers
+    uint16_t* glyph_colr_bases = 0;
+    xarr_setlen(glyph_colr_bases, font->info.numGlyphs);
+    memset(glyph_colr_bases, 0, font->info.numGlyphs * sizeof(uint16_t));
+    for (int i = 0; i < xarr_len(font->colr_bases); i++)
+    {
+        if (font->colr_bases[i].glyph_id < font->info.numGlyphs)
+        {
+            glyph_colr_bases[font->colr_bases[i].glyph_id] = (uint16_t)(i + 1);
+        }
+    }
+
+    size_t   index_map = (size_t)font->info.index_map;
+    uint16_t format    = index_map + 2 <= data->size ? read_u16be(data, index_map) : 0xffff;
+    if (format == 0)
+    {
+        // byte encoding table
+        map_codepoint_range(font, glyph_colr_bases, 0, 255);
+    }
+    else if ((format == 4) && ((index_map + 14) <= data->size))
+    {
+        // segment mapping to delta values
+        //   Offset +6:  u16 segCountX2
+        //   Offset +14: u16 endCode[segCount], u16 reservedPad, u16 startCode[segCount], ...
+        size_t seg_count = read_u16be(data, index_map + 6) / 2;
+        if ((index_map + 16 + seg_count * 4) <= data->size)
+        {
+            for (size_t i = 0; i < seg_count; i++)
+            {
+                uint16_t end_code   = read_u16be(data, index_map + 14 + i * 2);
+                uint16_t start_code = read_u16be(data, index_map + 16 + seg_count * 2 + i * 2);
+                map_codepoint_range(font, glyph_colr_bases, start_code, end_code);
+            }
+        }
+    }
+    else if ((format == 6) && ((index_map + 10) <= data->size))
     {
-        // not a bug, CPAL is optional
-        return true;
+        // trimmed table mapping
+        uint32_t first = read_u16be(data, index_map + 6);
+        uint32_t count = read_u16be(data, index_map + 8);
+        if (count > 0)
+        {
+            map_codepoint_range(font, glyph_colr_bases, first, first + count - 1);
+        }
     }
-    // Table header (12 bytes from table start):
-    //   Offset +0: u16 version
-    //   Offset +2: u16 numPaletteEntries   (number of colors per palette)
-    //   Offset +4: u16 numPalettes         (usually 1)
-    //   Offset +6: u16 numColorRecords     (total colors across all palettes)
-    //   Offset +8: u32 offsetFirstColorRecord  (from table start)
-    int num_entries       = (int)read_u16be(data, table_offset + 2);
-    int num_color_records = (int)read_u16be(data, table_offset + 6);
-    int color_offset      = table_offset + (int)read_u32be(data, table_offset + 8);
-    int count             = mini(num_entries, num_color_records);
-    xarr_setlen(font->cpal_colors, count);
-    for (int i = 0; i < count; i++)
+    else if (((format == 12) || (format == 13)) && ((index_map + 16) <= data->size))
     {
-        const uint8_t* src = (uint8_t*)data->ptr + color_offset + i * 4;
-        vec4_t*        dst = &font->cpal_colors[i];
-        dst->z             = ((float)*src++) / 255.0f;
-        dst->y             = ((float)*src++) / 255.0f;
-        dst->x             = ((float)*src++) / 255.0f;
-        dst->w             = ((float)*src) / 255.0f;
+        // segmented coverage / many-to-one range mappings
+        //   Offset +12: u32 numGroups
+        //   Offset +16: {u32 startCharCode, u32 endCharCode, u32 glyphID}[numGroups]
+        size_t num_groups = read_u32be(data, index_map + 12);
+        if (num_groups <= (data->size - index_map - 16) / 12)
+        {
+            for (size_t i = 0; i < num_groups; i++)
+            {
+                uint32_t start_code = read_u32be(data, index_map + 16 + i * 12);
+                uint32_t end_code   = read_u32be(data, index_map + 16 + i * 12 + 4);
+                map_codepoint_range(font, glyph_colr_bases, start_code, end_code);
+            }
+        }
     }
-    return true;
+    xarr_free(glyph_colr_bases);
 }
 
 static void free_build_glyph(slug_glyph_build_t* glyph)
@@ -337,7 +1776,12 @@ static void free_build_glyph(slug_glyph_build_t* glyph)
     xarr_free(glyph->vertical_bands);
 }
 
-static void init_build_glyph(const stbtt_fontinfo* info, int glyph_index, float em_scale, slug_glyph_build_t* out)
+static void init_build_glyph(
+    const stbtt_fontinfo* info,
+    int                   glyph_index,
+    float                 em_scale,
+    bool                  compact_curves,
+    slug_glyph_build_t*   out)
 {
     slug_glyph_build_t* glyph = out;
     memset(glyph, 0, sizeof(slug_glyph_build_t));
@@ -452,28 +1896,158 @@ static void init_build_glyph(const stbtt_fontinfo* info, int glyph_index, float
         }
     }
     stbtt_FreeShape(info, verts);
+
+    // Control points can stick out of the font's bbox (eg. cubics approximated above). Compact curves are
+    // quantized relative to the bbox, so it must contain every point. Other fonts keep the font's bbox, which is
+    // what they have always drawn with: growing it would change their band split and instance rect.
+    for (int i = 0; compact_curves && i < xarr_len(glyph->curves); i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            vec2_t p         = glyph->curves[i].p[j];
+            glyph->bbox.x0 = minf(glyph->bbox.x0, p.x);
+            glyph->bbox.y0 = minf(glyph->bbox.y0, p.y);
+            glyph->bbox.x1 = maxf(glyph->bbox.x1, p.x);
+            glyph->bbox.y1 = maxf(glyph->bbox.y1, p.y);
+        }
+    }
+}
+
+// Bands are sorted by descending sort_key so the shader can stop at the first curve that's entirely behind the
+// pixel. Most bands are short enough for insertion sort, long ones use an LSD radix sort on the key bits.
+// Both are stable, so curves with equal keys stay in curve order.
+#define SLUG_BAND_INSERTION_SORT_MAX (32)
+
+static uint32_t band_sort_bits(float key)
+{
+    // Maps floats to unsigned ints with the same ordering, then flips them so ascending bits is descending keys
+    uint32_t bits;
+    memcpy(&bits, &key, sizeof(bits));
+    bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    return ~bits;
 }
 
-static int band_cmp(const void* a, const void* b)
+static void insertion_sort_band(slug_band_entry_t* entries, int num_entries)
 {
-    const slug_band_entry_t* pa = (slug_band_entry_t*)a;
-    const slug_band_entry_t* pb = (slug_band_entry_t*)b;
-    // NOTE: inverted sort-order is not a bug
-    if (pa->sort_key > pb->sort_key)
+    for (int i = 1; i < num_entries; i++)
     {
-        return -1;
+        slug_band_entry_t entry = entries[i];
+        int               j     = i - 1;
+        // NOTE: inverted sort-order is not a bug
+        while ((j >= 0) && (entries[j].sort_key < entry.sort_key))
+        {
+            entries[j + 1] = entries[j];
+            j--;
+        }
+        entries[j + 1] = entry;
     }
-    else if (pa->sort_key < pb->sort_key)
+}
+
+static void radix_sort_band(slug_band_entry_t* entries, int num_entries, slug_band_entry_t** scratch)
+{
+    xarr_setlen(*scratch, num_entries);
+    slug_band_entry_t* src = entries;
+    slug_band_entry_t* dst = *scratch;
+    // 4 passes of 8 bits leaves the result back in entries
+    for (int shift = 0; shift < 32; shift += 8)
     {
-        return 1;
+        int counts[256] = {0};
+        for (int i = 0; i < num_entries; i++)
+        {
+            counts[(band_sort_bits(src[i].sort_key) >> shift) & 0xff]++;
+        }
+        int offset = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            int count  = counts[i];
+            counts[i]  = offset;
+            offset    += count;
+        }
+        for (int i = 0; i < num_entries; i++)
+        {
+            dst[counts[(band_sort_bits(src[i].sort_key) >> shift) & 0xff]++] = src[i];
+        }
+        slug_band_entry_t* tmp = src;
+        src                    = dst;
+        dst                    = tmp;
+    }
+    assert(src == entries);
+}
+
+static void sort_band(slug_band_entry_t* entries, slug_band_entry_t** scratch)
+{
+    int num_entries = (int)xarr_len(entries);
+    if (num_entries <= SLUG_BAND_INSERTION_SORT_MAX)
+    {
+        insertion_sort_band(entries, num_entries);
     }
     else
     {
-        return 0;
+        radix_sort_band(entries, num_entries, scratch);
+    }
+}
+
+// Curves are added to every band they overlap, padded by half a band so that pixels near a band edge still see
+// curves just across it
+static void curve_band_range(
+    float lo,
+    float hi,
+    float origin,
+    float band_size,
+    int   num_bands,
+    int*  band_first,
+    int*  band_last)
+{
+    float pad   = band_size * 0.5f;
+    *band_first = clampi((int)floorf((lo - pad - origin) / band_size), 0, num_bands - 1);
+    *band_last  = clampi((int)floorf((hi + pad - origin) / band_size), 0, num_bands - 1);
+}
+
+static void curve_extent(const slug_curve_t* curve, int axis, float* lo, float* hi)
+{
+    float a = axis == 0 ? curve->p[0].x : curve->p[0].y;
+    float b = axis == 0 ? curve->p[1].x : curve->p[1].y;
+    float c = axis == 0 ? curve->p[2].x : curve->p[2].y;
+    *lo     = minf(minf(a, b), c);
+    *hi     = maxf(maxf(a, b), c);
+}
+
+// Picks how many bands to split one axis of a glyph into. Bands all cover the same fraction of the glyph, so the
+// number of curves a pixel is expected to test is the average band occupancy. More bands lower it, but every band
+// adds a header and curves spanning several bands add a reference to each, so the count with the lowest occupancy
+// plus SLUG_BAND_TEXEL_COST per band texel wins. Wide glyphs end up with more vertical than horizontal bands and
+// simple glyphs stay small.
+static int choose_band_count(const slug_glyph_build_t* glyph, int axis, float origin, float extent, int band_limit)
+{
+    int   num_curves = (int)xarr_len(glyph->curves);
+    int   max_bands  = clampi(num_curves, 1, band_limit);
+    int   best_bands = 1;
+    float best_cost  = FLT_MAX;
+    for (int num_bands = 1; num_bands <= max_bands; num_bands++)
+    {
+        float band_size   = extent / (float)num_bands;
+        int   num_entries = 0;
+        for (int i = 0; i < num_curves; i++)
+        {
+            float lo, hi;
+            int   band_first, band_last;
+            curve_extent(&glyph->curves[i], axis, &lo, &hi);
+            curve_band_range(lo, hi, origin, band_size, num_bands, &band_first, &band_last);
+            num_entries += band_last - band_first + 1;
+        }
+        float occupancy = (float)num_entries / (float)num_bands;
+        float cost      = occupancy + SLUG_BAND_TEXEL_COST * (float)(num_bands + num_entries);
+        if (cost < best_cost)
+        {
+            best_cost  = cost;
+            best_bands = num_bands;
+        }
     }
+    return best_bands;
 }
 
-static void build_bands(slug_glyph_build_t* glyph)
+// band_limit_x and band_limit_y cap the number of vertical and horizontal bands, up to SLUG_MAX_BANDS
+static void build_bands_limited(slug_glyph_build_t* glyph, int band_limit_x, int band_limit_y)
 {
     int num_curves = (int)xarr_len(glyph->curves);
     if (0 == num_curves)
@@ -483,8 +2057,8 @@ static void build_bands(slug_glyph_build_t* glyph)
 
     float band_width             = maxf(glyph->bbox.x1 - glyph->bbox.x0, 1.0f);
     float band_height            = maxf(glyph->bbox.y1 - glyph->bbox.y0, 1.0f);
-    int   number_of_bands_height = clampi(num_curves, 1, SLUG_MAX_BANDS);
-    int   number_of_bands_width  = clampi(num_curves, 1, SLUG_MAX_BANDS);
+    int   number_of_bands_height = choose_band_count(glyph, 1, glyph->bbox.y0, band_height, band_limit_y);
+    int   number_of_bands_width  = choose_band_count(glyph, 0, glyph->bbox.x0, band_width, band_limit_x);
 
     xarr_setlen(glyph->horizontal_bands, number_of_bands_height);
     xarr_setlen(glyph->vertical_bands, number_of_bands_width);
@@ -501,26 +2075,23 @@ static void build_bands(slug_glyph_build_t* glyph)
 
     float horizontal_band_height = band_height / (float)number_of_bands_height;
     float vertical_band_width    = band_width / (float)number_of_bands_width;
-    float horizontal_pad         = horizontal_band_height * 0.5f;
-    float vertical_pad           = vertical_band_width * 0.5f;
 
     int band_first, band_last;
     for (int curve_index = 0; curve_index < xarr_len(glyph->curves); curve_index++)
     {
-        slug_curve_t* curve       = &glyph->curves[curve_index];
-        float         curve_y_min = minf(minf(curve->p[0].y, curve->p[1].y), curve->p[2].y);
-        float         curve_y_max = maxf(maxf(curve->p[0].y, curve->p[1].y), curve->p[2].y);
-        float         curve_x_min = minf(minf(curve->p[0].x, curve->p[1].x), curve->p[2].x);
-        float         curve_x_max = maxf(maxf(curve->p[0].x, curve->p[1].x), curve->p[2].x);
-
-        band_first = clampi(
-            (int)floorf((curve_y_min - horizontal_pad - glyph->bbox.y0) / horizontal_band_height),
-            0,
-            number_of_bands_height - 1);
-        band_last = clampi(
-            (int)floorf((curve_y_max + horizontal_pad - glyph->bbox.y0) / horizontal_band_height),
-            0,
-            number_of_bands_height - 1);
+        slug_curve_t* curve = &glyph->curves[curve_index];
+        float         curve_x_min, curve_x_max, curve_y_min, curve_y_max;
+        curve_extent(curve, 0, &curve_x_min, &curve_x_max);
+        curve_extent(curve, 1, &curve_y_min, &curve_y_max);
+
+        curve_band_range(
+            curve_y_min,
+            curve_y_max,
+            glyph->bbox.y0,
+            horizontal_band_height,
+            number_of_bands_height,
+            &band_first,
+            &band_last);
         for (int i = band_first; i <= band_last; i++)
         {
             xarr_push(
@@ -528,14 +2099,14 @@ static void build_bands(slug_glyph_build_t* glyph)
                 ((slug_band_entry_t){.curve_index = curve_index, .sort_key = curve_x_max}));
         }
 
-        band_first = clampi(
-            (int)floorf((curve_x_min - vertical_pad - glyph->bbox.x0) / vertical_band_width),
-            0,
-            number_of_bands_width - 1);
-        band_last = clampi(
-            (int)floorf((curve_x_max + vertical_pad - glyph->bbox.x0) / vertical_band_width),
-            0,
-            number_of_bands_width - 1);
+        curve_band_range(
+            curve_x_min,
+            curve_x_max,
+            glyph->bbox.x0,
+            vertical_band_width,
+            number_of_bands_width,
+            &band_first,
+            &band_last);
         for (int i = band_first; i <= band_last; i++)
         {
             xarr_push(
@@ -543,24 +2114,171 @@ static void build_bands(slug_glyph_build_t* glyph)
                 ((slug_band_entry_t){.curve_index = curve_index, .sort_key = curve_y_max}));
         }
     }
-    int num_horizontal_bands = (int)xarr_len(glyph->horizontal_bands);
-    for (int i = 0; i < num_horizontal_bands; i++)
+    slug_band_entry_t* scratch = NULL;
+    for (int i = 0; i < xarr_len(glyph->horizontal_bands); i++)
+    {
+        sort_band(glyph->horizontal_bands[i], &scratch);
+    }
+    for (int i = 0; i < xarr_len(glyph->vertical_bands); i++)
+    {
+        sort_band(glyph->vertical_bands[i], &scratch);
+    }
+    xarr_free(scratch);
+}
+
+static void build_bands(slug_glyph_build_t* glyph) { build_bands_limited(glyph, SLUG_MAX_BANDS, SLUG_MAX_BANDS); }
+
+//------------------------------------------------------------------------------
+//  Glyph LOD
+//
+//  A glyph's LOD replaces each run of consecutive curves of a contour with a
+//  single quadratic when that stays within the tolerance of the run. The
+//  replacement starts and ends where the run does and takes its control point
+//  from where the run's end tangents meet, or is a line when they don't meet
+//  ahead of both ends. Runs grow greedily, so long near colinear stretches and
+//  smooth arcs split into many curves collapse, while corners stay put.
+//  Contours that collapse entirely are dropped.
+//------------------------------------------------------------------------------
+
+// Max distance between a LOD curve and the curves it replaces, in pixels at lod_pixels_per_em
+#define SLUG_LOD_TOLERANCE_PIXELS (0.25f)
+// Thinnest band of a LOD glyph, in pixels at lod_pixels_per_em
+#define SLUG_LOD_MIN_BAND_PIXELS (1.0f)
+// Longest run of curves that gets replaced, which bounds the cost of fitting
+#define SLUG_LOD_MAX_RUN (16)
+// Curves are compared at this many points along them
+#define SLUG_LOD_SAMPLES (8)
+
+static float cross2(vec2_t a, vec2_t b) { return a.x * b.y - a.y * b.x; }
+
+static float dot2(vec2_t a, vec2_t b) { return a.x * b.x + a.y * b.y; }
+
+static float segment_distance_squared(vec2_t a, vec2_t b, vec2_t pt)
+{
+    vec2_t ab   = vec2_sub(b, a);
+    float  len2 = dot2(ab, ab);
+    float  t    = len2 > 0.0f ? minf(maxf(dot2(vec2_sub(pt, a), ab) / len2, 0.0f), 1.0f) : 0.0f;
+    vec2_t d    = vec2_sub(pt, vec2_add(a, vec2_mulf(ab, t)));
+    return dot2(d, d);
+}
+
+// Squared distance from pt to the curves, flattened to SLUG_LOD_SAMPLES lines each
+static float curves_distance_squared(const slug_curve_t* curves, int count, vec2_t pt)
+{
+    float best = FLT_MAX;
+    for (int i = 0; i < count; i++)
+    {
+        vec2_t a = curves[i].p[0];
+        for (int k = 1; k <= SLUG_LOD_SAMPLES; k++)
+        {
+            vec2_t b = eval_quad(&curves[i], (float)k / (float)SLUG_LOD_SAMPLES);
+            best     = minf(best, segment_distance_squared(a, b, pt));
+            a        = b;
+        }
+    }
+    return best;
+}
+
+// Whether every point of each set of curves is within tolerance of the other set
+static bool curves_within(const slug_curve_t* a, int count_a, const slug_curve_t* b, int count_b, float tolerance)
+{
+    float tolerance2 = tolerance * tolerance;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const slug_curve_t* from       = pass == 0 ? a : b;
+        const slug_curve_t* to         = pass == 0 ? b : a;
+        int                 count_from = pass == 0 ? count_a : count_b;
+        int                 count_to   = pass == 0 ? count_b : count_a;
+        for (int i = 0; i < count_from; i++)
+        {
+            for (int k = 1; k < SLUG_LOD_SAMPLES; k++)
+            {
+                vec2_t pt = eval_quad(&from[i], (float)k / (float)SLUG_LOD_SAMPLES);
+                if (curves_distance_squared(to, count_to, pt) > tolerance2)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Fits a single curve to a run of curves, returns false if it's off by more than tolerance. The control point must
+// stay inside the bbox, compact curves are quantized relative to it.
+static bool fit_lod_curve(const slug_curve_t* run, int count, slug_bbox_t bbox, float tolerance, slug_curve_t* out)
+{
+    vec2_t p0      = run[0].p[0];
+    vec2_t p2      = run[count - 1].p[2];
+    vec2_t control = vec2_mulf(vec2_add(p0, p2), 0.5f);
+    // End tangents, lines store their midpoint as the control point so they always have one
+    vec2_t d0    = vec2_sub(run[0].p[1], p0);
+    vec2_t d1    = vec2_sub(p2, run[count - 1].p[1]);
+    float  denom = cross2(d0, d1);
+    if (fabsf(denom) > 1e-6f * sqrtf(dot2(d0, d0) * dot2(d1, d1)))
     {
-        if (glyph->horizontal_bands[i])
+        vec2_t chord = vec2_sub(p2, p0);
+        float  s     = cross2(chord, d1) / denom;
+        float  u     = cross2(d0, chord) / denom;
+        vec2_t meet  = vec2_add(p0, vec2_mulf(d0, s));
+        if ((s > 0.0f) && (u > 0.0f) && (meet.x >= bbox.x0) && (meet.x <= bbox.x1) && (meet.y >= bbox.y0) &&
+            (meet.y <= bbox.y1))
         {
-            size_t num_band_entries = xarr_len(glyph->horizontal_bands[i]);
-            qsort(glyph->horizontal_bands[i], num_band_entries, sizeof(slug_band_entry_t), band_cmp);
+            control = meet;
         }
     }
-    int num_vertical_bands = (int)xarr_len(glyph->vertical_bands);
-    for (int i = 0; i < num_vertical_bands; i++)
+    *out = (slug_curve_t){.p = {p0, control, p2}};
+    return curves_within(out, 1, run, count, tolerance);
+}
+
+// Builds the simplified curves of glyph into out, with bands for drawing at up to lod_pixels_per_em. out keeps the
+// glyph's bbox so both draw from the same instance rect.
+static void build_lod_glyph(const slug_glyph_build_t* glyph, float lod_pixels_per_em, slug_glyph_build_t* out)
+{
+    memset(out, 0, sizeof(slug_glyph_build_t));
+    out->bbox    = glyph->bbox;
+    out->advance = glyph->advance;
+    out->lsb     = glyph->lsb;
+
+    float tolerance = SLUG_LOD_TOLERANCE_PIXELS / lod_pixels_per_em;
+    for (int contour_index = 0; contour_index < xarr_len(glyph->contours); contour_index++)
     {
-        if (glyph->vertical_bands[i])
+        const slug_contour_range_t* contour = &glyph->contours[contour_index];
+        const slug_curve_t*         curves  = &glyph->curves[contour->start];
+        int                         start   = (int)xarr_len(out->curves);
+        int                         i       = 0;
+        while (i < contour->count)
+        {
+            // Grow the run while a single curve still fits it
+            slug_curve_t merged = curves[i];
+            int          count  = 1;
+            slug_curve_t candidate;
+            while ((count < SLUG_LOD_MAX_RUN) && ((i + count) < contour->count) &&
+                   fit_lod_curve(&curves[i], count + 1, glyph->bbox, tolerance, &candidate))
+            {
+                merged = candidate;
+                count++;
+            }
+            xarr_push(out->curves, merged);
+            i += count;
+        }
+        int count = (int)xarr_len(out->curves) - start;
+        if (count >= 2)
+        {
+            xarr_push(out->contours, ((slug_contour_range_t){.start = start, .count = count}));
+        }
+        else
         {
-            size_t num_band_entries = xarr_len(glyph->vertical_bands[i]);
-            qsort(glyph->vertical_bands[i], num_band_entries, sizeof(slug_band_entry_t), band_cmp);
+            xarr_setlen(out->curves, start);
         }
     }
+
+    float extent_x = (glyph->bbox.x1 - glyph->bbox.x0) * lod_pixels_per_em;
+    float extent_y = (glyph->bbox.y1 - glyph->bbox.y0) * lod_pixels_per_em;
+    build_bands_limited(
+        out,
+        clampi((int)(extent_x / SLUG_LOD_MIN_BAND_PIXELS), 1, SLUG_MAX_BANDS),
+        clampi((int)(extent_y / SLUG_LOD_MIN_BAND_PIXELS), 1, SLUG_MAX_BANDS));
 }
 
 static void pad_to_row_curve_pixels(pack_textures_t* res, int needed)
@@ -637,45 +2355,118 @@ static void finalize_band_pixels(pack_textures_t* res)
     }
 }
 
+// A run of curve references already written for the current glyph. Band headers store their data offset
+// relative to the glyph, so runs can only be shared between bands of the same glyph.
+typedef struct
+{
+    uint32_t hash;
+    int      offset;
+    int      count;
+} band_run_t;
+
+typedef struct
+{
+    band_run_t runs[SLUG_MAX_BANDS * 2];
+    int        num_runs;
+} band_runs_t;
+
+static uint32_t hash_band(const slug_band_entry_t* band, const slug_curve_t* curves)
+{
+    // FNV-1a over the texture coordinates that end up in the band texture
+    uint32_t hash = 0x811c9dc5u;
+    for (int i = 0; i < xarr_len(band); i++)
+    {
+        const slug_curve_t* curve  = &curves[band[i].curve_index];
+        hash                      ^= ((uint32_t)curve->texture[1] << 16) | curve->texture[0];
+        hash                      *= 0x01000193u;
+    }
+    return hash;
+}
+
+static int find_band_run(
+    const band_runs_t*       runs,
+    const slug_band_entry_t* band,
+    const slug_curve_t*      curves,
+    const u16vec2_t*         glyph_pixels,
+    uint32_t                 hash)
+{
+    int num_entries = (int)xarr_len(band);
+    for (int run_index = 0; run_index < runs->num_runs; run_index++)
+    {
+        const band_run_t* run = &runs->runs[run_index];
+        if ((run->hash != hash) || (run->count != num_entries))
+        {
+            continue;
+        }
+        bool match = true;
+        for (int i = 0; match && (i < num_entries); i++)
+        {
+            const slug_curve_t* curve = &curves[band[i].curve_index];
+            const u16vec2_t*    texel = &glyph_pixels[run->offset + i];
+            match                     = (texel->x == curve->texture[0]) && (texel->y == curve->texture[1]);
+        }
+        if (match)
+        {
+            return run->offset;
+        }
+    }
+    return -1;
+}
+
 static void write_band_set(
     slug_band_entry_t** bands,
     slug_curve_t*       curves,
     u16vec2_t*          pixels,
     int                 glyph_start,
     int                 header_offset,
-    int*                write_offset)
+    int*                write_offset,
+    band_runs_t*        runs,
+    slug_font_stats_t*  stats)
 {
-    // Write headers: each band stores (count, data_offset) where data_offset
-    // is relative to glyph_start, matching how the shader indexes into the texture.
+    // Each band header stores (count, data_offset) where data_offset is relative to glyph_start, matching how
+    // the shader indexes into the texture. Neighbouring and mirrored bands often hold the same curves, so a band
+    // whose references were already written for this glyph points its header at that run instead of a copy.
     int data_offset = *write_offset;
     for (int band_index = 0; band_index < xarr_len(bands); band_index++)
     {
-        slug_band_entry_t* band                           = bands[band_index];
-        u16vec2_t          pixel                          = {(uint16_t)xarr_len(band), (uint16_t)data_offset};
-        pixels[glyph_start + header_offset + band_index]  = pixel;
-        data_offset                                      += (int)xarr_len(band);
-    }
-    // Write curve references at the offsets declared above
-    data_offset = *write_offset;
-    for (int band_index = 0; band_index < xarr_len(bands); band_index++)
-    {
-        slug_band_entry_t* band = bands[band_index];
-        for (int entry_index = 0; entry_index < xarr_len(band); entry_index++)
+        slug_band_entry_t* band        = bands[band_index];
+        int                num_entries = (int)xarr_len(band);
+        u16vec2_t*         header      = &pixels[glyph_start + header_offset + band_index];
+
+        stats->num_bands                 += 1;
+        stats->num_band_entries          += num_entries;
+        stats->max_band_entries           = maxi(stats->max_band_entries, num_entries);
+        stats->num_unshared_band_texels  += num_entries + 1;
+        if (num_entries == 0)
+        {
+            *header = (u16vec2_t){0, (uint16_t)data_offset};
+            continue;
+        }
+        uint32_t hash       = hash_band(band, curves);
+        int      run_offset = find_band_run(runs, band, curves, &pixels[glyph_start], hash);
+        if (run_offset >= 0)
+        {
+            *header                  = (u16vec2_t){(uint16_t)num_entries, (uint16_t)run_offset};
+            stats->num_shared_bands += 1;
+            continue;
+        }
+        assert(runs->num_runs < (int)(sizeof(runs->runs) / sizeof(runs->runs[0])));
+        runs->runs[runs->num_runs++] = (band_run_t){hash, data_offset, num_entries};
+
+        *header = (u16vec2_t){(uint16_t)num_entries, (uint16_t)data_offset};
+        for (int entry_index = 0; entry_index < num_entries; entry_index++)
         {
-            slug_band_entry_t* entry           = &band[entry_index];
-            slug_curve_t*      curve           = &curves[entry->curve_index];
-            u16vec2_t          pixel           = {curve->texture[0], curve->texture[1]};
-            pixels[glyph_start + data_offset]  = pixel;
+            slug_curve_t* curve                = &curves[band[entry_index].curve_index];
+            pixels[glyph_start + data_offset]  = (u16vec2_t){curve->texture[0], curve->texture[1]};
             data_offset                       += 1;
         }
     }
     *write_offset = data_offset;
 }
 
-static pack_textures_t pack_textures(slug_glyph_build_t* glyphs, int num_glyphs)
+// Appends the glyphs to whatever res already holds
+static void pack_textures(pack_textures_t* res, slug_glyph_build_t* glyphs, int num_glyphs)
 {
-    pack_textures_t res = {0};
-
     // Count how many texels we'll need so we can reserve upfront.
     // This avoids repeated realloc+copy as the dynamic arrays grow.
     int estimated_curve_size = 0;
@@ -711,60 +2502,280 @@ static pack_textures_t pack_textures(slug_glyph_build_t* glyphs, int num_glyphs)
         }
         estimated_band_size += band_size;
     }
-    xarr_setcap(res.curve_pixels, (estimated_curve_size * 6) / 5);
-    xarr_setcap(res.band_pixels, (estimated_band_size * 6) / 5);
+    xarr_setcap(res->curve_pixels, (int)xarr_len(res->curve_pixels) + (estimated_curve_size * 6) / 5);
+    xarr_setcap(res->band_pixels, (int)xarr_len(res->band_pixels) + (estimated_band_size * 6) / 5);
 
     for (int glyph_index = 0; glyph_index < num_glyphs; glyph_index++)
     {
-        slug_glyph_build_t* glyph = &glyphs[glyph_index];
-        // Pack curves into texture, recording each curve's texture coordinates
-        for (int contour_index = 0; contour_index < xarr_len(glyph->contours); contour_index++)
-        {
-            slug_contour_range_t* contour        = &glyph->contours[contour_index];
-            int                   entries_needed = contour->count + 1;
-            pad_to_row_curve_pixels(&res, entries_needed);
-            for (int i = 0; i < contour->count; i++)
-            {
-                slug_curve_t* curve       = &glyph->curves[contour->start + i];
-                int           pixel_index = (int)xarr_len(res.curve_pixels);
-                xarr_push(res.curve_pixels, vec4(curve->p[0].x, curve->p[0].y, curve->p[1].x, curve->p[1].y));
-                curve->texture[0] = (uint16_t)(pixel_index % SLUG_TEX_WIDTH);
-                curve->texture[1] = (uint16_t)(pixel_index / SLUG_TEX_WIDTH);
-            }
-            slug_curve_t* last_curve = &glyph->curves[contour->start + contour->count - 1];
-            xarr_push(res.curve_pixels, vec4(last_curve->p[2].x, last_curve->p[2].y, 0.0f, 0.0f));
-        }
+        pack_glyph(res, &glyphs[glyph_index]);
+    }
+}
+
+// Pads both textures to whole rows and sets their heights
+static void finalize_textures(pack_textures_t* res)
+{
+    finalize_curve_pixels(res);
+    finalize_band_pixels(res);
+}
 
-        // Pack band lookup tables into texture, referencing the curve coords set above
-        int num_h_bands = (int)xarr_len(glyph->horizontal_bands);
-        int num_v_bands = (int)xarr_len(glyph->vertical_bands);
-        if ((num_h_bands == 0) && (num_v_bands == 0))
+static void pack_glyph(pack_textures_t* res, slug_glyph_build_t* glyph)
+{
+    // Compact curves are stored relative to the glyph's bbox, which the shader gets per instance anyway
+    vec2_t curve_offset = vec2(0.0f, 0.0f);
+    vec2_t curve_scale  = vec2(1.0f, 1.0f);
+    if (res->compact_curves)
+    {
+        vec2_t half_extent = vec2((glyph->bbox.x1 - glyph->bbox.x0) * 0.5f, (glyph->bbox.y1 - glyph->bbox.y0) * 0.5f);
+        curve_offset       = vec2((glyph->bbox.x0 + glyph->bbox.x1) * 0.5f, (glyph->bbox.y0 + glyph->bbox.y1) * 0.5f);
+        curve_scale        = vec2(1.0f / maxf(half_extent.x, 1e-6f), 1.0f / maxf(half_extent.y, 1e-6f));
+    }
+    // Pack curves into texture, recording each curve's texture coordinates
+    for (int contour_index = 0; contour_index < xarr_len(glyph->contours); contour_index++)
+    {
+        slug_contour_range_t* contour        = &glyph->contours[contour_index];
+        int                   entries_needed = contour->count + 1;
+        pad_to_row_curve_pixels(res, entries_needed);
+        for (int i = 0; i < contour->count; i++)
         {
-            continue;
+            slug_curve_t* curve       = &glyph->curves[contour->start + i];
+            int           pixel_index = (int)xarr_len(res->curve_pixels);
+            vec2_t        p0          = vec2_mul(vec2_sub(curve->p[0], curve_offset), curve_scale);
+            vec2_t        p1          = vec2_mul(vec2_sub(curve->p[1], curve_offset), curve_scale);
+            xarr_push(res->curve_pixels, vec4(p0.x, p0.y, p1.x, p1.y));
+            curve->texture[0] = (uint16_t)(pixel_index % SLUG_TEX_WIDTH);
+            curve->texture[1] = (uint16_t)(pixel_index / SLUG_TEX_WIDTH);
         }
-        int header_size = num_h_bands + num_v_bands;
-        pad_to_row_band_pixels(&res, header_size);
+        slug_curve_t* last_curve = &glyph->curves[contour->start + contour->count - 1];
+        vec2_t        p2         = vec2_mul(vec2_sub(last_curve->p[2], curve_offset), curve_scale);
+        xarr_push(res->curve_pixels, vec4(p2.x, p2.y, 0.0f, 0.0f));
+    }
 
-        int glyph_start     = (int)xarr_len(res.band_pixels);
-        glyph->glyph_loc[0] = (int32_t)glyph_start % SLUG_TEX_WIDTH;
-        glyph->glyph_loc[1] = (int32_t)glyph_start / SLUG_TEX_WIDTH;
+    // Pack band lookup tables into texture, referencing the curve coords set above
+    int num_h_bands = (int)xarr_len(glyph->horizontal_bands);
+    int num_v_bands = (int)xarr_len(glyph->vertical_bands);
+    if ((num_h_bands == 0) && (num_v_bands == 0))
+    {
+        return;
+    }
+    int header_size = num_h_bands + num_v_bands;
+    pad_to_row_band_pixels(res, header_size);
 
-        int total_entries = header_size;
-        for (int i = 0; i < xarr_len(glyph->horizontal_bands); i++)
+    int glyph_start     = (int)xarr_len(res->band_pixels);
+    glyph->glyph_loc[0] = (int32_t)glyph_start % SLUG_TEX_WIDTH;
+    glyph->glyph_loc[1] = (int32_t)glyph_start / SLUG_TEX_WIDTH;
+
+    int total_entries = header_size;
+    for (int i = 0; i < xarr_len(glyph->horizontal_bands); i++)
+    {
+        total_entries += (int)xarr_len(glyph->horizontal_bands[i]);
+    }
+    for (int i = 0; i < xarr_len(glyph->vertical_bands); i++)
+    {
+        total_entries += (int)xarr_len(glyph->vertical_bands[i]);
+    }
+    xarr_setlen(res->band_pixels, glyph_start + total_entries);
+
+    int         write_offset = header_size;
+    band_runs_t runs         = {0};
+    write_band_set(
+        glyph->horizontal_bands,
+        glyph->curves,
+        res->band_pixels,
+        glyph_start,
+        0,
+        &write_offset,
+        &runs,
+        &res->stats);
+    write_band_set(
+        glyph->vertical_bands,
+        glyph->curves,
+        res->band_pixels,
+        glyph_start,
+        num_h_bands,
+        &write_offset,
+        &runs,
+        &res->stats);
+    // Shared bands leave the tail unused
+    xarr_setlen(res->band_pixels, glyph_start + write_offset);
+    res->stats.num_glyphs      += 1;
+    res->stats.num_band_texels += write_offset;
+}
+
+static slug_glyph_t make_glyph(const slug_glyph_build_t* glyph)
+{
+    return (slug_glyph_t){
+        .bbox        = glyph->bbox,
+        .advance     = glyph->advance,
+        .lsb         = glyph->lsb,
+        .max_band_x  = xarr_len(glyph->vertical_bands) - 1,
+        .max_band_y  = xarr_len(glyph->horizontal_bands) - 1,
+        .band_scale  = glyph->band_scale,
+        .band_offset = glyph->band_offset,
+        .glyph_loc =
+            {
+                [0] = glyph->glyph_loc[0],
+                [1] = glyph->glyph_loc[1],
+            },
+        .lod =
+            {
+                .max_band_x  = xarr_len(glyph->vertical_bands) - 1,
+                .max_band_y  = xarr_len(glyph->horizontal_bands) - 1,
+                .band_scale  = glyph->band_scale,
+                .band_offset = glyph->band_offset,
+                .glyph_loc   = {glyph->glyph_loc[0], glyph->glyph_loc[1]},
+            },
+    };
+}
+
+// Points the glyph's LOD at the packed bands of lod. Glyphs whose LOD lost all its curves keep their own bands.
+static void set_glyph_lod(slug_glyph_t* out, const slug_glyph_build_t* lod)
+{
+    if (xarr_len(lod->curves) == 0)
+    {
+        return;
+    }
+    out->lod.max_band_x   = xarr_len(lod->vertical_bands) - 1;
+    out->lod.max_band_y   = xarr_len(lod->horizontal_bands) - 1;
+    out->lod.band_scale   = lod->band_scale;
+    out->lod.band_offset  = lod->band_offset;
+    out->lod.glyph_loc[0] = lod->glyph_loc[0];
+    out->lod.glyph_loc[1] = lod->glyph_loc[1];
+}
+
+//------------------------------------------------------------------------------
+//  Parallel glyph building
+//
+//  Every glyph is built independently into its own slot of the build array, so
+//  threads never share mutable data apart from the batch counter. Packing runs
+//  afterwards on the calling thread in glyph order, which makes the textures
+//  identical to a serial build.
+//------------------------------------------------------------------------------
+
+typedef struct
+{
+    const stbtt_fontinfo* info;
+    float                 em_scale;
+    bool                  compact_curves;
+    slug_glyph_build_t*   glyphs;
+    slug_glyph_build_t*   lod_glyphs; // NULL to build no LOD
+    float                 lod_pixels_per_em;
+    int                   num_glyphs;
+    volatile long         next_glyph;
+} build_job_t;
+
+static int fetch_add_batch(build_job_t* job)
+{
+#ifdef _WIN32
+    return (int)InterlockedExchangeAdd(&job->next_glyph, SLUG_BUILD_BATCH);
+#else
+    return (int)__atomic_fetch_add(&job->next_glyph, SLUG_BUILD_BATCH, __ATOMIC_RELAXED);
+#endif
+}
+
+static void build_job_run(build_job_t* job)
+{
+    int begin;
+    while ((begin = fetch_add_batch(job)) < job->num_glyphs)
+    {
+        int end = mini(begin + SLUG_BUILD_BATCH, job->num_glyphs);
+        for (int i = begin; i < end; i++)
         {
-            total_entries += (int)xarr_len(glyph->horizontal_bands[i]);
+            init_build_glyph(job->info, i, job->em_scale, job->compact_curves, &job->glyphs[i]);
+            build_bands(&job->glyphs[i]);
+            if (job->lod_glyphs)
+            {
+                build_lod_glyph(&job->glyphs[i], job->lod_pixels_per_em, &job->lod_glyphs[i]);
+            }
         }
-        for (int i = 0; i < xarr_len(glyph->vertical_bands); i++)
+    }
+}
+
+#ifdef _WIN32
+typedef HANDLE build_thread_t;
+
+static DWORD WINAPI build_thread_proc(LPVOID arg)
+{
+    build_job_run((build_job_t*)arg);
+    return 0;
+}
+
+static bool build_thread_start(build_thread_t* thread, build_job_t* job)
+{
+    *thread = CreateThread(NULL, 0, build_thread_proc, job, 0, NULL);
+    return *thread != NULL;
+}
+
+static void build_thread_join(build_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static int get_num_cores(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t build_thread_t;
+
+static void* build_thread_proc(void* arg)
+{
+    build_job_run((build_job_t*)arg);
+    return NULL;
+}
+
+static bool build_thread_start(build_thread_t* thread, build_job_t* job)
+{
+    return pthread_create(thread, NULL, build_thread_proc, job) == 0;
+}
+
+static void build_thread_join(build_thread_t thread) { pthread_join(thread, NULL); }
+
+static int get_num_cores(void) { return (int)sysconf(_SC_NPROCESSORS_ONLN); }
+#endif
+
+static void build_glyphs_parallel(
+    const stbtt_fontinfo* info,
+    float                 em_scale,
+    bool                  compact_curves,
+    slug_glyph_build_t*   glyphs,
+    slug_glyph_build_t*   lod_glyphs,
+    float                 lod_pixels_per_em,
+    int                   num_threads)
+{
+    build_job_t job = {
+        .info              = info,
+        .em_scale          = em_scale,
+        .compact_curves    = compact_curves,
+        .glyphs            = glyphs,
+        .lod_glyphs        = lod_glyphs,
+        .lod_pixels_per_em = lod_pixels_per_em,
+        .num_glyphs        = (int)xarr_len(glyphs),
+        .next_glyph        = 0,
+    };
+    if (num_threads <= 0)
+    {
+        num_threads = get_num_cores();
+    }
+    // Not worth spinning up threads that would receive no batches
+    num_threads = clampi(num_threads, 1, SLUG_MAX_BUILD_THREADS);
+    num_threads = mini(num_threads, (job.num_glyphs + SLUG_BUILD_BATCH - 1) / SLUG_BUILD_BATCH);
+
+    build_thread_t threads[SLUG_MAX_BUILD_THREADS];
+    int            num_started = 0;
+    for (int i = 1; i < num_threads; i++)
+    {
+        if (build_thread_start(&threads[num_started], &job))
         {
-            total_entries += (int)xarr_len(glyph->vertical_bands[i]);
+            num_started++;
         }
-        xarr_setlen(res.band_pixels, glyph_start + total_entries);
-
-        int write_offset = header_size;
-        write_band_set(glyph->horizontal_bands, glyph->curves, res.band_pixels, glyph_start, 0, &write_offset);
-        write_band_set(glyph->vertical_bands, glyph->curves, res.band_pixels, glyph_start, num_h_bands, &write_offset);
     }
-    finalize_curve_pixels(&res);
-    finalize_band_pixels(&res);
-    return res;
+    // The calling thread works too. If thread creation failed it simply ends up doing more of the batches.
+    build_job_run(&job);
+    for (int i = 0; i < num_started; i++)
+    {
+        build_thread_join(threads[i]);
+    }
 }
@@ -1,5 +1,7 @@
+#pragma once
 #include "sokol_gfx.h"
 #include "stb_truetype.h"
+#include <math.h>
 #include <stdint.h>
 
 typedef struct vec2_t
@@ -21,6 +23,7 @@ static inline vec2_t vec2(float x, float y)
 }
 static inline vec2_t vec2_add(vec2_t a, vec2_t b) { return vec2(a.x + b.x, a.y + b.y); }
 static inline vec2_t vec2_sub(vec2_t a, vec2_t b) { return vec2(a.x - b.x, a.y - b.y); }
+static inline vec2_t vec2_mul(vec2_t a, vec2_t b) { return vec2(a.x * b.x, a.y * b.y); }
 static inline vec2_t vec2_mulf(vec2_t a, float s) { return vec2(a.x * s, a.y * s); }
 
 static inline vec4_t vec4(float x, float y, float z, float w)
@@ -89,6 +92,16 @@ typedef struct
     vec2_t      band_scale;
     vec2_t      band_offset;
     int         glyph_loc[2];
+    // Simplified curves in fewer bands for drawing small, see slug_font_desc_t.lod_pixels_per_em. Same as the bands
+    // above for fonts without LOD and for shapes. slug_glyph_lod() swaps them in.
+    struct
+    {
+        float  max_band_x;
+        float  max_band_y;
+        vec2_t band_scale;
+        vec2_t band_offset;
+        int    glyph_loc[2];
+    } lod;
 } slug_glyph_t;
 
 typedef struct
@@ -107,27 +120,279 @@ typedef struct
 
 typedef struct
 {
-    bool           valid;
-    slug_glyph_t*  glyphs; // managed via xhl/array.h
-    stbtt_fontinfo info;
-    struct
-    {
-        sg_image img;
-        sg_view  tex_view;
-        int      height;
-    } curve;
+    uint16_t glyph_index; // 0 for unmapped codepoints
+    uint16_t colr_base;   // index + 1 into colr_bases, 0 if the glyph has no color layers
+} slug_cmap_entry_t;
+
+typedef struct
+{
+    uint16_t x, y;
+} u16vec2_t;
+
+typedef struct
+{
+    int16_t x, y, z, w;
+} s16vec4_t;
+
+// Curve texels of compact fonts are RGBA16 snorm, these convert the same way the GPU does
+static inline int16_t slug_encode_snorm16(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t)lrintf(v * 32767.0f);
+}
+static inline float slug_decode_snorm16(int16_t v)
+{
+    float f = (float)v / 32767.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+typedef struct
+{
+    sg_image img;
+    sg_view  tex_view;
+    int      height;
+} slug_texture_t;
+
+// Band statistics, filled in for every glyph that gets packed. The average number of curves a pixel tests is
+// num_band_entries / num_bands.
+typedef struct
+{
+    int num_glyphs;               // glyphs that have bands
+    int num_bands;                // horizontal and vertical
+    int num_band_entries;         // curve references summed over all bands
+    int max_band_entries;         // most curve references in a single band
+    int num_shared_bands;         // bands that point at curve references written for another band of the glyph
+    int num_band_texels;          // band headers + curve references written to the band texture
+    int num_unshared_band_texels; // num_band_texels if every band wrote its own curve references
+} slug_font_stats_t;
+
+// Several fonts packed into one pair of curve and band textures. Glyph locations are absolute within the shared
+// textures, so glyphs from any font in the collection can be drawn together in one instanced draw.
+typedef struct
+{
+    bool           compact_curves;
+    bool           dirty;
+    slug_texture_t curve;
+    slug_texture_t band;
+    vec4_t*        curve_pixels; // managed via xhl/array.h
+    u16vec2_t*     band_pixels;  // managed via xhl/array.h
+} slug_font_collection_t;
+
+typedef struct
+{
+    // Same as slug_font_desc_t.compact_curves, but for every font in the collection
+    bool compact_curves;
+} slug_collection_desc_t;
+
+typedef struct
+{
+    bool                    valid;
+    bool                    compact_curves;
+    slug_glyph_t*           glyphs; // managed via xhl/array.h
+    stbtt_fontinfo          info;
+    slug_texture_t          curve;
+    slug_texture_t          band;
+    slug_font_collection_t* collection; // set for fonts in a collection, which owns the textures instead
+    vec4_t*                 cpal_colors; // managed via xhl/array.h
+    slug_colr_base_t*       colr_bases;  // managed via xhl/array.h
+    slug_colr_layer_t*      colr_layers; // managed via xhl/array.h;
+    // Codepoint lookup built from the cmap at load time, indexed by codepoint >> 8 and then codepoint & 255
+    uint16_t*               cmap_pages;   // managed via xhl/array.h, one index into cmap_entries per page
+    slug_cmap_entry_t*      cmap_entries; // managed via xhl/array.h, pages of 256 entries, page 0 is empty
+    slug_font_stats_t       stats;
+    float                   lod_pixels_per_em; // 0 if the font has no LOD
+    slug_font_stats_t       lod_stats;         // the bands of the LOD glyphs
+    // Only used by fonts loaded with slug_font_desc_t.lazy. Glyphs are built on first lookup and packed into
+    // these CPU-side copies of the textures, which get uploaded by slug_flush_font(). Fonts in a collection pack
+    // into the collection's copies instead.
     struct
     {
-        sg_image img;
-        sg_view  tex_view;
-        int      height;
-    } band;
-    vec4_t*            cpal_colors; // managed via xhl/array.h
-    slug_colr_base_t*  colr_bases;  // managed via xhl/array.h
-    slug_colr_layer_t* colr_layers; // managed via xhl/array.h;
+        bool       enabled;
+        bool       dirty;
+        float      em_scale;
+        uint8_t*   resident;     // managed via xhl/array.h, one flag per glyph
+        vec4_t*    curve_pixels; // managed via xhl/array.h
+        u16vec2_t* band_pixels;  // managed via xhl/array.h
+    } lazy;
 } slug_font_t;
 
+typedef struct
+{
+    // Number of threads used to build glyph curves and bands. 0 picks the number of logical cores, 1 builds
+    // everything on the calling thread. The packed textures are identical regardless of thread count.
+    int num_threads;
+    // Don't build any glyphs at load time. Glyphs are built on first use by slug_get_glyph() and the textures
+    // grow to fit, so memory scales with the glyphs actually used. Call slug_flush_font() once per frame before
+    // drawing. NOTE: the font data must outlive the font, which is already true for non-lazy fonts.
+    bool lazy;
+    // Store curve control points as RGBA16 snorm relative to each glyph's bbox instead of RGBA32F, which halves
+    // the curve texture. Draw these fonts with the slug shader's compact_curves uniform set.
+    bool compact_curves;
+    // Pack glyphs into the collection's textures instead of creating textures for this font. compact_curves is
+    // taken from the collection. The collection must outlive the font.
+    slug_font_collection_t* collection;
+    // Also build a simplified version of every glyph for drawing at fewer pixels per em than this. Curves that are
+    // within a quarter pixel of a single curve at this size are merged into it, and no band is thinner than a pixel,
+    // so small text tests fewer curves per pixel and touches fewer band texels. 0 builds no LOD.
+    float lod_pixels_per_em;
+} slug_font_desc_t;
+
 bool                    slug_load_font(slug_font_t* font, const slug_range_t* data);
+bool                    slug_load_font_desc(slug_font_t* font, const slug_range_t* data, const slug_font_desc_t* desc);
 void                    slug_unload_font(slug_font_t* font);
-const slug_glyph_t*     slug_get_glyph(const slug_font_t* font, uint32_t cp);
+void                    slug_flush_font(slug_font_t* font);
+int                     slug_find_glyph_index(const slug_font_t* font, uint32_t cp);
+const slug_glyph_t*     slug_get_glyph(slug_font_t* font, uint32_t cp);
+const slug_glyph_t*     slug_get_glyph_by_index(slug_font_t* font, int glyph_index);
 const slug_colr_base_t* slug_find_colr_base(const slug_font_t* font, uint32_t cp);
+
+// Whether glyphs drawn at pixels_per_em should use their LOD
+static inline bool slug_use_lod(const slug_font_t* font, float pixels_per_em)
+{
+    return pixels_per_em < font->lod_pixels_per_em;
+}
+// Returns the glyph with its LOD bands in place of its own, so it draws and rasterizes like any other glyph
+static inline slug_glyph_t slug_glyph_lod(const slug_glyph_t* glyph)
+{
+    slug_glyph_t lod = *glyph;
+    lod.max_band_x   = glyph->lod.max_band_x;
+    lod.max_band_y   = glyph->lod.max_band_y;
+    lod.band_scale   = glyph->lod.band_scale;
+    lod.band_offset  = glyph->lod.band_offset;
+    lod.glyph_loc[0] = glyph->lod.glyph_loc[0];
+    lod.glyph_loc[1] = glyph->lod.glyph_loc[1];
+    return lod;
+}
+
+// Fonts in a collection share its textures. Glyphs from all of them are uploaded by slug_flush_collection(), which
+// slug_flush_font() also calls for fonts in a collection. Unloading a font doesn't free its texels in the
+// collection, they are freed with the collection.
+void slug_init_collection(slug_font_collection_t* collection, const slug_collection_desc_t* desc);
+void slug_destroy_collection(slug_font_collection_t* collection);
+void slug_flush_collection(slug_font_collection_t* collection);
+
+// Shapes are arbitrary filled paths built into the same curve and band data as glyphs, so they draw with the slug
+// shaders too. Contours are filled with the nonzero winding rule, holes need to wind the opposite way to the outline
+// around them like they do in TrueType outlines and most SVG icons. Open contours are closed with a straight line.
+typedef struct
+{
+    // Path coordinates are divided by this, so shapes end up in ems like glyphs do. The shaders' precision limits are
+    // tuned for glyph sized coordinates, so keep shapes around 1 em large. 0 is the same as 1.
+    float units_per_em;
+    // Max distance between a cubic and the quadratics replacing it, in path units. 0 picks 1/1024 of each cubic's
+    // extent.
+    float cubic_tolerance;
+    // Fill with the even-odd rule instead. Contours are rewound by how deeply they're nested in the others, which
+    // doesn't work for contours that cross each other.
+    bool even_odd;
+} slug_shape_desc_t;
+
+typedef struct
+{
+    slug_glyph_build_t build;
+    float              scale; // 1 / units_per_em
+    float              cubic_tolerance;
+    bool               even_odd;
+    vec2_t             start;    // first point of the current contour
+    vec2_t             previous; // last point of the current contour
+    int                contour_start;
+    bool               in_contour;
+} slug_shape_builder_t;
+
+void slug_begin_shape(slug_shape_builder_t* shape, const slug_shape_desc_t* desc);
+void slug_shape_move_to(slug_shape_builder_t* shape, float x, float y);
+void slug_shape_line_to(slug_shape_builder_t* shape, float x, float y);
+void slug_shape_quad_to(slug_shape_builder_t* shape, float cx, float cy, float x, float y);
+void slug_shape_cubic_to(slug_shape_builder_t* shape, float c1x, float c1y, float c2x, float c2y, float x, float y);
+void slug_shape_close(slug_shape_builder_t* shape);
+// Adds one closed contour laid out like nanosvg paths: x0,y0 followed by cx1,cy1,cx2,cy2,x1,y1 for each cubic
+void slug_shape_add_cubic_path(slug_shape_builder_t* shape, const float* pts, int npts);
+// Builds the shape's bands and packs it into the collection, which gets uploaded by slug_flush_collection(). The
+// returned glyph draws like any glyph of the collection's fonts, its bbox is in ems and its advance and lsb are 0.
+// Frees the builder.
+void slug_end_shape(slug_shape_builder_t* shape, slug_font_collection_t* collection, slug_glyph_t* out);
+
+// An SVG image baked into shapes, one layer per filled SVG shape. Like COLR glyphs, every layer is drawn at the same
+// position in order, each with its own color.
+typedef struct
+{
+    slug_glyph_t shape;
+    vec4_t       color; // RGBA with the SVG shape's opacity multiplied into alpha
+} slug_icon_layer_t;
+
+typedef struct
+{
+    float              width;  // size of the SVG in ems, the larger side is 1 em. Layer bboxes are in ems too,
+    float              height; // relative to the SVG's bottom left corner with y pointing up
+    slug_icon_layer_t* layers; // managed via xhl/array.h
+} slug_icon_t;
+
+struct NSVGimage2;
+
+// Bakes the fills of a flat nanosvg image (nanosvg3.h) into the collection, so icons scale to any size without being
+// rasterized again. Gradients are approximated by the average of their stops, strokes aren't converted. desc sets
+// the cubic tolerance in SVG units, units_per_em and even_odd come from the SVG.
+void slug_bake_svg_icon(
+    slug_font_collection_t*  collection,
+    const struct NSVGimage2* svg,
+    const slug_shape_desc_t* desc,
+    slug_icon_t*             out);
+void slug_free_icon(slug_icon_t* icon);
+
+// The textures a font's glyphs are drawn with
+static inline const slug_texture_t* slug_curve_texture(const slug_font_t* font)
+{
+    return font->collection ? &font->collection->curve : &font->curve;
+}
+static inline const slug_texture_t* slug_band_texture(const slug_font_t* font)
+{
+    return font->collection ? &font->collection->band : &font->band;
+}
+
+// CPU-side copies of a font's textures, SLUG_TEX_WIDTH texels per row
+typedef struct
+{
+    const vec4_t*    curve_pixels; // not snorm encoded yet for compact curves, slug_rasterize_glyph() rounds them
+    const u16vec2_t* band_pixels;
+    bool             compact_curves;
+} slug_texels_t;
+
+// Only lazy fonts and fonts in a collection keep CPU-side texels, other fonts assert (and return false in release
+// builds). The texels hold the glyphs made resident so far and are invalidated by loading more glyphs.
+bool slug_get_font_texels(const slug_font_t* font, slug_texels_t* out);
+// Computes the same coverage as program_slug.glsl without a GPU, for regression tests or as a fallback renderer.
+// Pixel (x, y) samples the glyph at bbox.x0 + (x + 0.5) / pixels_per_em, bbox.y1 - (y + 0.5) / pixels_per_em, so
+// row 0 is the top of the glyph. A bitmap covering the bbox needs ceil(extent * pixels_per_em) pixels per axis.
+void slug_rasterize_glyph(
+    const slug_texels_t* texels,
+    const slug_glyph_t*  glyph,
+    float                pixels_per_em,
+    uint8_t*             coverage,
+    int                  width,
+    int                  height,
+    int                  stride);
+
+typedef struct
+{
+    float mean_error; // average absolute coverage difference over the glyph's bbox, 0 to 1
+    float max_error;  // largest absolute coverage difference of any pixel
+    int   num_pixels; // pixels that differ by more than 1/4
+} slug_lod_error_t;
+
+// Rasterizes the glyph and its LOD at pixels_per_em with slug_rasterize_glyph() and compares their coverage. A CPU
+// reference for how far below lod_pixels_per_em the LOD holds up. Returns false if the glyph has no bands.
+bool slug_measure_lod_error(
+    const slug_texels_t* texels,
+    const slug_glyph_t*  glyph,
+    float                pixels_per_em,
+    slug_lod_error_t*    out);
+
+// Font caches hold a font's fully built glyphs and packed textures so loading skips glyph building entirely.
+// slug_bake_font_cache() doesn't need sokol, so it can run in an offline tool. Free the baked cache with
+// slug_free_font_cache(). The cache may be memory-mapped when loading, slug_load_font_cache() returns false if
+// it's corrupt, from another version, or was baked from different font data, in which case bake it again.
+// slug_hash_font() only reads the font's size and table directory, which lists a checksum for every table.
+uint64_t slug_hash_font(const slug_range_t* data);
+bool     slug_bake_font_cache(const slug_range_t* data, const slug_font_desc_t* desc, slug_range_t* out_cache);
+void     slug_free_font_cache(slug_range_t* cache);
+bool     slug_load_font_cache(slug_font_t* font, const slug_range_t* data, const slug_range_t* cache);
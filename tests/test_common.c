@@ -0,0 +1,58 @@
+#include "test_common.h"
+
+// linked_arena.c's blocks
+#define XHL_ALLOC_IMPL
+#include <xhl/alloc.h>
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
+#define SOKOL_IMPL
+#define SOKOL_GFX_IMPL
+#define SOKOL_DUMMY_BACKEND
+#include <sokol_gfx.h>
+
+test_file_t test_read_file(const char* name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", SRC_DIR, name);
+
+    test_file_t file = {0};
+    FILE*       fp   = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    file.size = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    file.data = malloc(file.size);
+    if (file.data == NULL || fread(file.data, 1, file.size, fp) != file.size)
+    {
+        fprintf(stderr, "can't read %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    return file;
+}
+
+void test_free_file(test_file_t* file)
+{
+    free(file->data);
+    *file = (test_file_t){0};
+}
+
+void* test_sg_setup(void)
+{
+    void* sg = sg_setup(&(sg_desc){0});
+    TEST_CHECK(sg != NULL);
+    sg_set_global(sg);
+    return sg;
+}
+
+void test_sg_shutdown(void* sg)
+{
+    sg_set_global(NULL);
+    sg_shutdown(sg);
+}
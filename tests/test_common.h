@@ -0,0 +1,30 @@
+#pragma once
+// Helpers shared by the CPU tests, see the TESTS section of CMakeLists.txt
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Like xassert(), but stays on in release builds and says which check failed
+#define TEST_CHECK(cond)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                   \
+            exit(1);                                                                                                   \
+        }                                                                                                              \
+    } while (0)
+
+typedef struct
+{
+    void*  data;
+    size_t size;
+} test_file_t;
+
+// Reads a file relative to the repository root, failing the test if it's missing
+test_file_t test_read_file(const char* name);
+void        test_free_file(test_file_t* file);
+// Sets up sokol_gfx with the dummy backend as the global context
+void* test_sg_setup(void);
+void  test_sg_shutdown(void* sg);
@@ -0,0 +1,268 @@
+// nvgBeginFrame() reserves every per frame buffer at its high water mark, so a frame that draws no more than an earlier
+// one allocates nothing. This builds nanovg2.c & linked_arena.c with their heap and virtual memory calls routed through
+// counters, draws identical frames in each mode, then grows, shrinks & grows again. Only a frame setting a new high
+// water mark may allocate, and only the frame after it may free the blocks it outgrew.
+#include "test_common.h"
+
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xhl/alloc.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Tesselation threads allocate too, so the counters are bumped atomically
+static volatile long g_counting;
+static volatile long g_allocs;
+static volatile long g_frees;
+
+static void count_call(volatile long* counter)
+{
+    if (g_counting)
+    {
+#ifdef _WIN32
+        InterlockedIncrement(counter);
+#else
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+#endif
+    }
+}
+
+static void* count_malloc(size_t size)
+{
+    count_call(&g_allocs);
+    return malloc(size);
+}
+
+static void* count_calloc(size_t num, size_t size)
+{
+    count_call(&g_allocs);
+    return calloc(num, size);
+}
+
+static void* count_realloc(void* ptr, size_t size)
+{
+    count_call(&g_allocs);
+    return realloc(ptr, size);
+}
+
+static void count_free(void* ptr)
+{
+    if (ptr != NULL)
+        count_call(&g_frees);
+    free(ptr);
+}
+
+static void* count_xvalloc(void* hint, size_t size)
+{
+    count_call(&g_allocs);
+    return xvalloc(hint, size);
+}
+
+static void count_xvfree(void* ptr, size_t size)
+{
+    count_call(&g_frees);
+    xvfree(ptr, size);
+}
+
+// Everything below allocates through the counters. The headers above are already included, so only the calls in the
+// sources under test are renamed
+#define malloc(size)        count_malloc(size)
+#define calloc(num, size)   count_calloc(num, size)
+#define realloc(ptr, size)  count_realloc(ptr, size)
+#define free(ptr)           count_free(ptr)
+#define xvalloc(hint, size) count_xvalloc(hint, size)
+#define xvfree(ptr, size)   count_xvfree(ptr, size)
+#include "linked_arena.c"
+#include "nanovg2.c"
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#undef xvalloc
+#undef xvfree
+
+// Frames drawn with the first scene, the first of which sets the high water mark
+#define NUM_WARMUP_FRAMES (2)
+#define NUM_STEADY_FRAMES (4)
+
+static NVGcolour svg_colour(unsigned int c)
+{
+    // nanosvg colors are 0xAABBGGRR
+    return nvgRGBA(c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, (c >> 24) & 0xff);
+}
+
+static void draw_svg(NVGcontext* vg, NSVGimage* svg, float x, float y, float scale)
+{
+    nvgResetTransform(vg);
+    nvgTranslate(vg, x, y);
+    nvgScale(vg, scale, scale);
+    for (NSVGshape* shape = svg->shapes; shape != NULL; shape = shape->next)
+    {
+        if (!(shape->flags & NSVG_FLAGS_VISIBLE))
+        {
+            continue;
+        }
+        for (NSVGpath* path = shape->paths; path != NULL; path = path->next)
+        {
+            nvgBeginPath(vg);
+            nvgMoveTo(vg, path->pts[0], path->pts[1]);
+            for (int i = 0; i < path->npts - 1; i += 3)
+            {
+                const float* p = &path->pts[i * 2];
+                nvgBezierTo(vg, p[2], p[3], p[4], p[5], p[6], p[7]);
+            }
+            if (path->closed)
+            {
+                nvgClosePath(vg);
+            }
+            if (shape->fill.type == NSVG_PAINT_COLOR)
+            {
+                nvgSetColour(vg, svg_colour(shape->fill.color));
+                nvgFill(vg);
+            }
+            if (shape->stroke.type == NSVG_PAINT_COLOR)
+            {
+                nvgSetColour(vg, svg_colour(shape->stroke.color));
+                nvgStroke(vg, shape->strokeWidth);
+            }
+        }
+    }
+    nvgResetTransform(vg);
+}
+
+// Draws 'size' tigers and a panel of primitives that grows with them, plus a retained star
+static void draw_frame(NVGcontext* vg, NSVGimage* svg, NVGretainedPath* star, int size)
+{
+    nvgBeginFrame(vg, 1);
+    snvg_command_begin_pass(vg, &(sg_pass){0}, 0, 0, 800, 600, "pass");
+    snvg_command_draw_nvg(vg, "nvg");
+    for (int i = 0; i < size; i++)
+    {
+        draw_svg(vg, svg, 100 + i * 40, 100 + i * 20, 0.5f + 0.1f * i);
+    }
+    for (int i = 0; i < size * 10; i++)
+    {
+        float x = 20 + (i % 10) * 60;
+        float y = 400 + (i / 10) * 50;
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, x, y, 50, 30, 6);
+        nvgSetPaint(
+            vg,
+            nvgLinearGradient(vg, x, y, x + 50, y + 30, nvgRGBA(255, 0, 0, 255), nvgRGBA(0, 0, 255, 128)));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgArc(vg, x + 25, y + 15, 14, 0, NVG_PI * (0.5f + 0.1f * (i % 5)), NVG_CW);
+        nvgSetColour(vg, nvgRGBA(255, 200, 0, 200));
+        nvgStroke(vg, 3.0f);
+    }
+    nvgTranslate(vg, 500, 200);
+    nvgSetColour(vg, nvgRGBA(0, 160, 0, 255));
+    nvgFillRetainedPath(vg, star);
+    nvgStrokeRetainedPath(vg, star, 2.0f);
+    nvgResetTransform(vg);
+    snvg_command_end_pass(vg, "pass");
+    nvgEndFrame(vg);
+}
+
+// Draws a frame, counting its allocations & frees
+static void draw_counted(NVGcontext* vg, NSVGimage* svg, NVGretainedPath* star, int size, const char* name)
+{
+    g_allocs   = 0;
+    g_frees    = 0;
+    g_counting = 1;
+    draw_frame(vg, svg, star, size);
+    g_counting = 0;
+    printf(
+        "%s, size %d: %ld allocations, %ld frees, allocCount %d\n",
+        name,
+        size,
+        g_allocs,
+        g_frees,
+        vg->frame_stats.allocCount);
+}
+
+static void check_mode(NSVGimage* svg, const char* name, int flags, int numThreads)
+{
+    // Sizes drawn after the warm up. The first sets a new high water mark, no others do
+    static const int SIZES[] = {3, 1, 3, 3, 2, 3, 1, 1, 3};
+
+    NVGcontext* vg = nvgCreateContextEx(flags, numThreads);
+    TEST_CHECK(vg != NULL);
+
+    NVGretainedPath star = {0};
+    nvgBeginPath(vg);
+    for (int i = 0; i < 10; i++)
+    {
+        float a = i * NVG_PI / 5;
+        float r = (i & 1) ? 30 : 80;
+        if (i == 0)
+            nvgMoveTo(vg, cosf(a) * r, sinf(a) * r);
+        else
+            nvgLineTo(vg, cosf(a) * r, sinf(a) * r);
+    }
+    nvgClosePath(vg);
+    nvgRetainPath(vg, &star);
+
+    for (int i = 0; i < NUM_WARMUP_FRAMES; i++)
+    {
+        draw_frame(vg, svg, &star, 1);
+    }
+    for (int i = 0; i < NUM_STEADY_FRAMES; i++)
+    {
+        draw_counted(vg, svg, &star, 1, name);
+        TEST_CHECK(g_allocs == 0 && g_frees == 0);
+        TEST_CHECK(vg->frame_stats.allocCount == 0);
+    }
+
+    for (int i = 0; i < (int)(sizeof(SIZES) / sizeof(SIZES[0])); i++)
+    {
+        draw_counted(vg, svg, &star, SIZES[i], name);
+        if (i == 0)
+        {
+            TEST_CHECK(vg->frame_stats.allocCount > 0);
+        }
+        else
+        {
+            // Arena blocks outgrown by the previous frame are freed once its buffers are dropped
+            TEST_CHECK(g_allocs == 0 && (i == 1 || g_frees == 0));
+            TEST_CHECK(vg->frame_stats.allocCount == 0);
+        }
+    }
+
+    nvgFreeRetainedPath(&star);
+    nvgDestroyContext(vg);
+}
+
+int main(void)
+{
+    void*       sg   = test_sg_setup();
+    test_file_t file = test_read_file("Ghostscript_Tiger.svg");
+    // nsvgParse() wants a null terminated string it can write to
+    char* text = malloc(file.size + 1);
+    memcpy(text, file.data, file.size);
+    text[file.size] = 0;
+    NSVGimage* svg  = nsvgParse(text, "px", 96);
+    TEST_CHECK(svg != NULL);
+
+    check_mode(svg, "default", NVG_ANTIALIAS, 0);
+    check_mode(svg, "deferred", NVG_ANTIALIAS | NVG_DEFERRED_TESSELATION, 1);
+    // Batches fall to whichever thread takes them first, so each thread's share differs from frame to frame
+    check_mode(svg, "deferred, 4 threads", NVG_ANTIALIAS | NVG_DEFERRED_TESSELATION, 4);
+    check_mode(svg, "compact", NVG_ANTIALIAS | NVG_COMPACT_VERTICES, 0);
+    check_mode(svg, "vertex pull", NVG_ANTIALIAS | NVG_VERTEX_PULL, 0);
+    check_mode(svg, "sdf", NVG_ANTIALIAS | NVG_SDF_PRIMITIVES, 0);
+
+    nsvgDelete(svg);
+    free(text);
+    test_free_file(&file);
+    test_sg_shutdown(sg);
+    return 0;
+}
@@ -0,0 +1,256 @@
+// NVG_DEFERRED_TESSELATION records fills & strokes and tesselates them on worker threads in nvgEndFrame(), which must
+// leave the frame exactly as tesselating them as they're drawn does. This draws the same frames with and without it,
+// for each vertex layout & several thread counts, and checks the vertices, indexes, paints, SDF shapes and calls match
+// byte for byte.
+#include "test_common.h"
+
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+#include "nanovg2.h"
+#include <math.h>
+#include <string.h>
+
+#define NUM_FRAMES (3)
+
+static NVGcolour svg_colour(unsigned int c)
+{
+    // nanosvg colors are 0xAABBGGRR
+    return nvgRGBA(c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, (c >> 24) & 0xff);
+}
+
+static void draw_svg(NVGcontext* vg, NSVGimage* svg, float x, float y, float scale)
+{
+    nvgResetTransform(vg);
+    nvgTranslate(vg, x, y);
+    nvgScale(vg, scale, scale);
+    for (NSVGshape* shape = svg->shapes; shape != NULL; shape = shape->next)
+    {
+        if (!(shape->flags & NSVG_FLAGS_VISIBLE))
+        {
+            continue;
+        }
+        for (NSVGpath* path = shape->paths; path != NULL; path = path->next)
+        {
+            nvgBeginPath(vg);
+            nvgMoveTo(vg, path->pts[0], path->pts[1]);
+            for (int i = 0; i < path->npts - 1; i += 3)
+            {
+                const float* p = &path->pts[i * 2];
+                nvgBezierTo(vg, p[2], p[3], p[4], p[5], p[6], p[7]);
+            }
+            if (path->closed)
+            {
+                nvgClosePath(vg);
+            }
+            if (shape->fill.type == NSVG_PAINT_COLOR)
+            {
+                nvgSetColour(vg, svg_colour(shape->fill.color));
+                nvgFill(vg);
+            }
+            if (shape->stroke.type == NSVG_PAINT_COLOR)
+            {
+                nvgSetColour(vg, svg_colour(shape->stroke.color));
+                nvgStroke(vg, shape->strokeWidth);
+            }
+        }
+    }
+    nvgResetTransform(vg);
+}
+
+// Shapes the tiger doesn't draw: primitives, gradients, holes, every join and cap, and a blend mode change
+static void draw_shapes(NVGcontext* vg, int frame)
+{
+    for (int i = 0; i < 10 + frame * 10; i++)
+    {
+        float x = 20 + (i % 10) * 60;
+        float y = 400 + (i / 10) * 50;
+        nvgBeginPath(vg);
+        nvgRoundedRect(vg, x, y, 50, 30, 6);
+        nvgSetColour(vg, nvgRGBA(40 + i * 3, 80, 120, 255));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgCircle(vg, x + 25, y + 15, 8 + (i % 3));
+        nvgSetColour(vg, nvgRGBA(255, 200, 0, 200));
+        nvgFill(vg);
+
+        nvgBeginPath(vg);
+        nvgArc(vg, x + 25, y + 15, 14, 0, NVG_PI * (0.5f + 0.1f * (i % 5)), NVG_CW);
+        nvgSetLineCap(vg, NVG_ROUND);
+        nvgStroke(vg, 3.0f);
+        nvgSetLineCap(vg, NVG_BUTT);
+
+        nvgBeginPath(vg);
+        nvgEllipse(vg, x + 25, y + 15, 20, 6);
+        nvgSetPaint(
+            vg,
+            nvgLinearGradient(vg, x, y, x + 50, y + 30, nvgRGBA(255, 0, 0, 255), nvgRGBA(0, 0, 255, 128)));
+        nvgFill(vg);
+    }
+
+    // Concave, self intersecting star with a hole, filled then stroked with each join
+    nvgBeginPath(vg);
+    for (int i = 0; i < 10; i++)
+    {
+        float a = i * NVG_PI / 5 + frame * 0.1f;
+        float r = (i & 1) ? 30 : 80;
+        if (i == 0)
+            nvgMoveTo(vg, 500 + cosf(a) * r, 200 + sinf(a) * r);
+        else
+            nvgLineTo(vg, 500 + cosf(a) * r, 200 + sinf(a) * r);
+    }
+    nvgClosePath(vg);
+    nvgCircle(vg, 500, 200, 15);
+    nvgSetPathWinding(vg, NVG_HOLE);
+    nvgSetColour(vg, nvgRGBA(0, 160, 0, 255));
+    nvgFill(vg);
+    nvgSetLineJoin(vg, NVG_ROUND);
+    nvgSetColour(vg, nvgRGBA(0, 0, 0, 255));
+    nvgStroke(vg, 4.0f);
+    nvgSetLineJoin(vg, NVG_BEVEL);
+    nvgStroke(vg, 2.0f);
+    nvgSetLineJoin(vg, NVG_MITER);
+
+    nvgBeginPath(vg);
+    nvgMoveTo(vg, 600, 100);
+    nvgQuadTo(vg, 650, 20, 700, 100);
+    nvgArcTo(vg, 720, 160, 650, 180, 20);
+    nvgSetLineCap(vg, NVG_SQUARE);
+    nvgStroke(vg, 6.0f);
+    nvgSetLineCap(vg, NVG_BUTT);
+
+    // A whole turn closes into a ring, which NVG_SDF_PRIMITIVES draws as a circle's stroke
+    nvgBeginPath(vg);
+    nvgArc(vg, 700.5f, 480.5f, 40, 0.3f, 0.3f + NVG_PI * 2, NVG_CCW);
+    nvgSetLineCap(vg, NVG_ROUND);
+    nvgStroke(vg, 5.0f);
+    nvgSetLineCap(vg, NVG_BUTT);
+
+    nvgSetGlobalCompositeOperation(vg, NVG_LIGHTER);
+    nvgBeginPath(vg);
+    nvgRoundedRectVarying(vg, 600, 300, 100, 60, 4, 10, 20, 0);
+    nvgSetColour(vg, nvgRGBA(10, 20, 30, 128));
+    nvgFill(vg);
+    nvgSetGlobalCompositeOperation(vg, NVG_SOURCE_OVER);
+
+    // Hairline, drawn with alpha instead of width
+    nvgBeginPath(vg);
+    nvgMoveTo(vg, 0, 0);
+    nvgLineTo(vg, 800, 600);
+    nvgStroke(vg, 0.3f);
+}
+
+static void draw_frame(NVGcontext* vg, NSVGimage* svg, int frame)
+{
+    nvgBeginFrame(vg, 1);
+    snvg_command_begin_pass(vg, &(sg_pass){0}, 0, 0, 800, 600, "pass");
+    snvg_command_draw_nvg(vg, "nvg");
+    for (int i = 0; i <= frame; i++)
+    {
+        draw_svg(vg, svg, 100 + i * 40, 100 + i * 20, 0.5f + 0.1f * i);
+    }
+    draw_shapes(vg, frame);
+    snvg_command_end_pass(vg, "pass");
+    nvgEndFrame(vg);
+}
+
+static bool same_calls(const SGNVGcall* a, const SGNVGcall* b)
+{
+    for (; a != NULL && b != NULL; a = a->next, b = b->next)
+    {
+        if (a->type != b->type || a->vertexBase != b->vertexBase || a->indexOffset != b->indexOffset ||
+            a->fillCount != b->fillCount || a->strokeCount != b->strokeCount ||
+            a->triangleOffset != b->triangleOffset || a->triangleCount != b->triangleCount ||
+            memcmp(&a->blendFunc, &b->blendFunc, sizeof(a->blendFunc)) != 0)
+            return false;
+    }
+    return a == NULL && b == NULL;
+}
+
+// The frame each context left behind stays in its frame_arena until the next nvgBeginFrame()
+static void
+check_same_frame(const NVGcontext* serial, const NVGcontext* deferred, size_t vertex_size, size_t index_size)
+{
+    TEST_CHECK(serial->nverts > 0);
+    TEST_CHECK(serial->nverts == deferred->nverts);
+    TEST_CHECK(memcmp(serial->verts, deferred->verts, serial->nverts * vertex_size) == 0);
+    TEST_CHECK(serial->nindexes == deferred->nindexes);
+    // NVG_VERTEX_PULL has no indexes
+    TEST_CHECK(serial->nindexes == 0 || memcmp(serial->indexes, deferred->indexes, serial->nindexes * index_size) == 0);
+    TEST_CHECK(serial->npaints == deferred->npaints);
+    TEST_CHECK(memcmp(serial->paints, deferred->paints, serial->npaints * sizeof(*serial->paints)) == 0);
+    TEST_CHECK(serial->nsdfs == deferred->nsdfs);
+    TEST_CHECK(serial->nsdfs == 0 || memcmp(serial->sdfs, deferred->sdfs, serial->nsdfs * sizeof(*serial->sdfs)) == 0);
+
+    const SGNVGcommand* a = serial->first_command;
+    const SGNVGcommand* b = deferred->first_command;
+    for (; a != NULL && b != NULL; a = a->next, b = b->next)
+    {
+        TEST_CHECK(a->type == b->type);
+        if (a->type == SGNVG_CMD_DRAW_NVG)
+        {
+            TEST_CHECK(a->payload.drawNVG->num_calls == b->payload.drawNVG->num_calls);
+            TEST_CHECK(same_calls(a->payload.drawNVG->calls, b->payload.drawNVG->calls));
+        }
+    }
+    TEST_CHECK(a == NULL && b == NULL);
+}
+
+static void check_flags(NSVGimage* svg, const char* name, int flags, size_t vertex_size, size_t index_size)
+{
+    // Threads are started whatever the number of cores, so one core still runs them concurrently
+    static const int NUM_THREADS[] = {1, 2, 3, 8};
+
+    for (int i = 0; i < (int)(sizeof(NUM_THREADS) / sizeof(NUM_THREADS[0])); i++)
+    {
+        NVGcontext* serial   = nvgCreateContext(flags);
+        NVGcontext* deferred = nvgCreateContextEx(flags | NVG_DEFERRED_TESSELATION, NUM_THREADS[i]);
+        TEST_CHECK(serial != NULL && deferred != NULL);
+        TEST_CHECK(deferred->tess_pool != NULL);
+        for (int frame = 0; frame < NUM_FRAMES; frame++)
+        {
+            draw_frame(serial, svg, frame);
+            draw_frame(deferred, svg, frame);
+            check_same_frame(serial, deferred, vertex_size, index_size);
+            printf(
+                "%s, %d threads, frame %d: %d vertices, %d indexes, %d paints, %d SDF shapes match\n",
+                name,
+                NUM_THREADS[i],
+                frame,
+                serial->nverts,
+                serial->nindexes,
+                serial->npaints,
+                serial->nsdfs);
+        }
+        nvgDestroyContext(deferred);
+        nvgDestroyContext(serial);
+    }
+}
+
+int main(void)
+{
+    void*       sg   = test_sg_setup();
+    test_file_t file = test_read_file("Ghostscript_Tiger.svg");
+    // nsvgParse() wants a null terminated string it can write to
+    char* text = malloc(file.size + 1);
+    memcpy(text, file.data, file.size);
+    text[file.size] = 0;
+    NSVGimage* svg  = nsvgParse(text, "px", 96);
+    TEST_CHECK(svg != NULL);
+
+    check_flags(svg, "default", NVG_ANTIALIAS, sizeof(SGNVGattribute), sizeof(uint32_t));
+    check_flags(
+        svg,
+        "compact",
+        NVG_ANTIALIAS | NVG_COMPACT_VERTICES,
+        sizeof(SGNVGcompactAttribute),
+        sizeof(uint16_t));
+    check_flags(svg, "vertex pull", NVG_ANTIALIAS | NVG_VERTEX_PULL, sizeof(SGNVGpullAttribute), sizeof(uint32_t));
+    check_flags(svg, "sdf", NVG_ANTIALIAS | NVG_SDF_PRIMITIVES, sizeof(SGNVGattribute), sizeof(uint32_t));
+
+    nsvgDelete(svg);
+    free(text);
+    test_free_file(&file);
+    test_sg_shutdown(sg);
+    return 0;
+}
@@ -0,0 +1,134 @@
+// nvg__tesselateBezier() spreads points over a cubic so every segment of the polyline stays within tessTol of it. This
+// flattens each cubic of Ghostscript_Tiger.svg on its own at scales from well below to well above 1, measures how far
+// the curve strays from the polyline, and checks the worst case against tessTol at every scale.
+#include "test_common.h"
+
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+#include "nanovg2.h"
+#include <math.h>
+#include <string.h>
+
+// Points sampled along each cubic when measuring its distance to the polyline
+#define NUM_SAMPLES (1024)
+
+static double segment_distance(double px, double py, const NVGpoint* a, const NVGpoint* b)
+{
+    double dx  = b->x - a->x;
+    double dy  = b->y - a->y;
+    double len = dx * dx + dy * dy;
+    double t   = len > 0 ? ((px - a->x) * dx + (py - a->y) * dy) / len : 0;
+    t          = t < 0 ? 0 : t > 1 ? 1 : t;
+    double x   = a->x + t * dx - px;
+    double y   = a->y + t * dy - py;
+    return sqrt(x * x + y * y);
+}
+
+// Largest distance from the cubic c to the points vg flattened it to
+static double flatten_error(const NVGcontext* vg, const double* c)
+{
+    const NVGpoint* pts   = vg->cache.points;
+    int             npts  = vg->cache.npoints;
+    double          error = 0;
+    for (int i = 0; i <= NUM_SAMPLES; i++)
+    {
+        double t  = (double)i / NUM_SAMPLES;
+        double mt = 1 - t;
+        double x  = mt * mt * mt * c[0] + 3 * mt * mt * t * c[2] + 3 * mt * t * t * c[4] + t * t * t * c[6];
+        double y  = mt * mt * mt * c[1] + 3 * mt * mt * t * c[3] + 3 * mt * t * t * c[5] + t * t * t * c[7];
+
+        // A cubic ending where it started is flattened to a closed path without its last point
+        double nearest = vg->cache.paths[0].closed ? segment_distance(x, y, &pts[npts - 1], &pts[0]) : INFINITY;
+        for (int j = 0; j < npts - 1; j++)
+        {
+            double d = segment_distance(x, y, &pts[j], &pts[j + 1]);
+            nearest  = d < nearest ? d : nearest;
+        }
+        error = nearest > error ? nearest : error;
+    }
+    return error;
+}
+
+static void check_scale(NVGcontext* vg, NSVGimage* svg, float scale)
+{
+    int    num_curves   = 0;
+    int    num_segments = 0;
+    int    num_over     = 0;
+    double worst        = 0;
+
+    nvgBeginFrame(vg, 1.0f);
+    snvg_command_begin_pass(vg, &(sg_pass){0}, 0, 0, 1024, 1024, "flatten");
+    snvg_command_draw_nvg(vg, "curves");
+    for (NSVGshape* shape = svg->shapes; shape != NULL; shape = shape->next)
+    {
+        for (NSVGpath* path = shape->paths; path != NULL; path = path->next)
+        {
+            for (int i = 0; i < path->npts - 1; i += 3)
+            {
+                const float* p = &path->pts[i * 2];
+                double       c[8];
+                for (int k = 0; k < 8; k++)
+                {
+                    c[k] = p[k] * scale;
+                }
+                nvgBeginPath(vg);
+                nvgMoveTo(vg, c[0], c[1]);
+                nvgBezierTo(vg, c[2], c[3], c[4], c[5], c[6], c[7]);
+                // Stroking flattens the path into vg->cache right away
+                nvgStroke(vg, 1.0f);
+                if (vg->cache.npoints < 2)
+                {
+                    continue;
+                }
+
+                double error  = flatten_error(vg, c);
+                worst         = error > worst ? error : worst;
+                num_over     += error > vg->tessTol;
+                num_segments += vg->cache.npoints - 1;
+                num_curves++;
+            }
+        }
+    }
+    snvg_command_end_pass(vg, "flatten");
+    nvgEndFrame(vg);
+
+    printf(
+        "scale %.2f: %d curves, %d segments, worst error %.4f px, %d curves over tessTol %.4f\n",
+        scale,
+        num_curves,
+        num_segments,
+        worst,
+        num_over,
+        vg->tessTol);
+    TEST_CHECK(num_curves > 0);
+    TEST_CHECK(num_over == 0);
+}
+
+int main(void)
+{
+    // Scaling the curves up is the same as zooming in on them, each scale places points differently
+    static const float SCALES[] = {0.1f, 0.25f, 0.4f, 0.5f, 0.75f, 1.0f, 1.5f, 2.0f, 3.0f, 4.0f, 8.0f, 16.0f, 32.0f};
+
+    void*       sg   = test_sg_setup();
+    test_file_t file = test_read_file("Ghostscript_Tiger.svg");
+    // nsvgParse() wants a null terminated string it can write to
+    char* text = malloc(file.size + 1);
+    memcpy(text, file.data, file.size);
+    text[file.size] = 0;
+    NSVGimage* svg  = nsvgParse(text, "px", 96);
+    TEST_CHECK(svg != NULL);
+
+    NVGcontext* vg = nvgCreateContext(NVG_ANTIALIAS);
+    TEST_CHECK(vg != NULL);
+    for (int i = 0; i < (int)(sizeof(SCALES) / sizeof(SCALES[0])); i++)
+    {
+        check_scale(vg, svg, SCALES[i]);
+    }
+
+    nvgDestroyContext(vg);
+    nsvgDelete(svg);
+    free(text);
+    test_free_file(&file);
+    test_sg_shutdown(sg);
+    return 0;
+}
@@ -0,0 +1,325 @@
+// Pipelines are cached per blend state & SGNVGpipelineType in an LRU cache, found through an open addressed hash table
+// that removes entries by backward shift. This looks up many more pairs than the cache holds, including runs that hash
+// to the same slot, and checks each lookup against a reference LRU: every lookup must return the pipeline built for its
+// pair, count a hit or miss as the reference does, and leave every cached entry reachable through the table. Then it
+// checks that composite operations passed to nvgPrewarmPipelines() build nothing when they're first drawn.
+#include "test_common.h"
+
+#include <math.h>
+#include <string.h>
+
+// Includes nanovg2.c itself, to look up pipelines directly
+#include "nanovg2.c"
+
+// Lookups drawn at random, mostly from a set of pairs that fits in the cache
+#define NUM_RANDOM_LOOKUPS (20000)
+#define NUM_HOT_PAIRS      (NANOVG_SG_PIPELINE_CACHE_SIZE / 2)
+
+typedef struct
+{
+    SGNVGblend             blend;
+    uint32_t               blendNumber;
+    enum SGNVGpipelineType type;
+} pipeline_key_t;
+
+// The cache as it should be. Entries are found by their pair and evicted by their last use
+typedef struct
+{
+    uint32_t blend[NANOVG_SG_PIPELINE_CACHE_SIZE];
+    uint32_t type[NANOVG_SG_PIPELINE_CACHE_SIZE];
+    uint32_t lastUse[NANOVG_SG_PIPELINE_CACHE_SIZE];
+    int      count;
+    uint32_t currentUse;
+} reference_lru_t;
+
+// Returns whether the pair was cached, and caches it
+static bool reference_lookup(reference_lru_t* lru, const pipeline_key_t* key)
+{
+    int index = -1;
+    for (int i = 0; i < lru->count; i++)
+    {
+        if (lru->blend[i] == key->blendNumber && lru->type[i] == (uint32_t)key->type)
+            index = i;
+    }
+    bool hit = index >= 0;
+    if (!hit && lru->count < NANOVG_SG_PIPELINE_CACHE_SIZE)
+    {
+        index = lru->count++;
+    }
+    else if (!hit)
+    {
+        index = 0;
+        for (int i = 1; i < lru->count; i++)
+        {
+            if (lru->lastUse[i] < lru->lastUse[index])
+                index = i;
+        }
+    }
+    lru->blend[index]   = key->blendNumber;
+    lru->type[index]    = (uint32_t)key->type;
+    lru->lastUse[index] = ++lru->currentUse;
+    return hit;
+}
+
+// Every entry is found where its probe sequence leads, and the table holds nothing else
+static void check_table(SGNVGpipelineCache* cache)
+{
+    int num_slots = 0;
+    for (int i = 0; i < NANOVG_SG_PIPELINE_HASH_SIZE; i++)
+    {
+        num_slots += cache->slots[i] != 0;
+    }
+    TEST_CHECK(num_slots == cache->numEntries);
+    for (int i = 0; i < cache->numEntries; i++)
+    {
+        const SGNVGpipelineCacheEntry* entry = &cache->entries[i];
+        int slot = sgnvg__findPipelineSlot(cache, entry->blend, (enum SGNVGpipelineType)entry->type);
+        TEST_CHECK(cache->slots[slot] == i + 1);
+    }
+}
+
+static void lookup(NVGcontext* ctx, reference_lru_t* lru, const pipeline_key_t* key)
+{
+    SGNVGpipelineCache* cache  = &ctx->pipelineCache;
+    int                 hits   = ctx->frame_stats.pipelineCacheHits;
+    int                 misses = ctx->frame_stats.pipelineCacheMisses;
+    bool                hit    = reference_lookup(lru, key);
+
+    sgnvg__setBlend(ctx, key->blend);
+    sg_pipeline pipeline = sgnvg__getPipelineFromCache(ctx, key->type);
+    TEST_CHECK(ctx->frame_stats.pipelineCacheHits == hits + (hit ? 1 : 0));
+    TEST_CHECK(ctx->frame_stats.pipelineCacheMisses == misses + (hit ? 0 : 1));
+
+    const SGNVGpipelineCacheEntry* entry = NULL;
+    for (int i = 0; i < cache->numEntries; i++)
+    {
+        if (cache->entries[i].pipeline.id == pipeline.id)
+            entry = &cache->entries[i];
+    }
+    TEST_CHECK(entry != NULL);
+    TEST_CHECK(entry->blend == key->blendNumber && entry->type == (uint32_t)key->type);
+    TEST_CHECK(sg_query_pipeline_state(pipeline) == SG_RESOURCESTATE_VALID);
+    check_table(cache);
+}
+
+static void check_lookups(void)
+{
+    static const int FACTORS[] = {
+        NVG_ZERO,
+        NVG_ONE,
+        NVG_SRC_COLOUR,
+        NVG_ONE_MINUS_SRC_COLOUR,
+        NVG_DST_COLOUR,
+        NVG_ONE_MINUS_DST_COLOUR,
+        NVG_SRC_ALPHA,
+        NVG_ONE_MINUS_SRC_ALPHA,
+        NVG_DST_ALPHA,
+        NVG_ONE_MINUS_DST_ALPHA,
+        NVG_SRC_ALPHA_SATURATE,
+    };
+    enum
+    {
+        NUM_FACTORS = (int)(sizeof(FACTORS) / sizeof(FACTORS[0])),
+        NUM_PAIRS   = NUM_FACTORS * NUM_FACTORS * SGNVG_PIP_NUM_,
+    };
+
+    NVGcontext* ctx = nvgCreateContext(NVG_ANTIALIAS | NVG_SDF_PRIMITIVES);
+    TEST_CHECK(ctx != NULL);
+
+    pipeline_key_t* keys     = (pipeline_key_t*)malloc(NUM_PAIRS * sizeof(*keys));
+    int             num_keys = 0;
+    for (int src = 0; src < NUM_FACTORS; src++)
+    {
+        for (int dst = 0; dst < NUM_FACTORS; dst++)
+        {
+            NVGcompositeOperationState op = {FACTORS[src], FACTORS[dst], FACTORS[src], FACTORS[dst]};
+            SGNVGblend                 blend = sgnvg__blendCompositeOperation(op);
+            sgnvg__setBlend(ctx, blend);
+            for (enum SGNVGpipelineType type = 0; type < SGNVG_PIP_NUM_; type++)
+            {
+                keys[num_keys++] = (pipeline_key_t){blend, ctx->blendNumber, type};
+            }
+        }
+    }
+    TEST_CHECK(num_keys > NANOVG_SG_PIPELINE_CACHE_SIZE);
+
+    // nvgCreateContext() builds NVG_SOURCE_OVER's pipelines
+    reference_lru_t     lru   = {0};
+    SGNVGpipelineCache* cache = &ctx->pipelineCache;
+    for (int i = 0; i < cache->numEntries; i++)
+    {
+        lru.blend[i]   = cache->entries[i].blend;
+        lru.type[i]    = cache->entries[i].type;
+        lru.lastUse[i] = cache->entries[i].lastUse;
+    }
+    lru.count      = cache->numEntries;
+    lru.currentUse = cache->currentUse;
+
+    // The pairs hashing to the most crowded slot and the one after it, whose probe sequences run into each other
+    int* slot_counts = (int*)calloc(NANOVG_SG_PIPELINE_HASH_SIZE, sizeof(int));
+    int  crowded     = 0;
+    int  max_count   = 0;
+    for (int i = 0; i < num_keys; i++)
+    {
+        slot_counts[sgnvg__pipelineHash(keys[i].blendNumber, keys[i].type)]++;
+    }
+    for (int i = 0; i < NANOVG_SG_PIPELINE_HASH_SIZE; i++)
+    {
+        int count = slot_counts[i] + slot_counts[(i + 1) & (NANOVG_SG_PIPELINE_HASH_SIZE - 1)];
+        if (count > max_count)
+        {
+            max_count = count;
+            crowded   = i;
+        }
+    }
+    pipeline_key_t colliding[NANOVG_SG_PIPELINE_CACHE_SIZE / 2];
+    int            num_colliding = 0;
+    for (int i = 0; i < num_keys && num_colliding < NANOVG_SG_PIPELINE_CACHE_SIZE / 2; i++)
+    {
+        int home = sgnvg__pipelineHash(keys[i].blendNumber, keys[i].type);
+        if (((home - crowded) & (NANOVG_SG_PIPELINE_HASH_SIZE - 1)) <= 1)
+            colliding[num_colliding++] = keys[i];
+    }
+    TEST_CHECK(num_colliding > 2);
+    printf("%d pairs, %d of them hash to slots %d & %d\n", num_keys, num_colliding, crowded, crowded + 1);
+
+    // Colliding pairs are built & found again, then evicted & rebuilt among all the others
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < num_colliding; i++)
+        {
+            lookup(ctx, &lru, &colliding[i]);
+        }
+    }
+    for (int i = 0; i < num_keys; i++)
+    {
+        lookup(ctx, &lru, &keys[i]);
+        if ((i & 7) == 0)
+            lookup(ctx, &lru, &colliding[(i / 8) % num_colliding]);
+    }
+
+    // Cycling through more pairs than fit evicts each before its next use
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < num_keys; i++)
+        {
+            lookup(ctx, &lru, &keys[i]);
+        }
+    }
+
+    uint32_t rng = 1;
+    for (int i = 0; i < NUM_RANDOM_LOOKUPS; i++)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        int hot = (rng >> 8) % NUM_HOT_PAIRS;
+        int any = (rng >> 16) % num_keys;
+        lookup(ctx, &lru, (rng >> 30) != 0 ? &keys[hot * 7] : &keys[any]);
+    }
+    printf(
+        "%d hits, %d misses, %d pipelines cached\n",
+        ctx->frame_stats.pipelineCacheHits,
+        ctx->frame_stats.pipelineCacheMisses,
+        cache->numEntries);
+    TEST_CHECK(cache->numEntries == NANOVG_SG_PIPELINE_CACHE_SIZE);
+
+    free(slot_counts);
+    free(keys);
+    nvgDestroyContext(ctx);
+}
+
+// Draws a convex & a concave fill, a stroke and an SDF circle with each composite operation
+static void draw_frame(NVGcontext* ctx, const int* ops, int count)
+{
+    nvgBeginFrame(ctx, 1);
+    snvg_command_begin_pass(ctx, &(sg_pass){0}, 0, 0, 800, 600, "pass");
+    snvg_command_draw_nvg(ctx, "nvg");
+    for (int i = 0; i < count; i++)
+    {
+        float x = 20 + i * 60;
+        nvgSetGlobalCompositeOperation(ctx, ops[i]);
+        nvgSetColour(ctx, nvgRGBA(200, 100, 50, 128));
+
+        nvgBeginPath(ctx);
+        nvgRect(ctx, x, 20, 50, 30);
+        nvgFill(ctx);
+
+        nvgBeginPath(ctx);
+        for (int j = 0; j < 10; j++)
+        {
+            float a = j * NVG_PI / 5;
+            float r = (j & 1) ? 10 : 25;
+            if (j == 0)
+                nvgMoveTo(ctx, x + 25 + cosf(a) * r, 100 + sinf(a) * r);
+            else
+                nvgLineTo(ctx, x + 25 + cosf(a) * r, 100 + sinf(a) * r);
+        }
+        nvgClosePath(ctx);
+        nvgFill(ctx);
+        nvgStroke(ctx, 2.0f);
+
+        nvgBeginPath(ctx);
+        nvgCircle(ctx, x + 25, 160, 20);
+        nvgFill(ctx);
+    }
+    snvg_command_end_pass(ctx, "pass");
+    nvgEndFrame(ctx);
+}
+
+static void check_prewarm(const char* name, int flags)
+{
+    static const int OPS[] = {
+        NVG_SOURCE_OVER,
+        NVG_SOURCE_IN,
+        NVG_SOURCE_OUT,
+        NVG_ATOP,
+        NVG_DESTINATION_OVER,
+        NVG_DESTINATION_IN,
+        NVG_DESTINATION_OUT,
+        NVG_DESTINATION_ATOP,
+        NVG_LIGHTER,
+        NVG_COPY,
+        NVG_XOR,
+    };
+    const int num_ops = (int)(sizeof(OPS) / sizeof(OPS[0]));
+
+    NVGcontext* ctx = nvgCreateContext(flags);
+    TEST_CHECK(ctx != NULL);
+    nvgPrewarmPipelines(ctx, OPS, num_ops);
+    draw_frame(ctx, OPS, num_ops);
+    printf(
+        "%s: %d prewarmed operations drawn with %d hits, %d misses\n",
+        name,
+        num_ops,
+        ctx->frame_stats.pipelineCacheHits,
+        ctx->frame_stats.pipelineCacheMisses);
+    TEST_CHECK(ctx->frame_stats.pipelineCacheHits > 0);
+    TEST_CHECK(ctx->frame_stats.pipelineCacheMisses == 0);
+
+    // A blend func that wasn't prewarmed builds its pipelines when it's first drawn, and never again
+    nvgBeginFrame(ctx, 1);
+    snvg_command_begin_pass(ctx, &(sg_pass){0}, 0, 0, 800, 600, "pass");
+    snvg_command_draw_nvg(ctx, "nvg");
+    nvgSetGlobalCompositeBlendFunc(ctx, NVG_DST_COLOUR, NVG_ZERO);
+    nvgBeginPath(ctx);
+    nvgRect(ctx, 20, 20, 50, 30);
+    nvgFill(ctx);
+    snvg_command_end_pass(ctx, "pass");
+    nvgEndFrame(ctx);
+    TEST_CHECK(ctx->frame_stats.pipelineCacheMisses > 0);
+    draw_frame(ctx, OPS, num_ops);
+    TEST_CHECK(ctx->frame_stats.pipelineCacheMisses == 0);
+
+    nvgDestroyContext(ctx);
+}
+
+int main(void)
+{
+    void* sg = test_sg_setup();
+
+    check_lookups();
+    check_prewarm("default", NVG_ANTIALIAS);
+    check_prewarm("sdf", NVG_ANTIALIAS | NVG_SDF_PRIMITIVES);
+
+    test_sg_shutdown(sg);
+    return 0;
+}
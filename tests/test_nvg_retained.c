@@ -0,0 +1,215 @@
+// Retained paths replay their tesselated geometry while the transform only moves, rotates or slightly scales it, and
+// strokes while their style is unchanged. This draws a retained path under a series of transforms and stroke styles,
+// checks which draws rebuild the geometry and which replay it, and compares each frame's vertices: a replay must
+// place the geometry it built where the transform moved it to, and where the transform didn't scale it, must also
+// match drawing the same path immediately with nvgFill() or nvgStroke().
+#include "test_common.h"
+
+#include "nanovg2.h"
+#include <math.h>
+#include <string.h>
+
+// Largest difference allowed between vertices, in pixels or texture coordinates
+#define MAX_VERTEX_DIFF (1e-3f)
+
+enum
+{
+    REBUILD,       // the transform or style changed too much
+    REPLAY,        // moved or rotated, so it matches the path drawn immediately too
+    REPLAY_SCALED, // scaled within NVG_RETAIN_SCALE_TOLERANCE, which moves the fringe & stroke width with it
+};
+
+typedef struct
+{
+    const char* name;
+    float       xform[6];
+    int         expect;
+    // Stroke style, unused by fills
+    float strokeWidth;
+    int   lineJoin;
+    int   lineCap;
+} retained_case_t;
+
+// A concave star with a round hole, so the fill has a fringe, a cover quad and flattened curves
+static void draw_path(NVGcontext* vg)
+{
+    nvgBeginPath(vg);
+    for (int i = 0; i < 10; i++)
+    {
+        float a = i * NVG_PI / 5;
+        float r = (i & 1) ? 40 : 100;
+        if (i == 0)
+            nvgMoveTo(vg, cosf(a) * r, sinf(a) * r);
+        else
+            nvgLineTo(vg, cosf(a) * r, sinf(a) * r);
+    }
+    nvgClosePath(vg);
+    nvgCircle(vg, 0, 0, 20);
+    nvgSetPathWinding(vg, NVG_HOLE);
+}
+
+// Fills or strokes the retained path, or the same path drawn immediately if path is NULL
+static void draw_frame(NVGcontext* vg, NVGretainedPath* path, const retained_case_t* c, bool stroke)
+{
+    nvgBeginFrame(vg, 1);
+    snvg_command_begin_pass(vg, &(sg_pass){0}, 0, 0, 800, 600, "pass");
+    snvg_command_draw_nvg(vg, "nvg");
+    nvgTransform(vg, c->xform[0], c->xform[1], c->xform[2], c->xform[3], c->xform[4], c->xform[5]);
+    nvgSetColour(vg, nvgRGBA(0, 160, 0, 255));
+    nvgSetLineJoin(vg, c->lineJoin);
+    nvgSetLineCap(vg, c->lineCap);
+    if (path == NULL)
+        draw_path(vg);
+    if (stroke && path != NULL)
+        nvgStrokeRetainedPath(vg, path, c->strokeWidth);
+    else if (stroke)
+        nvgStroke(vg, c->strokeWidth);
+    else if (path != NULL)
+        nvgFillRetainedPath(vg, path);
+    else
+        nvgFill(vg);
+    snvg_command_end_pass(vg, "pass");
+    nvgEndFrame(vg);
+    nvgResetTransform(vg);
+}
+
+// Compares the first count vertices, moving a's by move if it isn't NULL. Returns the largest difference
+static float
+compare_verts(const SGNVGattribute* a, const SGNVGattribute* b, int count, const float* move, bool same_tcoords)
+{
+    float max_diff = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        float x = a[i].vertex[0], y = a[i].vertex[1];
+        if (move != NULL)
+            nvgTransformPoint(&x, &y, move, a[i].vertex[0], a[i].vertex[1]);
+        max_diff = fmaxf(max_diff, fmaxf(fabsf(x - b[i].vertex[0]), fabsf(y - b[i].vertex[1])));
+        if (same_tcoords)
+        {
+            max_diff = fmaxf(max_diff, fabsf(a[i].tcoord[0] - b[i].tcoord[0]));
+            max_diff = fmaxf(max_diff, fabsf(a[i].tcoord[1] - b[i].tcoord[1]));
+        }
+    }
+    return max_diff;
+}
+
+static void check_cases(const char* kind, const retained_case_t* cases, int num_cases, bool stroke)
+{
+    NVGcontext* retained  = nvgCreateContext(NVG_ANTIALIAS);
+    NVGcontext* immediate = nvgCreateContext(NVG_ANTIALIAS);
+    TEST_CHECK(retained != NULL && immediate != NULL);
+
+    NVGretainedPath path = {0};
+    draw_path(retained);
+    nvgRetainPath(retained, &path);
+    const NVGretainedGeometry* geo = stroke ? &path.stroke : &path.fill;
+
+    // The vertices drawn by the last rebuild, and the transform they were built with
+    SGNVGattribute* built     = NULL;
+    int             num_built = 0;
+    float           built_xform[6];
+
+    for (int i = 0; i < num_cases; i++)
+    {
+        const retained_case_t* c      = &cases[i];
+        NVGretainedGeometry    before = *geo;
+        draw_frame(retained, &path, c, stroke);
+        draw_frame(immediate, NULL, c, stroke);
+
+        // Rebuilding stores the transform & style it built with, replays leave them be
+        bool rebuilt = !before.built || memcmp(before.xform, geo->xform, sizeof(geo->xform)) != 0 ||
+                       before.strokeWidth != geo->strokeWidth || before.lineJoin != geo->lineJoin ||
+                       before.lineCap != geo->lineCap;
+        TEST_CHECK(geo->built);
+        TEST_CHECK(rebuilt == (c->expect == REBUILD));
+        TEST_CHECK(memcmp(geo->xform, rebuilt ? c->xform : before.xform, sizeof(geo->xform)) == 0);
+
+        // Fills end with a cover quad, which replays may loosen around the moved bounds
+        int   count    = retained->nverts - (stroke ? 0 : 4);
+        float max_diff = 0.0f;
+        if (c->expect == REBUILD)
+        {
+            TEST_CHECK(retained->nverts == immediate->nverts);
+            max_diff = compare_verts(retained->verts, immediate->verts, retained->nverts, NULL, true);
+
+            free(built);
+            num_built = retained->nverts;
+            built     = (SGNVGattribute*)malloc(num_built * sizeof(*built));
+            memcpy(built, retained->verts, num_built * sizeof(*built));
+            memcpy(built_xform, c->xform, sizeof(built_xform));
+        }
+        else
+        {
+            // Where the move from the built transform to this one takes the built vertices
+            float move[6];
+            TEST_CHECK(nvgTransformInverse(move, built_xform));
+            nvgTransformMultiply(move, c->xform);
+            TEST_CHECK(retained->nverts == num_built);
+            max_diff = compare_verts(built, retained->verts, count, move, true);
+            if (c->expect == REPLAY)
+            {
+                TEST_CHECK(retained->nverts == immediate->nverts);
+                max_diff = fmaxf(max_diff, compare_verts(retained->verts, immediate->verts, count, NULL, true));
+            }
+        }
+        printf(
+            "%s, %s: %s %d vertices, within %g\n",
+            kind,
+            c->name,
+            c->expect == REBUILD ? "rebuilt" : "replayed",
+            retained->nverts,
+            max_diff);
+        TEST_CHECK(max_diff <= MAX_VERTEX_DIFF);
+    }
+
+    free(built);
+    nvgFreeRetainedPath(&path);
+    nvgDestroyContext(immediate);
+    nvgDestroyContext(retained);
+}
+
+int main(void)
+{
+    void* sg = test_sg_setup();
+
+    const float c = cosf(0.7f), s = sinf(0.7f);
+    // Each case is drawn after the one before it, so rebuilds & replays are relative to the last rebuild
+    const retained_case_t fills[] = {
+        {"built", {1, 0, 0, 1, 400, 300}, REBUILD},
+        {"translated", {1, 0, 0, 1, 430.25f, 287.5f}, REPLAY},
+        {"rotated", {c, s, -s, c, 410, 305}, REPLAY},
+        {"scaled within tolerance", {1.05f, 0, 0, 1.05f, 400, 300}, REPLAY_SCALED},
+        {"rotated & scaled within tolerance", {0.95f * c, 0.95f * s, -0.95f * s, 0.95f * c, 400, 300}, REPLAY_SCALED},
+        {"scaled beyond tolerance", {1.2f, 0, 0, 1.2f, 400, 300}, REBUILD},
+        {"scaled back", {1, 0, 0, 1, 400, 300}, REBUILD},
+        {"scaled unevenly", {1, 0, 0, 1.03f, 400, 300}, REBUILD},
+        {"skewed", {1, 0, 0.2f, 1, 400, 300}, REBUILD},
+    };
+    enum
+    {
+        NUM_FILLS   = (int)(sizeof(fills) / sizeof(fills[0])),
+        NUM_STYLES  = 4,
+        NUM_STROKES = NUM_FILLS + NUM_STYLES,
+    };
+
+    // The same transforms, then changes to the stroke style alone rebuild, and an unchanged one replays again
+    retained_case_t strokes[NUM_STROKES] = {
+        [NUM_FILLS + 0] = {"wider", {1, 0, 0.2f, 1, 400, 300}, REBUILD, 5.0f, NVG_MITER, NVG_BUTT},
+        [NUM_FILLS + 1] = {"round joins", {1, 0, 0.2f, 1, 400, 300}, REBUILD, 5.0f, NVG_ROUND, NVG_BUTT},
+        [NUM_FILLS + 2] = {"square caps", {1, 0, 0.2f, 1, 400, 300}, REBUILD, 5.0f, NVG_ROUND, NVG_SQUARE},
+        [NUM_FILLS + 3] = {"same style translated", {1, 0, 0.2f, 1, 380, 320}, REPLAY, 5.0f, NVG_ROUND, NVG_SQUARE},
+    };
+    for (int i = 0; i < NUM_FILLS; i++)
+    {
+        strokes[i]             = fills[i];
+        strokes[i].strokeWidth = 3.0f;
+        strokes[i].lineJoin    = NVG_MITER;
+        strokes[i].lineCap     = NVG_BUTT;
+    }
+
+    check_cases("fill", fills, NUM_FILLS, false);
+    check_cases("stroke", strokes, NUM_STROKES, true);
+
+    test_sg_shutdown(sg);
+    return 0;
+}
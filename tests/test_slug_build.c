@@ -0,0 +1,41 @@
+// Building a font's glyphs on any number of threads must pack the same textures as building them on one thread.
+// Font caches hold the packed curve and band textures along with every glyph's texture locations, so comparing the
+// baked caches covers everything the build threads produce.
+#include "test_common.h"
+
+#include "slugutil.h"
+#include <string.h>
+
+static void check_font(const char* name, slug_font_desc_t desc)
+{
+    static const int NUM_THREADS[] = {0, 2, 3, 7};
+
+    test_file_t  file   = test_read_file(name);
+    slug_range_t data   = {file.data, file.size};
+    slug_range_t serial = {0};
+
+    desc.num_threads = 1;
+    TEST_CHECK(slug_bake_font_cache(&data, &desc, &serial));
+    for (int i = 0; i < (int)(sizeof(NUM_THREADS) / sizeof(NUM_THREADS[0])); i++)
+    {
+        slug_range_t parallel = {0};
+        desc.num_threads      = NUM_THREADS[i];
+        TEST_CHECK(slug_bake_font_cache(&data, &desc, &parallel));
+        TEST_CHECK(parallel.size == serial.size);
+        TEST_CHECK(memcmp(parallel.ptr, serial.ptr, serial.size) == 0);
+        slug_free_font_cache(&parallel);
+    }
+    printf("%s: %zu byte cache identical on 1, 2, 3, 7 and all threads\n", name, serial.size);
+
+    slug_free_font_cache(&serial);
+    test_free_file(&file);
+}
+
+int main(void)
+{
+    check_font("Cairo.ttf", (slug_font_desc_t){0});
+    check_font("Cairo.ttf", (slug_font_desc_t){.compact_curves = true, .lod_pixels_per_em = 16.0f});
+    check_font("lucide.ttf", (slug_font_desc_t){0});
+    check_font("twemoji.ttf", (slug_font_desc_t){0});
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Compact fonts store curve points relative to each glyph's bbox as RGBA16 snorm. Decoding them like the shader does
+// must land within half a quantization step of the points a float font stores for the same glyph, which also checks
+// that every point lies inside the bbox the shader decodes with. Every glyph is then rasterized from both fonts with
+// slug_rasterize_glyph(), which decodes compact curves itself, so a sign or bbox error that flips a curve's winding
+// shows up as coverage even where the points compare equal.
+#include "test_common.h"
+
+#include "slugutil.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decodes the snorm point at texel.xy or texel.zw relative to the glyph's bbox
+static vec2_t decode_point(const slug_glyph_t* glyph, vec4_t texel, bool zw)
+{
+    vec2_t half_extent = vec2((glyph->bbox.x1 - glyph->bbox.x0) * 0.5f, (glyph->bbox.y1 - glyph->bbox.y0) * 0.5f);
+    vec2_t center      = vec2((glyph->bbox.x0 + glyph->bbox.x1) * 0.5f, (glyph->bbox.y0 + glyph->bbox.y1) * 0.5f);
+    float  x           = slug_decode_snorm16(slug_encode_snorm16(zw ? texel.z : texel.x));
+    float  y           = slug_decode_snorm16(slug_encode_snorm16(zw ? texel.w : texel.y));
+    return vec2_add(vec2_mul(vec2(x, y), half_extent), center);
+}
+
+static float check_point(const slug_glyph_t* glyph, vec4_t compact, vec4_t exact, bool zw)
+{
+    // Rounding to the nearest step is off by half a step, plus float rounding in the bbox transforms
+    vec2_t max_error = vec2(
+        (glyph->bbox.x1 - glyph->bbox.x0) * 0.5f * (0.5f / 32767.0f) + 1e-6f,
+        (glyph->bbox.y1 - glyph->bbox.y0) * 0.5f * (0.5f / 32767.0f) + 1e-6f);
+    // The encoder clamps to [-1, 1], so a point outside the bbox would decode to its edge
+    vec2_t exact_point = zw ? vec2(exact.z, exact.w) : vec2(exact.x, exact.y);
+    TEST_CHECK(exact_point.x >= glyph->bbox.x0 && exact_point.x <= glyph->bbox.x1);
+    TEST_CHECK(exact_point.y >= glyph->bbox.y0 && exact_point.y <= glyph->bbox.y1);
+    vec2_t point = decode_point(glyph, compact, zw);
+    vec2_t error = vec2(fabsf(point.x - exact_point.x), fabsf(point.y - exact_point.y));
+    TEST_CHECK(error.x <= max_error.x && error.y <= max_error.y);
+    return fmaxf(error.x, error.y);
+}
+
+// Largest coverage difference (out of 255) of any pixel. Points move by about 1/1000 of a pixel at these sizes, which
+// only shifts pixels whose centers lie right on a curve
+#define MAX_COVERAGE_DIFF (16)
+
+// Rasterizes the glyph from both fonts at pixels_per_em, returns the largest coverage difference of any pixel
+static int check_coverage(
+    const slug_texels_t* compact_texels,
+    const slug_glyph_t*  compact_glyph,
+    const slug_texels_t* exact_texels,
+    const slug_glyph_t*  exact_glyph,
+    float                pixels_per_em)
+{
+    int width  = (int)ceilf((exact_glyph->bbox.x1 - exact_glyph->bbox.x0) * pixels_per_em);
+    int height = (int)ceilf((exact_glyph->bbox.y1 - exact_glyph->bbox.y0) * pixels_per_em);
+    if ((width <= 0) || (height <= 0))
+    {
+        return 0;
+    }
+    uint8_t* compact_coverage = (uint8_t*)malloc((size_t)width * height);
+    uint8_t* exact_coverage   = (uint8_t*)malloc((size_t)width * height);
+    slug_rasterize_glyph(compact_texels, compact_glyph, pixels_per_em, compact_coverage, width, height, width);
+    slug_rasterize_glyph(exact_texels, exact_glyph, pixels_per_em, exact_coverage, width, height, width);
+    int max_diff = 0;
+    for (int i = 0; i < width * height; i++)
+    {
+        int diff = abs((int)compact_coverage[i] - (int)exact_coverage[i]);
+        max_diff = diff > max_diff ? diff : max_diff;
+    }
+    TEST_CHECK(max_diff <= MAX_COVERAGE_DIFF);
+    free(compact_coverage);
+    free(exact_coverage);
+    return max_diff;
+}
+
+int main(void)
+{
+    void*        sg   = test_sg_setup();
+    test_file_t  file = test_read_file("Cairo.ttf");
+    slug_range_t data = {file.data, file.size};
+
+    // Lazy fonts keep their texels on the CPU. Both pack every glyph in the same order, so their curves share texels.
+    slug_font_t compact = {0};
+    slug_font_t exact   = {0};
+    TEST_CHECK(slug_load_font_desc(&compact, &data, &(slug_font_desc_t){.lazy = true, .compact_curves = true}));
+    TEST_CHECK(slug_load_font_desc(&exact, &data, &(slug_font_desc_t){.lazy = true}));
+    int num_glyphs = compact.info.numGlyphs;
+    for (int i = 0; i < num_glyphs; i++)
+    {
+        slug_get_glyph_by_index(&compact, i);
+        slug_get_glyph_by_index(&exact, i);
+    }
+    slug_texels_t compact_texels, exact_texels;
+    TEST_CHECK(slug_get_font_texels(&compact, &compact_texels));
+    TEST_CHECK(slug_get_font_texels(&exact, &exact_texels));
+
+    int   num_curves = 0;
+    float max_error  = 0.0f;
+    for (int i = 0; i < num_glyphs; i++)
+    {
+        const slug_glyph_t* glyph = &compact.glyphs[i];
+        int  num_bands = (int)glyph->max_band_y + 1 + (int)glyph->max_band_x + 1;
+        int  start     = glyph->glyph_loc[1] * SLUG_TEX_WIDTH + glyph->glyph_loc[0];
+        for (int band = 0; band < num_bands; band++)
+        {
+            u16vec2_t header = compact_texels.band_pixels[start + band];
+            for (int j = 0; j < header.x; j++)
+            {
+                u16vec2_t entry = compact_texels.band_pixels[start + header.y + j];
+                int       curve = entry.y * SLUG_TEX_WIDTH + entry.x;
+                vec4_t    p01   = compact_texels.curve_pixels[curve];
+                vec4_t    p2    = compact_texels.curve_pixels[curve + 1];
+                max_error = fmaxf(max_error, check_point(glyph, p01, exact_texels.curve_pixels[curve], false));
+                max_error = fmaxf(max_error, check_point(glyph, p01, exact_texels.curve_pixels[curve], true));
+                max_error = fmaxf(max_error, check_point(glyph, p2, exact_texels.curve_pixels[curve + 1], false));
+                num_curves++;
+            }
+        }
+    }
+    TEST_CHECK(num_curves > 0);
+    printf("Cairo.ttf: %d compact curve references decode within %g em\n", num_curves, max_error);
+
+    // A size small enough to blend curves into shared pixels and one large enough to resolve them
+    static const float SIZES[] = {16.0f, 96.0f};
+    for (int s = 0; s < (int)(sizeof(SIZES) / sizeof(SIZES[0])); s++)
+    {
+        float pixels_per_em = SIZES[s];
+        int   max_diff      = 0;
+        for (int i = 0; i < num_glyphs; i++)
+        {
+            int diff = check_coverage(
+                &compact_texels,
+                &compact.glyphs[i],
+                &exact_texels,
+                &exact.glyphs[i],
+                pixels_per_em);
+            max_diff = diff > max_diff ? diff : max_diff;
+        }
+        printf("Cairo.ttf at %g pixels per em: compact coverage within %d of float\n", pixels_per_em, max_diff);
+    }
+
+    slug_unload_font(&compact);
+    slug_unload_font(&exact);
+    test_free_file(&file);
+    test_sg_shutdown(sg);
+    return 0;
+}
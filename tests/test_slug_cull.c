@@ -0,0 +1,142 @@
+// cull_glyphs() is the CPU mirror of program_slug.glsl's cull passes, and the draw loop reads its prefix and visible
+// lists the same way it reads the GPU's. This runs it over glyphs straddling each edge of a cull rect and checks both
+// lists against the compaction worked out by hand.
+#include "test_common.h"
+
+#include "program_slug_cull.h"
+#include <string.h>
+
+#define MAX_GLYPHS (256)
+#define ARRLEN(a)  ((int)(sizeof(a) / sizeof(a[0])))
+
+static glyph_vertex_t glyph_at(float x, float y, float w, float h)
+{
+    return (glyph_vertex_t){.draw_rect = {x, y, w, h}};
+}
+
+static void check_cull(
+    const char*           name,
+    const glyph_vertex_t* glyphs,
+    int                   num_glyphs,
+    vec4_t                cull_rect,
+    const int*            expected_visible,
+    int                   num_expected)
+{
+    int prefix[MAX_GLYPHS + 1];
+    int visible[MAX_GLYPHS];
+    memset(visible, 0xff, sizeof(visible));
+    int num_visible = cull_glyphs(glyphs, num_glyphs, cull_rect, prefix, visible);
+    printf("%s: %d of %d glyphs visible\n", name, num_visible, num_glyphs);
+
+    TEST_CHECK(num_visible == num_expected);
+    TEST_CHECK(prefix[num_glyphs] == num_expected);
+    for (int i = 0; i < num_expected; i++)
+    {
+        TEST_CHECK(visible[i] == expected_visible[i]);
+    }
+    // Nothing is written past the visible glyphs, the GPU leaves that part of the list alone too
+    for (int i = num_expected; i < num_glyphs; i++)
+    {
+        TEST_CHECK(visible[i] == -1);
+    }
+    // prefix[i] counts the expected glyphs before instance i
+    int next = 0;
+    for (int i = 0; i <= num_glyphs; i++)
+    {
+        TEST_CHECK(prefix[i] == next);
+        if ((next < num_expected) && (expected_visible[next] == i))
+        {
+            next++;
+        }
+    }
+}
+
+// One glyph on each side of each edge of the rect, plus glyphs that only touch an edge, which pass like they do in
+// glyph_visible()
+static void check_edges(void)
+{
+    const vec4_t         rect     = {100, 50, 300, 250};
+    const glyph_vertex_t glyphs[] = {
+        glyph_at(150, 100, 20, 20), // 0: inside
+        glyph_at(90, 100, 20, 20),  // 1: straddles the left edge
+        glyph_at(60, 100, 20, 20),  // 2: left of the rect
+        glyph_at(290, 100, 20, 20), // 3: straddles the right edge
+        glyph_at(320, 100, 20, 20), // 4: right of the rect
+        glyph_at(150, 40, 20, 20),  // 5: straddles the top edge
+        glyph_at(150, 10, 20, 20),  // 6: above the rect
+        glyph_at(150, 240, 20, 20), // 7: straddles the bottom edge
+        glyph_at(150, 270, 20, 20), // 8: below the rect
+        glyph_at(80, 100, 20, 20),  // 9: right side touches the left edge
+        glyph_at(300, 100, 20, 20), // 10: left side touches the right edge
+        glyph_at(79, 100, 20, 20),  // 11: one pixel short of the left edge
+        glyph_at(90, 40, 20, 20),   // 12: straddles the top left corner
+        glyph_at(290, 240, 20, 20), // 13: straddles the bottom right corner
+        glyph_at(60, 270, 20, 20),  // 14: diagonally past the bottom left corner
+        glyph_at(50, 40, 400, 300), // 15: covers the whole rect
+    };
+    const int expected[] = {0, 1, 3, 5, 7, 9, 10, 12, 13, 15};
+    check_cull("edges", glyphs, ARRLEN(glyphs), rect, expected, ARRLEN(expected));
+}
+
+// Glyphs drawn flipped have a negative width or height, and the draw rect then extends left or up from its origin
+static void check_flipped(void)
+{
+    const vec4_t         rect     = {100, 50, 300, 250};
+    const glyph_vertex_t glyphs[] = {
+        glyph_at(110, 100, -20, 20),  // 0: straddles the left edge from inside
+        glyph_at(95, 100, -20, 20),   // 1: left of the rect, though its origin is nearly at the edge
+        glyph_at(320, 100, -30, 20),  // 2: origin right of the rect, straddles the right edge
+        glyph_at(320, 100, -10, 20),  // 3: right of the rect
+        glyph_at(150, 60, 20, -20),   // 4: straddles the top edge
+        glyph_at(150, 45, 20, -20),   // 5: above the rect
+        glyph_at(150, 260, -20, -20), // 6: straddles the bottom edge, flipped both ways
+    };
+    const int expected[] = {0, 2, 4, 6};
+    check_cull("flipped", glyphs, ARRLEN(glyphs), rect, expected, ARRLEN(expected));
+}
+
+// Rows of glyphs sliding past the rect, long enough to span several cull groups, with runs of culled glyphs at the
+// start, middle and end of the stream
+static void check_rows(void)
+{
+    const vec4_t   rect = {0, 0, 640, 480};
+    glyph_vertex_t glyphs[MAX_GLYPHS];
+    int            expected[MAX_GLYPHS];
+    int            num_glyphs   = 0;
+    int            num_expected = 0;
+    for (int row = 0; row < 4; row++)
+    {
+        // row 0 straddles the top edge of the rect, row 1 its bottom edge, row 2 is inside and row 3 below it
+        static const float ROW_Y[] = {-10, 470, 200, 500};
+        for (int col = 0; col < 60; col++)
+        {
+            // 24 pixel wide glyphs every 16 pixels, starting left of the rect and ending right of it
+            float x = -200 + col * 16.0f;
+            if ((row != 3) && (x + 24 >= 0) && (x <= 640))
+            {
+                expected[num_expected++] = num_glyphs;
+            }
+            glyphs[num_glyphs++] = glyph_at(x, ROW_Y[row], 24, 30);
+        }
+    }
+    TEST_CHECK(num_glyphs > 3 * 64);
+    check_cull("rows", glyphs, num_glyphs, rect, expected, num_expected);
+}
+
+// Everything culled and an empty stream still leave a valid prefix list
+static void check_empty(void)
+{
+    const vec4_t         rect     = {0, 0, 640, 480};
+    const glyph_vertex_t glyphs[] = {glyph_at(-100, 0, 20, 20), glyph_at(700, 0, 20, 20), glyph_at(0, 500, 20, 20)};
+    check_cull("all culled", glyphs, ARRLEN(glyphs), rect, NULL, 0);
+    check_cull("no glyphs", glyphs, 0, rect, NULL, 0);
+}
+
+int main(void)
+{
+    check_edges();
+    check_flipped();
+    check_rows();
+    check_empty();
+    return 0;
+}
@@ -0,0 +1,86 @@
+// LOD glyphs are built to stay within a quarter pixel of the full glyph at lod_pixels_per_em. This rasterizes every
+// glyph of each bundled font and its LOD with slug_measure_lod_error() at the sizes the LOD is drawn at, and checks
+// that the coverage they produce stays close.
+#include "test_common.h"
+
+#include "slugutil.h"
+#include <math.h>
+
+#define LOD_PIXELS_PER_EM (16.0f)
+
+// Average coverage error over a glyph's bbox, averaged over the whole font. Single glyphs a pixel or two across can
+// be off by far more, as a quarter pixel is then a large part of every pixel they touch.
+#define MAX_FONT_MEAN_ERROR (0.04f)
+// Share of all pixels whose coverage differs by more than 1/4
+#define MAX_FONT_PIXELS_OFF (0.01f)
+
+static void check_font(const char* name)
+{
+    // The LOD is drawn below LOD_PIXELS_PER_EM, where it is coarsest relative to a pixel right at the switch
+    static const float SIZES[] = {8.0f, 12.0f, LOD_PIXELS_PER_EM - 0.01f};
+
+    test_file_t  file = test_read_file(name);
+    slug_font_t  font = {0};
+    slug_range_t data = {file.data, file.size};
+    TEST_CHECK(
+        slug_load_font_desc(&font, &data, &(slug_font_desc_t){.lazy = true, .lod_pixels_per_em = LOD_PIXELS_PER_EM}));
+
+    // Making glyphs resident may move the texels, so build them all before measuring
+    for (int i = 0; i < font.info.numGlyphs; i++)
+    {
+        TEST_CHECK(slug_get_glyph_by_index(&font, i) != NULL);
+    }
+    slug_texels_t texels;
+    TEST_CHECK(slug_get_font_texels(&font, &texels));
+
+    for (int s = 0; s < (int)(sizeof(SIZES) / sizeof(SIZES[0])); s++)
+    {
+        float sum_error  = 0.0f;
+        float worst_max  = 0.0f;
+        int   num_glyphs = 0;
+        int   num_off    = 0;
+        int   num_pixels = 0;
+        for (int i = 0; i < font.info.numGlyphs; i++)
+        {
+            const slug_glyph_t* glyph = slug_get_glyph_by_index(&font, i);
+            slug_lod_error_t    error;
+            if (slug_measure_lod_error(&texels, glyph, SIZES[s], &error))
+            {
+                // Same bitmap size as slug_measure_lod_error()
+                int width   = (int)ceilf((glyph->bbox.x1 - glyph->bbox.x0) * SIZES[s]);
+                int height  = (int)ceilf((glyph->bbox.y1 - glyph->bbox.y0) * SIZES[s]);
+                sum_error  += error.mean_error;
+                worst_max   = error.max_error > worst_max ? error.max_error : worst_max;
+                num_off    += error.num_pixels;
+                num_pixels += (width > 1 ? width : 1) * (height > 1 ? height : 1);
+                num_glyphs++;
+            }
+        }
+        TEST_CHECK(num_glyphs > 0);
+        float mean_error = sum_error / (float)num_glyphs;
+        float pixels_off = (float)num_off / (float)num_pixels;
+        printf(
+            "%s at %.2f ppem: %d glyphs, mean error %.4f, worst pixel %.3f, %.3f%% of pixels off by > 1/4\n",
+            name,
+            SIZES[s],
+            num_glyphs,
+            mean_error,
+            worst_max,
+            pixels_off * 100.0f);
+        TEST_CHECK(mean_error <= MAX_FONT_MEAN_ERROR);
+        TEST_CHECK(pixels_off <= MAX_FONT_PIXELS_OFF);
+    }
+
+    slug_unload_font(&font);
+    test_free_file(&file);
+}
+
+int main(void)
+{
+    void* sg = test_sg_setup();
+    check_font("Cairo.ttf");
+    check_font("lucide.ttf");
+    check_font("twemoji.ttf");
+    test_sg_shutdown(sg);
+    return 0;
+}
@@ -0,0 +1,155 @@
+// slug_rasterize_glyph() computes the same coverage as program_slug.glsl, so it pins down what the shader draws. This
+// rasterizes a line of Cairo.ttf glyphs at a size that uses their LOD and at one that doesn't, once from float and once
+// from compact curves, and compares the coverage to golden images in tests/golden.
+//
+// Run with SLUG_UPDATE_GOLDEN=1 in the environment to rewrite the golden images after an intended change, and look
+// at the diff before committing them. A failing run writes what it rasterized next to the test executable.
+#include "test_common.h"
+
+#include "slugutil.h"
+#include <string.h>
+
+// Coverage is allowed to be off by this much (out of 255), as compilers may fuse multiplies and adds differently
+#define MAX_COVERAGE_DIFF (2)
+
+static const char* TEXT = "Slug &@ 0123 Quartz";
+
+typedef struct
+{
+    int      width;
+    int      height;
+    uint8_t* pixels;
+} image_t;
+
+// Places each glyph's bbox next to the previous one, one row per size
+static image_t rasterize_text(slug_font_t* font, const float* sizes, int num_sizes)
+{
+    slug_texels_t texels;
+    image_t       image = {0};
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int y = 0;
+        for (int row = 0; row < num_sizes; row++)
+        {
+            float pixels_per_em = sizes[row];
+            int   x             = 0;
+            int   row_height    = 0;
+            for (const char* c = TEXT; *c != 0; c++)
+            {
+                const slug_glyph_t* glyph = slug_get_glyph(font, (uint32_t)*c);
+                TEST_CHECK(glyph != NULL);
+                int width  = (int)ceilf((glyph->bbox.x1 - glyph->bbox.x0) * pixels_per_em);
+                int height = (int)ceilf((glyph->bbox.y1 - glyph->bbox.y0) * pixels_per_em);
+                if ((width <= 0) || (height <= 0))
+                {
+                    continue;
+                }
+                if (pass == 1)
+                {
+                    // Glyphs become resident in the first pass, which may move the texels
+                    slug_glyph_t drawn = slug_use_lod(font, pixels_per_em) ? slug_glyph_lod(glyph) : *glyph;
+                    uint8_t*     dst   = &image.pixels[y * image.width + x];
+                    slug_rasterize_glyph(&texels, &drawn, pixels_per_em, dst, width, height, image.width);
+                }
+                x          += width + 1;
+                row_height  = height > row_height ? height : row_height;
+            }
+            image.width  = x > image.width ? x : image.width;
+            y           += row_height + 1;
+        }
+        if (pass == 0)
+        {
+            image.height = y;
+            image.pixels = calloc((size_t)image.width * image.height, 1);
+            TEST_CHECK(slug_get_font_texels(font, &texels));
+        }
+    }
+    return image;
+}
+
+static void write_pgm(const char* path, const image_t* image)
+{
+    FILE* fp = fopen(path, "wb");
+    TEST_CHECK(fp != NULL);
+    fprintf(fp, "P5\n%d %d\n255\n", image->width, image->height);
+    fwrite(image->pixels, 1, (size_t)image->width * image->height, fp);
+    fclose(fp);
+}
+
+static void check_golden(const char* name, const image_t* image)
+{
+    char path[1024];
+    if (getenv("SLUG_UPDATE_GOLDEN") != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/tests/golden/%s.pgm", SRC_DIR, name);
+        write_pgm(path, image);
+        printf("%s: wrote %s\n", name, path);
+        return;
+    }
+
+    snprintf(path, sizeof(path), "tests/golden/%s.pgm", name);
+    test_file_t golden = test_read_file(path);
+    int         width = 0, height = 0, header_size = 0;
+    TEST_CHECK(sscanf((const char*)golden.data, "P5\n%d %d\n255\n%n", &width, &height, &header_size) == 2);
+    TEST_CHECK(header_size > 0 && golden.size == (size_t)header_size + (size_t)width * height);
+
+    int num_diffs = 0;
+    int max_diff  = 0;
+    if ((width == image->width) && (height == image->height))
+    {
+        const uint8_t* expected = (const uint8_t*)golden.data + header_size;
+        for (int i = 0; i < width * height; i++)
+        {
+            int diff  = abs((int)image->pixels[i] - (int)expected[i]);
+            max_diff  = diff > max_diff ? diff : max_diff;
+            num_diffs += diff > MAX_COVERAGE_DIFF;
+        }
+    }
+    else
+    {
+        num_diffs = -1;
+        printf("%s: rasterized %dx%d, golden image is %dx%d\n", name, image->width, image->height, width, height);
+    }
+    if (num_diffs != 0)
+    {
+        snprintf(path, sizeof(path), "%s.actual.pgm", name);
+        write_pgm(path, image);
+        printf("%s: %d pixels differ by more than %d, wrote %s\n", name, num_diffs, MAX_COVERAGE_DIFF, path);
+    }
+    else
+    {
+        printf("%s: %dx%d matches, max difference %d\n", name, width, height, max_diff);
+    }
+    TEST_CHECK(num_diffs == 0);
+    test_free_file(&golden);
+}
+
+static void check_font(const char* name, bool compact_curves)
+{
+    // 12 pixels per em draws with the LOD, 40 with the full glyphs
+    static const float SIZES[] = {12.0f, 40.0f};
+
+    test_file_t  file = test_read_file("Cairo.ttf");
+    slug_font_t  font = {0};
+    slug_range_t data = {file.data, file.size};
+    TEST_CHECK(slug_load_font_desc(
+        &font,
+        &data,
+        &(slug_font_desc_t){.lazy = true, .compact_curves = compact_curves, .lod_pixels_per_em = 16.0f}));
+
+    image_t image = rasterize_text(&font, SIZES, (int)(sizeof(SIZES) / sizeof(SIZES[0])));
+    check_golden(name, &image);
+
+    free(image.pixels);
+    slug_unload_font(&font);
+    test_free_file(&file);
+}
+
+int main(void)
+{
+    void* sg = test_sg_setup();
+    check_font("slug_raster_cairo", false);
+    check_font("slug_raster_cairo_compact", true);
+    test_sg_shutdown(sg);
+    return 0;
+}